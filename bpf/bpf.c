@@ -12,24 +12,29 @@
 #include "assert.h"
 #include "bpf.h"
 #include "bpf/store.h"
+#include "bpf/instruction.h"
 #include <debug_progmem.h>
 
 extern int bpf_run(bpf_t *bpf, const void *ctx, int64_t *result);
 
-void* bpf_get_mem(const bpf_t *bpf, uint8_t size, const intptr_t addr, uint8_t type)
+void* bpf_get_mem(const bpf_t *bpf, size_t size, const intptr_t addr, uint8_t type)
 {
-    const intptr_t end = addr + size;
+    const intptr_t end = (intptr_t)((uintptr_t)addr + size);
+    if (end < addr) {
+        debug_d("Access to 0x%x with len %u wraps\n", (void*)addr, (unsigned)size);
+        return NULL;
+    }
     for (const bpf_mem_region_t *region = &bpf->stack_region; region; region = region->next) {
         if (addr >= (intptr_t)region->start && end <= (intptr_t)(region->start + region->len)) {
             if ((region->flag & type) == 0) {
-                debug_d("Denied access to 0x%x with len %u\n", (void*)addr, size);
+                debug_d("Denied access to 0x%x with len %u\n", (void*)addr, (unsigned)size);
                 return NULL;
             }
             return (void*)(region->phys_start + addr - region->start);
         }
     }
 
-    debug_d("Attempt to access invalid memory at 0x%x with len %u\n", (void*)addr, size);
+    debug_d("Attempt to access invalid memory at 0x%x with len %u\n", (void*)addr, (unsigned)size);
     return NULL;
 }
 
@@ -46,7 +51,10 @@ int bpf_load_allowed(const bpf_t *bpf, void *addr, size_t size)
 static int _execute(bpf_t *bpf, void *ctx, int64_t *result)
 {
     assert(bpf->flags & BPF_FLAG_SETUP_DONE);
-    return bpf_run(bpf, ctx, result);
+    bpf_code_cache_enter(bpf);
+    int res = bpf_run(bpf, ctx, result);
+    bpf_code_cache_leave(bpf);
+    return res;
 }
 
 int bpf_execute(bpf_t *bpf, void *ctx, size_t ctx_len, int64_t *result)
@@ -98,8 +106,12 @@ int bpf_setup(bpf_t *bpf)
         memcpy(ptr, data, ALIGNUP4(hdr.data_len));
         memset(ptr + hdr.data_len, 0, hdr.bss_len);
 
+        /*
+         * Map the RAM copy at its own address. LDDWD instructions resolve to this,
+         * so addresses passed to helpers refer to RAM and not the image.
+         */
         bpf_mem_region_t data_region = {
-            .start = data,
+            .start = ptr,
             .phys_start = ptr,
             .len = len,
             .flag = BPF_MEM_REGION_READ | BPF_MEM_REGION_WRITE,
@@ -121,6 +133,19 @@ int bpf_setup(bpf_t *bpf)
     bpf_mem_region_t arg_region = {};
     bpf->arg_region = arg_region;
 
+    /* Map values are linked in after the argument region */
+    if(bpf_map_setup(bpf) < 0) {
+        free((void*)bpf->data_region.phys_start);
+        bpf->data_region.phys_start = NULL;
+        return -1;
+    }
+
+    bpf->text = rbpf_text(bpf);
+
+    /* Has no effect if the local store is already in use */
+    bpf_store_set_local_type(bpf, CONFIG_BPF_STORE_LOCAL_TYPE);
+    bpf_store_set_local_quota(bpf, CONFIG_BPF_STORE_LOCAL_QUOTA);
+
     bpf->flags |= BPF_FLAG_SETUP_DONE;
 
     return 0;
@@ -131,10 +156,41 @@ void bpf_destroy(bpf_t* bpf)
     if(bpf == NULL) {
         return;
     }
+    bpf_code_cache_release(bpf);
+    bpf_store_clear_local(bpf);
+    bpf_store_set_local_cache(bpf, 0, 0);
+    bpf_map_destroy(bpf);
     free((void*)bpf->data_region.phys_start);
     memset(bpf, 0, sizeof(bpf_t));
 }
 
+void bpf_relocate(const bpf_t *bpf, void *text, size_t len)
+{
+    bpf_instruction_t *end = (bpf_instruction_t*)((uint8_t*)text + len);
+    for (bpf_instruction_t *i = text; i + 1 < end; i++) {
+        const uint8_t *base;
+        switch (i->opcode) {
+        case BPF_INSTRUCTION_LDDW:
+            i++;
+            continue;
+        case BPF_INSTRUCTION_LDDWD:
+            base = bpf->data_region.phys_start;
+            break;
+        case BPF_INSTRUCTION_LDDWR:
+            base = bpf->rodata_region.phys_start;
+            break;
+        default:
+            continue;
+        }
+        uint64_t offset = (uint32_t)i[0].immediate | ((uint64_t)(uint32_t)i[1].immediate << 32);
+        uint64_t addr = (uintptr_t)base + offset;
+        i[0].opcode = BPF_INSTRUCTION_LDDW;
+        i[0].immediate = (int32_t)(uint32_t)addr;
+        i[1].immediate = (int32_t)(uint32_t)(addr >> 32);
+        i++;
+    }
+}
+
 void bpf_add_region(bpf_t *bpf, bpf_mem_region_t *region,
                     void *start, size_t len, uint8_t flags)
 {
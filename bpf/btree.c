@@ -24,21 +24,21 @@
 #include <debug_progmem.h>
 #include "include/bpf/btree.h"
 
-static void _path_helper(btree_node_t *node, size_t depth, void *ctx)
+static inline uint8_t _height(const btree_node_t *node)
 {
-    (void)node;
-    size_t *max_depth = ctx;
-    if (*max_depth < depth) {
-        *max_depth = depth;
-    }
+    return node ? node->height : 0;
+}
+
+static void _update_height(btree_node_t *node)
+{
+    uint8_t left = _height(node->left);
+    uint8_t right = _height(node->right);
+    node->height = 1 + (left > right ? left : right);
 }
 
-static size_t _max_path(btree_node_t *node)
+static inline int _balance_factor(const btree_node_t *node)
 {
-    size_t len = 0;
-    btree_t start = {.start = node};
-    btree_traverse(&start, _path_helper, &len);
-    return len;
+    return (int)_height(node->right) - (int)_height(node->left);
 }
 
 /**
@@ -64,28 +64,20 @@ static btree_node_t *_find_key(btree_node_t *cur_node, btree_node_t **parent, ui
     return cur_node;
 }
 
-static size_t _find_distance(btree_node_t *parent, btree_node_t *child)
-{
-    size_t depth = 0;
-    while (child && (parent != child)) {
-        depth++;
-        child = child->parent;
-    }
-    return depth;
-}
-
 static btree_node_t *_find_min(btree_node_t *node)
 {
-    btree_node_t *min = NULL;
-    _find_key(node, &min, 0);
-    return min;
+    while (node && node->left) {
+        node = node->left;
+    }
+    return node;
 }
 
 static btree_node_t *_find_max(btree_node_t *node)
 {
-    btree_node_t *max = NULL;
-    _find_key(node, &max, UINT32_MAX);
-    return max;
+    while (node && node->right) {
+        node = node->right;
+    }
+    return node;
 }
 
 static void _replace_ref(btree_node_t *parent, btree_node_t *child, btree_node_t *new)
@@ -123,6 +115,8 @@ static void _rotate_left(btree_t *btree, btree_node_t *root, btree_node_t *pivot
     _update_parent_ref(pivot->left, root);
     root->right = pivot->left;
     pivot->left = root;
+    _update_height(root);
+    _update_height(pivot);
 }
 
 static void _rotate_right(btree_t *btree, btree_node_t *root, btree_node_t *pivot)
@@ -131,42 +125,46 @@ static void _rotate_right(btree_t *btree, btree_node_t *root, btree_node_t *pivo
     _update_parent_ref(pivot->right, root);
     root->left = pivot->right;
     pivot->right = root;
+    _update_height(root);
+    _update_height(pivot);
 }
 
+/*
+ * Walk up from node restoring heights and the AVL property. Every node below
+ * node must already be balanced with a valid height. Stops as soon as a
+ * subtree keeps its previous height, so costs at most O(log n).
+ */
 static void _balance(btree_t *btree, btree_node_t *node)
 {
-    int child_balance = 0;
     while (node) {
-        /* Determine max length of the other branch */
-        /* TODO: reuse the result from the previous loop */
-        int balance = _max_path(node->right) - _max_path(node->left);
+        uint8_t old_height = node->height;
+        int balance = _balance_factor(node);
         if (balance > 1) {
-            /* right/left case */
-            if (child_balance < 0) {
-                /* Transform to right/right case */
-                _rotate_right(btree, node->right,
-                              node->right->left);
+            if (_balance_factor(node->right) < 0) {
+                /* right/left case: transform to right/right case */
+                _rotate_right(btree, node->right, node->right->left);
             }
             /* right/right case */
             _rotate_left(btree, node, node->right);
-            node = node->right;
-            child_balance = 0;
+            node = node->parent;
         }
         else if (balance < -1) {
-            /* left/right case */
-            if (child_balance > 0) {
-                /* Transform to left/left case */
+            if (_balance_factor(node->left) > 0) {
+                /* left/right case: transform to left/left case */
                 _rotate_left(btree, node->left, node->left->right);
             }
             /* left/left case */
             _rotate_right(btree, node, node->left);
-            node = node->left;
-            child_balance = 0;
+            node = node->parent;
         }
         else {
-            child_balance = balance;
-            node = node->parent;
+            _update_height(node);
+        }
+
+        if (node->height == old_height) {
+            break;
         }
+        node = node->parent;
     }
 }
 
@@ -176,38 +174,116 @@ btree_node_t *btree_find_key(btree_t *btree, uint32_t key)
     return _find_key(btree->start, &_tmp, key);
 }
 
-int btree_insert(btree_t *btree, btree_node_t *new, uint32_t key)
+/* Closest node to key on the given side, or the node with key itself */
+static btree_node_t *_find_near(btree_node_t *cur_node, uint32_t key, bool above)
 {
-    new->left = NULL;
-    new->right = NULL;
-    new->key = key;
+    btree_node_t *best = NULL;
+    while (cur_node) {
+        if (cur_node->key == key) {
+            return cur_node;
+        }
+        if ((cur_node->key > key) == above) {
+            best = cur_node;
+        }
+        cur_node = (cur_node->key > key) ? cur_node->left : cur_node->right;
+    }
+    return best;
+}
 
-    if (_find_key(btree->start, &new->parent, key) != NULL) {
-        return BTREE_ERROR_NODE_EXISTS;
+btree_node_t *btree_find_ceil(btree_t *btree, uint32_t key)
+{
+    return _find_near(btree->start, key, true);
+}
+
+btree_node_t *btree_find_floor(btree_t *btree, uint32_t key)
+{
+    return _find_near(btree->start, key, false);
+}
+
+/* In-order neighbour using parent links, successor if above */
+static btree_node_t *_step(btree_node_t *node, bool above)
+{
+    btree_node_t *child = above ? node->right : node->left;
+    if (child) {
+        for (;;) {
+            btree_node_t *next = above ? child->left : child->right;
+            if (next == NULL) {
+                return child;
+            }
+            child = next;
+        }
+    }
+    btree_node_t *parent = node->parent;
+    while (parent && node == (above ? parent->right : parent->left)) {
+        node = parent;
+        parent = parent->parent;
     }
+    return parent;
+}
 
-    btree_node_t *p = new->parent;
+btree_node_t *btree_next(btree_node_t *node)
+{
+    return _step(node, true);
+}
 
-    if (!p) {
+btree_node_t *btree_prev(btree_node_t *node)
+{
+    return _step(node, false);
+}
+
+/* Link a new node below parent, as found by _find_key(), and rebalance */
+static void _link(btree_t *btree, btree_node_t *new, btree_node_t *parent, uint32_t key)
+{
+    new->left = NULL;
+    new->right = NULL;
+    new->key = key;
+    new->height = 1;
+    new->parent = parent;
+
+    if (!parent) {
         btree->start = new;
-        return BTREE_OK;
+        return;
     }
 
-    if (p->key > key) {
-        p->left = new;
+    if (parent->key > key) {
+        parent->left = new;
     }
     else {
-        p->right = new;
+        parent->right = new;
     }
 
-    /* Only balance if the rank changes */
-    if (!(p->left && p->right)) {
-        _balance(btree, p);
+    _balance(btree, parent);
+}
+
+int btree_insert(btree_t *btree, btree_node_t *new, uint32_t key)
+{
+    btree_node_t *parent = NULL;
+    if (_find_key(btree->start, &parent, key) != NULL) {
+        return BTREE_ERROR_NODE_EXISTS;
     }
 
+    _link(btree, new, parent, key);
     return BTREE_OK;
 }
 
+btree_node_t *btree_find_or_insert(btree_t *btree, uint32_t key, btree_alloc_cb_t alloc,
+                                   void *ctx, bool *inserted)
+{
+    *inserted = false;
+    btree_node_t *parent = NULL;
+    btree_node_t *node = _find_key(btree->start, &parent, key);
+    if (node || !alloc) {
+        return node;
+    }
+
+    node = alloc(ctx);
+    if (node) {
+        _link(btree, node, parent, key);
+        *inserted = true;
+    }
+    return node;
+}
+
 btree_node_t *btree_remove(btree_t *btree, uint32_t key)
 {
     btree_node_t *balance_start = NULL;
@@ -218,13 +294,12 @@ btree_node_t *btree_remove(btree_t *btree, uint32_t key)
         return NULL;
     }
 
-    btree_node_t *left = _find_min(d->left);
-    btree_node_t *right = _find_max(d->right);
-
-    size_t left_len = _find_distance(d, left) + _max_path(left);
-    size_t right_len = _find_distance(d, right) + _max_path(right);
+    /* In-order predecessor and successor */
+    btree_node_t *left = _find_max(d->left);
+    btree_node_t *right = _find_min(d->right);
 
-    btree_node_t *replacement = left_len > right_len ? left : right;
+    /* Take the replacement from the taller side */
+    btree_node_t *replacement = _height(d->left) > _height(d->right) ? left : right;
 
     if (d->parent) {
         _replace_ref(d->parent, d, replacement);
@@ -243,13 +318,17 @@ btree_node_t *btree_remove(btree_t *btree, uint32_t key)
         /* Overwrite the node acting as the deleted nodes replacement with it's
          * child node */
         _replace_ref(p_replacement, replacement, dangling);
+        _update_parent_ref(dangling, p_replacement);
         /* Overwrite the replacements children with the deleted nodes children */
         replacement->left = d->left;
         replacement->right = d->right;
         _update_parent_ref(replacement->right, replacement);
         _update_parent_ref(replacement->left, replacement);
+        /* Nodes between p_replacement and replacement are rebalanced on the way up */
+        replacement->height = d->height;
 
-        balance_start = p_replacement;
+        /* The deleted node may have been the replacement's parent */
+        balance_start = (p_replacement == d) ? replacement : p_replacement;
     }
 
     _balance(btree, balance_start);
@@ -297,12 +376,33 @@ void btree_traverse(btree_t *btree, btree_cb_t cb, void *ctx)
     }
 }
 
-size_t btree_max_depth(btree_t *btree)
+void btree_clear(btree_t *btree, btree_cb_t cb, void *ctx)
 {
-    if (btree->start) {
-        return _max_path(btree->start);
+    btree_node_t *node = btree->start;
+    btree->start = NULL;
+
+    /* Post-order walk, detaching each leaf from its parent */
+    while (node) {
+        if (node->left) {
+            node = node->left;
+            continue;
+        }
+        if (node->right) {
+            node = node->right;
+            continue;
+        }
+        btree_node_t *parent = node->parent;
+        if (parent) {
+            _replace_ref(parent, node, NULL);
+        }
+        cb(node, 0, ctx);
+        node = parent;
     }
-    return 0;
+}
+
+size_t btree_max_depth(btree_t *btree)
+{
+    return _height(btree->start);
 }
 
 static void _dump(btree_node_t *node, size_t level, char *prefix)
@@ -0,0 +1,32 @@
+#include <stdint.h>
+#include "include/bpf/clock.h"
+#include "include/bpf/sync.h"
+#include <debug_progmem.h>
+
+#if CONFIG_BPF_CONCURRENT
+uint32_t bpf_clock_ms(void)
+{
+    /* Extend the microsecond clock to 64 bits, shared between threads */
+    static uint64_t total_us;
+    uint64_t old = __atomic_load_n(&total_us, __ATOMIC_RELAXED);
+    uint64_t now;
+    do {
+        now = old + (uint32_t)(system_get_time() - (uint32_t)old);
+    } while (!__atomic_compare_exchange_n(&total_us, &old, now, true, __ATOMIC_RELAXED,
+                                          __ATOMIC_RELAXED));
+    return now / 1000;
+}
+#else
+uint32_t bpf_clock_ms(void)
+{
+    static uint32_t last_us;
+    static uint32_t rem_us;
+    static uint32_t ms;
+    uint32_t now = system_get_time();
+    rem_us += now - last_us;
+    last_us = now;
+    ms += rem_us / 1000;
+    rem_us %= 1000;
+    return ms;
+}
+#endif
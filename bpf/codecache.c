@@ -0,0 +1,222 @@
+#include <stdint.h>
+#include <stdlib.h>
+#include <stdbool.h>
+
+#include "bpf.h"
+#include "bpf/instruction.h"
+#include "bpf/codecache.h"
+#include "bpf/sync.h"
+
+#include <debug_progmem.h>
+
+#if CONFIG_BPF_CODE_CACHE_SIZE
+
+struct bpf_code_cache_entry {
+    bpf_code_cache_entry_t *next;   ///< Next entry, in most recently used order
+    bpf_t *owner;                   ///< Container using this code
+    size_t size;                    ///< Allocated size including this header
+    uint16_t busy;                  ///< Number of active executions
+    uint64_t code[];                ///< Copy of the text section
+};
+
+static bpf_code_cache_entry_t *_entries;
+static bpf_code_cache_stats_t _stats;
+static uint32_t _executions;        ///< Executions since last decay
+static uint16_t _epoch;             ///< Incremented on each decay
+
+/*
+ * Eviction changes the state of other containers, which with CONFIG_BPF_CONCURRENT
+ * may be executing on other threads, so the whole cache is guarded by one lock.
+ * It is held only briefly when entering and leaving an execution.
+ */
+static bpf_mutex_t _mutex = BPF_MUTEX_INIT;
+
+/*
+ * Get decayed execution frequency for a container
+ */
+static uint32_t _frequency(bpf_t *bpf)
+{
+    uint16_t age = _epoch - bpf->exec_epoch;
+    if (age != 0) {
+        bpf->exec_count = (age >= 32) ? 0 : (bpf->exec_count >> age);
+        bpf->exec_epoch = _epoch;
+    }
+    return bpf->exec_count;
+}
+
+static void _unlink(bpf_code_cache_entry_t *entry)
+{
+    for (bpf_code_cache_entry_t **p = &_entries; *p; p = &(*p)->next) {
+        if (*p == entry) {
+            *p = entry->next;
+            return;
+        }
+    }
+}
+
+static void _free_entry(bpf_code_cache_entry_t *entry)
+{
+    _unlink(entry);
+    bpf_t *owner = entry->owner;
+    owner->code_cache = NULL;
+    owner->text = rbpf_text(owner);
+    _stats.bytes_used -= entry->size;
+    _stats.entries--;
+    free(entry);
+}
+
+/*
+ * Find least frequently used idle entry below the given frequency.
+ * The list is in recency order, so ties go to the least recently used.
+ */
+static bpf_code_cache_entry_t *_find_victim(uint32_t below)
+{
+    bpf_code_cache_entry_t *victim = NULL;
+    uint32_t victim_freq = 0;
+    for (bpf_code_cache_entry_t *entry = _entries; entry; entry = entry->next) {
+        if (entry->busy) {
+            continue;
+        }
+        uint32_t freq = _frequency(entry->owner);
+        if (freq < below && (!victim || freq <= victim_freq)) {
+            victim = entry;
+            victim_freq = freq;
+        }
+    }
+    return victim;
+}
+
+static bool _make_room(size_t size, uint32_t freq)
+{
+    /* Check first so entries aren't evicted for nothing */
+    size_t available = CONFIG_BPF_CODE_CACHE_SIZE - _stats.bytes_used;
+    for (bpf_code_cache_entry_t *entry = _entries; entry && available < size;
+         entry = entry->next) {
+        if (!entry->busy && _frequency(entry->owner) < freq) {
+            available += entry->size;
+        }
+    }
+    if (available < size) {
+        return false;
+    }
+
+    while (CONFIG_BPF_CODE_CACHE_SIZE - _stats.bytes_used < size) {
+        bpf_code_cache_entry_t *victim = _find_victim(freq);
+        debug_d("[BPF] Code cache evict %p", victim->owner);
+        _free_entry(victim);
+        _stats.evictions++;
+    }
+    return true;
+}
+
+static void _promote(bpf_t *bpf, uint32_t freq)
+{
+    size_t len = rbpf_header(bpf).text_len;
+    size_t size = sizeof(bpf_code_cache_entry_t) + len;
+    if (size > CONFIG_BPF_CODE_CACHE_SIZE || !_make_room(size, freq)) {
+        _stats.rejections++;
+        return;
+    }
+
+    bpf_code_cache_entry_t *entry = malloc(size);
+    if (entry == NULL) {
+        debug_w("[BPF] Code cache out of memory, %u bytes", (unsigned)size);
+        _stats.rejections++;
+        return;
+    }
+    entry->owner = bpf;
+    entry->size = size;
+    entry->busy = 0;
+
+    /* Flash must be read using aligned accesses */
+    const volatile uint64_t *src = rbpf_text(bpf);
+    for (size_t i = 0; i < len / sizeof(uint64_t); i++) {
+        entry->code[i] = src[i];
+    }
+    /* Copy is private to this instance so data references can be resolved now */
+    bpf_relocate(bpf, entry->code, len);
+
+    entry->next = _entries;
+    _entries = entry;
+    bpf->code_cache = entry;
+    bpf->text = entry->code;
+    _stats.bytes_used += size;
+    _stats.entries++;
+    _stats.insertions++;
+    debug_d("[BPF] Code cache insert %p, %u bytes", bpf, (unsigned)size);
+}
+
+void bpf_code_cache_enter(bpf_t *bpf)
+{
+    bpf_mutex_lock(&_mutex);
+    if (++_executions >= CONFIG_BPF_CODE_CACHE_DECAY) {
+        _executions = 0;
+        _epoch++;
+    }
+
+    uint32_t freq = _frequency(bpf);
+    if (freq < UINT32_MAX) {
+        bpf->exec_count = ++freq;
+    }
+
+    bpf_code_cache_entry_t *entry = bpf->code_cache;
+    if (entry) {
+        /* Move to front so list stays in recency order */
+        if (_entries != entry) {
+            _unlink(entry);
+            entry->next = _entries;
+            _entries = entry;
+        }
+        _stats.hits++;
+    }
+    else {
+        _stats.misses++;
+        if (freq >= CONFIG_BPF_CODE_CACHE_THRESHOLD) {
+            _promote(bpf, freq);
+        }
+        entry = bpf->code_cache;
+    }
+
+    if (entry) {
+        entry->busy++;
+    }
+    bpf_mutex_unlock(&_mutex);
+}
+
+void bpf_code_cache_leave(bpf_t *bpf)
+{
+    bpf_mutex_lock(&_mutex);
+    if (bpf->code_cache) {
+        bpf->code_cache->busy--;
+    }
+    bpf_mutex_unlock(&_mutex);
+}
+
+void bpf_code_cache_release(bpf_t *bpf)
+{
+    bpf_mutex_lock(&_mutex);
+    if (bpf->code_cache) {
+        _free_entry(bpf->code_cache);
+    }
+    bpf_mutex_unlock(&_mutex);
+}
+
+void bpf_code_cache_get_stats(bpf_code_cache_stats_t *stats)
+{
+    bpf_mutex_lock(&_mutex);
+    *stats = _stats;
+    bpf_mutex_unlock(&_mutex);
+}
+
+void bpf_code_cache_reset_stats(void)
+{
+    bpf_mutex_lock(&_mutex);
+    _stats.hits = 0;
+    _stats.misses = 0;
+    _stats.insertions = 0;
+    _stats.evictions = 0;
+    _stats.rejections = 0;
+    bpf_mutex_unlock(&_mutex);
+}
+
+#endif /* CONFIG_BPF_CODE_CACHE_SIZE */
@@ -0,0 +1,368 @@
+/**
+ * @ingroup sys_ctree
+ * @{
+ * @file
+ * @brief   Compact AVL tree implementation
+ * @}
+ */
+
+#include <stdint.h>
+#include <stdbool.h>
+#include "include/bpf/ctree.h"
+
+#define TALLER      0x8000U
+#define INDEX_MASK  0x7FFFU
+
+enum {
+    LEFT = 0,
+    RIGHT = 1,
+};
+
+/*
+ * Path from the root to a node. dir[i] is the side of node[i] taken next.
+ */
+typedef struct {
+    uint16_t node[CTREE_MAX_DEPTH];
+    uint8_t dir[CTREE_MAX_DEPTH];
+    unsigned len;
+} path_t;
+
+static inline ctree_node_t *_node(const ctree_t *tree, uint16_t index)
+{
+    return ctree_node(tree, index);
+}
+
+static inline uint16_t _child(const ctree_node_t *node, unsigned dir)
+{
+    return node->link[dir] & INDEX_MASK;
+}
+
+static inline void _set_child(ctree_node_t *node, unsigned dir, uint16_t child)
+{
+    node->link[dir] = (node->link[dir] & TALLER) | child;
+}
+
+/* Returns -1 if left side taller, +1 if right side taller, 0 if balanced */
+static inline int _balance(const ctree_node_t *node)
+{
+    return (int)(node->link[RIGHT] >> 15) - (int)(node->link[LEFT] >> 15);
+}
+
+static inline void _set_balance(ctree_node_t *node, int balance)
+{
+    node->link[LEFT] = (node->link[LEFT] & INDEX_MASK) | (balance < 0 ? TALLER : 0);
+    node->link[RIGHT] = (node->link[RIGHT] & INDEX_MASK) | (balance > 0 ? TALLER : 0);
+}
+
+/* +1 for RIGHT, -1 for LEFT */
+static inline int _sign(unsigned dir)
+{
+    return dir ? 1 : -1;
+}
+
+static void _replace(ctree_t *tree, const path_t *path, unsigned level, uint16_t index)
+{
+    if (level == 0) {
+        tree->root = index;
+    }
+    else {
+        _set_child(_node(tree, path->node[level - 1]), path->dir[level - 1], index);
+    }
+}
+
+/*
+ * Rebalance node x whose dir side is two levels taller.
+ * Returns the new subtree root. *shorter is set if the subtree height is now
+ * one less than before the rotation.
+ */
+static uint16_t _rotate(ctree_t *tree, uint16_t x, unsigned dir, bool *shorter)
+{
+    unsigned other = !dir;
+    ctree_node_t *xn = _node(tree, x);
+    uint16_t z = _child(xn, dir);
+    ctree_node_t *zn = _node(tree, z);
+    int zb = _balance(zn);
+
+    if (zb == -_sign(dir)) {
+        /* Double rotation */
+        uint16_t y = _child(zn, other);
+        ctree_node_t *yn = _node(tree, y);
+        int yb = _balance(yn);
+        _set_child(xn, dir, _child(yn, other));
+        _set_child(zn, other, _child(yn, dir));
+        _set_child(yn, other, x);
+        _set_child(yn, dir, z);
+        _set_balance(xn, (yb == _sign(dir)) ? -_sign(dir) : 0);
+        _set_balance(zn, (yb == -_sign(dir)) ? _sign(dir) : 0);
+        _set_balance(yn, 0);
+        *shorter = true;
+        return y;
+    }
+
+    /* Single rotation */
+    _set_child(xn, dir, _child(zn, other));
+    _set_child(zn, other, x);
+    if (zb == 0) {
+        /* Only possible after removal */
+        _set_balance(xn, _sign(dir));
+        _set_balance(zn, -_sign(dir));
+        *shorter = false;
+    }
+    else {
+        _set_balance(xn, 0);
+        _set_balance(zn, 0);
+        *shorter = true;
+    }
+    return z;
+}
+
+ctree_node_t *ctree_find(const ctree_t *tree, uint32_t key)
+{
+    uint16_t index = tree->root;
+    while (index) {
+        ctree_node_t *node = _node(tree, index);
+        if (key == node->key) {
+            return node;
+        }
+        index = _child(node, key > node->key);
+    }
+    return NULL;
+}
+
+/* Closest node to key on the given side, or the node with key itself */
+static ctree_node_t *_find_near(const ctree_t *tree, uint32_t key, bool above)
+{
+    ctree_node_t *best = NULL;
+    uint16_t index = tree->root;
+    while (index) {
+        ctree_node_t *node = _node(tree, index);
+        if (key == node->key) {
+            return node;
+        }
+        if ((node->key > key) == above) {
+            best = node;
+        }
+        index = _child(node, key > node->key);
+    }
+    return best;
+}
+
+ctree_node_t *ctree_find_ceil(const ctree_t *tree, uint32_t key)
+{
+    return _find_near(tree, key, true);
+}
+
+ctree_node_t *ctree_find_floor(const ctree_t *tree, uint32_t key)
+{
+    return _find_near(tree, key, false);
+}
+
+/*
+ * Descend towards key, recording the path.
+ * Returns the matching node index, or 0 with the path ending at the insertion point.
+ */
+static uint16_t _descend(const ctree_t *tree, uint32_t key, path_t *path)
+{
+    path->len = 0;
+    uint16_t cur = tree->root;
+    while (cur) {
+        ctree_node_t *node = _node(tree, cur);
+        if (key == node->key) {
+            return cur;
+        }
+        unsigned dir = key > node->key;
+        path->node[path->len] = cur;
+        path->dir[path->len] = dir;
+        path->len++;
+        cur = _child(node, dir);
+    }
+    return 0;
+}
+
+/* Link a new node at the end of path and rebalance */
+static void _attach(ctree_t *tree, const path_t *path, uint16_t index)
+{
+    ctree_node_t *new = _node(tree, index);
+    new->link[LEFT] = 0;
+    new->link[RIGHT] = 0;
+    _replace(tree, path, path->len, index);
+
+    /* Retrace: the subtree on path->dir[level] side grew by one */
+    for (unsigned level = path->len; level-- > 0;) {
+        uint16_t p = path->node[level];
+        ctree_node_t *pn = _node(tree, p);
+        unsigned dir = path->dir[level];
+        int balance = _balance(pn);
+        if (balance == -_sign(dir)) {
+            _set_balance(pn, 0);
+            break;
+        }
+        if (balance == 0) {
+            _set_balance(pn, _sign(dir));
+            continue;
+        }
+        bool shorter;
+        _replace(tree, path, level, _rotate(tree, p, dir, &shorter));
+        /* Rotation after insert always restores the original height */
+        break;
+    }
+}
+
+int ctree_insert(ctree_t *tree, uint16_t index)
+{
+    path_t path;
+    if (_descend(tree, _node(tree, index)->key, &path)) {
+        return CTREE_ERROR_NODE_EXISTS;
+    }
+    _attach(tree, &path, index);
+    return CTREE_OK;
+}
+
+ctree_node_t *ctree_find_or_insert(ctree_t *tree, uint32_t key, ctree_alloc_cb_t alloc,
+                                   void *ctx, bool *inserted)
+{
+    *inserted = false;
+    path_t path;
+    uint16_t index = _descend(tree, key, &path);
+    if (index) {
+        return _node(tree, index);
+    }
+    if (!alloc) {
+        return NULL;
+    }
+
+    index = alloc(ctx);
+    if (index == 0) {
+        return NULL;
+    }
+    ctree_node_t *node = _node(tree, index);
+    node->key = key;
+    node->value = 0;
+    _attach(tree, &path, index);
+    *inserted = true;
+    return node;
+}
+
+uint16_t ctree_remove(ctree_t *tree, uint32_t key, uint32_t *value)
+{
+    path_t path;
+    path.len = 0;
+    uint16_t cur = tree->root;
+    ctree_node_t *node = NULL;
+    while (cur) {
+        node = _node(tree, cur);
+        if (key == node->key) {
+            break;
+        }
+        unsigned dir = key > node->key;
+        path.node[path.len] = cur;
+        path.dir[path.len] = dir;
+        path.len++;
+        cur = _child(node, dir);
+    }
+    if (!cur) {
+        return 0;
+    }
+    if (value) {
+        *value = node->value;
+    }
+
+    if (_child(node, LEFT) && _child(node, RIGHT)) {
+        /* Move in-order successor into this node and remove successor instead */
+        path.node[path.len] = cur;
+        path.dir[path.len] = RIGHT;
+        path.len++;
+        uint16_t succ = _child(node, RIGHT);
+        ctree_node_t *sn = _node(tree, succ);
+        while (_child(sn, LEFT)) {
+            path.node[path.len] = succ;
+            path.dir[path.len] = LEFT;
+            path.len++;
+            succ = _child(sn, LEFT);
+            sn = _node(tree, succ);
+        }
+        node->key = sn->key;
+        node->value = sn->value;
+        cur = succ;
+        node = sn;
+    }
+
+    /* Node has at most one child, which takes its place */
+    uint16_t child = _child(node, LEFT) ? _child(node, LEFT) : _child(node, RIGHT);
+    _replace(tree, &path, path.len, child);
+
+    /* Retrace: the subtree on path.dir[level] side shrank by one */
+    for (unsigned level = path.len; level-- > 0;) {
+        uint16_t p = path.node[level];
+        ctree_node_t *pn = _node(tree, p);
+        unsigned dir = path.dir[level];
+        int balance = _balance(pn);
+        if (balance == 0) {
+            _set_balance(pn, -_sign(dir));
+            break;
+        }
+        if (balance == _sign(dir)) {
+            _set_balance(pn, 0);
+            continue;
+        }
+        bool shorter;
+        _replace(tree, &path, level, _rotate(tree, p, !dir, &shorter));
+        if (!shorter) {
+            break;
+        }
+    }
+
+    return cur;
+}
+
+void ctree_traverse(const ctree_t *tree, ctree_cb_t cb, void *ctx)
+{
+    uint16_t stack[CTREE_MAX_DEPTH];
+    unsigned len = 0;
+    uint16_t cur = tree->root;
+    while (cur || len) {
+        while (cur) {
+            stack[len++] = cur;
+            cur = _child(_node(tree, cur), LEFT);
+        }
+        ctree_node_t *node = _node(tree, stack[--len]);
+        cb(node, ctx);
+        cur = _child(node, RIGHT);
+    }
+}
+
+void ctree_clear(ctree_t *tree, ctree_cb_t cb, void *ctx)
+{
+    /* Pre-order walk, holding at most one pending right child per level */
+    uint16_t stack[CTREE_MAX_DEPTH + 1];
+    unsigned len = 0;
+    if (tree->root) {
+        stack[len++] = tree->root;
+    }
+    tree->root = 0;
+    while (len) {
+        ctree_node_t *node = _node(tree, stack[--len]);
+        uint16_t left = _child(node, LEFT);
+        uint16_t right = _child(node, RIGHT);
+        if (right) {
+            stack[len++] = right;
+        }
+        if (left) {
+            stack[len++] = left;
+        }
+        cb(node, ctx);
+    }
+}
+
+size_t ctree_max_depth(const ctree_t *tree)
+{
+    size_t depth = 0;
+    uint16_t cur = tree->root;
+    while (cur) {
+        const ctree_node_t *node = _node(tree, cur);
+        depth++;
+        /* Follow the taller side */
+        cur = _child(node, _balance(node) < 0 ? LEFT : RIGHT);
+    }
+    return depth;
+}
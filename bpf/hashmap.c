@@ -0,0 +1,16 @@
+/**
+ * @ingroup sys_hashmap
+ * @{
+ * @file
+ * @brief   Robin Hood hash map with 32-bit keys and values
+ *
+ * The implementation is in hashmap_impl.h.
+ * @}
+ */
+
+#include "include/bpf/hashmap.h"
+
+#define HASHMAP_KEY_T   uint32_t
+#define HASHMAP(name)   hashmap_##name
+
+#include "hashmap_impl.h"
@@ -0,0 +1,16 @@
+/**
+ * @ingroup sys_hashmap64
+ * @{
+ * @file
+ * @brief   Robin Hood hash map with 64-bit keys and values
+ *
+ * The implementation is in hashmap_impl.h.
+ * @}
+ */
+
+#include "include/bpf/hashmap64.h"
+
+#define HASHMAP_KEY_T   uint64_t
+#define HASHMAP(name)   hashmap64_##name
+
+#include "hashmap_impl.h"
@@ -0,0 +1,278 @@
+/**
+ * @ingroup sys_hashmap
+ * @{
+ * @file
+ * @brief   Robin Hood hash map implementation, shared by hashmap and hashmap64
+ *
+ * Included once by each map flavour after its public header, with:
+ *
+ * - `HASHMAP_KEY_T`: type of keys and values
+ * - `HASHMAP(name)`: expands to the flavour's public name, e.g. `hashmap_##name`
+ *
+ * @}
+ */
+
+#include <stdint.h>
+#include <stdlib.h>
+#include <stdbool.h>
+#include <string.h>
+
+#if !defined(HASHMAP_KEY_T) || !defined(HASHMAP)
+#error "Define HASHMAP_KEY_T and HASHMAP() before including hashmap_impl.h"
+#endif
+
+#define MIN_CAPACITY    8U
+#define MAX_DISTANCE    UINT8_MAX
+
+/*
+ * Each slot has a probe distance byte stored after the slot array:
+ * 0 for an empty slot, otherwise 1 + the distance from the entry's home slot.
+ */
+static inline uint8_t *_dist(const HASHMAP(t) *map)
+{
+    return (uint8_t *)(map->slots + map->capacity);
+}
+
+/*
+ * Locate key, or the slot where it should be inserted.
+ * On return *dist holds the probe distance for that slot.
+ */
+static uint32_t _probe(const HASHMAP(t) *map, HASHMAP_KEY_T key, uint8_t *dist, bool *found)
+{
+    const uint8_t *d = _dist(map);
+    uint32_t mask = map->capacity - 1;
+    uint32_t idx = HASHMAP(home)(map, key);
+    unsigned probe = 1;
+    /* Entries further along are closer to home than key would be, so it can't be there */
+    while (d[idx] >= probe) {
+        if (map->slots[idx].key == key) {
+            *found = true;
+            *dist = probe;
+            return idx;
+        }
+        idx = (idx + 1) & mask;
+        probe++;
+    }
+    *found = false;
+    *dist = (probe > MAX_DISTANCE) ? 0 : probe;
+    return idx;
+}
+
+/*
+ * Insert a key known to be absent at the slot found by _probe().
+ * Robin Hood insertion is equivalent to shifting the run of entries between
+ * the insertion point and the next empty slot along by one, so check that no
+ * probe distance overflows before changing anything.
+ */
+static HASHMAP(entry_t) *_insert_at(HASHMAP(t) *map, uint32_t pos, uint8_t dist,
+                                    HASHMAP_KEY_T key, HASHMAP_KEY_T value)
+{
+    uint8_t *d = _dist(map);
+    uint32_t mask = map->capacity - 1;
+    if (dist == 0) {
+        return NULL;
+    }
+
+    uint32_t end = pos;
+    while (d[end] != 0) {
+        if (d[end] == MAX_DISTANCE) {
+            return NULL;
+        }
+        end = (end + 1) & mask;
+    }
+
+    while (end != pos) {
+        uint32_t prev = (end - 1) & mask;
+        map->slots[end] = map->slots[prev];
+        d[end] = d[prev] + 1;
+        end = prev;
+    }
+    map->slots[pos].key = key;
+    map->slots[pos].value = value;
+    d[pos] = dist;
+    return &map->slots[pos];
+}
+
+static HASHMAP(entry_t) *_place(HASHMAP(t) *map, HASHMAP_KEY_T key, HASHMAP_KEY_T value)
+{
+    uint8_t dist;
+    bool found;
+    uint32_t pos = _probe(map, key, &dist, &found);
+    return _insert_at(map, pos, dist, key, value);
+}
+
+static int _resize(HASHMAP(t) *map, uint32_t capacity);
+
+static inline bool _needs_grow(const HASHMAP(t) *map)
+{
+    /* Keep load factor at or below 3/4 */
+    return (map->count + 1) * 4 > map->capacity * 3;
+}
+
+/* Insert a key known to be absent, growing the table as required */
+static HASHMAP(entry_t) *_insert(HASHMAP(t) *map, HASHMAP_KEY_T key, HASHMAP_KEY_T value)
+{
+    if (_needs_grow(map)) {
+        if (_resize(map, map->capacity ? map->capacity * 2 : MIN_CAPACITY) < 0) {
+            return NULL;
+        }
+    }
+
+    HASHMAP(entry_t) *entry;
+    while ((entry = _place(map, key, value)) == NULL) {
+        if (_resize(map, map->capacity * 2) < 0) {
+            return NULL;
+        }
+    }
+    map->count++;
+    return entry;
+}
+
+static int _resize(HASHMAP(t) *map, uint32_t capacity)
+{
+    for (;;) {
+        HASHMAP(t) new_map = {
+            .slots = calloc(capacity, sizeof(HASHMAP(entry_t)) + 1),
+            .capacity = capacity,
+            .count = map->count,
+        };
+        if (new_map.slots == NULL) {
+            return HASHMAP_ERROR_NO_MEM;
+        }
+
+        bool ok = true;
+        const uint8_t *d = _dist(map);
+        for (uint32_t i = 0; ok && i < map->capacity; i++) {
+            if (d[i] != 0) {
+                ok = _place(&new_map, map->slots[i].key, map->slots[i].value) != NULL;
+            }
+        }
+        if (ok) {
+            free(map->slots);
+            *map = new_map;
+            return HASHMAP_OK;
+        }
+
+        /* Pathological clustering, try a larger table */
+        free(new_map.slots);
+        capacity *= 2;
+    }
+}
+
+HASHMAP(entry_t) *HASHMAP(find)(const HASHMAP(t) *map, HASHMAP_KEY_T key)
+{
+    if (map->count == 0) {
+        return NULL;
+    }
+    uint8_t dist;
+    bool found;
+    uint32_t idx = _probe(map, key, &dist, &found);
+    return found ? &map->slots[idx] : NULL;
+}
+
+int HASHMAP(insert)(HASHMAP(t) *map, HASHMAP_KEY_T key, HASHMAP_KEY_T value)
+{
+    if (HASHMAP(find)(map, key)) {
+        return HASHMAP_ERROR_EXISTS;
+    }
+    return _insert(map, key, value) ? HASHMAP_OK : HASHMAP_ERROR_NO_MEM;
+}
+
+HASHMAP(entry_t) *HASHMAP(find_or_insert)(HASHMAP(t) *map, HASHMAP_KEY_T key, bool insert,
+                                          bool *inserted)
+{
+    *inserted = false;
+    if (map->count != 0) {
+        uint8_t dist;
+        bool found;
+        uint32_t pos = _probe(map, key, &dist, &found);
+        if (found) {
+            return &map->slots[pos];
+        }
+        if (!insert) {
+            return NULL;
+        }
+        /* Insert where the probe stopped unless the table must change first */
+        if (!_needs_grow(map)) {
+            HASHMAP(entry_t) *entry = _insert_at(map, pos, dist, key, 0);
+            if (entry) {
+                map->count++;
+                *inserted = true;
+                return entry;
+            }
+        }
+    }
+    else if (!insert) {
+        return NULL;
+    }
+
+    HASHMAP(entry_t) *entry = _insert(map, key, 0);
+    *inserted = (entry != NULL);
+    return entry;
+}
+
+int HASHMAP(remove)(HASHMAP(t) *map, HASHMAP_KEY_T key, HASHMAP_KEY_T *value)
+{
+    if (map->count == 0) {
+        return HASHMAP_ERROR_NOT_FOUND;
+    }
+    uint8_t dist;
+    bool found;
+    uint32_t idx = _probe(map, key, &dist, &found);
+    if (!found) {
+        return HASHMAP_ERROR_NOT_FOUND;
+    }
+    if (value) {
+        *value = map->slots[idx].value;
+    }
+
+    /* Backward shift: pull following displaced entries one slot closer to home */
+    uint8_t *d = _dist(map);
+    uint32_t mask = map->capacity - 1;
+    uint32_t next = (idx + 1) & mask;
+    while (d[next] > 1) {
+        map->slots[idx] = map->slots[next];
+        d[idx] = d[next] - 1;
+        idx = next;
+        next = (next + 1) & mask;
+    }
+    d[idx] = 0;
+
+    map->count--;
+    if (map->count == 0) {
+        HASHMAP(clear)(map);
+    }
+    else if (map->capacity > MIN_CAPACITY && map->count * 8 < map->capacity) {
+        /* Failure just leaves the map larger than necessary */
+        (void)_resize(map, map->capacity / 2);
+    }
+    return HASHMAP_OK;
+}
+
+void HASHMAP(foreach)(HASHMAP(t) *map, HASHMAP(cb_t) cb, void *ctx)
+{
+    const uint8_t *d = _dist(map);
+    for (uint32_t i = 0; i < map->capacity; i++) {
+        if (d[i] != 0) {
+            cb(&map->slots[i], ctx);
+        }
+    }
+}
+
+void HASHMAP(clear)(HASHMAP(t) *map)
+{
+    free(map->slots);
+    memset(map, 0, sizeof(*map));
+}
+
+size_t HASHMAP(max_probe)(const HASHMAP(t) *map)
+{
+    const uint8_t *d = _dist(map);
+    uint8_t max = 0;
+    for (uint32_t i = 0; i < map->capacity; i++) {
+        if (d[i] > max) {
+            max = d[i];
+        }
+    }
+    return max;
+}
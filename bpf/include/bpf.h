@@ -27,7 +27,9 @@
 #include <stdint.h>
 #include <string.h>
 #include <assert.h>
-#include "bpf/btree.h"
+#include "bpf/store.h"
+#include "bpf/codecache.h"
+#include "bpf/map.h"
 
 #ifdef __cplusplus
 extern "C" {
@@ -37,6 +39,16 @@ extern "C" {
 #define CONFIG_BPF_ENABLE_ALU32 (0)
 #endif
 
+/**
+ * @brief Select interpreter engine
+ *
+ * 1: Computed jump table (jumptable.c), fastest dispatch
+ * 0: Switch-case (switch.c), smallest code size
+ */
+#ifndef CONFIG_BPF_USE_JUMPTABLE
+#define CONFIG_BPF_USE_JUMPTABLE (1)
+#endif
+
 #ifndef CONFIG_BPF_BRANCHES_ALLOWED
 #define CONFIG_BPF_BRANCHES_ALLOWED 200
 #endif
@@ -45,6 +57,8 @@ extern "C" {
 
 #define RBPF_MAGIC_NO 0x72425046 /**< Magic header number: "rBPF" */
 
+#define RBPF_FLAG_MAPS 0x02 /**< Header flag: Map table follows function table */
+
 typedef struct __attribute__((packed)) {
     uint32_t magic;      /**< Magic number */
     uint32_t version;    /**< Version of the application */
@@ -113,7 +127,13 @@ typedef struct bpf_s {
     bpf_mem_region_t rodata_region;
     bpf_mem_region_t data_region;
     bpf_mem_region_t arg_region;
-    btree_t btree;                  ///< Local btree
+    bpf_store_t store;              ///< Local key-value store
+    bpf_map_t *maps;                ///< Maps declared by container, see map.h
+    uint32_t num_maps;
+    const void *text;               ///< Code to execute, in the application image or code cache
+    bpf_code_cache_entry_t *code_cache; ///< Code cache entry, NULL if executing from image
+    uint32_t exec_count;            ///< Recent execution count, used by code cache
+    uint16_t exec_epoch;            ///< Code cache decay epoch for exec_count
     uint16_t flags;                 ///< bpf_instance_flag_t
     uint32_t branches_remaining;    ///< Number of allowed branch instructions remaining
 } bpf_t;
@@ -137,6 +157,10 @@ int bpf_setup(bpf_t *bpf);
  * 
  * DATA and BSS sections are copied to RAM which is dynamically allocated by `bpf_setup()`.
  * This ensures container code is not modified and permits multiple instances.
+ *
+ * Local store entries are returned to the shared pool.
+ *
+ * Maps are freed.
  */
 void bpf_destroy(bpf_t *bpf);
 
@@ -168,6 +192,17 @@ int bpf_execute(bpf_t *bpf, void *ctx, size_t ctx_size, int64_t *result);
  */
 int bpf_execute_ctx(bpf_t *bpf, void *ctx, size_t ctx_size, int64_t *result);
 
+/**
+ * @brief Resolve data and rodata references in a RAM copy of the container code
+ * @param bpf Container, after bpf_setup()
+ * @param text Copy of the text section
+ * @param len Length of text in bytes
+ *
+ * LDDWD and LDDWR instructions are rewritten as LDDW with the final address,
+ * so they execute as a plain immediate load.
+ */
+void bpf_relocate(const bpf_t *bpf, void *text, size_t len);
+
 /**
  * @brief Add an additional memory region to the container
  * @param bpf
@@ -188,7 +223,7 @@ void bpf_add_region(bpf_t *bpf, bpf_mem_region_t *region,
  * @retval void* On success, points to system memory address.
  * Returns NULL if block is invalid or write access requested for read-only region.
  */
-void* bpf_get_mem(const bpf_t *bpf, uint8_t size, const intptr_t addr, uint8_t type);
+void* bpf_get_mem(const bpf_t *bpf, size_t size, const intptr_t addr, uint8_t type);
 
 /*
  * @brief Check whether WRITE access is permitted for given memory block
@@ -16,10 +16,9 @@
  * implementation. It can be used to implement key-value stores and other
  * key-based structures.
  *
- * The binary search tree provided here is optimized for fast key lookups.
- * Insertions and deletions are slow and should be avoided when possible. Both
- * insertions and deletions trigger the relative slow balancing algorithm to
- * keep the tree into an relative optimal shape for search operations.
+ * The binary search tree provided here is an AVL tree. Each node stores the
+ * height of its subtree, which is maintained incrementally so lookups,
+ * insertions and deletions are all O(log n).
  *
  * The btree_node_t structs stores the required internal references and a key.
  * It is up to the implementor to inherit from the struct and add the required
@@ -82,6 +81,7 @@
 
 #include <stdint.h>
 #include <stddef.h>
+#include <stdbool.h>
 
 #ifdef __cplusplus
 extern "C" {
@@ -110,6 +110,7 @@ struct btree_node {
     struct btree_node *right;   /**< Higher value reference */
     struct btree_node *parent;  /**< Parent node reference  */
     uint32_t key;               /**< Key of this node       */
+    uint8_t height;             /**< Height of the subtree rooted here, leaf is 1 */
 };
 
 /**
@@ -160,6 +161,44 @@ void btree_traverse(btree_t *btree, btree_cb_t cb, void *ctx);
  */
 btree_node_t *btree_find_key(btree_t *btree, uint32_t key);
 
+/**
+ * @brief Find the node with the smallest key greater than or equal to a key
+ *
+ * @param   btree   Tree to search
+ * @param   key     Key to compare with
+ *
+ * @returns         The node found, NULL if all keys are less than @p key
+ */
+btree_node_t *btree_find_ceil(btree_t *btree, uint32_t key);
+
+/**
+ * @brief Find the node with the largest key less than or equal to a key
+ *
+ * @param   btree   Tree to search
+ * @param   key     Key to compare with
+ *
+ * @returns         The node found, NULL if all keys are greater than @p key
+ */
+btree_node_t *btree_find_floor(btree_t *btree, uint32_t key);
+
+/**
+ * @brief Get the node with the next higher key
+ *
+ * @param   node    Node in a tree
+ *
+ * @returns         In-order successor, NULL if @p node has the highest key
+ */
+btree_node_t *btree_next(btree_node_t *node);
+
+/**
+ * @brief Get the node with the next lower key
+ *
+ * @param   node    Node in a tree
+ *
+ * @returns         In-order predecessor, NULL if @p node has the lowest key
+ */
+btree_node_t *btree_prev(btree_node_t *node);
+
 /**
  * @brief Insert a new node into the tree
  *
@@ -169,6 +208,33 @@ btree_node_t *btree_find_key(btree_t *btree, uint32_t key);
  */
 int btree_insert(btree_t *btree, btree_node_t *newNode, uint32_t key);
 
+/**
+ * @brief Node allocation callback for btree_find_or_insert()
+ *
+ * @param   ctx     Context passed to btree_find_or_insert()
+ *
+ * @returns         Node to insert, NULL if none is available
+ */
+typedef btree_node_t *(*btree_alloc_cb_t)(void *ctx);
+
+/**
+ * @brief Find a node, inserting one if the key is absent
+ *
+ * Descends the tree once. If the key is not found, @p alloc is called for a
+ * new node which is linked in at the point where the descent stopped.
+ *
+ * @param   btree       Tree to search
+ * @param   key         Key to find
+ * @param   alloc       Called to allocate a node if key is absent, may be NULL
+ * @param   ctx         Context to pass to @p alloc
+ * @param   inserted    Set to true if a node was inserted
+ *
+ * @returns             The node with the requested key
+ * @returns             NULL if the key was not found and no node was allocated
+ */
+btree_node_t *btree_find_or_insert(btree_t *btree, uint32_t key, btree_alloc_cb_t alloc,
+                                   void *ctx, bool *inserted);
+
 /**
  * @brief Remove a node from the tree
  *
@@ -180,12 +246,24 @@ int btree_insert(btree_t *btree, btree_node_t *newNode, uint32_t key);
  */
 btree_node_t *btree_remove(btree_t *btree, uint32_t key);
 
+/**
+ * @brief Remove all nodes from the tree
+ *
+ * Nodes are detached from the tree before the callback is invoked for them,
+ * so the callback may deallocate them. Takes O(n) time.
+ *
+ * @param   btree   Tree to clear
+ * @param   cb      Callback to call for every removed node, depth is always 0
+ * @param   ctx     Context to pass to every callback
+ */
+void btree_clear(btree_t *btree, btree_cb_t cb, void *ctx);
+
 /**
  * @brief Auxiliary function to retrieve the depth of the tree
  *
  * @param   btree   tree to find the max depth for
  *
- * @returns         Depth of the tree
+ * @returns         Depth of the tree, 0 if empty. Takes constant time.
  */
 size_t btree_max_depth(btree_t *btree);
 
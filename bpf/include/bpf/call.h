@@ -40,8 +40,9 @@ extern "C" {
  * @brief System call implementation prototype
  * 
  * All calls must accept bpf parameter and from 0 to 5 parameters.
+ * Arguments are pointer-sized so addresses are passed intact on 64-bit hosts.
  */
-typedef uint32_t (*bpf_call_t)(bpf_t* bpf, uint32_t a1, uint32_t a2, uint32_t a3, uint32_t a4, uint32_t a5);
+typedef uint32_t (*bpf_call_t)(bpf_t* bpf, uintptr_t a1, uintptr_t a2, uintptr_t a3, uintptr_t a4, uintptr_t a5);
 
 /**
  * @brief Map function code to system call
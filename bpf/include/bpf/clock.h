@@ -0,0 +1,38 @@
+/**
+ * @defgroup    sys_bpf_clock BPF millisecond clock
+ * @ingroup     sys_bpf
+ * @brief       Millisecond time shared by store lifetimes, window maps and bpf_now_ms()
+ *
+ * `system_get_time()` counts microseconds in 32 bits, so dividing it by 1000
+ * gives a millisecond count which jumps back to 0 every 71.6 minutes. This
+ * clock instead accumulates the microsecond deltas between calls, so it
+ * counts on steadily and only wraps at 2^32 ms, about 49.7 days. It must be
+ * read at least once per microsecond timer period to see every wrap, which
+ * any regular activity does.
+ *
+ * @{
+ *
+ * @file
+ */
+
+#ifndef BPF_CLOCK_H
+#define BPF_CLOCK_H
+
+#include <stdint.h>
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+/**
+ * @brief Get the time in milliseconds
+ *
+ * Safe to call from several threads if `CONFIG_BPF_CONCURRENT` is set.
+ */
+uint32_t bpf_clock_ms(void);
+
+#ifdef __cplusplus
+}
+#endif
+#endif /* BPF_CLOCK_H */
+/** @} */
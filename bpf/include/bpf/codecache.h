@@ -0,0 +1,137 @@
+/**
+ * @defgroup    sys_bpf_codecache BPF code cache
+ * @ingroup     sys_bpf
+ * @brief       RAM copies of frequently executed container code
+ *
+ * Container images normally execute directly from flash, which is slow on
+ * targets where flash is memory-mapped through a cache. The code cache copies
+ * the text section of frequently executed containers into RAM, bounded by a
+ * global byte budget (`CONFIG_BPF_CODE_CACHE_SIZE`).
+ *
+ * Each container instance counts its executions. Counts are halved every
+ * `CONFIG_BPF_CODE_CACHE_DECAY` executions (across all containers) so they
+ * reflect recent use. Once a container reaches `CONFIG_BPF_CODE_CACHE_THRESHOLD`
+ * it is copied to RAM, evicting the least frequently used entries if required.
+ * An entry is only evicted for a container which is executed more often.
+ *
+ * The cache is disabled when `CONFIG_BPF_CODE_CACHE_SIZE` is 0.
+ *
+ * @{
+ *
+ * @file
+ */
+
+#ifndef BPF_CODECACHE_H
+#define BPF_CODECACHE_H
+
+#include <stdint.h>
+#include <stddef.h>
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+#ifndef CONFIG_BPF_CODE_CACHE_SIZE
+#define CONFIG_BPF_CODE_CACHE_SIZE          (0U)
+#endif
+
+#ifndef CONFIG_BPF_CODE_CACHE_THRESHOLD
+#define CONFIG_BPF_CODE_CACHE_THRESHOLD     (4U)
+#endif
+
+#ifndef CONFIG_BPF_CODE_CACHE_DECAY
+#define CONFIG_BPF_CODE_CACHE_DECAY         (256U)
+#endif
+
+/**
+ * @brief Code cache statistics
+ */
+typedef struct {
+    uint32_t hits;          ///< Executions served from RAM
+    uint32_t misses;        ///< Executions served from flash
+    uint32_t insertions;    ///< Containers copied into RAM
+    uint32_t evictions;     ///< Containers evicted to make room for others
+    uint32_t rejections;    ///< Promotions refused for lack of budget (held by more frequent entries) or heap
+    size_t bytes_used;      ///< RAM currently allocated to cached code
+    size_t entries;         ///< Number of cached containers
+} bpf_code_cache_stats_t;
+
+/**
+ * @brief Cache entry, allocated with the code copy appended
+ */
+typedef struct bpf_code_cache_entry bpf_code_cache_entry_t;
+
+/* bpf.h includes this header, so use the struct tag */
+struct bpf_s;
+
+#if CONFIG_BPF_CODE_CACHE_SIZE
+
+/**
+ * @brief Called before container execution to select RAM or flash code
+ * @param bpf
+ *
+ * Sets `bpf->text`. The entry cannot be evicted until bpf_code_cache_leave().
+ */
+void bpf_code_cache_enter(struct bpf_s *bpf);
+
+/**
+ * @brief Called after container execution
+ * @param bpf
+ */
+void bpf_code_cache_leave(struct bpf_s *bpf);
+
+/**
+ * @brief Discard any cached code for a container
+ * @param bpf
+ *
+ * Called by bpf_destroy()
+ */
+void bpf_code_cache_release(struct bpf_s *bpf);
+
+/**
+ * @brief Read cache statistics
+ * @param stats OUT
+ */
+void bpf_code_cache_get_stats(bpf_code_cache_stats_t *stats);
+
+/**
+ * @brief Zero cache counters
+ *
+ * Sizes are not affected.
+ */
+void bpf_code_cache_reset_stats(void);
+
+#else
+
+static inline void bpf_code_cache_enter(struct bpf_s *bpf)
+{
+    (void)bpf;
+}
+
+static inline void bpf_code_cache_leave(struct bpf_s *bpf)
+{
+    (void)bpf;
+}
+
+static inline void bpf_code_cache_release(struct bpf_s *bpf)
+{
+    (void)bpf;
+}
+
+static inline void bpf_code_cache_get_stats(bpf_code_cache_stats_t *stats)
+{
+    bpf_code_cache_stats_t empty = { 0 };
+    *stats = empty;
+}
+
+static inline void bpf_code_cache_reset_stats(void)
+{
+}
+
+#endif /* CONFIG_BPF_CODE_CACHE_SIZE */
+
+#ifdef __cplusplus
+}
+#endif
+#endif /* BPF_CODECACHE_H */
+/** @} */
@@ -0,0 +1,202 @@
+/**
+ * @defgroup    sys_ctree Compact binary tree
+ * @ingroup     sys
+ * @brief       AVL tree of 32-bit key/value pairs using 16-bit node indices
+ *
+ * A space-efficient alternative to @ref sys_btree. Nodes are allocated from a
+ * single array and reference each other by index instead of by pointer.
+ * There is no parent reference: operations descend iteratively, recording
+ * their path on a small stack so they can rebalance on the way back up.
+ *
+ * Each node is 12 bytes: key, value and two child links. The top bit of a
+ * child link is set when that side of the subtree is taller, which is all the
+ * balance information AVL needs. This leaves 15 bits for the index, so a tree
+ * can hold at most @ref CTREE_MAX_NODES nodes.
+ *
+ * Allocating nodes is the responsibility of the application. A node is
+ * identified by its index + 1 in the node array, so 0 means "no node".
+ *
+ * Removal may move another node's key and value into the removed node's slot.
+ * The slot which is actually released is returned.
+ *
+ * @{
+ *
+ * @file
+ */
+
+#ifndef CTREE_H
+#define CTREE_H
+
+#include <stdint.h>
+#include <stddef.h>
+#include <stdbool.h>
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+/**
+ * @brief Maximum number of nodes in a tree
+ */
+#define CTREE_MAX_NODES     0x7FFFU
+
+/**
+ * @brief Longest possible path, the maximum height of an AVL tree of CTREE_MAX_NODES
+ */
+#define CTREE_MAX_DEPTH     22
+
+enum {
+    CTREE_OK = 0,                   /**< No error */
+    CTREE_ERROR_NODE_EXISTS = -1,   /**< Key already exists in the tree */
+};
+
+/**
+ * @brief Compact tree node
+ */
+typedef struct {
+    uint32_t key;       /**< Key of this node */
+    uint32_t value;     /**< Value associated with the key */
+    uint16_t link[2];   /**< Left and right child, top bit set if that side is taller */
+} ctree_node_t;
+
+/**
+ * @brief Compact tree reference
+ */
+typedef struct {
+    ctree_node_t *nodes;    /**< Node array, indices refer to this */
+    uint16_t root;          /**< Root node index, 0 if empty */
+} ctree_t;
+
+/**
+ * @brief Callback function for tree traversal
+ *
+ * @param   node    Current node. The value may be modified.
+ * @param   ctx     Pointer to the supplied traversal context
+ */
+typedef void (*ctree_cb_t)(ctree_node_t *node, void *ctx);
+
+/**
+ * @brief Get a node from its index
+ */
+static inline ctree_node_t *ctree_node(const ctree_t *tree, uint16_t index)
+{
+    return &tree->nodes[index - 1];
+}
+
+/**
+ * @brief Find a node with a specified key
+ *
+ * @param   tree    Tree to search
+ * @param   key     Key to find
+ *
+ * @returns         The node with the requested key
+ * @returns         NULL if no node was found
+ */
+ctree_node_t *ctree_find(const ctree_t *tree, uint32_t key);
+
+/**
+ * @brief Find the node with the smallest key greater than or equal to a key
+ *
+ * @param   tree    Tree to search
+ * @param   key     Key to compare with
+ *
+ * @returns         The node found, NULL if all keys are less than @p key
+ */
+ctree_node_t *ctree_find_ceil(const ctree_t *tree, uint32_t key);
+
+/**
+ * @brief Find the node with the largest key less than or equal to a key
+ *
+ * @param   tree    Tree to search
+ * @param   key     Key to compare with
+ *
+ * @returns         The node found, NULL if all keys are greater than @p key
+ */
+ctree_node_t *ctree_find_floor(const ctree_t *tree, uint32_t key);
+
+/**
+ * @brief Insert a node into the tree
+ *
+ * @param   tree    Tree to insert into
+ * @param   index   Index of an unused node, with key and value set
+ *
+ * @returns         CTREE_OK on success
+ * @returns         CTREE_ERROR_NODE_EXISTS if the key is already present
+ */
+int ctree_insert(ctree_t *tree, uint16_t index);
+
+/**
+ * @brief Node allocation callback for ctree_find_or_insert()
+ *
+ * @param   ctx     Context passed to ctree_find_or_insert()
+ *
+ * @returns         Index of an unused node, 0 if none is available
+ */
+typedef uint16_t (*ctree_alloc_cb_t)(void *ctx);
+
+/**
+ * @brief Find a node, inserting one if the key is absent
+ *
+ * Descends the tree once. If the key is not found, @p alloc is called for a
+ * new node which is given the key and a value of 0, then linked in using the
+ * recorded path.
+ *
+ * @param   tree        Tree to search
+ * @param   key         Key to find
+ * @param   alloc       Called to allocate a node if key is absent, may be NULL
+ * @param   ctx         Context to pass to @p alloc
+ * @param   inserted    Set to true if a node was inserted
+ *
+ * @returns             The node with the requested key
+ * @returns             NULL if the key was not found and no node was allocated
+ */
+ctree_node_t *ctree_find_or_insert(ctree_t *tree, uint32_t key, ctree_alloc_cb_t alloc,
+                                   void *ctx, bool *inserted);
+
+/**
+ * @brief Remove a key from the tree
+ *
+ * @param   tree    Tree to remove from
+ * @param   key     Key to remove
+ * @param   value   If not NULL, receives the value of the removed key
+ *
+ * @returns         Index of the node no longer used by the tree
+ * @returns         0 if the key was not found
+ */
+uint16_t ctree_remove(ctree_t *tree, uint32_t key, uint32_t *value);
+
+/**
+ * @brief Traverse the full tree, visiting every node exactly once in ascending
+ *        order.
+ *
+ * @param   tree    Tree to traverse
+ * @param   cb      Callback to call for every node
+ * @param   ctx     Context to pass to every callback
+ */
+void ctree_traverse(const ctree_t *tree, ctree_cb_t cb, void *ctx);
+
+/**
+ * @brief Remove all nodes from the tree
+ *
+ * The callback may deallocate the node it is passed. Takes O(n) time.
+ *
+ * @param   tree    Tree to clear
+ * @param   cb      Callback to call for every removed node
+ * @param   ctx     Context to pass to every callback
+ */
+void ctree_clear(ctree_t *tree, ctree_cb_t cb, void *ctx);
+
+/**
+ * @brief Retrieve the depth of the tree
+ *
+ * @param   tree    Tree to inspect
+ *
+ * @returns         Depth of the tree, 0 if empty. Takes O(log n) time.
+ */
+size_t ctree_max_depth(const ctree_t *tree);
+
+#ifdef __cplusplus
+}
+#endif
+#endif /* CTREE_H */
+/** @} */
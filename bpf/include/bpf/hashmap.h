@@ -0,0 +1,179 @@
+/**
+ * @defgroup    sys_hashmap Hash map
+ * @ingroup     sys
+ * @brief       Open-addressing hash map of 32-bit keys to 32-bit values
+ *
+ * Keys and values are stored together in a single contiguous array of slots,
+ * so a lookup usually touches one cache line of entries plus one cache line of
+ * probe distances.
+ *
+ * Collisions are resolved with Robin Hood linear probing: an entry being
+ * inserted displaces any entry which is closer to its home slot. This keeps
+ * probe sequences short and lets a lookup stop early on a miss.
+ * Removal shifts the following entries back by one slot, so no tombstones are
+ * left behind and performance does not degrade with churn.
+ *
+ * The slot array is allocated with malloc() on first insertion. It doubles in
+ * size when more than 3/4 full and halves when less than 1/8 full.
+ * It is freed when the last entry is removed.
+ *
+ * Entries are in no particular order.
+ *
+ * @{
+ *
+ * @file
+ */
+
+#ifndef HASHMAP_H
+#define HASHMAP_H
+
+#include <stdint.h>
+#include <stddef.h>
+#include <stdbool.h>
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+enum {
+    HASHMAP_OK = 0,                 /**< No error */
+    HASHMAP_ERROR_EXISTS = -1,      /**< Key already exists in the map */
+    HASHMAP_ERROR_NO_MEM = -2,      /**< Slot array could not be allocated */
+    HASHMAP_ERROR_NOT_FOUND = -3,   /**< Key not found */
+};
+
+/**
+ * @brief Map entry
+ */
+typedef struct {
+    uint32_t key;   /**< Key of this entry */
+    uint32_t value; /**< Value associated with the key */
+} hashmap_entry_t;
+
+/**
+ * @brief Hash map
+ *
+ * Zero-initialise before use.
+ */
+typedef struct {
+    hashmap_entry_t *slots; /**< Slot array followed by probe distances, NULL if empty */
+    uint32_t capacity;      /**< Number of slots, a power of 2 */
+    uint32_t count;         /**< Number of entries */
+} hashmap_t;
+
+/**
+ * @brief Get the home slot for a key
+ *
+ * Keys are mixed with the MurmurHash3 finaliser so sequential, strided and
+ * multiplicatively generated keys are all spread evenly.
+ *
+ * @param   map     Map with a non-zero capacity
+ * @param   key
+ *
+ * @returns         Index of the first slot probed for key
+ */
+static inline uint32_t hashmap_home(const hashmap_t *map, uint32_t key)
+{
+    key ^= key >> 16;
+    key *= 0x85ebca6bU;
+    key ^= key >> 13;
+    key *= 0xc2b2ae35U;
+    key ^= key >> 16;
+    return key & (map->capacity - 1);
+}
+
+/**
+ * @brief Callback function for iteration
+ *
+ * @param   entry   Current entry. The value may be modified.
+ * @param   ctx     Pointer to the supplied context
+ */
+typedef void (*hashmap_cb_t)(hashmap_entry_t *entry, void *ctx);
+
+/**
+ * @brief Find an entry
+ *
+ * @param   map     Map to search
+ * @param   key     Key to find
+ *
+ * @returns         The entry, valid until the map is next modified
+ * @returns         NULL if the key was not found
+ */
+hashmap_entry_t *hashmap_find(const hashmap_t *map, uint32_t key);
+
+/**
+ * @brief Insert a new entry
+ *
+ * @param   map     Map to insert into
+ * @param   key     Key to insert
+ * @param   value   Value to associate with the key
+ *
+ * @returns         HASHMAP_OK on success
+ * @returns         HASHMAP_ERROR_EXISTS if the key is already present
+ * @returns         HASHMAP_ERROR_NO_MEM if the map could not grow
+ */
+int hashmap_insert(hashmap_t *map, uint32_t key, uint32_t value);
+
+/**
+ * @brief Find an entry, inserting it if absent
+ *
+ * Locates the key with a single probe sequence. If it is absent and @p insert
+ * is set, the key is placed where the probe stopped, with a value of 0.
+ * A table resize is only needed when the load factor would be exceeded.
+ *
+ * @param   map         Map to search
+ * @param   key         Key to find
+ * @param   insert      Insert key if not found
+ * @param   inserted    Set to true if the key was inserted
+ *
+ * @returns             Entry for the key
+ * @returns             NULL if the key was not found and not inserted
+ */
+hashmap_entry_t *hashmap_find_or_insert(hashmap_t *map, uint32_t key, bool insert, bool *inserted);
+
+/**
+ * @brief Remove an entry
+ *
+ * @param   map     Map to remove from
+ * @param   key     Key to remove
+ * @param   value   If not NULL, receives the value of the removed entry
+ *
+ * @returns         HASHMAP_OK on success
+ * @returns         HASHMAP_ERROR_NOT_FOUND if the key was not found
+ */
+int hashmap_remove(hashmap_t *map, uint32_t key, uint32_t *value);
+
+/**
+ * @brief Visit every entry once, in unspecified order
+ *
+ * The map must not be modified by the callback, other than entry values.
+ *
+ * @param   map     Map to iterate
+ * @param   cb      Callback to call for every entry
+ * @param   ctx     Context to pass to every callback
+ */
+void hashmap_foreach(hashmap_t *map, hashmap_cb_t cb, void *ctx);
+
+/**
+ * @brief Remove all entries and free the slot array
+ *
+ * @param   map     Map to clear
+ */
+void hashmap_clear(hashmap_t *map);
+
+/**
+ * @brief Get the longest probe sequence in the map
+ *
+ * A diagnostic measure of clustering: 1 means every entry is in its home slot.
+ *
+ * @param   map     Map to inspect
+ *
+ * @returns         Largest probe distance, 0 if the map is empty
+ */
+size_t hashmap_max_probe(const hashmap_t *map);
+
+#ifdef __cplusplus
+}
+#endif
+#endif /* HASHMAP_H */
+/** @} */
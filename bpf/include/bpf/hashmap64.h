@@ -0,0 +1,142 @@
+/**
+ * @defgroup    sys_hashmap64 Wide hash map
+ * @ingroup     sys
+ * @brief       Open-addressing hash map of 64-bit keys to 64-bit values
+ *
+ * Same design as @ref sys_hashmap, with 16-byte slots. Robin Hood linear
+ * probing with backward-shift removal, a slot array which grows when more than
+ * 3/4 full and shrinks when less than 1/8 full, and no allocation while empty.
+ *
+ * Values are plain integers. Callers wanting to store a pointer convert it
+ * with `uintptr_t`.
+ *
+ * Entries are in no particular order.
+ *
+ * @{
+ *
+ * @file
+ */
+
+#ifndef HASHMAP64_H
+#define HASHMAP64_H
+
+#include <stdint.h>
+#include <stddef.h>
+#include <stdbool.h>
+#include "hashmap.h"
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+/**
+ * @brief Map entry
+ */
+typedef struct {
+    uint64_t key;   /**< Key of this entry */
+    uint64_t value; /**< Value associated with the key */
+} hashmap64_entry_t;
+
+/**
+ * @brief Hash map
+ *
+ * Zero-initialise before use.
+ */
+typedef struct {
+    hashmap64_entry_t *slots;   /**< Slot array followed by probe distances, NULL if empty */
+    uint32_t capacity;          /**< Number of slots, a power of 2 */
+    uint32_t count;             /**< Number of entries */
+} hashmap64_t;
+
+/**
+ * @brief Get the home slot for a key
+ *
+ * Keys are mixed with the 64-bit MurmurHash3 finaliser, so keys differing
+ * only in their upper half are spread as well as those differing in the lower.
+ *
+ * @param   map     Map with a non-zero capacity
+ * @param   key
+ *
+ * @returns         Index of the first slot probed for key
+ */
+static inline uint32_t hashmap64_home(const hashmap64_t *map, uint64_t key)
+{
+    key ^= key >> 33;
+    key *= 0xff51afd7ed558ccdULL;
+    key ^= key >> 33;
+    key *= 0xc4ceb9fe1a85ec53ULL;
+    key ^= key >> 33;
+    return (uint32_t)key & (map->capacity - 1);
+}
+
+/**
+ * @brief Callback function for iteration
+ *
+ * @param   entry   Current entry. The value may be modified.
+ * @param   ctx     Pointer to the supplied context
+ */
+typedef void (*hashmap64_cb_t)(hashmap64_entry_t *entry, void *ctx);
+
+/**
+ * @brief Find an entry
+ *
+ * @param   map     Map to search
+ * @param   key     Key to find
+ *
+ * @returns         Entry, NULL if key is not in the map
+ */
+hashmap64_entry_t *hashmap64_find(const hashmap64_t *map, uint64_t key);
+
+/**
+ * @brief Insert a new entry
+ *
+ * @returns         HASHMAP_OK, HASHMAP_ERROR_EXISTS or HASHMAP_ERROR_NO_MEM
+ */
+int hashmap64_insert(hashmap64_t *map, uint64_t key, uint64_t value);
+
+/**
+ * @brief Find an entry, inserting it with value 0 if not found
+ *
+ * @param   map         Map to search
+ * @param   key         Key to find
+ * @param   insert      false to only search
+ * @param   inserted    Set to true if a new entry was created
+ *
+ * @returns             Entry, NULL if not found and not inserted
+ */
+hashmap64_entry_t *hashmap64_find_or_insert(hashmap64_t *map, uint64_t key, bool insert,
+                                            bool *inserted);
+
+/**
+ * @brief Remove an entry
+ *
+ * @param   map     Map to remove from
+ * @param   key     Key to remove
+ * @param   value   Receives value of removed entry, may be NULL
+ *
+ * @returns         HASHMAP_OK or HASHMAP_ERROR_NOT_FOUND
+ */
+int hashmap64_remove(hashmap64_t *map, uint64_t key, uint64_t *value);
+
+/**
+ * @brief Invoke a callback for every entry, in no particular order
+ *
+ * The map must not be modified by the callback other than changing values.
+ */
+void hashmap64_foreach(hashmap64_t *map, hashmap64_cb_t cb, void *ctx);
+
+/**
+ * @brief Remove all entries and free the slot array
+ */
+void hashmap64_clear(hashmap64_t *map);
+
+/**
+ * @brief Get the longest probe sequence in the map, 0 if empty
+ */
+size_t hashmap64_max_probe(const hashmap64_t *map);
+
+#ifdef __cplusplus
+}
+#endif
+#endif /* HASHMAP64_H */
+/** @} */
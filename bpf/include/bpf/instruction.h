@@ -81,6 +81,11 @@ extern "C" {
 
 #define BPF_INSTRUCTION_ALU_BYTESWAP    0xd0
 
+/* Double-length load instructions */
+#define BPF_INSTRUCTION_LDDW            0x18    ///< 64-bit immediate
+#define BPF_INSTRUCTION_LDDWD           0xB8    ///< Address within data section
+#define BPF_INSTRUCTION_LDDWR           0xD8    ///< Address within rodata section
+
 /**
  * @brief eBPF instruction format
  *
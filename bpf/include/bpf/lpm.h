@@ -0,0 +1,133 @@
+/**
+ * @defgroup    sys_lpm Longest-prefix-match trie
+ * @ingroup     sys
+ * @brief       Path-compressed binary trie of bit-string prefixes
+ *
+ * Prefixes are compared most significant bit first, as for network addresses.
+ * A lookup visits at most one node per distinct prefix length on the path to the
+ * address, so its cost depends on the address length and not the number of prefixes.
+ *
+ * Nodes hold their prefix bits inline with 16-bit child indices, 12 bytes for
+ * IPv4 and 24 bytes for IPv6, and are kept in a single array which is allocated
+ * by the caller. Nodes which only join two branches have no value.
+ *
+ * Prefixes are associated with value indices in the range 0 to max_prefixes - 1,
+ * which do not change while the prefix is present.
+ *
+ * @{
+ *
+ * @file
+ */
+
+#ifndef LPM_H
+#define LPM_H
+
+#include <stdint.h>
+#include <stddef.h>
+#include <stdbool.h>
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+/**
+ * @brief Largest number of prefixes a trie may hold
+ */
+#define LPM_TRIE_MAX_PREFIXES 32767
+
+/**
+ * @brief Trie
+ *
+ * Initialise using lpm_trie_init().
+ */
+typedef struct {
+    uint8_t *nodes;             /**< Node array */
+    uint16_t *free_values;      /**< Stack of unused value indices */
+    uint16_t node_size;         /**< Bytes per node */
+    uint16_t data_size;         /**< Bytes of prefix data */
+    uint16_t max_prefixes;
+    uint16_t num_free_values;
+    uint16_t root;
+    uint16_t free_nodes;        /**< List of unused nodes */
+    uint32_t count;             /**< Number of prefixes */
+} lpm_trie_t;
+
+/**
+ * @brief Get memory required by a trie
+ * @param data_size Bytes of prefix data, e.g. 4 for IPv4 addresses
+ * @param max_prefixes
+ * @retval size_t Bytes required, 0 if parameters are out of range
+ */
+size_t lpm_trie_mem_size(size_t data_size, size_t max_prefixes);
+
+/**
+ * @brief Initialise an empty trie
+ * @param trie
+ * @param mem Block of lpm_trie_mem_size() bytes, aligned to 4 bytes
+ * @param data_size
+ * @param max_prefixes
+ */
+void lpm_trie_init(lpm_trie_t *trie, void *mem, size_t data_size, size_t max_prefixes);
+
+/**
+ * @brief Remove all prefixes
+ */
+void lpm_trie_clear(lpm_trie_t *trie);
+
+/**
+ * @brief Find longest prefix matching an address
+ * @param trie
+ * @param data Address of data_size bytes
+ * @param prefixlen Number of bits of data to consider
+ * @retval int Value index of the longest matching prefix, -1 if none match
+ */
+int lpm_trie_lookup(const lpm_trie_t *trie, const uint8_t *data, unsigned prefixlen);
+
+/**
+ * @brief Find an exact prefix
+ * @retval int Value index, -1 if not found
+ */
+int lpm_trie_find(const lpm_trie_t *trie, const uint8_t *data, unsigned prefixlen);
+
+/**
+ * @brief Add a prefix
+ * @param trie
+ * @param data Prefix bits, those beyond prefixlen are ignored
+ * @param prefixlen
+ * @param inserted OUT true if the prefix was added, false if already present
+ * @retval int Value index, -1 if the trie is full
+ */
+int lpm_trie_insert(lpm_trie_t *trie, const uint8_t *data, unsigned prefixlen, bool *inserted);
+
+/**
+ * @brief Remove a prefix
+ * @retval int Value index which was released, -1 if not found
+ */
+int lpm_trie_remove(lpm_trie_t *trie, const uint8_t *data, unsigned prefixlen);
+
+/**
+ * @brief Get the prefix following another, for iteration
+ * @param trie
+ * @param data Previous prefix, NULL to get the first
+ * @param prefixlen Length of previous prefix
+ * @param next_data OUT Receives the next prefix, unused bits cleared. May be the same as data.
+ * @param next_prefixlen OUT Length of the next prefix
+ * @retval int 0 on success, -1 at the end
+ *
+ * Prefixes are returned in unspecified order.
+ * Iteration restarts if the previous prefix has been removed.
+ */
+int lpm_trie_next(const lpm_trie_t *trie, const uint8_t *data, unsigned prefixlen,
+                  uint8_t *next_data, unsigned *next_prefixlen);
+
+/**
+ * @brief Get the number of nodes in use, for diagnostics
+ * @retval size_t Nodes not on the free list, at most 2n - 1 for n prefixes
+ */
+size_t lpm_trie_nodes_used(const lpm_trie_t *trie);
+
+#ifdef __cplusplus
+}
+#endif
+#endif /* LPM_H */
+/** @} */
@@ -0,0 +1,408 @@
+/**
+ * @defgroup    sys_bpf_map BPF maps
+ * @ingroup     sys_bpf
+ * @brief       Typed maps declared by containers
+ *
+ * Containers declare maps with fixed key and value sizes using BPF_MAP().
+ * The declarations are recorded in a table which follows the function table
+ * in the RBF image, indicated by `RBPF_FLAG_MAPS` in the header, and each
+ * container instance gets its own maps when bpf_setup() is called.
+ *
+ * - BPF_MAP_TYPE_ARRAY: The key is a uint32_t index. Lookup is a bounds check.
+ *   Values are zero initially and cannot be removed.
+ * - BPF_MAP_TYPE_HASH: Open-addressing hash table, allocated at its full size.
+ *   Slots refer to a separate array of values, so removing a key moves other
+ *   keys closer to their home slot but never moves their values.
+ * - BPF_MAP_TYPE_COUNTER: A hash table with uint64_t values, added to by
+ *   bpf_map_add() which inserts missing keys.
+ * - BPF_MAP_TYPE_LPM_TRIE: Prefixes held in a trie (see lpm.h). Keys are a uint32_t
+ *   prefix length followed by the address. Lookups return the value of the longest
+ *   prefix which matches, other operations use the exact prefix.
+ * - BPF_MAP_TYPE_BLOOM_FILTER: Set membership test which may give false positives
+ *   but never false negatives, see bpf_map_bloom_add(). The value size gives the
+ *   number of hashes.
+ * - BPF_MAP_TYPE_COUNT_MIN: Count-min sketch giving frequency estimates which may
+ *   be high but are never low, see bpf_map_sketch_add(). The value size gives the
+ *   number of rows and max_entries the width of each row.
+ * - BPF_MAP_TYPE_HISTOGRAM: Distribution of uint32_t values in max_entries buckets,
+ *   see bpf_map_histogram_add(). The value size gives the bucket width, or 0 for
+ *   log2 buckets. Values beyond the last bucket are counted in it.
+ * - BPF_MAP_TYPE_WINDOW: Sliding time-window counter of max_entries slots, see
+ *   bpf_map_window_add(). The value size gives the slot duration in milliseconds.
+ * - BPF_MAP_TYPE_RINGBUF: Ring of variable-length records passed from the container
+ *   to the host (see ringbuf.h). max_entries gives the size in bytes, rounded up to a
+ *   power of 2. The container writes a record in place between bpf_map_ringbuf_reserve()
+ *   and bpf_map_ringbuf_submit(), during which the record is its only accessible part
+ *   of the ring, and the host reads it in place.
+ * - BPF_MAP_TYPE_QUEUE: Queue of fixed-size records (see queue.h) shared by all
+ *   containers declaring a queue of the same name, size and record size, for
+ *   passing records from one container to another. The value size gives the
+ *   record size and max_entries the capacity, rounded up to a power of 2.
+ *   The first map to push and the first to pop are the only producer and consumer.
+ *
+ * Sketches and aggregates have no keys, or do not store them, and have no values.
+ * Only their own functions apply to them.
+ *
+ * Values are held in a separate region which containers may read and write,
+ * so lookups return a pointer which the container uses directly.
+ * Keys and table state are not accessible to the container.
+ *
+ * @{
+ *
+ * @file
+ */
+
+#ifndef BPF_MAP_H
+#define BPF_MAP_H
+
+#include <stdint.h>
+#include <stddef.h>
+#include <stdbool.h>
+#include "shared.h"
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+/**
+ * @brief Maximum size of a map key in bytes
+ */
+#ifndef CONFIG_BPF_MAP_KEY_MAX
+#define CONFIG_BPF_MAP_KEY_MAX      (64U)
+#endif
+
+/**
+ * @brief Maximum total memory for a single map in bytes
+ */
+#ifndef CONFIG_BPF_MAP_SIZE_MAX
+#define CONFIG_BPF_MAP_SIZE_MAX     (65536U)
+#endif
+
+/**
+ * @brief Maximum number of hashes for a Bloom filter, or rows for a count-min sketch
+ */
+#define BPF_MAP_SKETCH_HASHES_MAX   (8U)
+
+/**
+ * @brief Maximum number of buckets for a log2 histogram, enough for any uint32_t value
+ */
+#define BPF_MAP_LOG2_BUCKETS_MAX    (33U)
+
+/**
+ * @brief Histogram summary
+ */
+typedef struct {
+    uint64_t sum;               ///< Total of all values
+    uint32_t count;             ///< Number of values
+    uint32_t min;               ///< Smallest value, 0 if there are none
+    uint32_t max;
+} bpf_map_histogram_t;
+
+/**
+ * @brief Map table entry in RBF image
+ */
+typedef struct __attribute__((packed)) {
+    uint16_t name_offset;   ///< Offset in rodata of the map name
+    uint8_t type;           ///< bpf_map_type_t
+    uint8_t flags;          ///< Reserved, 0
+    uint32_t key_size;
+    uint32_t value_size;
+    uint32_t max_entries;
+} rbpf_map_t;
+
+struct bpf_s;
+
+/**
+ * @brief A map instance
+ */
+typedef struct bpf_map bpf_map_t;
+
+/**
+ * @brief Callback for ring buffer events
+ */
+typedef void (*bpf_map_notify_t)(bpf_map_t *map, void *param);
+
+/**
+ * @brief Create maps declared by a container
+ * @retval int 0 on success, -1 if the map table is invalid or memory is not available
+ *
+ * Called by bpf_setup()
+ */
+int bpf_map_setup(struct bpf_s *bpf);
+
+/**
+ * @brief Release maps
+ *
+ * Called by bpf_destroy()
+ */
+void bpf_map_destroy(struct bpf_s *bpf);
+
+/**
+ * @brief Get number of maps
+ */
+size_t bpf_map_count(const struct bpf_s *bpf);
+
+/**
+ * @brief Get a map by index
+ * @retval bpf_map_t* NULL if index is out of range
+ */
+bpf_map_t *bpf_map_get(const struct bpf_s *bpf, uint32_t index);
+
+/**
+ * @brief Find a map by name
+ * @retval bpf_map_t* NULL if not found
+ */
+bpf_map_t *bpf_map_find(const struct bpf_s *bpf, const char *name);
+
+/**
+ * @brief Get map name, from container rodata
+ */
+const char *bpf_map_name(const bpf_map_t *map);
+
+/**
+ * @brief Get map type
+ */
+bpf_map_type_t bpf_map_type(const bpf_map_t *map);
+
+/**
+ * @brief Get size of map keys in bytes
+ */
+size_t bpf_map_key_size(const bpf_map_t *map);
+
+/**
+ * @brief Get size of map values in bytes
+ */
+size_t bpf_map_value_size(const bpf_map_t *map);
+
+/**
+ * @brief Get array length, or maximum number of keys
+ */
+size_t bpf_map_max_entries(const bpf_map_t *map);
+
+/**
+ * @brief Get number of keys, the array length for array maps
+ *
+ * For Bloom filters, the number of keys added which were not already present
+ * (or reported as present). For count-min sketches and windows, the sum of all counts,
+ * for histograms the number of values, for ring buffers the number of records submitted
+ * and for queues the number of records waiting.
+ */
+size_t bpf_map_entries(const bpf_map_t *map);
+
+/**
+ * @brief Find a value
+ * @param map
+ * @param key Must be the map's key size
+ * @retval void* Value, valid until the key is removed. NULL if not found.
+ */
+void *bpf_map_lookup(bpf_map_t *map, const void *key);
+
+/**
+ * @brief Set a value, inserting key if required
+ * @param map
+ * @param key
+ * @param value Must be the map's value size
+ * @retval int 0 on success, -1 if the map is full or the index is out of range
+ */
+int bpf_map_update(bpf_map_t *map, const void *key, const void *value);
+
+/**
+ * @brief Remove a key
+ * @retval int 0 on success, -1 if not found or the map is an array
+ */
+int bpf_map_remove(bpf_map_t *map, const void *key);
+
+/**
+ * @brief Add to a 64-bit value
+ * @param map Must have 8-byte values
+ * @param key Inserted with a value of 0 if not found
+ * @param delta Wraps on overflow, so `(uint64_t)-1` decrements
+ * @retval int 0 on success, -1 if the value size is wrong or the map is full
+ */
+int bpf_map_add(bpf_map_t *map, const void *key, uint64_t delta);
+
+/**
+ * @brief Get the key following another, for iteration
+ * @param map
+ * @param key Previous key, NULL to get the first
+ * @param next Receives the next key. May be the same buffer as key.
+ * @retval int 0 on success, -1 at the end
+ *
+ * Keys of hash maps are returned in unspecified order.
+ * Iteration restarts if key has been removed.
+ */
+int bpf_map_next_key(const bpf_map_t *map, const void *key, void *next);
+
+/**
+ * @brief Remove all keys, or zero all values of an array map
+ */
+void bpf_map_clear(bpf_map_t *map);
+
+/**
+ * @brief Add a key to a Bloom filter
+ * @retval int 0 on success, -1 if the map is not a Bloom filter
+ */
+int bpf_map_bloom_add(bpf_map_t *map, const void *key);
+
+/**
+ * @brief Test whether a key may have been added to a Bloom filter
+ * @retval int 1 if possibly present, 0 if definitely not, -1 if the map is not a Bloom filter
+ */
+int bpf_map_bloom_test(const bpf_map_t *map, const void *key);
+
+/**
+ * @brief Count occurrences of a key in a count-min sketch
+ * @param map
+ * @param key
+ * @param count Number of occurrences to add
+ * @retval uint32_t New estimate for key, saturating. 0 if the map is not a count-min sketch.
+ *
+ * Uses conservative update, only raising counters which are below the new estimate,
+ * which reduces over-estimation for infrequent keys.
+ */
+uint32_t bpf_map_sketch_add(bpf_map_t *map, const void *key, uint32_t count);
+
+/**
+ * @brief Estimate occurrences of a key in a count-min sketch
+ * @retval uint32_t Estimate, which is never less than the true count
+ */
+uint32_t bpf_map_sketch_estimate(const bpf_map_t *map, const void *key);
+
+/**
+ * @brief Add a value to a histogram
+ * @retval int 0 on success, -1 if the map is not a histogram
+ */
+int bpf_map_histogram_add(bpf_map_t *map, uint32_t value);
+
+/**
+ * @brief Read a histogram
+ * @param map
+ * @param stats OUT Summary, may be NULL
+ * @param buckets OUT Receives bucket counts, may be NULL
+ * @param max_buckets Size of the buckets array
+ * @retval size_t Number of buckets in the histogram, 0 if the map is not a histogram
+ */
+size_t bpf_map_histogram_read(const bpf_map_t *map, bpf_map_histogram_t *stats, uint32_t *buckets,
+                              size_t max_buckets);
+
+/**
+ * @brief Get the smallest value counted by a histogram bucket
+ *
+ * Log2 bucket 0 counts zero values, and bucket n values from 2^(n-1) to 2^n - 1.
+ */
+uint32_t bpf_map_histogram_bucket_base(const bpf_map_t *map, unsigned index);
+
+/**
+ * @brief Add to a window counter
+ * @param map
+ * @param now_ms Current time, as returned by the bpf_now_ms() helper
+ * @param delta
+ * @retval uint32_t New window total, 0 if the map is not a window
+ */
+uint32_t bpf_map_window_add(bpf_map_t *map, uint32_t now_ms, uint32_t delta);
+
+/**
+ * @brief Read a window counter
+ * @param map
+ * @param now_ms Current time
+ * @param counts OUT Receives the slot counts, oldest first and ending with the current slot. May be NULL.
+ * @param max_counts Size of the counts array
+ * @retval uint32_t Total of all slots
+ *
+ * The current slot is partly complete, so the total covers between (slots - 1) and
+ * slots times the slot duration.
+ */
+uint32_t bpf_map_window_read(const bpf_map_t *map, uint32_t now_ms, uint32_t *counts, size_t max_counts);
+
+/**
+ * @brief Reserve a ring buffer record, and make it accessible to the container
+ * @param map
+ * @param len Size of record
+ * @retval void* Record to write, NULL if the ring is full
+ *
+ * A record reserved earlier and not yet submitted is discarded.
+ */
+void *bpf_map_ringbuf_reserve(bpf_map_t *map, uint32_t len);
+
+/**
+ * @brief Pass the reserved record to the consumer
+ * @param map
+ * @param record As returned by bpf_map_ringbuf_reserve()
+ * @retval int 0 on success, -1 if record is not the current reservation
+ *
+ * Calls the notify callback if the ring was empty.
+ */
+int bpf_map_ringbuf_submit(bpf_map_t *map, const void *record);
+
+/**
+ * @brief Abandon the reserved record
+ * @retval int 0 on success, -1 if record is not the current reservation
+ */
+int bpf_map_ringbuf_discard(bpf_map_t *map, const void *record);
+
+/**
+ * @brief Copy a record into the ring
+ * @retval int 0 on success, -1 if the ring is full
+ */
+int bpf_map_ringbuf_output(bpf_map_t *map, const void *data, uint32_t len);
+
+/**
+ * @brief Get the first record waiting in a ring buffer
+ * @param map
+ * @param len OUT Size of the record
+ * @retval const void* Record, valid until bpf_map_ringbuf_consume() is called. NULL if none.
+ *
+ * May be called from a different thread to the container.
+ */
+const void *bpf_map_ringbuf_peek(bpf_map_t *map, uint32_t *len);
+
+/**
+ * @brief Release the record returned by bpf_map_ringbuf_peek()
+ */
+void bpf_map_ringbuf_consume(bpf_map_t *map);
+
+/**
+ * @brief Get number of records lost because the ring was full
+ */
+uint32_t bpf_map_ringbuf_dropped(const bpf_map_t *map);
+
+/**
+ * @brief Set a callback for a ring buffer or queue
+ * @param map
+ * @param notify Called on the producer's thread when a record is added to an empty ring or queue.
+ * The consumer should then read until it is empty, as it is not called again until then.
+ * NULL to remove.
+ * @param param Passed to the callback
+ *
+ * For ring buffers, set the callback before running the container.
+ *
+ * A queue has one callback, which is passed this map and removed when the map is destroyed.
+ * It is called with a lock held, so must not set callbacks or create or destroy containers.
+ */
+void bpf_map_set_notify(bpf_map_t *map, bpf_map_notify_t notify, void *param);
+
+/**
+ * @brief Copy a record into a queue
+ * @param map
+ * @param record Of the queue's record size
+ * @retval int 0 on success, -1 if the queue is full or another map is its producer
+ *
+ * The first map to push to a queue becomes its only producer until destroyed.
+ * Only one thread may push through that map at a time.
+ */
+int bpf_map_queue_push(bpf_map_t *map, const void *record);
+
+/**
+ * @brief Copy the first record out of a queue and remove it
+ * @retval int 0 on success, -1 if the queue is empty or another map is its consumer
+ *
+ * The first map to pop from or clear a queue becomes its only consumer until destroyed.
+ * Only one thread may pop through that map at a time.
+ */
+int bpf_map_queue_pop(bpf_map_t *map, void *record);
+
+#ifdef __cplusplus
+}
+#endif
+#endif /* BPF_MAP_H */
+/** @} */
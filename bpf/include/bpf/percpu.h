@@ -0,0 +1,122 @@
+/**
+ * @defgroup    sys_bpf_percpu BPF per-thread store
+ * @ingroup     sys_bpf_store
+ * @brief       Global counters updated separately by each thread
+ *
+ * Values which every container execution updates, such as event counters,
+ * make a single shared entry a point of contention once containers run on
+ * several threads (see `CONFIG_BPF_CONCURRENT`). This store, like the eBPF
+ * per-CPU maps, instead holds a separate copy of each value for every thread.
+ * Updates only touch the calling thread's shard, and reads merge the values
+ * from all shards: summed, the smallest, the largest, or each one separately.
+ *
+ * There are `CONFIG_BPF_PERCPU_SHARDS` shards, each a hash table in its own
+ * cache line with its own lock. Threads are assigned shards in turn, so with
+ * more threads than shards some share, which remains correct but contends.
+ * A shard's lock is normally only taken by its own thread, so is uncontended
+ * except while a read is merging it. Without `CONFIG_BPF_CONCURRENT` there is
+ * a single shard and no locking.
+ *
+ * Entries are separate from the global store. Each shard holds at most
+ * `CONFIG_BPF_STORE_HASH_MAX_ENTRIES` keys.
+ *
+ * @{
+ *
+ * @file
+ */
+
+#ifndef BPF_PERCPU_H
+#define BPF_PERCPU_H
+
+#include <stdint.h>
+#include <stddef.h>
+#include "store.h"
+#include "sync.h"
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+/**
+ * @brief Number of per-thread shards
+ */
+#ifndef CONFIG_BPF_PERCPU_SHARDS
+#if CONFIG_BPF_CONCURRENT
+#define CONFIG_BPF_PERCPU_SHARDS    (16U)
+#else
+#define CONFIG_BPF_PERCPU_SHARDS    (1U)
+#endif
+#endif
+
+/**
+ * @brief How shard values are combined when read
+ */
+typedef enum {
+    BPF_PERCPU_SUM,     ///< Total of all values
+    BPF_PERCPU_MIN,     ///< Smallest value
+    BPF_PERCPU_MAX,     ///< Largest value
+} bpf_percpu_merge_t;
+
+/**
+ * @brief Add to the calling thread's value
+ * @param key
+ * @param delta Amount to add, wraps on overflow
+ * @retval int error code, -1 if the shard is full
+ *
+ * A key not yet in the shard is added with a value of delta.
+ */
+int bpf_percpu_add(uint32_t key, uint32_t delta);
+
+/**
+ * @brief Set the calling thread's value
+ * @param key
+ * @param value
+ * @retval int error code, -1 if the shard is full
+ */
+int bpf_percpu_update(uint32_t key, uint32_t value);
+
+/**
+ * @brief Read a value merged across all shards
+ * @param key
+ * @param merge
+ * @param value Receives merged value, 0 if the key is not found.
+ * Minimum and maximum consider only shards holding the key.
+ * @retval int error code, -1 if the key is not found or merge is invalid
+ *
+ * Shards are read one at a time, so concurrent updates may be partially included.
+ */
+int bpf_percpu_lookup(uint32_t key, bpf_percpu_merge_t merge, uint64_t *value);
+
+/**
+ * @brief Read the value from every shard
+ * @param key
+ * @param values Receives one value per shard, 0 where the key is not found
+ * @param max Size of values
+ * @retval int Number of shards, which may exceed max, -1 if the key is not found
+ */
+int bpf_percpu_lookup_all(uint32_t key, uint32_t *values, size_t max);
+
+/**
+ * @brief Remove key from all shards
+ * @retval int error code, -1 if the key was not found
+ */
+int bpf_percpu_remove(uint32_t key);
+
+/**
+ * @brief Remove all entries from all shards
+ */
+void bpf_percpu_clear(void);
+
+/**
+ * @brief Get the number of shards
+ */
+static inline size_t bpf_percpu_shards(void)
+{
+    return CONFIG_BPF_PERCPU_SHARDS;
+}
+
+#ifdef __cplusplus
+}
+#endif
+#endif /* BPF_PERCPU_H */
+/** @} */
@@ -0,0 +1,129 @@
+/**
+ * @defgroup    sys_bpf_pool BPF growable memory pool
+ * @ingroup     sys_bpf
+ * @brief       Fixed-size element allocator which grows and shrinks in chunks
+ *
+ * Built on @ref sys_memarray. A pool starts with an optional static region
+ * which is always available. When that is exhausted, further chunks of
+ * elements are allocated from the heap, up to an optional limit.
+ * Each heap chunk has its own free list, and chunks with free elements are
+ * linked together, so allocation takes constant time. Freeing an element
+ * locates its chunk by binary search of an address-ordered chunk table.
+ *
+ * A heap chunk is released again once all its elements are free and the pool
+ * still has at least one chunk's worth of free elements elsewhere, so a pool
+ * hovering around a chunk boundary does not repeatedly allocate and free.
+ *
+ * Statistics are maintained as counters so reading them takes constant time.
+ *
+ * With `CONFIG_BPF_CONCURRENT`, pools may be used from several threads. The
+ * static region is then a lock-free stack, and heap chunks are managed under
+ * a mutex. Statistics may be momentarily inconsistent with each other.
+ *
+ * @{
+ *
+ * @file
+ */
+
+#ifndef BPF_POOL_H
+#define BPF_POOL_H
+
+#include <stdint.h>
+#include <stddef.h>
+#include "../../memarray.h"
+#include "sync.h"
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+/**
+ * @brief Pool statistics
+ */
+typedef struct {
+    size_t size;            ///< Element size in bytes
+    size_t capacity;        ///< Elements currently available, in use or free
+    size_t in_use;          ///< Elements allocated
+    size_t free;            ///< Elements available without growing
+    size_t high_water;      ///< Largest value of in_use since last reset
+    size_t chunks;          ///< Heap chunks currently allocated
+    uint32_t failures;      ///< Allocations refused since last reset
+} bpf_pool_stats_t;
+
+/**
+ * @brief Heap chunk, allocated with its elements appended
+ */
+typedef struct bpf_pool_chunk bpf_pool_chunk_t;
+
+/**
+ * @brief Memory pool
+ */
+typedef struct {
+#if CONFIG_BPF_CONCURRENT
+    uint64_t free_head;         ///< Static region free list, update count << 32 | 1 + index
+    bpf_mutex_t mutex;          ///< Guards heap chunks
+#else
+    memarray_t array;           ///< Free list for static region
+#endif
+    const void *data;           ///< Static region, never released
+    bpf_pool_chunk_t *partial;  ///< Heap chunks with free elements
+    bpf_pool_chunk_t **chunks;  ///< All heap chunks, ordered by address
+    size_t chunks_alloc;        ///< Allocated length of chunks table
+    size_t num;                 ///< Elements in static region
+    size_t chunk_len;           ///< Elements per heap chunk, 0 if the pool cannot grow
+    size_t max;                 ///< Maximum capacity, 0 for no limit
+    bpf_pool_stats_t stats;     ///< Usage counters
+} bpf_pool_t;
+
+/**
+ * @brief Initialise a pool
+ *
+ * @param pool      Pool to initialise
+ * @param size      Element size, at least `sizeof(void*)`
+ * @param data      Static region, may be NULL
+ * @param num       Number of elements in @p data
+ * @param chunk_len Number of elements to allocate from the heap when the pool is
+ *                  exhausted, 0 to never grow
+ * @param max       Maximum total number of elements, 0 for no limit
+ */
+void bpf_pool_init(bpf_pool_t *pool, size_t size, void *data, size_t num,
+                   size_t chunk_len, size_t max);
+
+/**
+ * @brief Allocate an element
+ *
+ * @returns Uninitialised element, NULL if the pool is exhausted and cannot grow
+ */
+void *bpf_pool_alloc(bpf_pool_t *pool);
+
+/**
+ * @brief Return an element to the pool
+ *
+ * @param pool
+ * @param ptr   Element previously returned by bpf_pool_alloc() for this pool
+ */
+void bpf_pool_free(bpf_pool_t *pool, void *ptr);
+
+/**
+ * @brief Read pool statistics
+ */
+static inline void bpf_pool_get_stats(const bpf_pool_t *pool, bpf_pool_stats_t *stats)
+{
+    *stats = pool->stats;
+#if CONFIG_BPF_CONCURRENT
+    stats->in_use = bpf_atomic_load(&pool->stats.in_use);
+    stats->free = bpf_atomic_load(&pool->stats.free);
+    stats->high_water = bpf_atomic_load(&pool->stats.high_water);
+#endif
+}
+
+/**
+ * @brief Reset high water mark to current usage and clear failure count
+ */
+void bpf_pool_reset_stats(bpf_pool_t *pool);
+
+#ifdef __cplusplus
+}
+#endif
+#endif /* BPF_POOL_H */
+/** @} */
@@ -0,0 +1,77 @@
+/**
+ * @defgroup    sys_spsc_queue Record queue
+ * @ingroup     sys
+ * @brief       Lock-free single-producer, single-consumer queue of fixed-size records
+ *
+ * Records are copied into and out of a power of 2 number of slots.
+ * Producer and consumer may be on different threads if `CONFIG_BPF_CONCURRENT`
+ * is set, without locking.
+ *
+ * @{
+ *
+ * @file
+ */
+
+#ifndef SPSC_QUEUE_H
+#define SPSC_QUEUE_H
+
+#include <stdint.h>
+#include <stddef.h>
+#include <stdbool.h>
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+/**
+ * @brief Queue
+ *
+ * Initialise using spsc_queue_init().
+ */
+typedef struct {
+    uint8_t *slots;
+    uint32_t record_size;
+    uint32_t capacity;          /**< Number of slots, a power of 2 */
+    uint32_t head;              /**< Free-running index of next record to pop, written by the consumer */
+    uint32_t tail;              /**< Free-running index of next slot to fill, written by the producer */
+} spsc_queue_t;
+
+/**
+ * @brief Initialise an empty queue
+ * @param queue
+ * @param mem Block of capacity * record_size bytes
+ * @param record_size
+ * @param capacity A power of 2
+ */
+void spsc_queue_init(spsc_queue_t *queue, void *mem, uint32_t record_size, uint32_t capacity);
+
+/**
+ * @brief Copy a record into the queue
+ * @param queue
+ * @param record
+ * @param was_empty OUT true if the queue was empty, so the consumer may need waking
+ * @retval bool false if the queue is full
+ */
+bool spsc_queue_push(spsc_queue_t *queue, const void *record, bool *was_empty);
+
+/**
+ * @brief Copy the first record out of the queue and remove it
+ * @retval bool false if the queue is empty
+ */
+bool spsc_queue_pop(spsc_queue_t *queue, void *record);
+
+/**
+ * @brief Remove all records, as the consumer
+ */
+void spsc_queue_drain(spsc_queue_t *queue);
+
+/**
+ * @brief Get number of records waiting
+ */
+uint32_t spsc_queue_count(const spsc_queue_t *queue);
+
+#ifdef __cplusplus
+}
+#endif
+#endif /* SPSC_QUEUE_H */
+/** @} */
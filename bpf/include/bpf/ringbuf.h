@@ -0,0 +1,105 @@
+/**
+ * @defgroup    sys_ringbuf Record ring buffer
+ * @ingroup     sys
+ * @brief       Lock-free single-producer, single-consumer ring of variable-length records
+ *
+ * The producer reserves space for a record, writes it in place and then submits it.
+ * The consumer reads records in place and releases them once done, so neither side
+ * copies the data. Producer and consumer may be on different threads if
+ * `CONFIG_BPF_CONCURRENT` is set, without locking.
+ *
+ * Records are preceded by an 8-byte header and start on an 8-byte boundary.
+ * A record is never split at the end of the ring: if it does not fit,
+ * the remainder is skipped using a padding record.
+ *
+ * One reservation may be outstanding at a time.
+ *
+ * @{
+ *
+ * @file
+ */
+
+#ifndef RINGBUF_H
+#define RINGBUF_H
+
+#include <stdint.h>
+#include <stddef.h>
+#include <stdbool.h>
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+/**
+ * @brief Smallest ring size in bytes
+ */
+#define RINGBUF_SIZE_MIN 64U
+
+/**
+ * @brief Ring
+ *
+ * Initialise using ringbuf_init().
+ */
+typedef struct {
+    uint8_t *data;
+    uint32_t size;              /**< Bytes of data, a power of 2 */
+    uint32_t producer;          /**< Free-running offset of next record, written by the producer */
+    uint32_t consumer;          /**< Free-running offset of first record, written by the consumer */
+    uint32_t reserved_len;      /**< Length of outstanding reservation, 0 if none */
+    uint32_t reserved_pad;      /**< Bytes skipped at the end of the ring for the reservation */
+    uint32_t submitted;         /**< Records submitted */
+    uint32_t dropped;           /**< Reservations which failed as the ring was full */
+} ringbuf_t;
+
+/**
+ * @brief Initialise an empty ring
+ * @param ring
+ * @param mem Block of size bytes, aligned to 8 bytes
+ * @param size A power of 2, at least RINGBUF_SIZE_MIN
+ */
+void ringbuf_init(ringbuf_t *ring, void *mem, uint32_t size);
+
+/**
+ * @brief Reserve space for a record
+ * @param ring
+ * @param len Bytes required, non-zero
+ * @retval void* Record to be written, NULL if there is not enough space
+ *
+ * Any reservation which has not been submitted is discarded.
+ */
+void *ringbuf_reserve(ringbuf_t *ring, uint32_t len);
+
+/**
+ * @brief Make the reserved record available to the consumer
+ * @retval bool true if the ring was empty, so the consumer may need waking
+ */
+bool ringbuf_submit(ringbuf_t *ring);
+
+/**
+ * @brief Abandon the reserved record
+ */
+void ringbuf_discard(ringbuf_t *ring);
+
+/**
+ * @brief Get the first record
+ * @param ring
+ * @param len OUT Length of the record
+ * @retval const void* The record, valid until ringbuf_consume() is called. NULL if the ring is empty.
+ */
+const void *ringbuf_peek(ringbuf_t *ring, uint32_t *len);
+
+/**
+ * @brief Release the record returned by ringbuf_peek()
+ */
+void ringbuf_consume(ringbuf_t *ring);
+
+/**
+ * @brief Get number of bytes waiting to be consumed, including headers and padding
+ */
+uint32_t ringbuf_used(const ringbuf_t *ring);
+
+#ifdef __cplusplus
+}
+#endif
+#endif /* RINGBUF_H */
+/** @} */
@@ -18,6 +18,130 @@
 extern "C" {
 #endif
 
+/**
+ * @brief Map types
+ */
+typedef enum {
+	BPF_MAP_TYPE_ARRAY = 1,        ///< Fixed number of values indexed by a uint32_t key
+	BPF_MAP_TYPE_HASH = 2,         ///< Hash table with fixed-size keys and values
+	BPF_MAP_TYPE_COUNTER = 3,      ///< Hash table with uint64_t values, see bpf_add_map()
+	BPF_MAP_TYPE_LPM_TRIE = 4,     ///< Longest-prefix-match trie, keys start with a uint32_t prefix length
+	BPF_MAP_TYPE_BLOOM_FILTER = 5, ///< Set membership with false positives, see BPF_BLOOM_FILTER()
+	BPF_MAP_TYPE_COUNT_MIN = 6,    ///< Frequency estimates, see BPF_COUNT_MIN_SKETCH()
+	BPF_MAP_TYPE_HISTOGRAM = 7,    ///< Value distribution, see BPF_HISTOGRAM_LOG2() and BPF_HISTOGRAM_LINEAR()
+	BPF_MAP_TYPE_WINDOW = 8,       ///< Sliding time-window counter, see BPF_WINDOW()
+	BPF_MAP_TYPE_RINGBUF = 9,      ///< Records passed to the host, see BPF_RINGBUF()
+	BPF_MAP_TYPE_QUEUE = 10,       ///< Records passed between containers, see BPF_QUEUE()
+} bpf_map_type_t;
+
+/**
+ * @brief Keys for LPM trie maps
+ *
+ * Lookups give the address length as prefixlen and return the value of the longest matching prefix.
+ * Updates and deletions use the exact prefix. Address bits are compared most significant first.
+ * @{
+ */
+typedef struct {
+	uint32_t prefixlen;
+	uint8_t addr[4];
+} bpf_lpm_key_ipv4_t;
+
+typedef struct {
+	uint32_t prefixlen;
+	uint8_t addr[16];
+} bpf_lpm_key_ipv6_t;
+/** @} */
+
+/**
+ * @brief Map declaration in a container
+ *
+ * Use BPF_MAP() to declare maps. They are created for each container instance
+ * by bpf_setup(). References to a declaration are replaced by its map index
+ * when the container is converted to RBF format.
+ */
+typedef struct {
+	uint32_t type;        ///< bpf_map_type_t
+	uint32_t key_size;    ///< Bytes per key
+	uint32_t value_size;  ///< Bytes per value
+	uint32_t max_entries; ///< Number of array elements, or maximum number of keys
+} bpf_map_def_t;
+
+#define BPF_MAP_SECTION "maps"
+
+#define BPF_MAP(name, map_type, key_type, value_type, max_entries)                                                     \
+	bpf_map_def_t name __attribute__((section(BPF_MAP_SECTION), used)) = {                                             \
+		map_type, sizeof(key_type), sizeof(value_type), max_entries}
+
+/**
+ * @brief Declare a Bloom filter
+ * @param max_entries Expected number of keys
+ * @param hashes Number of hashes, 1 to 8. The false positive rate is about 2^-hashes
+ * with max_entries keys added.
+ */
+#define BPF_BLOOM_FILTER(name, key_type, max_entries, hashes)                                                          \
+	bpf_map_def_t name __attribute__((section(BPF_MAP_SECTION), used)) = {                                             \
+		BPF_MAP_TYPE_BLOOM_FILTER, sizeof(key_type), hashes, max_entries}
+
+/**
+ * @brief Declare a count-min sketch
+ * @param width Counters per row, rounded up to a power of 2. Estimates exceed the true
+ * count by at most about 2/width of the total count.
+ * @param depth Number of rows, 1 to 8, each using a separate hash
+ */
+#define BPF_COUNT_MIN_SKETCH(name, key_type, width, depth)                                                             \
+	bpf_map_def_t name __attribute__((section(BPF_MAP_SECTION), used)) = {                                             \
+		BPF_MAP_TYPE_COUNT_MIN, sizeof(key_type), depth, width}
+
+/**
+ * @brief Declare a histogram with power of 2 buckets
+ * @param buckets Number of buckets, up to 33. Bucket 0 counts zero values, bucket n values
+ * from 2^(n-1) to 2^n - 1, and the last bucket any larger values.
+ */
+#define BPF_HISTOGRAM_LOG2(name, buckets)                                                                              \
+	bpf_map_def_t name __attribute__((section(BPF_MAP_SECTION), used)) = {                                             \
+		BPF_MAP_TYPE_HISTOGRAM, 0, 0, buckets}
+
+/**
+ * @brief Declare a histogram with equal width buckets
+ * @param buckets Number of buckets, the last also counting any larger values
+ * @param width Range of values counted by each bucket
+ */
+#define BPF_HISTOGRAM_LINEAR(name, buckets, width)                                                                     \
+	bpf_map_def_t name __attribute__((section(BPF_MAP_SECTION), used)) = {                                             \
+		BPF_MAP_TYPE_HISTOGRAM, 0, width, buckets}
+
+/**
+ * @brief Declare a sliding time-window counter
+ * @param slots Number of slots, the last being the current slot
+ * @param slot_ms Duration of each slot in milliseconds
+ *
+ * For example, BPF_WINDOW(requests, 10, 1000) gives a count for the last 10 seconds,
+ * resolved to 1 second.
+ */
+#define BPF_WINDOW(name, slots, slot_ms)                                                                               \
+	bpf_map_def_t name __attribute__((section(BPF_MAP_SECTION), used)) = {                                             \
+		BPF_MAP_TYPE_WINDOW, 0, slot_ms, slots}
+
+/**
+ * @brief Declare a ring buffer for passing records to the host
+ * @param size Bytes, rounded up to a power of 2. Each record takes an extra 8 bytes,
+ * rounded up to a multiple of 8.
+ */
+#define BPF_RINGBUF(name, size)                                                                                        \
+	bpf_map_def_t name __attribute__((section(BPF_MAP_SECTION), used)) = {                                             \
+		BPF_MAP_TYPE_RINGBUF, 0, 0, size}
+
+/**
+ * @brief Declare a queue for passing records between containers
+ * @param max_entries Capacity, rounded up to a power of 2
+ *
+ * Containers declaring a queue with the same name share it. One container pushes
+ * records and another pops them.
+ */
+#define BPF_QUEUE(name, record_type, max_entries)                                                                      \
+	bpf_map_def_t name __attribute__((section(BPF_MAP_SECTION), used)) = {                                             \
+		BPF_MAP_TYPE_QUEUE, 0, sizeof(record_type), max_entries}
+
 /* Aux helper functions (stdlib) */
 #define BPF_SYSCALL_STD(XX)                                                                                            \
 	XX(0x01, bpf_printf, int, const char*, ...)                                                                        \
@@ -28,7 +152,84 @@ extern "C" {
 	XX(0x10, bpf_store_global, int, uint32_t key, uint32_t value)                                                      \
 	XX(0x11, bpf_store_local, int, uint32_t key, uint32_t value)                                                       \
 	XX(0x12, bpf_fetch_global, int, uint32_t key, uint32_t* value)                                                     \
-	XX(0x13, bpf_fetch_local, int, uint32_t key, uint32_t* value)
+	XX(0x13, bpf_fetch_local, int, uint32_t key, uint32_t* value)                                                      \
+	XX(0x14, bpf_lookup_global, int, uint32_t key, uint32_t* value)                                                    \
+	XX(0x15, bpf_lookup_local, int, uint32_t key, uint32_t* value)                                                     \
+	XX(0x16, bpf_delete_global, int, uint32_t key)                                                                     \
+	XX(0x17, bpf_delete_local, int, uint32_t key)                                                                      \
+	XX(0x18, bpf_fetch_add_global, int, uint32_t key, uint32_t delta, uint32_t* old)                                   \
+	XX(0x19, bpf_fetch_add_local, int, uint32_t key, uint32_t delta, uint32_t* old)                                    \
+	XX(0x1A, bpf_cas_global, int, uint32_t key, uint32_t expected, uint32_t desired, uint32_t* actual)                 \
+	XX(0x1B, bpf_cas_local, int, uint32_t key, uint32_t expected, uint32_t desired, uint32_t* actual)                  \
+	XX(0x1C, bpf_min_global, int, uint32_t key, uint32_t value)                                                        \
+	XX(0x1D, bpf_min_local, int, uint32_t key, uint32_t value)                                                         \
+	XX(0x1E, bpf_max_global, int, uint32_t key, uint32_t value)                                                        \
+	XX(0x1F, bpf_max_local, int, uint32_t key, uint32_t value)                                                         \
+	XX(0x30, bpf_fetch_many_global, int, const uint32_t* keys, uint32_t* values, uint32_t count)                       \
+	XX(0x31, bpf_fetch_many_local, int, const uint32_t* keys, uint32_t* values, uint32_t count)                        \
+	XX(0x32, bpf_update_many_global, int, const uint32_t* keys, const uint32_t* values, uint32_t count)                \
+	XX(0x33, bpf_update_many_local, int, const uint32_t* keys, const uint32_t* values, uint32_t count)                 \
+	XX(0x34, bpf_scan_global, int, uint32_t key, uint32_t* items, uint32_t max, uint32_t reverse)                      \
+	XX(0x35, bpf_scan_local, int, uint32_t key, uint32_t* items, uint32_t max, uint32_t reverse)                       \
+	XX(0x46, bpf_set_ttl_global, int, uint32_t key, uint32_t ttl)                                                      \
+	XX(0x47, bpf_set_ttl_local, int, uint32_t key, uint32_t ttl)
+
+/* Wide key/value store functions, with 64-bit arguments passed by reference */
+#define BPF_SYSCALL_WIDE(XX)                                                                                           \
+	XX(0x36, bpf_store64_global, int, const uint64_t* key, const uint64_t* value)                                      \
+	XX(0x37, bpf_store64_local, int, const uint64_t* key, const uint64_t* value)                                       \
+	XX(0x38, bpf_lookup64_global, int, const uint64_t* key, uint64_t* value)                                           \
+	XX(0x39, bpf_lookup64_local, int, const uint64_t* key, uint64_t* value)                                            \
+	XX(0x3A, bpf_fetch_add64_global, int, const uint64_t* key, const uint64_t* delta, uint64_t* old)                   \
+	XX(0x3B, bpf_fetch_add64_local, int, const uint64_t* key, const uint64_t* delta, uint64_t* old)                    \
+	XX(0x3C, bpf_delete64_global, int, const uint64_t* key)                                                            \
+	XX(0x3D, bpf_delete64_local, int, const uint64_t* key)                                                             \
+	XX(0x40, bpf_set_blob_global, int, const uint64_t* key, const void* data, uint32_t len)                            \
+	XX(0x41, bpf_set_blob_local, int, const uint64_t* key, const void* data, uint32_t len)                             \
+	XX(0x42, bpf_get_blob_global, int, const uint64_t* key, void* buf, uint32_t size)                                  \
+	XX(0x43, bpf_get_blob_local, int, const uint64_t* key, void* buf, uint32_t size)                                   \
+	XX(0x44, bpf_delete_blob_global, int, const uint64_t* key)                                                         \
+	XX(0x45, bpf_delete_blob_local, int, const uint64_t* key)
+
+/* Per-thread store functions */
+#define BPF_SYSCALL_PERCPU(XX)                                                                                         \
+	XX(0x48, bpf_add_percpu, int, uint32_t key, uint32_t delta)                                                        \
+	XX(0x49, bpf_store_percpu, int, uint32_t key, uint32_t value)                                                      \
+	XX(0x4A, bpf_lookup_percpu, int, uint32_t key, uint32_t merge, uint64_t* value)                                    \
+	XX(0x4B, bpf_lookup_all_percpu, int, uint32_t key, uint32_t* values, uint32_t max)
+
+/* Map functions, taking a map declared with BPF_MAP() */
+#define BPF_SYSCALL_MAPS(XX)                                                                                           \
+	XX(0x4C, bpf_lookup_map, int, const void* map, const void* key, uint64_t* value)                                   \
+	XX(0x4D, bpf_update_map, int, const void* map, const void* key, const void* value)                                 \
+	XX(0x4E, bpf_delete_map, int, const void* map, const void* key)                                                    \
+	XX(0x4F, bpf_add_map, int, const void* map, const void* key, const uint64_t* delta)
+
+/* Sketch functions, taking a map declared with BPF_BLOOM_FILTER() or BPF_COUNT_MIN_SKETCH() */
+#define BPF_SYSCALL_SKETCH(XX)                                                                                         \
+	XX(0x50, bpf_bloom_add, int, const void* map, const void* key)                                                     \
+	XX(0x51, bpf_bloom_test, int, const void* map, const void* key)                                                    \
+	XX(0x52, bpf_sketch_add, uint32_t, const void* map, const void* key, uint32_t count)                               \
+	XX(0x53, bpf_sketch_estimate, uint32_t, const void* map, const void* key)
+
+/* Aggregation functions, taking a map declared with BPF_HISTOGRAM_LOG2(), BPF_HISTOGRAM_LINEAR() or BPF_WINDOW() */
+#define BPF_SYSCALL_AGGREGATE(XX)                                                                                      \
+	XX(0x54, bpf_histogram_add, int, const void* map, uint32_t value)                                                  \
+	XX(0x55, bpf_window_add, uint32_t, const void* map, uint32_t delta)                                                \
+	XX(0x56, bpf_window_total, uint32_t, const void* map)
+
+/* Ring buffer functions, taking a map declared with BPF_RINGBUF() */
+#define BPF_SYSCALL_RINGBUF(XX)                                                                                        \
+	XX(0x57, bpf_ringbuf_reserve, int, const void* map, uint32_t size, uint64_t* record)                               \
+	XX(0x58, bpf_ringbuf_submit, int, const void* map, const void* record)                                             \
+	XX(0x59, bpf_ringbuf_discard, int, const void* map, const void* record)                                            \
+	XX(0x5A, bpf_ringbuf_output, int, const void* map, const void* data, uint32_t size)
+
+/* Queue functions, taking a map declared with BPF_QUEUE() */
+#define BPF_SYSCALL_QUEUE(XX)                                                                                          \
+	XX(0x5B, bpf_queue_push, int, const void* map, const void* record)                                                 \
+	XX(0x5C, bpf_queue_pop, int, const void* map, void* record)                                                        \
+	XX(0x5D, bpf_queue_count, uint32_t, const void* map)
 
 /* Time(r) functions */
 #define BPF_SYSCALL_TIMER(XX) XX(0x20, bpf_now_ms, uint32_t)
@@ -36,6 +237,13 @@ extern "C" {
 #define BPF_SYSCALL_MAP(XX)                                                                                            \
 	BPF_SYSCALL_STD(XX)                                                                                                \
 	BPF_SYSCALL_STORE(XX)                                                                                              \
+	BPF_SYSCALL_WIDE(XX)                                                                                               \
+	BPF_SYSCALL_PERCPU(XX)                                                                                             \
+	BPF_SYSCALL_MAPS(XX)                                                                                               \
+	BPF_SYSCALL_SKETCH(XX)                                                                                             \
+	BPF_SYSCALL_AGGREGATE(XX)                                                                                          \
+	BPF_SYSCALL_RINGBUF(XX)                                                                                            \
+	BPF_SYSCALL_QUEUE(XX)                                                                                              \
 	BPF_SYSCALL_TIMER(XX)                                                                                              \
 	BPF_SYSCALL_APP(XX)
 
@@ -12,6 +12,45 @@
  * @ingroup     sys_bpf
  * @brief       API for the eBPF key-value store
  *
+ * There is one global store shared by all containers, plus a local store for
+ * each container instance. Each store is backed by one of:
+ *
+ * - BPF_STORE_TYPE_TREE: An AVL tree with entries allocated from a shared pool
+ *   of `BPF_STORE_POOL_SIZE` entries. Iteration is in key order.
+ * - BPF_STORE_TYPE_HASH: An open-addressing hash table holding keys and values
+ *   in a contiguous array, see @ref sys_hashmap. Faster for exact-match access,
+ *   which is what containers use. Ordered iteration requires sorting, which
+ *   only bpf_store_iter_global() does, and ordered scans examine every entry.
+ *
+ * The backend is selected by `CONFIG_BPF_STORE_GLOBAL_TYPE` and
+ * `CONFIG_BPF_STORE_LOCAL_TYPE`, and may be changed at runtime while a store is
+ * empty.
+ *
+ * Each store may have a quota limiting its number of entries, so a single
+ * container cannot exhaust the shared pool. Part of the pool may also be
+ * reserved for the global store. Local stores are released by bpf_destroy().
+ *
+ * Each store also has two wide variants, hash tables with 64-bit keys holding
+ * either 64-bit values or small blobs of up to `CONFIG_BPF_STORE_BLOB_MAX`
+ * bytes. These are separate from the 32-bit entries, are limited in size like
+ * hash stores and are subject to the same quota, applied to each separately.
+ *
+ * A store may be bounded, acting as a cache. Once it holds the configured
+ * number of entries, or cannot otherwise grow, inserting a key evicts the
+ * least recently used entry. Entries may also be given a lifetime, after
+ * which they are removed. Expiry is checked whenever a key is accessed, and a
+ * timer wheel of `CONFIG_BPF_STORE_TTL_SLOTS` slots is swept a few entries
+ * at a time by each store operation, so no operation has to do much work.
+ * Scans and iteration skip expired entries, but counts may include some not
+ * yet removed. This applies to the 32-bit entries only.
+ *
+ * Tree entries, and any other fixed-size allocations made by stores, come
+ * from a set of size-classed pools, see @ref sys_bpf_pool. The tree entry pool
+ * starts with `BPF_STORE_POOL_SIZE` static entries and may grow from the heap
+ * up to `CONFIG_BPF_STORE_POOL_MAX`. Use bpf_store_get_pool_stats() to size it.
+ *
+ * The application may watch a key or range of keys in the global store, see
+ * bpf_store_watch_global(), instead of polling it for changes.
  *
  * @{
  *
@@ -25,7 +64,12 @@
 
 #include <stdint.h>
 #include <stdlib.h>
+#include <stdbool.h>
 #include "btree.h"
+#include "ctree.h"
+#include "hashmap.h"
+#include "hashmap64.h"
+#include "pool.h"
 
 #ifdef __cplusplus
 extern "C" {
@@ -35,6 +79,63 @@ extern "C" {
 #define CONFIG_BPF_STORE_NUM_VALUES     (16U)
 #endif /* CONFIG_BPF_STORE_NUM_VALUES */
 
+/**
+ * @brief Use the compact tree layout
+ *
+ * Tree stores use @ref sys_ctree, with 12-byte entries referenced by 16-bit
+ * pool indices, instead of @ref sys_btree entries containing three pointers.
+ * The pool occupies the same RAM as `CONFIG_BPF_STORE_NUM_VALUES` regular
+ * entries but holds two to three times as many, up to CTREE_MAX_NODES.
+ */
+#ifndef CONFIG_BPF_STORE_COMPACT
+#define CONFIG_BPF_STORE_COMPACT    (0)
+#endif
+
+/**
+ * @brief Store backend
+ */
+typedef enum {
+    BPF_STORE_TYPE_TREE = 0,    ///< AVL tree using the shared entry pool
+    BPF_STORE_TYPE_HASH = 1,    ///< Open-addressing hash table
+} bpf_store_type_t;
+
+#ifndef CONFIG_BPF_STORE_GLOBAL_TYPE
+#define CONFIG_BPF_STORE_GLOBAL_TYPE    BPF_STORE_TYPE_TREE
+#endif
+
+#ifndef CONFIG_BPF_STORE_LOCAL_TYPE
+#define CONFIG_BPF_STORE_LOCAL_TYPE     BPF_STORE_TYPE_TREE
+#endif
+
+/**
+ * @brief Default maximum number of entries in each local store, 0 for no limit
+ */
+#ifndef CONFIG_BPF_STORE_LOCAL_QUOTA
+#define CONFIG_BPF_STORE_LOCAL_QUOTA    (0U)
+#endif
+
+/**
+ * @brief Maximum number of entries in the global store, 0 for no limit
+ */
+#ifndef CONFIG_BPF_STORE_GLOBAL_QUOTA
+#define CONFIG_BPF_STORE_GLOBAL_QUOTA   (0U)
+#endif
+
+/**
+ * @brief Number of pool entries local stores may not use, so they remain
+ *        available to a global tree store
+ */
+#ifndef CONFIG_BPF_STORE_GLOBAL_RESERVE
+#define CONFIG_BPF_STORE_GLOBAL_RESERVE (0U)
+#endif
+
+/**
+ * @brief Maximum number of entries in each hash table store
+ */
+#ifndef CONFIG_BPF_STORE_HASH_MAX_ENTRIES
+#define CONFIG_BPF_STORE_HASH_MAX_ENTRIES   CONFIG_BPF_STORE_NUM_VALUES
+#endif
+
 /**
  * @brief eBPF key-value object
  */
@@ -43,6 +144,183 @@ typedef struct {
     uint32_t value;     ///< Value
 } bpf_store_keyval_t;
 
+#if CONFIG_BPF_STORE_COMPACT
+typedef ctree_t bpf_store_tree_t;           ///< Tree type used by stores
+typedef ctree_node_t bpf_store_entry_t;     ///< Pool entry type
+
+#define BPF_STORE_POOL_COMPACT_SIZE \
+    (CONFIG_BPF_STORE_NUM_VALUES * sizeof(bpf_store_keyval_t) / sizeof(ctree_node_t))
+
+/**
+ * @brief Number of entries in the shared tree pool
+ */
+#define BPF_STORE_POOL_SIZE \
+    (BPF_STORE_POOL_COMPACT_SIZE < CTREE_MAX_NODES ? BPF_STORE_POOL_COMPACT_SIZE : CTREE_MAX_NODES)
+#else
+typedef btree_t bpf_store_tree_t;           ///< Tree type used by stores
+typedef bpf_store_keyval_t bpf_store_entry_t;   ///< Pool entry type
+
+/**
+ * @brief Number of entries in the shared tree pool
+ */
+#define BPF_STORE_POOL_SIZE     CONFIG_BPF_STORE_NUM_VALUES
+#endif
+
+/**
+ * @brief Number of elements allocated from the heap each time a store pool is exhausted
+ */
+#ifndef CONFIG_BPF_STORE_POOL_CHUNK
+#define CONFIG_BPF_STORE_POOL_CHUNK     (8U)
+#endif
+
+/**
+ * @brief Maximum number of tree entries, 0 for no limit other than the heap
+ *
+ * By default the tree pool does not grow beyond its static entries.
+ * The compact layout addresses entries by index into the static pool so
+ * never grows.
+ */
+#ifndef CONFIG_BPF_STORE_POOL_MAX
+#define CONFIG_BPF_STORE_POOL_MAX       BPF_STORE_POOL_SIZE
+#endif
+
+/**
+ * @brief Maximum length of a blob value in bytes
+ *
+ * Blobs are allocated from the store pools together with a length byte,
+ * so at most 63.
+ */
+#ifndef CONFIG_BPF_STORE_BLOB_MAX
+#define CONFIG_BPF_STORE_BLOB_MAX       (32U)
+#endif
+
+#if CONFIG_BPF_STORE_BLOB_MAX > 63
+#error "CONFIG_BPF_STORE_BLOB_MAX must not exceed 63"
+#endif
+
+/**
+ * @brief Timer wheel slots for expiring entries in bounded stores, a power of 2
+ */
+#ifndef CONFIG_BPF_STORE_TTL_SLOTS
+#define CONFIG_BPF_STORE_TTL_SLOTS      (64U)
+#endif
+
+#if (CONFIG_BPF_STORE_TTL_SLOTS & (CONFIG_BPF_STORE_TTL_SLOTS - 1)) != 0
+#error "CONFIG_BPF_STORE_TTL_SLOTS must be a power of 2"
+#endif
+
+/**
+ * @brief Time covered by each timer wheel slot, in milliseconds
+ */
+#ifndef CONFIG_BPF_STORE_TTL_TICK_MS
+#define CONFIG_BPF_STORE_TTL_TICK_MS    (100U)
+#endif
+
+/**
+ * @brief Maximum number of timer wheel entries examined by each store operation
+ */
+#ifndef CONFIG_BPF_STORE_TTL_SWEEP
+#define CONFIG_BPF_STORE_TTL_SWEEP      (4U)
+#endif
+
+/**
+ * @brief Store pool size classes
+ */
+typedef enum {
+    BPF_STORE_POOL_ENTRY,   ///< Tree entries, sizeof(bpf_store_entry_t)
+    BPF_STORE_POOL_16,      ///< Up to 16 bytes
+    BPF_STORE_POOL_32,      ///< Up to 32 bytes
+    BPF_STORE_POOL_64,      ///< Up to 64 bytes
+    BPF_STORE_POOL_CLASSES,
+} bpf_store_pool_class_t;
+
+/**
+ * @brief Recency and expiry tracking for a bounded store
+ */
+typedef struct bpf_store_cache bpf_store_cache_t;
+
+/**
+ * @brief Bounded store statistics
+ */
+typedef struct {
+    uint32_t capacity;          ///< Maximum number of entries
+    uint32_t ttl;               ///< Default lifetime of new entries in milliseconds, 0 for none
+    uint32_t evictions;         ///< Least recently used entries removed to make room
+    uint32_t expirations;       ///< Entries removed after their lifetime elapsed
+} bpf_store_cache_stats_t;
+
+/**
+ * @brief A key-value store
+ *
+ * Zero-initialised stores are empty trees.
+ */
+typedef struct {
+    union {
+        bpf_store_tree_t tree;  ///< BPF_STORE_TYPE_TREE
+        hashmap_t hash;         ///< BPF_STORE_TYPE_HASH
+    };
+    hashmap64_t wide;           ///< 64-bit keys with 64-bit values
+    hashmap64_t blobs;          ///< 64-bit keys with blob values, see CONFIG_BPF_STORE_BLOB_MAX
+    bpf_store_cache_t *cache;   ///< Set for bounded stores, see bpf_store_set_global_cache()
+    uint32_t count;             ///< Number of entries
+    uint32_t quota;             ///< Maximum number of entries, 0 for no limit
+    uint8_t type;               ///< bpf_store_type_t
+} bpf_store_t;
+
+/**
+ * @brief Key/value pair returned by scans
+ */
+typedef struct {
+    uint32_t key;
+    uint32_t value;
+} bpf_store_kv_t;
+
+/**
+ * @brief Callback for store iteration
+ * @param key
+ * @param value
+ * @param ctx Context passed to the iteration function
+ */
+typedef void (*bpf_store_iter_cb_t)(uint32_t key, uint32_t value, void *ctx);
+
+/**
+ * @brief Change to a value in the global store
+ *
+ * A key which doesn't exist reads as 0.
+ */
+typedef struct {
+    uint32_t key;
+    uint32_t old_value;
+    uint32_t new_value;
+} bpf_store_change_t;
+
+/**
+ * @brief Callback for store watches
+ * @param change
+ * @param param Passed to bpf_store_watch_global()
+ */
+typedef void (*bpf_store_watch_cb_t)(const bpf_store_change_t *change, void *param);
+
+/**
+ * @brief Watch on a range of keys in the global store
+ *
+ * Allocated by the caller and initialised by bpf_store_watch_global().
+ */
+typedef struct bpf_store_watch {
+    struct bpf_store_watch *next;
+    struct bpf_store_watch *held;   ///< Next watch locked by the same writer
+    uint32_t first;                 ///< First key watched
+    uint32_t last;                  ///< Last key watched, inclusive
+    bpf_store_watch_cb_t cb;
+    void *param;
+#if CONFIG_BPF_CONCURRENT
+    bpf_mutex_t lock;               ///< Held while a change to a watched key is made and reported
+#endif
+} bpf_store_watch_t;
+
+/* bpf.h includes this header, so use the struct tag */
+struct bpf_s;
+
 /**
  * @brief Initialise global store
  * 
@@ -64,7 +342,7 @@ int bpf_store_update_global(uint32_t key, uint32_t value);
  * @param value
  * @retval int error code
  */
-int bpf_store_update_local(bpf_t *bpf, uint32_t key, uint32_t value);
+int bpf_store_update_local(struct bpf_s *bpf, uint32_t key, uint32_t value);
 
 /**
  * @brief Read value from global store
@@ -84,14 +362,448 @@ int bpf_store_fetch_global(uint32_t key, uint32_t *value);
  * 
  * If value doesn't exist, add it with default value (0)
  */
-int bpf_store_fetch_local(bpf_t *bpf, uint32_t key, uint32_t *value);
+int bpf_store_fetch_local(struct bpf_s *bpf, uint32_t key, uint32_t *value);
+
+/**
+ * @brief Remove key from global store
+ * @param key
+ * @retval int error code, -1 if key doesn't exist
+ *
+ * The entry is returned to the shared pool.
+ */
+int bpf_store_remove_global(uint32_t key);
+
+/**
+ * @brief Remove key from local store
+ * @param key
+ * @retval int error code, -1 if key doesn't exist
+ */
+int bpf_store_remove_local(struct bpf_s *bpf, uint32_t key);
+
+/**
+ * @brief Read several values from the global store
+ * @param keys Keys to read
+ * @param values Receives values, in the same order as keys
+ * @param count Number of keys
+ * @retval int error code, -1 if any value could not be added
+ *
+ * As for bpf_store_fetch_global(), missing keys are added with value 0.
+ * Tree stores visit keys in ascending order for better cache locality.
+ */
+int bpf_store_fetch_many_global(const uint32_t *keys, uint32_t *values, size_t count);
+
+/**
+ * @brief Read several values from a local store
+ * @see bpf_store_fetch_many_global()
+ */
+int bpf_store_fetch_many_local(struct bpf_s *bpf, const uint32_t *keys, uint32_t *values,
+                               size_t count);
+
+/**
+ * @brief Update several values in the global store
+ * @param keys Keys to update
+ * @param values New values, in the same order as keys
+ * @param count Number of keys
+ * @retval int error code, -1 if any value could not be stored
+ *
+ * If a key appears more than once, the last value is stored.
+ */
+int bpf_store_update_many_global(const uint32_t *keys, const uint32_t *values, size_t count);
+
+/**
+ * @brief Update several values in a local store
+ * @see bpf_store_update_many_global()
+ */
+int bpf_store_update_many_local(struct bpf_s *bpf, const uint32_t *keys, const uint32_t *values,
+                                size_t count);
+
+/**
+ * @brief Store a 64-bit value with a 64-bit key in global store
+ * @retval int error code, -1 if store is full
+ */
+int bpf_store_update64_global(uint64_t key, uint64_t value);
+
+/**
+ * @brief Store a 64-bit value with a 64-bit key in a local store
+ * @see bpf_store_update64_global()
+ */
+int bpf_store_update64_local(struct bpf_s *bpf, uint64_t key, uint64_t value);
+
+/**
+ * @brief Read a 64-bit value from global store
+ * @param key
+ * @param value Receives value, 0 if key doesn't exist
+ * @retval int error code, -1 if key doesn't exist
+ */
+int bpf_store_lookup64_global(uint64_t key, uint64_t *value);
+
+/**
+ * @brief Read a 64-bit value from a local store
+ * @see bpf_store_lookup64_global()
+ */
+int bpf_store_lookup64_local(struct bpf_s *bpf, uint64_t key, uint64_t *value);
+
+/**
+ * @brief Add to a 64-bit value in global store, returning the previous value
+ * @param key
+ * @param delta Amount to add, wraps on overflow
+ * @param old Receives previous value, 0 if key was added
+ * @retval int error code, -1 if store is full
+ */
+int bpf_store_fetch_add64_global(uint64_t key, uint64_t delta, uint64_t *old);
+
+/**
+ * @brief Add to a 64-bit value in a local store
+ * @see bpf_store_fetch_add64_global()
+ */
+int bpf_store_fetch_add64_local(struct bpf_s *bpf, uint64_t key, uint64_t delta, uint64_t *old);
+
+/**
+ * @brief Remove a 64-bit value from global store
+ * @retval int error code, -1 if key doesn't exist
+ */
+int bpf_store_remove64_global(uint64_t key);
+
+/**
+ * @brief Remove a 64-bit value from a local store
+ * @see bpf_store_remove64_global()
+ */
+int bpf_store_remove64_local(struct bpf_s *bpf, uint64_t key);
+
+/**
+ * @brief Store a blob in global store
+ * @param key
+ * @param data
+ * @param len Length of data, at most CONFIG_BPF_STORE_BLOB_MAX
+ * @retval int error code, -1 if too long, store is full or pool is exhausted
+ *
+ * Any existing blob with the same key is replaced. On failure it is left unchanged.
+ */
+int bpf_store_set_blob_global(uint64_t key, const void *data, size_t len);
+
+/**
+ * @brief Store a blob in a local store
+ * @see bpf_store_set_blob_global()
+ */
+int bpf_store_set_blob_local(struct bpf_s *bpf, uint64_t key, const void *data, size_t len);
+
+/**
+ * @brief Read a blob from global store
+ * @param key
+ * @param buf Receives blob data, truncated to @p size
+ * @param size Size of @p buf
+ * @retval int Length of blob, -1 if key doesn't exist
+ */
+int bpf_store_get_blob_global(uint64_t key, void *buf, size_t size);
+
+/**
+ * @brief Read a blob from a local store
+ * @see bpf_store_get_blob_global()
+ */
+int bpf_store_get_blob_local(struct bpf_s *bpf, uint64_t key, void *buf, size_t size);
+
+/**
+ * @brief Remove a blob from global store, returning its memory to the pool
+ * @retval int error code, -1 if key doesn't exist
+ */
+int bpf_store_remove_blob_global(uint64_t key);
+
+/**
+ * @brief Remove a blob from a local store
+ * @see bpf_store_remove_blob_global()
+ */
+int bpf_store_remove_blob_local(struct bpf_s *bpf, uint64_t key);
+
+/**
+ * @brief Read entries from global store in key order
+ * @param key First key to read
+ * @param items Receives entries
+ * @param max Size of @p items
+ * @param reverse false to read keys >= @p key in ascending order,
+ *                true to read keys <= @p key in descending order
+ * @retval size_t Number of entries read
+ *
+ * Read the next range by calling again with the key following the last one returned.
+ * Tree stores find the first key in O(log n) then follow parent links to
+ * each subsequent entry, or search again from the root with the compact layout.
+ * Hash table stores are unordered, so each call examines every entry.
+ */
+size_t bpf_store_scan_global(uint32_t key, bpf_store_kv_t *items, size_t max, bool reverse);
+
+/**
+ * @brief Read entries from a local store in key order
+ * @see bpf_store_scan_global()
+ */
+size_t bpf_store_scan_local(struct bpf_s *bpf, uint32_t key, bpf_store_kv_t *items, size_t max,
+                            bool reverse);
+
+/**
+ * @brief Read value from global store without adding it
+ * @param key
+ * @param value Receives value, 0 if key doesn't exist
+ * @retval int error code, -1 if key doesn't exist
+ */
+int bpf_store_lookup_global(uint32_t key, uint32_t *value);
+
+/**
+ * @brief Read value from local store without adding it
+ * @param key
+ * @param value Receives value, 0 if key doesn't exist
+ * @retval int error code, -1 if key doesn't exist
+ */
+int bpf_store_lookup_local(struct bpf_s *bpf, uint32_t key, uint32_t *value);
 
 /**
- * @brief Iterate through all values in global store
+ * @brief Add to a value in the global store
+ * @param key
+ * @param delta Amount to add, wraps on overflow
+ * @param old If not NULL, receives the value before the addition
+ * @retval int error code
+ *
+ * If value doesn't exist, it is added with value @p delta.
+ * Locating the key and updating it takes a single traversal.
+ */
+int bpf_store_fetch_add_global(uint32_t key, uint32_t delta, uint32_t *old);
+
+/**
+ * @brief Add to a value in a local store
+ * @see bpf_store_fetch_add_global()
+ */
+int bpf_store_fetch_add_local(struct bpf_s *bpf, uint32_t key, uint32_t delta, uint32_t *old);
+
+/**
+ * @brief Compare and swap a value in the global store
+ * @param key
+ * @param expected Value to compare with
+ * @param desired Value to store if the current value equals @p expected
+ * @param actual If not NULL, receives the value before the operation
+ * @retval int 0 if value was replaced, 1 if it did not match, -1 on error
+ *
+ * A key which doesn't exist reads as 0, and is only added if @p expected is 0.
+ */
+int bpf_store_cas_global(uint32_t key, uint32_t expected, uint32_t desired, uint32_t *actual);
+
+/**
+ * @brief Compare and swap a value in a local store
+ * @see bpf_store_cas_global()
+ */
+int bpf_store_cas_local(struct bpf_s *bpf, uint32_t key, uint32_t expected, uint32_t desired,
+                        uint32_t *actual);
+
+/**
+ * @brief Store the lesser of a value and the value in the global store
+ * @param key
+ * @param value
+ * @retval int error code
+ *
+ * If the key doesn't exist it is added with @p value.
+ */
+int bpf_store_min_global(uint32_t key, uint32_t value);
+
+/**
+ * @brief Store the lesser of a value and the value in a local store
+ * @see bpf_store_min_global()
+ */
+int bpf_store_min_local(struct bpf_s *bpf, uint32_t key, uint32_t value);
+
+/**
+ * @brief Store the greater of a value and the value in the global store
+ * @param key
+ * @param value
+ * @retval int error code
+ *
+ * If the key doesn't exist it is added with @p value.
+ */
+int bpf_store_max_global(uint32_t key, uint32_t value);
+
+/**
+ * @brief Store the greater of a value and the value in a local store
+ * @see bpf_store_max_global()
+ */
+int bpf_store_max_local(struct bpf_s *bpf, uint32_t key, uint32_t value);
+
+/**
+ * @brief Bound the global store, evicting least recently used entries when full
+ * @param capacity Maximum number of entries, 0 to remove the bound
+ * @param ttl Default lifetime of new entries in milliseconds, 0 for no expiry
+ * @retval int error code, -1 if the store is not empty or memory is unavailable
+ *
+ * Tracking memory for @p capacity entries is allocated from the heap.
+ * The bound may only be set or changed while the store is empty,
+ * but may be removed at any time. Lifetimes must be less than 2^31 ms.
+ */
+int bpf_store_set_global_cache(uint32_t capacity, uint32_t ttl);
+
+/**
+ * @brief Bound a local store
+ * @see bpf_store_set_global_cache()
+ *
+ * The bound is removed when the container is destroyed.
+ */
+int bpf_store_set_local_cache(struct bpf_s *bpf, uint32_t capacity, uint32_t ttl);
+
+/**
+ * @brief Set the lifetime of an entry in the global store
+ * @param key
+ * @param ttl Lifetime from now in milliseconds, 0 for no expiry
+ * @retval int error code, -1 if the key doesn't exist or the store is not bounded
+ */
+int bpf_store_set_ttl_global(uint32_t key, uint32_t ttl);
+
+/**
+ * @brief Set the lifetime of an entry in a local store
+ * @see bpf_store_set_ttl_global()
+ */
+int bpf_store_set_ttl_local(struct bpf_s *bpf, uint32_t key, uint32_t ttl);
+
+/**
+ * @brief Read statistics for the global store bound
+ * @retval int error code, -1 if the store is not bounded
+ */
+int bpf_store_get_global_cache_stats(bpf_store_cache_stats_t *stats);
+
+/**
+ * @brief Read statistics for a local store bound
+ * @see bpf_store_get_global_cache_stats()
+ */
+int bpf_store_get_local_cache_stats(const struct bpf_s *bpf, bpf_store_cache_stats_t *stats);
+
+/**
+ * @brief Select backend for the global store
+ * @param type
+ * @retval int error code, -1 if the store is not empty
+ */
+int bpf_store_set_global_type(bpf_store_type_t type);
+
+/**
+ * @brief Select backend for a local store
+ * @param type
+ * @retval int error code, -1 if the store is not empty
+ *
+ * bpf_setup() applies `CONFIG_BPF_STORE_LOCAL_TYPE`.
+ */
+int bpf_store_set_local_type(struct bpf_s *bpf, bpf_store_type_t type);
+
+/**
+ * @brief Remove all entries from the global store
+ */
+void bpf_store_clear_global(void);
+
+/**
+ * @brief Remove all entries from a local store
+ *
+ * Called by bpf_destroy()
+ */
+void bpf_store_clear_local(struct bpf_s *bpf);
+
+/**
+ * @brief Set maximum number of entries in the global store
+ * @param quota 0 for no limit
+ *
+ * Existing entries are not affected.
+ */
+void bpf_store_set_global_quota(uint32_t quota);
+
+/**
+ * @brief Set maximum number of entries in a local store
+ * @param quota 0 for no limit
+ *
+ * bpf_setup() applies `CONFIG_BPF_STORE_LOCAL_QUOTA`.
+ * Existing entries are not affected.
+ */
+void bpf_store_set_local_quota(struct bpf_s *bpf, uint32_t quota);
+
+/**
+ * @brief Get number of entries in the global store
+ */
+size_t bpf_store_count_global(void);
+
+/**
+ * @brief Get number of entries in a local store
+ */
+size_t bpf_store_count_local(const struct bpf_s *bpf);
+
+/**
+ * @brief Get the global store, for diagnostics
+ */
+const bpf_store_t *bpf_store_get_global(void);
+
+/**
+ * @brief Allocate memory from the store pools
+ * @param size Number of bytes required, at most 64
+ * @retval Allocated element from the smallest suitable size class, NULL if none available
+ */
+void *bpf_store_pool_alloc(size_t size);
+
+/**
+ * @brief Return memory to the store pools
+ * @param ptr Element returned by bpf_store_pool_alloc()
+ * @param size Size passed to bpf_store_pool_alloc()
+ */
+void bpf_store_pool_free(void *ptr, size_t size);
+
+/**
+ * @brief Read statistics for a store pool
+ * @param cls Size class
+ * @param stats Receives statistics
+ * @retval int error code, -1 if class is invalid
+ */
+int bpf_store_get_pool_stats(bpf_store_pool_class_t cls, bpf_pool_stats_t *stats);
+
+/**
+ * @brief Reset high water marks and failure counts for all store pools
+ */
+void bpf_store_reset_pool_stats(void);
+
+/**
+ * @brief Call a function whenever a value in the global store changes
+ * @param watch Remains in use until passed to bpf_store_unwatch_global()
+ * @param first First key to watch
+ * @param last Last key to watch, the same as @p first for a single key
+ * @param cb Called with the key and its old and new values
+ * @param param Passed to callback
+ * @retval int error code, -1 if the range or callback is invalid
+ *
+ * Updates, additions, compare-and-swap, minimum and maximum operations and removals
+ * are reported if they change the value, after the store is unlocked. Entries
+ * which are evicted, expire or are cleared are not reported.
+ *
+ * Callbacks run on the thread making the change, one at a time for each watch, so
+ * should do no more than queue work. They must not change the global store or add or
+ * remove watches. Changes are reported in the order they were made, including
+ * concurrent changes to the same key, because changes to a watched key are made one
+ * at a time. Changes to keys outside the range spanned by all watches cost a single test.
+ */
+int bpf_store_watch_global(bpf_store_watch_t *watch, uint32_t first, uint32_t last,
+                           bpf_store_watch_cb_t cb, void *param);
+
+/**
+ * @brief Stop watching the global store
+ *
+ * On return the callback is not running and will not be called again.
+ */
+void bpf_store_unwatch_global(bpf_store_watch_t *watch);
+
+/**
+ * @brief Iterate through all values in global store, in key order
  * @param cb Callback to invoke for each value
  * @param ctx Passed to callback
+ *
+ * Entries are copied, sorted by key for a hash table store, then visited with
+ * the store unlocked, so the callback may change the global store. It sees the
+ * values as they were when iteration began. If the copy cannot be allocated then
+ * entries are read in batches, each reflecting the store at the time it is read.
+ */
+void bpf_store_iter_global(bpf_store_iter_cb_t cb, void *ctx);
+
+/**
+ * @brief Iterate through all values in a local store
+ * @param cb Callback to invoke for each value
+ * @param ctx Passed to callback
+ *
+ * Trees are visited in key order, hash tables in unspecified order.
  */
-void bpf_store_iter_global(btree_cb_t cb, void *ctx);
+void bpf_store_iter_local(struct bpf_s *bpf, bpf_store_iter_cb_t cb, void *ctx);
 
 #ifdef __cplusplus
 }
@@ -0,0 +1,222 @@
+/**
+ * @defgroup    sys_bpf_sync BPF synchronisation
+ * @ingroup     sys_bpf
+ * @brief       Locks and atomic operations for multi-threaded hosts
+ *
+ * Containers normally run on a single thread, so shared state needs no
+ * protection. Setting `CONFIG_BPF_CONCURRENT` allows containers to run on
+ * several threads at once, using POSIX threads. Otherwise the locks here are
+ * empty and the atomic operations are plain memory accesses.
+ *
+ * The reader-writer lock is intended for data which is read far more often
+ * than it is restructured. Each reader increments a counter in one of
+ * `CONFIG_BPF_SYNC_READER_SLOTS` slots, chosen per thread, each in its own
+ * cache line. Readers on different threads therefore do not contend unless a
+ * writer is active. A writer waits for all slots to drain, so is relatively
+ * expensive. The lock is not recursive.
+ *
+ * @{
+ *
+ * @file
+ */
+
+#ifndef BPF_SYNC_H
+#define BPF_SYNC_H
+
+#include <stdint.h>
+#include <stdbool.h>
+
+#ifndef CONFIG_BPF_CONCURRENT
+#define CONFIG_BPF_CONCURRENT           (0)
+#endif
+
+#if CONFIG_BPF_CONCURRENT
+#include <pthread.h>
+#endif
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+/**
+ * @brief Number of reader counters in a reader-writer lock, a power of 2
+ */
+#ifndef CONFIG_BPF_SYNC_READER_SLOTS
+#define CONFIG_BPF_SYNC_READER_SLOTS    (16U)
+#endif
+
+#if (CONFIG_BPF_SYNC_READER_SLOTS & (CONFIG_BPF_SYNC_READER_SLOTS - 1)) != 0
+#error "CONFIG_BPF_SYNC_READER_SLOTS must be a power of 2"
+#endif
+
+#define BPF_SYNC_CACHE_LINE             (64U)
+
+#if CONFIG_BPF_CONCURRENT
+
+/**
+ * @brief Mutual exclusion lock
+ */
+typedef pthread_mutex_t bpf_mutex_t;
+
+#define BPF_MUTEX_INIT      PTHREAD_MUTEX_INITIALIZER
+
+static inline void bpf_mutex_init(bpf_mutex_t *mutex)
+{
+    pthread_mutex_init(mutex, NULL);
+}
+
+static inline void bpf_mutex_lock(bpf_mutex_t *mutex)
+{
+    pthread_mutex_lock(mutex);
+}
+
+static inline void bpf_mutex_unlock(bpf_mutex_t *mutex)
+{
+    pthread_mutex_unlock(mutex);
+}
+
+/**
+ * @brief Reader-writer lock
+ *
+ * Zero-initialise before use.
+ */
+typedef struct {
+    struct {
+        uint32_t readers;
+    } __attribute__((aligned(BPF_SYNC_CACHE_LINE))) slots[CONFIG_BPF_SYNC_READER_SLOTS];
+    uint32_t writer;        ///< Set while a writer holds or is waiting for the lock
+    bpf_mutex_t mutex;      ///< Serialises writers
+} bpf_rwlock_t;
+
+#define BPF_RWLOCK_INIT     { .mutex = BPF_MUTEX_INIT }
+
+/**
+ * @brief Acquire shared access
+ */
+void bpf_rwlock_read_lock(bpf_rwlock_t *lock);
+
+/**
+ * @brief Release shared access
+ */
+void bpf_rwlock_read_unlock(bpf_rwlock_t *lock);
+
+/**
+ * @brief Acquire exclusive access, waiting for current readers to finish
+ */
+void bpf_rwlock_write_lock(bpf_rwlock_t *lock);
+
+/**
+ * @brief Release exclusive access
+ */
+void bpf_rwlock_write_unlock(bpf_rwlock_t *lock);
+
+/**
+ * @brief Get a number for the calling thread
+ *
+ * Threads are numbered from 0 in the order they first call this.
+ */
+uint32_t bpf_sync_thread_index(void);
+
+/*
+ * Relaxed atomic operations on naturally aligned integers of any size.
+ * Ordering is provided by the locks.
+ */
+#define bpf_atomic_load(ptr)                __atomic_load_n((ptr), __ATOMIC_RELAXED)
+#define bpf_atomic_store(ptr, val)          __atomic_store_n((ptr), (val), __ATOMIC_RELAXED)
+#define bpf_atomic_fetch_add(ptr, val)      __atomic_fetch_add((ptr), (val), __ATOMIC_RELAXED)
+#define bpf_atomic_exchange(ptr, val)       __atomic_exchange_n((ptr), (val), __ATOMIC_RELAXED)
+#define bpf_atomic_add(ptr, val)            ((void)__atomic_add_fetch((ptr), (val), __ATOMIC_RELAXED))
+#define bpf_atomic_sub(ptr, val)            ((void)__atomic_sub_fetch((ptr), (val), __ATOMIC_RELAXED))
+#define bpf_atomic_cas(ptr, expected, desired)                                                      \
+    __atomic_compare_exchange_n((ptr), (expected), (desired), false, __ATOMIC_RELAXED,              \
+                                __ATOMIC_RELAXED)
+
+/*
+ * Ordered operations for lock-free producer/consumer indices
+ */
+#define bpf_atomic_load_acquire(ptr)        __atomic_load_n((ptr), __ATOMIC_ACQUIRE)
+#define bpf_atomic_load_seq_cst(ptr)        __atomic_load_n((ptr), __ATOMIC_SEQ_CST)
+#define bpf_atomic_store_seq_cst(ptr, val)  __atomic_store_n((ptr), (val), __ATOMIC_SEQ_CST)
+
+#else
+
+typedef struct {
+} bpf_mutex_t;
+
+#define BPF_MUTEX_INIT      {}
+
+static inline void bpf_mutex_init(bpf_mutex_t *mutex)
+{
+    (void)mutex;
+}
+
+static inline void bpf_mutex_lock(bpf_mutex_t *mutex)
+{
+    (void)mutex;
+}
+
+static inline void bpf_mutex_unlock(bpf_mutex_t *mutex)
+{
+    (void)mutex;
+}
+
+static inline uint32_t bpf_sync_thread_index(void)
+{
+    return 0;
+}
+
+typedef struct {
+} bpf_rwlock_t;
+
+#define BPF_RWLOCK_INIT     {}
+
+static inline void bpf_rwlock_read_lock(bpf_rwlock_t *lock)
+{
+    (void)lock;
+}
+
+static inline void bpf_rwlock_read_unlock(bpf_rwlock_t *lock)
+{
+    (void)lock;
+}
+
+static inline void bpf_rwlock_write_lock(bpf_rwlock_t *lock)
+{
+    (void)lock;
+}
+
+static inline void bpf_rwlock_write_unlock(bpf_rwlock_t *lock)
+{
+    (void)lock;
+}
+
+/* Plain accesses, so targets without atomic instructions need no library support */
+#define bpf_atomic_load(ptr)                (*(ptr))
+#define bpf_atomic_store(ptr, val)          ((void)(*(ptr) = (val)))
+#define bpf_atomic_fetch_add(ptr, val)      ({ __typeof__(*(ptr)) _old = *(ptr); *(ptr) += (val); _old; })
+#define bpf_atomic_exchange(ptr, val)       ({ __typeof__(*(ptr)) _old = *(ptr); *(ptr) = (val); _old; })
+#define bpf_atomic_add(ptr, val)            ((void)(*(ptr) += (val)))
+#define bpf_atomic_sub(ptr, val)            ((void)(*(ptr) -= (val)))
+#define bpf_atomic_cas(ptr, expected, desired)                                                      \
+    ({                                                                                              \
+        bool _equal = (*(ptr) == *(expected));                                                      \
+        if (_equal) {                                                                               \
+            *(ptr) = (desired);                                                                     \
+        }                                                                                           \
+        else {                                                                                      \
+            *(expected) = *(ptr);                                                                   \
+        }                                                                                           \
+        _equal;                                                                                     \
+    })
+
+#define bpf_atomic_load_acquire(ptr)        (*(ptr))
+#define bpf_atomic_load_seq_cst(ptr)        (*(ptr))
+#define bpf_atomic_store_seq_cst(ptr, val)  ((void)(*(ptr) = (val)))
+
+#endif /* CONFIG_BPF_CONCURRENT */
+
+#ifdef __cplusplus
+}
+#endif
+#endif /* BPF_SYNC_H */
+/** @} */
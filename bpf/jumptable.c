@@ -17,6 +17,8 @@
 
 #include <debug_progmem.h>
 
+#if CONFIG_BPF_USE_JUMPTABLE
+
 /**
  * This is a set of macros to easily implement the similar eBPF instructions
  */
@@ -116,7 +118,7 @@ int bpf_run(bpf_t *bpf, const void *ctx, int64_t *result)
     regmap[10] = (uint64_t)(uintptr_t)(bpf->stack + bpf->stack_size);
 
 
-    const volatile bpf_instruction_t *pc = (const volatile bpf_instruction_t*)rbpf_text(bpf);
+    const volatile bpf_instruction_t *pc = (const volatile bpf_instruction_t*)bpf->text;
     bpf_instruction_t instr;
     bool jump_cond = false;
     void* memptr;
@@ -156,9 +158,9 @@ int bpf_run(bpf_t *bpf, const void *ctx, int64_t *result)
         JMP_OPCODE(SLT, 0xC0),
         JMP_OPCODE(SLE, 0xD0),
 
-        [0x18] = &&MEM_LDDW_IMM,
-        [0xB8] = &&MEM_LDDWD_IMM,
-        [0xD8] = &&MEM_LDDWR_IMM,
+        [BPF_INSTRUCTION_LDDW] = &&MEM_LDDW_IMM,
+        [BPF_INSTRUCTION_LDDWD] = &&MEM_LDDWD_IMM,
+        [BPF_INSTRUCTION_LDDWR] = &&MEM_LDDWR_IMM,
 
         MEM_OPCODE(STX, 0x63),
         MEM_OPCODE(ST,  0x62),
@@ -268,7 +270,7 @@ ALU64_NEG_REG:
 
 #if (CONFIG_BPF_ENABLE_ALU32)
 ALU32_NEG_REG:
-    DST = -(int32_t)DST;
+    DST = (uint32_t)-(int32_t)DST;
     CONT;
 
     /* MOV */
@@ -280,10 +282,10 @@ ALU32_MOV_REG:
     CONT;
 #endif
 ALU64_MOV_IMM:
-    DST = (uint32_t)IMM;
+    DST = (int64_t)IMM;
     CONT;
 ALU64_MOV_REG:
-    DST = (uint32_t)SRC;
+    DST = SRC;
     CONT;
 
     /* Arithmetic shift */
@@ -295,29 +297,29 @@ ALU64_ARSH_IMM:
     CONT;
 #if (CONFIG_BPF_ENABLE_ALU32)
 ALU32_ARSH_REG:
-    DST = (int32_t)DST >> SRC;
+    DST = (uint32_t)((int32_t)DST >> SRC);
     CONT;
 ALU32_ARSH_IMM:
-    DST =  (int32_t)DST >> IMM;
+    DST = (uint32_t)((int32_t)DST >> IMM);
     CONT;
 #endif
 
 MEM_LDDW_IMM:
-    DST = (uint64_t)instr.immediate;
+    DST = (uint32_t)instr.immediate;
     DST |= (uint64_t)(GET_INSTRUCTION(pc + 1).immediate) << 32;
     pc++;
     CONT;
 
 MEM_LDDWD_IMM:
-    DST = (intptr_t)rbpf_data(bpf);
-    DST += (uint64_t)instr.immediate;
+    DST = (uintptr_t)bpf->data_region.phys_start;
+    DST += (uint32_t)instr.immediate;
     DST += (uint64_t)(GET_INSTRUCTION(pc + 1).immediate) << 32;
     pc++;
     CONT;
 
 MEM_LDDWR_IMM:
-    DST = (intptr_t)rbpf_rodata(bpf);
-    DST += (uint64_t)instr.immediate;
+    DST = (uintptr_t)bpf->rodata_region.phys_start;
+    DST += (uint32_t)instr.immediate;
     DST += (uint64_t)(GET_INSTRUCTION(pc + 1).immediate) << 32;
     pc++;
     CONT;
@@ -399,3 +401,4 @@ exit:
     return res;
 }
 
+#endif /* CONFIG_BPF_USE_JUMPTABLE */
@@ -0,0 +1,315 @@
+#include <stdint.h>
+#include <stddef.h>
+#include <stdbool.h>
+#include <string.h>
+#include "include/bpf/lpm.h"
+
+#define NIL 0xFFFF
+
+typedef struct {
+    uint16_t child[2];
+    uint16_t prefixlen;
+    uint16_t value;             ///< NIL for nodes which only join two branches
+    uint8_t data[];
+} node_t;
+
+/*
+ * A trie with n prefixes has at most n - 1 joining nodes
+ */
+static size_t _node_capacity(size_t max_prefixes)
+{
+    return 2 * max_prefixes - 1;
+}
+
+static size_t _node_size(size_t data_size)
+{
+    return (sizeof(node_t) + data_size + 3) & ~3U;
+}
+
+static node_t *_node(const lpm_trie_t *trie, uint16_t index)
+{
+    return (node_t *)(trie->nodes + (size_t)index * trie->node_size);
+}
+
+/* Bit n of data, most significant first */
+static unsigned _bit(const uint8_t *data, unsigned n)
+{
+    return (data[n / 8] >> (7 - (n % 8))) & 1;
+}
+
+/* Number of leading bits which are equal, up to limit */
+static unsigned _match_len(const uint8_t *a, const uint8_t *b, unsigned limit)
+{
+    for (unsigned i = 0; i * 8 < limit; i++) {
+        uint8_t diff = a[i] ^ b[i];
+        if (diff) {
+            unsigned n = i * 8 + __builtin_clz(diff) - (sizeof(unsigned) - 1) * 8;
+            return (n < limit) ? n : limit;
+        }
+    }
+    return limit;
+}
+
+/* Copy prefix bits and clear the remainder */
+static void _copy_prefix(uint8_t *dst, const uint8_t *src, unsigned prefixlen, size_t data_size)
+{
+    unsigned bytes = prefixlen / 8;
+    memmove(dst, src, bytes);
+    if (prefixlen % 8) {
+        dst[bytes] = src[bytes] & (0xFF << (8 - prefixlen % 8));
+        bytes++;
+    }
+    memset(dst + bytes, 0, data_size - bytes);
+}
+
+static uint16_t _alloc_node(lpm_trie_t *trie, const uint8_t *data, unsigned prefixlen, uint16_t value)
+{
+    uint16_t index = trie->free_nodes;
+    node_t *node = _node(trie, index);
+    trie->free_nodes = node->child[0];
+    node->child[0] = node->child[1] = NIL;
+    node->prefixlen = prefixlen;
+    node->value = value;
+    _copy_prefix(node->data, data, prefixlen, trie->data_size);
+    return index;
+}
+
+static void _free_node(lpm_trie_t *trie, uint16_t index)
+{
+    node_t *node = _node(trie, index);
+    node->value = NIL;
+    node->child[0] = trie->free_nodes;
+    trie->free_nodes = index;
+}
+
+static uint16_t _alloc_value(lpm_trie_t *trie)
+{
+    ++trie->count;
+    return trie->free_values[--trie->num_free_values];
+}
+
+static void _free_value(lpm_trie_t *trie, uint16_t value)
+{
+    --trie->count;
+    trie->free_values[trie->num_free_values++] = value;
+}
+
+/* Locate node holding exact prefix, which may be a joining node */
+static uint16_t _find_node(const lpm_trie_t *trie, const uint8_t *data, unsigned prefixlen)
+{
+    uint16_t index = trie->root;
+    while (index != NIL) {
+        const node_t *node = _node(trie, index);
+        if (node->prefixlen > prefixlen ||
+            _match_len(node->data, data, node->prefixlen) != node->prefixlen) {
+            return NIL;
+        }
+        if (node->prefixlen == prefixlen) {
+            return index;
+        }
+        index = node->child[_bit(data, node->prefixlen)];
+    }
+    return NIL;
+}
+
+size_t lpm_trie_mem_size(size_t data_size, size_t max_prefixes)
+{
+    if (data_size == 0 || data_size > 0xFFFF / 8 || max_prefixes == 0 ||
+        max_prefixes > LPM_TRIE_MAX_PREFIXES) {
+        return 0;
+    }
+    return _node_capacity(max_prefixes) * _node_size(data_size) +
+           ((max_prefixes * sizeof(uint16_t) + 3) & ~3U);
+}
+
+void lpm_trie_init(lpm_trie_t *trie, void *mem, size_t data_size, size_t max_prefixes)
+{
+    trie->nodes = mem;
+    trie->node_size = _node_size(data_size);
+    trie->data_size = data_size;
+    trie->max_prefixes = max_prefixes;
+    trie->free_values = (uint16_t *)(trie->nodes + _node_capacity(max_prefixes) * trie->node_size);
+    lpm_trie_clear(trie);
+}
+
+void lpm_trie_clear(lpm_trie_t *trie)
+{
+    size_t capacity = _node_capacity(trie->max_prefixes);
+    for (size_t i = 0; i < capacity; i++) {
+        node_t *node = _node(trie, i);
+        node->child[0] = (i + 1 < capacity) ? i + 1 : NIL;
+        node->value = NIL;
+    }
+    trie->free_nodes = 0;
+    trie->root = NIL;
+    /* Values are handed out from index 0 upwards */
+    for (unsigned i = 0; i < trie->max_prefixes; i++) {
+        trie->free_values[i] = trie->max_prefixes - 1 - i;
+    }
+    trie->num_free_values = trie->max_prefixes;
+    trie->count = 0;
+}
+
+int lpm_trie_lookup(const lpm_trie_t *trie, const uint8_t *data, unsigned prefixlen)
+{
+    int found = -1;
+    uint16_t index = trie->root;
+    while (index != NIL) {
+        const node_t *node = _node(trie, index);
+        if (node->prefixlen > prefixlen ||
+            _match_len(node->data, data, node->prefixlen) != node->prefixlen) {
+            break;
+        }
+        if (node->value != NIL) {
+            found = node->value;
+        }
+        if (node->prefixlen == prefixlen) {
+            break;
+        }
+        index = node->child[_bit(data, node->prefixlen)];
+    }
+    return found;
+}
+
+int lpm_trie_find(const lpm_trie_t *trie, const uint8_t *data, unsigned prefixlen)
+{
+    uint16_t index = _find_node(trie, data, prefixlen);
+    if (index == NIL || _node(trie, index)->value == NIL) {
+        return -1;
+    }
+    return _node(trie, index)->value;
+}
+
+int lpm_trie_insert(lpm_trie_t *trie, const uint8_t *data, unsigned prefixlen, bool *inserted)
+{
+    *inserted = false;
+
+    uint16_t *slot = &trie->root;
+    node_t *node = NULL;
+    unsigned match = 0;
+    while (*slot != NIL) {
+        node = _node(trie, *slot);
+        unsigned limit = (node->prefixlen < prefixlen) ? node->prefixlen : prefixlen;
+        match = _match_len(node->data, data, limit);
+        if (match != node->prefixlen || node->prefixlen == prefixlen) {
+            break;
+        }
+        slot = &node->child[_bit(data, node->prefixlen)];
+    }
+
+    if (*slot != NIL && match == prefixlen && node->prefixlen == prefixlen) {
+        /* Prefix present, or a joining node which can take a value */
+        if (node->value == NIL) {
+            if (trie->num_free_values == 0) {
+                return -1;
+            }
+            node->value = _alloc_value(trie);
+            *inserted = true;
+        }
+        return node->value;
+    }
+
+    /* Capacity is sufficient for any arrangement of max_prefixes values */
+    if (trie->num_free_values == 0) {
+        return -1;
+    }
+    uint16_t value = _alloc_value(trie);
+    uint16_t index = _alloc_node(trie, data, prefixlen, value);
+    *inserted = true;
+
+    if (*slot == NIL) {
+        *slot = index;
+    } else if (match == prefixlen) {
+        /* New prefix is above existing node */
+        _node(trie, index)->child[_bit(node->data, prefixlen)] = *slot;
+        *slot = index;
+    } else {
+        /* Prefixes diverge, so join them */
+        uint16_t join = _alloc_node(trie, data, match, NIL);
+        node_t *join_node = _node(trie, join);
+        join_node->child[_bit(node->data, match)] = *slot;
+        join_node->child[_bit(data, match)] = index;
+        *slot = join;
+    }
+    return value;
+}
+
+int lpm_trie_remove(lpm_trie_t *trie, const uint8_t *data, unsigned prefixlen)
+{
+    uint16_t *parent_slot = NULL;
+    uint16_t *slot = &trie->root;
+    while (*slot != NIL) {
+        node_t *node = _node(trie, *slot);
+        if (node->prefixlen > prefixlen ||
+            _match_len(node->data, data, node->prefixlen) != node->prefixlen) {
+            return -1;
+        }
+        if (node->prefixlen == prefixlen) {
+            break;
+        }
+        parent_slot = slot;
+        slot = &node->child[_bit(data, node->prefixlen)];
+    }
+    if (*slot == NIL) {
+        return -1;
+    }
+    uint16_t index = *slot;
+    node_t *node = _node(trie, index);
+    uint16_t value = node->value;
+    if (value == NIL) {
+        return -1;
+    }
+    _free_value(trie, value);
+
+    /* Node still joins two branches */
+    if (node->child[0] != NIL && node->child[1] != NIL) {
+        node->value = NIL;
+        return value;
+    }
+
+    uint16_t child = (node->child[0] != NIL) ? node->child[0] : node->child[1];
+    *slot = child;
+    _free_node(trie, index);
+
+    /* A joining parent left with a single branch is no longer needed */
+    if (child == NIL && parent_slot != NULL) {
+        uint16_t parent = *parent_slot;
+        node_t *parent_node = _node(trie, parent);
+        if (parent_node->value == NIL) {
+            *parent_slot = (parent_node->child[0] != NIL) ? parent_node->child[0] : parent_node->child[1];
+            _free_node(trie, parent);
+        }
+    }
+    return value;
+}
+
+int lpm_trie_next(const lpm_trie_t *trie, const uint8_t *data, unsigned prefixlen,
+                  uint8_t *next_data, unsigned *next_prefixlen)
+{
+    size_t index = 0;
+    if (data) {
+        uint16_t prev = _find_node(trie, data, prefixlen);
+        index = (prev == NIL) ? 0 : prev + 1;
+    }
+    size_t capacity = _node_capacity(trie->max_prefixes);
+    for (; index < capacity; index++) {
+        const node_t *node = _node(trie, index);
+        if (node->value != NIL) {
+            memmove(next_data, node->data, trie->data_size);
+            *next_prefixlen = node->prefixlen;
+            return 0;
+        }
+    }
+    return -1;
+}
+
+size_t lpm_trie_nodes_used(const lpm_trie_t *trie)
+{
+    size_t capacity = _node_capacity(trie->max_prefixes);
+    size_t free_count = 0;
+    for (uint16_t index = trie->free_nodes; index != NIL && free_count < capacity;
+         index = _node(trie, index)->child[0]) {
+        free_count++;
+    }
+    return capacity - free_count;
+}
@@ -0,0 +1,1071 @@
+#include <stdint.h>
+#include <stddef.h>
+#include <stdbool.h>
+#include <stdlib.h>
+#include <string.h>
+#include "bpf.h"
+#include "include/bpf/map.h"
+#include "include/bpf/lpm.h"
+#include "include/bpf/ringbuf.h"
+#include "include/bpf/queue.h"
+#include "include/bpf/sync.h"
+#include <debug_progmem.h>
+
+struct bpf_map {
+    bpf_mem_region_t region;    ///< Values, accessible to the container
+    const char *name;
+    uint8_t *keys;              ///< Hash maps only
+    uint32_t *slots;            ///< Hash maps only, value number + 1 for each slot, 0 if empty
+    uint32_t *spare;            ///< Hash maps only, value numbers not in use
+    lpm_trie_t lpm;             ///< LPM tries only
+    ringbuf_t ring;             ///< Ring buffers only, the region covers the reserved record
+    struct shared_queue *queue; ///< Queues only
+    bpf_map_notify_t notify;    ///< Ring buffers only
+    void *notify_param;
+    uint32_t private_size;      ///< Bytes of data for maps without values
+    uint32_t interval;          ///< Linear histogram bucket width, or window slot duration in ms
+    uint8_t hashes;             ///< Sketches only, number of hashes or rows
+    uint32_t capacity;          ///< Number of slots
+    uint32_t count;             ///< Number of keys in use
+    uint32_t key_size;
+    uint32_t value_size;
+    uint32_t value_stride;      ///< Spacing of values, keeping them aligned
+    uint32_t max_entries;
+    uint8_t type;
+};
+
+static bool _is_hash(const bpf_map_t *map)
+{
+    return map->type == BPF_MAP_TYPE_HASH || map->type == BPF_MAP_TYPE_COUNTER;
+}
+
+/* Sketches and aggregates have no values, and their data is not accessible to the container */
+static bool _is_private(const bpf_map_t *map)
+{
+    return map->type >= BPF_MAP_TYPE_BLOOM_FILTER;
+}
+
+typedef struct {
+    bpf_map_histogram_t stats;
+    uint32_t buckets[];
+} histogram_t;
+
+typedef struct {
+    uint32_t epoch;             ///< Time divided by the slot duration
+    uint32_t count;
+} window_slot_t;
+
+/*
+ * Queues are shared by all maps with the same name, and freed with the last of them.
+ * The first map to push becomes the producer and the first to pop the consumer,
+ * until destroyed, so a second instance of a container cannot race with the first.
+ */
+typedef struct shared_queue {
+    struct shared_queue *next;
+    spsc_queue_t queue;
+    uint32_t refs;
+    const bpf_map_t *producer;  ///< Only map which may push, NULL until claimed
+    const bpf_map_t *consumer;  ///< Only map which may pop or drain, NULL until claimed
+    bpf_map_notify_t notify;
+    void *notify_param;
+    bpf_map_t *notify_map;      ///< Map passed to notify
+    char name[];                ///< Followed by slots
+} shared_queue_t;
+
+static shared_queue_t *_queues;
+static bpf_mutex_t _queues_lock = BPF_MUTEX_INIT;
+
+static uint32_t _add_sat(uint32_t a, uint32_t b)
+{
+    return (b > UINT32_MAX - a) ? UINT32_MAX : a + b;
+}
+
+static uint8_t *_value(const bpf_map_t *map, uint32_t slot)
+{
+    return (uint8_t *)map->region.phys_start + slot * map->value_stride;
+}
+
+static uint8_t *_key(const bpf_map_t *map, uint32_t slot)
+{
+    return map->keys + slot * map->key_size;
+}
+
+static uint8_t *_slot_value(const bpf_map_t *map, uint32_t slot)
+{
+    return _value(map, map->slots[slot] - 1);
+}
+
+/* FNV-1a, finished with a multiply so low bits depend on the whole key */
+static uint32_t _hash(const void *key, size_t len)
+{
+    const uint8_t *p = key;
+    uint32_t h = 2166136261U;
+    while (len--) {
+        h = (h ^ *p++) * 16777619U;
+    }
+    h ^= h >> 16;
+    return h * 0x45d9f3bU;
+}
+
+/* SplitMix64 finaliser */
+static uint64_t _mix64(uint64_t h)
+{
+    h = (h ^ (h >> 30)) * 0xbf58476d1ce4e5b9ULL;
+    h = (h ^ (h >> 27)) * 0x94d049bb133111ebULL;
+    return h ^ (h >> 31);
+}
+
+/*
+ * 64-bit FNV-1a, mixed. Bloom filters derive each of their bit positions from
+ * the two halves (Kirsch-Mitzenmacher double hashing).
+ */
+static uint64_t _hash64(const void *key, size_t len)
+{
+    const uint8_t *p = key;
+    uint64_t h = 14695981039346656037ULL;
+    while (len--) {
+        h = (h ^ *p++) * 1099511628211ULL;
+    }
+    return _mix64(h);
+}
+
+/*
+ * Locate key, returning its slot or capacity if not found.
+ * If vacant is given it receives the empty slot which ended the probe.
+ * There is always one, as tables are never full.
+ */
+static uint32_t _find(const bpf_map_t *map, const void *key, uint32_t *vacant)
+{
+    uint32_t mask = map->capacity - 1;
+    uint32_t slot = _hash(key, map->key_size) & mask;
+    while (map->slots[slot] != 0) {
+        if (memcmp(_key(map, slot), key, map->key_size) == 0) {
+            return slot;
+        }
+        slot = (slot + 1) & mask;
+    }
+    if (vacant) {
+        *vacant = slot;
+    }
+    return map->capacity;
+}
+
+/*
+ * Empty a slot by backward shift, as in hashmap_impl.h, so no removed markers
+ * are left to lengthen later probes. Each following key up to an empty slot
+ * moves into the gap if that is no earlier than its home slot. Only keys and
+ * value numbers move, so values stay where the container found them.
+ */
+static void _vacate(bpf_map_t *map, uint32_t slot)
+{
+    uint32_t mask = map->capacity - 1;
+    for (uint32_t next = (slot + 1) & mask; map->slots[next] != 0; next = (next + 1) & mask) {
+        uint32_t home = _hash(_key(map, next), map->key_size) & mask;
+        if (((next - home) & mask) >= ((next - slot) & mask)) {
+            memcpy(_key(map, slot), _key(map, next), map->key_size);
+            map->slots[slot] = map->slots[next];
+            slot = next;
+        }
+    }
+    map->slots[slot] = 0;
+}
+
+/*
+ * LPM trie keys are a uint32_t prefix length followed by the data.
+ * Lookups find the longest matching prefix, insertions use the exact prefix.
+ */
+static uint8_t *_access_lpm(bpf_map_t *map, const void *key, bool insert)
+{
+    uint32_t prefixlen;
+    memcpy(&prefixlen, key, sizeof(prefixlen));
+    if (prefixlen > map->lpm.data_size * 8U) {
+        return NULL;
+    }
+    const uint8_t *data = (const uint8_t *)key + sizeof(prefixlen);
+    if (!insert) {
+        int value = lpm_trie_lookup(&map->lpm, data, prefixlen);
+        return (value < 0) ? NULL : _value(map, value);
+    }
+    bool inserted;
+    int value = lpm_trie_insert(&map->lpm, data, prefixlen, &inserted);
+    if (value < 0) {
+        return NULL;
+    }
+    uint8_t *ptr = _value(map, value);
+    if (inserted) {
+        memset(ptr, 0, map->value_size);
+    }
+    return ptr;
+}
+
+/* Locate value for key, inserting it with a zero value if permitted */
+static uint8_t *_access(bpf_map_t *map, const void *key, bool insert)
+{
+    if (_is_private(map)) {
+        return NULL;
+    }
+    if (map->type == BPF_MAP_TYPE_ARRAY) {
+        uint32_t index;
+        memcpy(&index, key, sizeof(index));
+        return (index < map->capacity) ? _value(map, index) : NULL;
+    }
+    if (map->type == BPF_MAP_TYPE_LPM_TRIE) {
+        return _access_lpm(map, key, insert);
+    }
+
+    uint32_t vacant;
+    uint32_t slot = _find(map, key, &vacant);
+    if (slot < map->capacity) {
+        return _slot_value(map, slot);
+    }
+    if (!insert || map->count >= map->max_entries) {
+        return NULL;
+    }
+    ++map->count;
+    map->slots[vacant] = map->spare[map->max_entries - map->count] + 1;
+    memcpy(_key(map, vacant), key, map->key_size);
+    uint8_t *value = _slot_value(map, vacant);
+    memset(value, 0, map->value_size);
+    return value;
+}
+
+static bool _check_def(const rbpf_map_t *def, const char *rodata, size_t rodata_len)
+{
+    if (def->name_offset >= rodata_len ||
+        memchr(rodata + def->name_offset, '\0', rodata_len - def->name_offset) == NULL) {
+        return false;
+    }
+    if (def->max_entries == 0) {
+        return false;
+    }
+    /* Only log2 histograms and ring buffers have no value size */
+    if (def->value_size == 0 && def->type != BPF_MAP_TYPE_HISTOGRAM && def->type != BPF_MAP_TYPE_RINGBUF) {
+        return false;
+    }
+    switch (def->type) {
+    case BPF_MAP_TYPE_ARRAY:
+        return def->key_size == sizeof(uint32_t);
+    case BPF_MAP_TYPE_COUNTER:
+        if (def->value_size != sizeof(uint64_t)) {
+            return false;
+        }
+        /* fall-through */
+    case BPF_MAP_TYPE_HASH:
+        return def->key_size != 0 && def->key_size <= CONFIG_BPF_MAP_KEY_MAX;
+    case BPF_MAP_TYPE_LPM_TRIE:
+        return def->key_size > sizeof(uint32_t) && def->key_size <= CONFIG_BPF_MAP_KEY_MAX &&
+               def->max_entries <= LPM_TRIE_MAX_PREFIXES;
+    case BPF_MAP_TYPE_BLOOM_FILTER:
+    case BPF_MAP_TYPE_COUNT_MIN:
+        /* value_size gives the number of hashes or rows */
+        return def->key_size != 0 && def->key_size <= CONFIG_BPF_MAP_KEY_MAX &&
+               def->value_size <= BPF_MAP_SKETCH_HASHES_MAX &&
+               def->max_entries <= CONFIG_BPF_MAP_SIZE_MAX;
+    case BPF_MAP_TYPE_HISTOGRAM:
+        /* value_size gives the linear bucket width, 0 for log2 buckets */
+        return def->key_size == 0 &&
+               def->max_entries <= (def->value_size ? CONFIG_BPF_MAP_SIZE_MAX : BPF_MAP_LOG2_BUCKETS_MAX);
+    case BPF_MAP_TYPE_WINDOW:
+        /* value_size gives the slot duration */
+        return def->key_size == 0 && def->max_entries <= CONFIG_BPF_MAP_SIZE_MAX;
+    case BPF_MAP_TYPE_QUEUE:
+        return def->key_size == 0 && def->max_entries <= CONFIG_BPF_MAP_SIZE_MAX &&
+               def->value_size <= CONFIG_BPF_MAP_SIZE_MAX;
+    case BPF_MAP_TYPE_RINGBUF:
+        /* max_entries gives the size in bytes */
+        return def->key_size == 0 && def->value_size == 0 && def->max_entries <= CONFIG_BPF_MAP_SIZE_MAX;
+    default:
+        return false;
+    }
+}
+
+/*
+ * Bloom filters get a power of 2 number of bits, at least max_entries * hashes / ln(2),
+ * which gives a false positive rate of about 2^-hashes once max_entries keys are added.
+ * Count-min sketches have a row of width max_entries, rounded up, for each hash.
+ * Histograms have max_entries buckets and windows max_entries slots.
+ */
+static bool _create_private(bpf_map_t *map, const rbpf_map_t *def, unsigned index)
+{
+    uint32_t width;
+    size_t size;
+    switch (def->type) {
+    case BPF_MAP_TYPE_BLOOM_FILTER: {
+        uint64_t min = (uint64_t)def->max_entries * def->value_size * 1443U / 1000U;
+        for (width = 32; width < min && width / 8 <= CONFIG_BPF_MAP_SIZE_MAX; width <<= 1) {
+        }
+        size = width / 8;
+        map->hashes = def->value_size;
+        break;
+    }
+    case BPF_MAP_TYPE_COUNT_MIN:
+        for (width = 4; width < def->max_entries && width <= CONFIG_BPF_MAP_SIZE_MAX; width <<= 1) {
+        }
+        size = (size_t)width * def->value_size * sizeof(uint32_t);
+        map->hashes = def->value_size;
+        break;
+    case BPF_MAP_TYPE_HISTOGRAM:
+        width = def->max_entries;
+        size = sizeof(histogram_t) + (size_t)width * sizeof(uint32_t);
+        map->interval = def->value_size;
+        break;
+    case BPF_MAP_TYPE_WINDOW:
+        width = def->max_entries;
+        size = (size_t)width * sizeof(window_slot_t);
+        map->interval = def->value_size;
+        break;
+    default:
+        for (width = RINGBUF_SIZE_MIN; width < def->max_entries && width <= CONFIG_BPF_MAP_SIZE_MAX;
+             width <<= 1) {
+        }
+        size = width;
+        break;
+    }
+    if (size > CONFIG_BPF_MAP_SIZE_MAX) {
+        debug_e("[MAP] #%u too large", index);
+        return false;
+    }
+    uint8_t *mem = calloc(1, size);
+    if (mem == NULL) {
+        debug_e("[MAP] No memory for #%u", index);
+        return false;
+    }
+    map->capacity = width;
+    map->private_size = size;
+    if (def->type == BPF_MAP_TYPE_RINGBUF) {
+        ringbuf_init(&map->ring, mem, size);
+        map->region.flag = BPF_MEM_REGION_READ | BPF_MEM_REGION_WRITE;
+        return true;
+    }
+    /* Not accessible to the container */
+    map->region.phys_start = mem;
+    return true;
+}
+
+/* Find or create the shared queue for a map */
+static bool _attach_queue(bpf_map_t *map, const rbpf_map_t *def, unsigned index)
+{
+    uint32_t capacity;
+    for (capacity = 1; capacity < def->max_entries; capacity <<= 1) {
+    }
+    if ((uint64_t)capacity * def->value_size > CONFIG_BPF_MAP_SIZE_MAX) {
+        debug_e("[MAP] #%u too large", index);
+        return false;
+    }
+
+    bpf_mutex_lock(&_queues_lock);
+    shared_queue_t *q;
+    for (q = _queues; q != NULL; q = q->next) {
+        if (strcmp_P(q->name, map->name) == 0) {
+            break;
+        }
+    }
+    if (q != NULL) {
+        if (q->queue.record_size != def->value_size || q->queue.capacity != capacity) {
+            bpf_mutex_unlock(&_queues_lock);
+            debug_e("[MAP] #%u does not match existing queue", index);
+            return false;
+        }
+        ++q->refs;
+    } else {
+        size_t name_size = (strlen_P(map->name) + 1 + 7) & ~7U;
+        q = calloc(1, sizeof(shared_queue_t) + name_size + (size_t)capacity * def->value_size);
+        if (q == NULL) {
+            bpf_mutex_unlock(&_queues_lock);
+            debug_e("[MAP] No memory for #%u", index);
+            return false;
+        }
+        memcpy_P(q->name, map->name, strlen_P(map->name) + 1);
+        spsc_queue_init(&q->queue, q->name + name_size, def->value_size, capacity);
+        q->refs = 1;
+        q->next = _queues;
+        _queues = q;
+    }
+    bpf_mutex_unlock(&_queues_lock);
+
+    map->queue = q;
+    map->capacity = capacity;
+    map->max_entries = capacity;
+    map->value_size = def->value_size;
+    return true;
+}
+
+static void _detach_queue(bpf_map_t *map)
+{
+    shared_queue_t *q = map->queue;
+    if (q == NULL) {
+        return;
+    }
+    bpf_mutex_lock(&_queues_lock);
+    if (q->notify_map == map) {
+        q->notify = NULL;
+        q->notify_map = NULL;
+    }
+    if (q->producer == map) {
+        bpf_atomic_store_seq_cst(&q->producer, NULL);
+    }
+    if (q->consumer == map) {
+        bpf_atomic_store_seq_cst(&q->consumer, NULL);
+    }
+    if (--q->refs == 0) {
+        shared_queue_t **prev = &_queues;
+        while (*prev != q) {
+            prev = &(*prev)->next;
+        }
+        *prev = q->next;
+        free(q);
+    }
+    bpf_mutex_unlock(&_queues_lock);
+    map->queue = NULL;
+}
+
+/* All values are unused, taken from the end of the spare list in order */
+static void _reset_spare(bpf_map_t *map)
+{
+    for (uint32_t i = 0; i < map->max_entries; i++) {
+        map->spare[i] = map->max_entries - 1 - i;
+    }
+}
+
+/* Allocate storage for a validated map definition */
+static bool _create(bpf_map_t *map, const rbpf_map_t *def, const char *name, unsigned index)
+{
+    map->name = name;
+    map->type = def->type;
+    map->key_size = def->key_size;
+    map->max_entries = def->max_entries;
+    if (map->type == BPF_MAP_TYPE_QUEUE) {
+        return _attach_queue(map, def, index);
+    }
+    if (_is_private(map)) {
+        return _create_private(map, def, index);
+    }
+    map->value_size = def->value_size;
+    map->value_stride = (def->value_size <= 4) ? 4 : (def->value_size + 7) & ~7U;
+
+    /*
+     * Hash tables are kept at most 3/4 full, and always have a free slot to end a probe.
+     * Slots refer to values, of which there are max_entries, so values never move.
+     */
+    uint32_t capacity = def->max_entries;
+    if (_is_hash(map)) {
+        uint32_t min = def->max_entries + def->max_entries / 3 + 1;
+        for (capacity = 4; capacity < min && capacity <= CONFIG_BPF_MAP_SIZE_MAX; capacity <<= 1) {
+        }
+    }
+    if (def->max_entries > CONFIG_BPF_MAP_SIZE_MAX / map->value_stride ||
+        capacity > CONFIG_BPF_MAP_SIZE_MAX) {
+        debug_e("[MAP] #%u too large", index);
+        return false;
+    }
+    size_t values_size = def->max_entries * map->value_stride;
+    size_t size = values_size;
+    if (_is_hash(map)) {
+        size += capacity * (sizeof(uint32_t) + map->key_size) + def->max_entries * sizeof(uint32_t);
+    } else if (map->type == BPF_MAP_TYPE_LPM_TRIE) {
+        size += lpm_trie_mem_size(map->key_size - sizeof(uint32_t), capacity);
+    }
+    if (size > CONFIG_BPF_MAP_SIZE_MAX) {
+        debug_e("[MAP] #%u too large", index);
+        return false;
+    }
+
+    uint8_t *mem = calloc(1, size);
+    if (mem == NULL) {
+        debug_e("[MAP] No memory for #%u", index);
+        return false;
+    }
+    map->capacity = capacity;
+    if (_is_hash(map)) {
+        /* Values are 4-byte aligned, so the slot and spare arrays go first */
+        map->slots = (uint32_t *)(mem + values_size);
+        map->spare = map->slots + capacity;
+        map->keys = (uint8_t *)(map->spare + def->max_entries);
+        _reset_spare(map);
+    } else if (map->type == BPF_MAP_TYPE_LPM_TRIE) {
+        lpm_trie_init(&map->lpm, mem + values_size, map->key_size - sizeof(uint32_t), capacity);
+    } else {
+        map->count = capacity;
+    }
+    map->region.start = map->region.phys_start = mem;
+    map->region.len = values_size;
+    map->region.flag = BPF_MEM_REGION_READ | BPF_MEM_REGION_WRITE;
+    return true;
+}
+
+int bpf_map_setup(bpf_t *bpf)
+{
+    rbpf_header_t hdr = rbpf_header(bpf);
+    if ((hdr.flags & RBPF_FLAG_MAPS) == 0) {
+        return 0;
+    }
+
+    /* Map table follows function table */
+    uint64_t table = sizeof(rbpf_header_t) + (uint64_t)hdr.data_len + hdr.rodata_len +
+                     hdr.text_len + (uint64_t)hdr.functions * sizeof(rbpf_function_t);
+    uint32_t num_maps;
+    if (table + sizeof(num_maps) > bpf->application_len) {
+        debug_e("[MAP] Table missing");
+        return -1;
+    }
+    size_t offset = (size_t)table;
+    memcpy(&num_maps, bpf->application + offset, sizeof(num_maps));
+    offset += sizeof(num_maps);
+    if (num_maps > (bpf->application_len - offset) / sizeof(rbpf_map_t)) {
+        debug_e("[MAP] Table truncated");
+        return -1;
+    }
+    if (num_maps == 0) {
+        return 0;
+    }
+
+    bpf_map_t *maps = calloc(num_maps, sizeof(bpf_map_t));
+    if (maps == NULL) {
+        return -1;
+    }
+    bpf->maps = maps;
+    bpf->num_maps = num_maps;
+
+    const char *rodata = rbpf_rodata(bpf);
+    for (uint32_t i = 0; i < num_maps; i++) {
+        rbpf_map_t def;
+        memcpy(&def, bpf->application + offset + i * sizeof(def), sizeof(def));
+        if (!_check_def(&def, rodata, hdr.rodata_len)) {
+            debug_e("[MAP] Invalid definition #%u", (unsigned)i);
+            bpf_map_destroy(bpf);
+            return -1;
+        }
+        bpf_map_t *map = &maps[i];
+        if (!_create(map, &def, rodata + def.name_offset, i)) {
+            bpf_map_destroy(bpf);
+            return -1;
+        }
+        /* A ring buffer region is empty until a record is reserved */
+        if (map->region.len != 0 || map->type == BPF_MAP_TYPE_RINGBUF) {
+            bpf_add_region(bpf, &map->region, (void *)map->region.phys_start, map->region.len,
+                           map->region.flag);
+        }
+    }
+
+    return 0;
+}
+
+void bpf_map_destroy(bpf_t *bpf)
+{
+    for (uint32_t i = 0; i < bpf->num_maps; i++) {
+        bpf_map_t *map = &bpf->maps[i];
+        if (map->type == BPF_MAP_TYPE_QUEUE) {
+            _detach_queue(map);
+        } else {
+            free(map->type == BPF_MAP_TYPE_RINGBUF ? map->ring.data : (void *)map->region.phys_start);
+        }
+    }
+    free(bpf->maps);
+    bpf->maps = NULL;
+    bpf->num_maps = 0;
+}
+
+size_t bpf_map_count(const bpf_t *bpf)
+{
+    return bpf->num_maps;
+}
+
+bpf_map_t *bpf_map_get(const bpf_t *bpf, uint32_t index)
+{
+    return (index < bpf->num_maps) ? &bpf->maps[index] : NULL;
+}
+
+bpf_map_t *bpf_map_find(const bpf_t *bpf, const char *name)
+{
+    for (uint32_t i = 0; i < bpf->num_maps; i++) {
+        /* Names are in the container image, which may be in flash */
+        if (strcmp_P(name, bpf->maps[i].name) == 0) {
+            return &bpf->maps[i];
+        }
+    }
+    return NULL;
+}
+
+const char *bpf_map_name(const bpf_map_t *map)
+{
+    return map->name;
+}
+
+bpf_map_type_t bpf_map_type(const bpf_map_t *map)
+{
+    return map->type;
+}
+
+size_t bpf_map_key_size(const bpf_map_t *map)
+{
+    return map->key_size;
+}
+
+size_t bpf_map_value_size(const bpf_map_t *map)
+{
+    return map->value_size;
+}
+
+size_t bpf_map_max_entries(const bpf_map_t *map)
+{
+    return map->max_entries;
+}
+
+size_t bpf_map_entries(const bpf_map_t *map)
+{
+    if (map->type == BPF_MAP_TYPE_LPM_TRIE) {
+        return map->lpm.count;
+    }
+    if (map->type == BPF_MAP_TYPE_RINGBUF) {
+        return bpf_atomic_load(&map->ring.submitted);
+    }
+    if (map->type == BPF_MAP_TYPE_QUEUE) {
+        return spsc_queue_count(&map->queue->queue);
+    }
+    return map->count;
+}
+
+void *bpf_map_lookup(bpf_map_t *map, const void *key)
+{
+    return _access(map, key, false);
+}
+
+int bpf_map_update(bpf_map_t *map, const void *key, const void *value)
+{
+    uint8_t *ptr = _access(map, key, true);
+    if (ptr == NULL) {
+        return -1;
+    }
+    memmove(ptr, value, map->value_size);
+    return 0;
+}
+
+int bpf_map_remove(bpf_map_t *map, const void *key)
+{
+    if (map->type == BPF_MAP_TYPE_LPM_TRIE) {
+        uint32_t prefixlen;
+        memcpy(&prefixlen, key, sizeof(prefixlen));
+        if (prefixlen > map->lpm.data_size * 8U) {
+            return -1;
+        }
+        return lpm_trie_remove(&map->lpm, (const uint8_t *)key + sizeof(prefixlen), prefixlen) < 0 ? -1 : 0;
+    }
+    if (!_is_hash(map)) {
+        return -1;
+    }
+    uint32_t slot = _find(map, key, NULL);
+    if (slot == map->capacity) {
+        return -1;
+    }
+    map->spare[map->max_entries - map->count] = map->slots[slot] - 1;
+    --map->count;
+    _vacate(map, slot);
+    return 0;
+}
+
+int bpf_map_add(bpf_map_t *map, const void *key, uint64_t delta)
+{
+    if (map->value_size != sizeof(uint64_t)) {
+        return -1;
+    }
+    uint8_t *ptr = _access(map, key, true);
+    if (ptr == NULL) {
+        return -1;
+    }
+    /* Values are 8-byte aligned */
+    *(uint64_t *)ptr += delta;
+    return 0;
+}
+
+static int _next_key_lpm(const bpf_map_t *map, const void *key, void *next)
+{
+    const uint8_t *data = NULL;
+    uint32_t prefixlen = 0;
+    if (key) {
+        memcpy(&prefixlen, key, sizeof(prefixlen));
+        data = (const uint8_t *)key + sizeof(prefixlen);
+    }
+    if (prefixlen > map->lpm.data_size * 8U) {
+        data = NULL;
+    }
+    unsigned next_prefixlen;
+    if (lpm_trie_next(&map->lpm, data, prefixlen, (uint8_t *)next + sizeof(prefixlen), &next_prefixlen) < 0) {
+        return -1;
+    }
+    prefixlen = next_prefixlen;
+    memcpy(next, &prefixlen, sizeof(prefixlen));
+    return 0;
+}
+
+int bpf_map_next_key(const bpf_map_t *map, const void *key, void *next)
+{
+    if (_is_private(map)) {
+        return -1;
+    }
+    if (map->type == BPF_MAP_TYPE_LPM_TRIE) {
+        return _next_key_lpm(map, key, next);
+    }
+    if (!_is_hash(map)) {
+        uint32_t index = 0;
+        if (key) {
+            memcpy(&index, key, sizeof(index));
+            ++index;
+        }
+        if (index >= map->capacity) {
+            return -1;
+        }
+        memcpy(next, &index, sizeof(index));
+        return 0;
+    }
+
+    uint32_t slot = 0;
+    if (key) {
+        slot = _find(map, key, NULL);
+        slot = (slot == map->capacity) ? 0 : slot + 1;
+    }
+    for (; slot < map->capacity; slot++) {
+        if (map->slots[slot] != 0) {
+            memmove(next, _key(map, slot), map->key_size);
+            return 0;
+        }
+    }
+    return -1;
+}
+
+/* Take the producer or consumer role for a queue, false if another map has it */
+static bool _claim(const bpf_map_t **role, const bpf_map_t *map)
+{
+    const bpf_map_t *owner = bpf_atomic_load_acquire(role);
+    if (owner == NULL && bpf_atomic_cas(role, &owner, map)) {
+        return true;
+    }
+    return owner == map;
+}
+
+void bpf_map_clear(bpf_map_t *map)
+{
+    if (map->type == BPF_MAP_TYPE_QUEUE) {
+        if (_claim(&map->queue->consumer, map)) {
+            spsc_queue_drain(&map->queue->queue);
+        }
+        return;
+    }
+    if (map->type == BPF_MAP_TYPE_RINGBUF) {
+        ringbuf_init(&map->ring, map->ring.data, map->ring.size);
+        map->region.len = 0;
+        return;
+    }
+    memset((void *)map->region.phys_start, 0, map->region.len);
+    if (_is_private(map)) {
+        memset((void *)map->region.phys_start, 0, map->private_size);
+        map->count = 0;
+    } else if (_is_hash(map)) {
+        memset(map->slots, 0, map->capacity * sizeof(uint32_t));
+        _reset_spare(map);
+        map->count = 0;
+    } else if (map->type == BPF_MAP_TYPE_LPM_TRIE) {
+        lpm_trie_clear(&map->lpm);
+    }
+}
+
+int bpf_map_bloom_add(bpf_map_t *map, const void *key)
+{
+    if (map->type != BPF_MAP_TYPE_BLOOM_FILTER) {
+        return -1;
+    }
+    uint8_t *bits = (uint8_t *)map->region.phys_start;
+    uint64_t h = _hash64(key, map->key_size);
+    uint32_t h1 = h;
+    uint32_t h2 = (h >> 32) | 1;
+    uint8_t changed = 0;
+    for (unsigned i = 0; i < map->hashes; i++) {
+        uint32_t bit = (h1 + i * h2) & (map->capacity - 1);
+        uint8_t mask = 1U << (bit % 8);
+        changed |= ~bits[bit / 8] & mask;
+        bits[bit / 8] |= mask;
+    }
+    /* Counts distinct keys, less any false positives */
+    if (changed) {
+        ++map->count;
+    }
+    return 0;
+}
+
+int bpf_map_bloom_test(const bpf_map_t *map, const void *key)
+{
+    if (map->type != BPF_MAP_TYPE_BLOOM_FILTER) {
+        return -1;
+    }
+    const uint8_t *bits = map->region.phys_start;
+    uint64_t h = _hash64(key, map->key_size);
+    uint32_t h1 = h;
+    uint32_t h2 = (h >> 32) | 1;
+    for (unsigned i = 0; i < map->hashes; i++) {
+        uint32_t bit = (h1 + i * h2) & (map->capacity - 1);
+        if ((bits[bit / 8] & (1U << (bit % 8))) == 0) {
+            return 0;
+        }
+    }
+    return 1;
+}
+
+/*
+ * Visit the counter for key in each row, returning the smallest.
+ * Rows are hashed separately: with double hashing, keys which collide in
+ * the first two rows of a narrow sketch would collide in all of them.
+ */
+static uint32_t _sketch_min(const bpf_map_t *map, const void *key, uint32_t **cells)
+{
+    uint32_t *counters = (uint32_t *)map->region.phys_start;
+    uint64_t h = _hash64(key, map->key_size);
+    uint32_t min = UINT32_MAX;
+    for (unsigned row = 0; row < map->hashes; row++) {
+        uint32_t col = _mix64(h + row * 0x9e3779b97f4a7c15ULL) & (map->capacity - 1);
+        uint32_t *cell = &counters[row * map->capacity + col];
+        if (*cell < min) {
+            min = *cell;
+        }
+        cells[row] = cell;
+    }
+    return min;
+}
+
+uint32_t bpf_map_sketch_add(bpf_map_t *map, const void *key, uint32_t count)
+{
+    if (map->type != BPF_MAP_TYPE_COUNT_MIN) {
+        return 0;
+    }
+    uint32_t *cells[BPF_MAP_SKETCH_HASHES_MAX];
+    uint32_t estimate = _sketch_min(map, key, cells);
+    estimate = _add_sat(estimate, count);
+    /* Conservative update: counters already above the new estimate are not raised */
+    for (unsigned row = 0; row < map->hashes; row++) {
+        if (*cells[row] < estimate) {
+            *cells[row] = estimate;
+        }
+    }
+    map->count = _add_sat(map->count, count);
+    return estimate;
+}
+
+uint32_t bpf_map_sketch_estimate(const bpf_map_t *map, const void *key)
+{
+    if (map->type != BPF_MAP_TYPE_COUNT_MIN) {
+        return 0;
+    }
+    uint32_t *cells[BPF_MAP_SKETCH_HASHES_MAX];
+    return _sketch_min(map, key, cells);
+}
+
+/* Bucket 0 holds zero values, bucket n values from 2^(n-1) to 2^n - 1, and the last any larger */
+static uint32_t _bucket(const bpf_map_t *map, uint32_t value)
+{
+    uint32_t bucket;
+    if (map->interval != 0) {
+        bucket = value / map->interval;
+    } else {
+        bucket = (value == 0) ? 0 : 32 - __builtin_clz(value);
+    }
+    return (bucket < map->capacity) ? bucket : map->capacity - 1;
+}
+
+int bpf_map_histogram_add(bpf_map_t *map, uint32_t value)
+{
+    if (map->type != BPF_MAP_TYPE_HISTOGRAM) {
+        return -1;
+    }
+    histogram_t *hist = (histogram_t *)map->region.phys_start;
+    bpf_map_histogram_t *stats = &hist->stats;
+    if (stats->count == 0 || value < stats->min) {
+        stats->min = value;
+    }
+    if (value > stats->max) {
+        stats->max = value;
+    }
+    stats->sum += value;
+    stats->count = _add_sat(stats->count, 1);
+    map->count = stats->count;
+    uint32_t *bucket = &hist->buckets[_bucket(map, value)];
+    *bucket = _add_sat(*bucket, 1);
+    return 0;
+}
+
+size_t bpf_map_histogram_read(const bpf_map_t *map, bpf_map_histogram_t *stats, uint32_t *buckets,
+                              size_t max_buckets)
+{
+    if (map->type != BPF_MAP_TYPE_HISTOGRAM) {
+        return 0;
+    }
+    const histogram_t *hist = (const histogram_t *)map->region.phys_start;
+    if (stats) {
+        *stats = hist->stats;
+    }
+    if (buckets) {
+        size_t count = (max_buckets < map->capacity) ? max_buckets : map->capacity;
+        memcpy(buckets, hist->buckets, count * sizeof(uint32_t));
+    }
+    return map->capacity;
+}
+
+uint32_t bpf_map_histogram_bucket_base(const bpf_map_t *map, unsigned index)
+{
+    if (map->interval != 0) {
+        return index * map->interval;
+    }
+    return (index == 0) ? 0 : 1U << (index - 1);
+}
+
+uint32_t bpf_map_window_add(bpf_map_t *map, uint32_t now_ms, uint32_t delta)
+{
+    if (map->type != BPF_MAP_TYPE_WINDOW) {
+        return 0;
+    }
+    /* Slots are reused in turn, starting afresh when their epoch has passed */
+    window_slot_t *slots = (window_slot_t *)map->region.phys_start;
+    uint32_t epoch = now_ms / map->interval;
+    window_slot_t *slot = &slots[epoch % map->capacity];
+    if (slot->epoch != epoch) {
+        slot->epoch = epoch;
+        slot->count = 0;
+    }
+    slot->count = _add_sat(slot->count, delta);
+    map->count = _add_sat(map->count, delta);
+    return bpf_map_window_read(map, now_ms, NULL, 0);
+}
+
+uint32_t bpf_map_window_read(const bpf_map_t *map, uint32_t now_ms, uint32_t *counts, size_t max_counts)
+{
+    if (map->type != BPF_MAP_TYPE_WINDOW) {
+        return 0;
+    }
+    const window_slot_t *slots = (const window_slot_t *)map->region.phys_start;
+    uint32_t first = now_ms / map->interval - (map->capacity - 1);
+    uint32_t total = 0;
+    for (uint32_t i = 0; i < map->capacity; i++) {
+        /* Slots left from an earlier window count as zero */
+        uint32_t epoch = first + i;
+        const window_slot_t *slot = &slots[epoch % map->capacity];
+        uint32_t count = (slot->epoch == epoch) ? slot->count : 0;
+        if (i < max_counts) {
+            counts[i] = count;
+        }
+        total = _add_sat(total, count);
+    }
+    return total;
+}
+
+void *bpf_map_ringbuf_reserve(bpf_map_t *map, uint32_t len)
+{
+    if (map->type != BPF_MAP_TYPE_RINGBUF) {
+        return NULL;
+    }
+    void *record = ringbuf_reserve(&map->ring, len);
+    map->region.start = map->region.phys_start = record;
+    map->region.len = record ? len : 0;
+    return record;
+}
+
+/* Check record is the current reservation, and revoke container access to it */
+static bool _release_record(bpf_map_t *map, const void *record)
+{
+    if (map->type != BPF_MAP_TYPE_RINGBUF || map->region.len == 0 ||
+        record != map->region.phys_start) {
+        return false;
+    }
+    map->region.len = 0;
+    return true;
+}
+
+int bpf_map_ringbuf_submit(bpf_map_t *map, const void *record)
+{
+    if (!_release_record(map, record)) {
+        return -1;
+    }
+    if (ringbuf_submit(&map->ring) && map->notify) {
+        map->notify(map, map->notify_param);
+    }
+    return 0;
+}
+
+int bpf_map_ringbuf_discard(bpf_map_t *map, const void *record)
+{
+    if (!_release_record(map, record)) {
+        return -1;
+    }
+    ringbuf_discard(&map->ring);
+    return 0;
+}
+
+int bpf_map_ringbuf_output(bpf_map_t *map, const void *data, uint32_t len)
+{
+    void *record = bpf_map_ringbuf_reserve(map, len);
+    if (record == NULL) {
+        return -1;
+    }
+    /* Data may be in a discarded reservation */
+    memmove(record, data, len);
+    return bpf_map_ringbuf_submit(map, record);
+}
+
+const void *bpf_map_ringbuf_peek(bpf_map_t *map, uint32_t *len)
+{
+    return (map->type == BPF_MAP_TYPE_RINGBUF) ? ringbuf_peek(&map->ring, len) : NULL;
+}
+
+void bpf_map_ringbuf_consume(bpf_map_t *map)
+{
+    if (map->type == BPF_MAP_TYPE_RINGBUF) {
+        ringbuf_consume(&map->ring);
+    }
+}
+
+uint32_t bpf_map_ringbuf_dropped(const bpf_map_t *map)
+{
+    return (map->type == BPF_MAP_TYPE_RINGBUF) ? bpf_atomic_load(&map->ring.dropped) : 0;
+}
+
+void bpf_map_set_notify(bpf_map_t *map, bpf_map_notify_t notify, void *param)
+{
+    if (map->type == BPF_MAP_TYPE_QUEUE) {
+        bpf_mutex_lock(&_queues_lock);
+        map->queue->notify = notify;
+        map->queue->notify_param = param;
+        map->queue->notify_map = notify ? map : NULL;
+        bpf_mutex_unlock(&_queues_lock);
+        return;
+    }
+    map->notify = notify;
+    map->notify_param = param;
+}
+
+int bpf_map_queue_push(bpf_map_t *map, const void *record)
+{
+    if (map->type != BPF_MAP_TYPE_QUEUE) {
+        return -1;
+    }
+    shared_queue_t *q = map->queue;
+    bool was_empty;
+    if (!_claim(&q->producer, map) || !spsc_queue_push(&q->queue, record, &was_empty)) {
+        return -1;
+    }
+    /* Locked so the consumer's map cannot be destroyed during the callback */
+    if (was_empty) {
+        bpf_mutex_lock(&_queues_lock);
+        if (q->notify) {
+            q->notify(q->notify_map, q->notify_param);
+        }
+        bpf_mutex_unlock(&_queues_lock);
+    }
+    return 0;
+}
+
+int bpf_map_queue_pop(bpf_map_t *map, void *record)
+{
+    if (map->type != BPF_MAP_TYPE_QUEUE) {
+        return -1;
+    }
+    if (!_claim(&map->queue->consumer, map)) {
+        return -1;
+    }
+    return spsc_queue_pop(&map->queue->queue, record) ? 0 : -1;
+}
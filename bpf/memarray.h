@@ -98,11 +98,11 @@ static inline void *memarray_alloc(memarray_t *mem)
  */
 static inline void *memarray_calloc(memarray_t *mem)
 {
-    void *new = memarray_alloc(mem);
-    if (new) {
-        memset(new, 0, mem->size);
+    void *ptr = memarray_alloc(mem);
+    if (ptr) {
+        memset(ptr, 0, mem->size);
     }
-    return new;
+    return ptr;
 }
 
 /**
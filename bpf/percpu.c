@@ -0,0 +1,125 @@
+#include <stdint.h>
+#include <stddef.h>
+#include <stdbool.h>
+#include "include/bpf/percpu.h"
+
+/* Shards are kept apart so threads updating their own do not share cache lines */
+#if CONFIG_BPF_CONCURRENT
+#define SHARD_ALIGN __attribute__((aligned(BPF_SYNC_CACHE_LINE)))
+#else
+#define SHARD_ALIGN
+#endif
+
+typedef struct {
+    hashmap_t map;
+    bpf_mutex_t mutex;
+} SHARD_ALIGN shard_t;
+
+static shard_t _shards[CONFIG_BPF_PERCPU_SHARDS] = {
+    [0 ... CONFIG_BPF_PERCPU_SHARDS - 1] = { .mutex = BPF_MUTEX_INIT },
+};
+
+static shard_t *_own_shard(void)
+{
+    return &_shards[bpf_sync_thread_index() % CONFIG_BPF_PERCPU_SHARDS];
+}
+
+/* Called with the shard locked */
+static hashmap_entry_t *_access(shard_t *shard, uint32_t key)
+{
+    bool allowed = shard->map.count < CONFIG_BPF_STORE_HASH_MAX_ENTRIES;
+    bool inserted;
+    return hashmap_find_or_insert(&shard->map, key, allowed, &inserted);
+}
+
+int bpf_percpu_add(uint32_t key, uint32_t delta)
+{
+    shard_t *shard = _own_shard();
+    bpf_mutex_lock(&shard->mutex);
+    hashmap_entry_t *entry = _access(shard, key);
+    if (entry) {
+        entry->value += delta;
+    }
+    bpf_mutex_unlock(&shard->mutex);
+    return entry ? 0 : -1;
+}
+
+int bpf_percpu_update(uint32_t key, uint32_t value)
+{
+    shard_t *shard = _own_shard();
+    bpf_mutex_lock(&shard->mutex);
+    hashmap_entry_t *entry = _access(shard, key);
+    if (entry) {
+        entry->value = value;
+    }
+    bpf_mutex_unlock(&shard->mutex);
+    return entry ? 0 : -1;
+}
+
+/* Read value from one shard, returns false if key not found */
+static bool _read(shard_t *shard, uint32_t key, uint32_t *value)
+{
+    bpf_mutex_lock(&shard->mutex);
+    hashmap_entry_t *entry = hashmap_find(&shard->map, key);
+    *value = entry ? entry->value : 0;
+    bpf_mutex_unlock(&shard->mutex);
+    return entry != NULL;
+}
+
+int bpf_percpu_lookup(uint32_t key, bpf_percpu_merge_t merge, uint64_t *value)
+{
+    *value = 0;
+    if (merge > BPF_PERCPU_MAX) {
+        return -1;
+    }
+    bool found = false;
+    for (unsigned i = 0; i < CONFIG_BPF_PERCPU_SHARDS; i++) {
+        uint32_t v;
+        if (!_read(&_shards[i], key, &v)) {
+            continue;
+        }
+        if (!found || merge == BPF_PERCPU_SUM) {
+            *value += v;
+        }
+        else if ((merge == BPF_PERCPU_MIN) ? (v < *value) : (v > *value)) {
+            *value = v;
+        }
+        found = true;
+    }
+    return found ? 0 : -1;
+}
+
+int bpf_percpu_lookup_all(uint32_t key, uint32_t *values, size_t max)
+{
+    bool found = false;
+    for (unsigned i = 0; i < CONFIG_BPF_PERCPU_SHARDS; i++) {
+        uint32_t v;
+        found |= _read(&_shards[i], key, &v);
+        if (i < max) {
+            values[i] = v;
+        }
+    }
+    return found ? CONFIG_BPF_PERCPU_SHARDS : -1;
+}
+
+int bpf_percpu_remove(uint32_t key)
+{
+    bool found = false;
+    for (unsigned i = 0; i < CONFIG_BPF_PERCPU_SHARDS; i++) {
+        shard_t *shard = &_shards[i];
+        bpf_mutex_lock(&shard->mutex);
+        found |= (hashmap_remove(&shard->map, key, NULL) == HASHMAP_OK);
+        bpf_mutex_unlock(&shard->mutex);
+    }
+    return found ? 0 : -1;
+}
+
+void bpf_percpu_clear(void)
+{
+    for (unsigned i = 0; i < CONFIG_BPF_PERCPU_SHARDS; i++) {
+        shard_t *shard = &_shards[i];
+        bpf_mutex_lock(&shard->mutex);
+        hashmap_clear(&shard->map);
+        bpf_mutex_unlock(&shard->mutex);
+    }
+}
@@ -0,0 +1,298 @@
+#include <stdint.h>
+#include <stdlib.h>
+#include <string.h>
+#include <stdbool.h>
+
+#include "bpf/pool.h"
+
+#include <debug_progmem.h>
+
+struct bpf_pool_chunk {
+    memarray_t array;           ///< Free elements in this chunk
+    bpf_pool_chunk_t *prev;     ///< Partial list links
+    bpf_pool_chunk_t *next;
+    size_t in_use;              ///< Allocated elements in this chunk
+    uint64_t data[];            ///< Elements
+};
+
+static bool _contains(const bpf_pool_t *pool, const void *region, size_t num, const void *ptr)
+{
+    const uint8_t *start = region;
+    return (const uint8_t*)ptr >= start && (const uint8_t*)ptr < start + num * pool->stats.size;
+}
+
+/* Index of first chunk with address above ptr */
+static size_t _upper_bound(const bpf_pool_t *pool, const void *ptr)
+{
+    size_t lo = 0;
+    size_t hi = pool->stats.chunks;
+    while (lo < hi) {
+        size_t mid = (lo + hi) / 2;
+        if ((const void*)pool->chunks[mid] <= ptr) {
+            lo = mid + 1;
+        }
+        else {
+            hi = mid;
+        }
+    }
+    return lo;
+}
+
+static bpf_pool_chunk_t *_find_chunk(const bpf_pool_t *pool, const void *ptr)
+{
+    size_t i = _upper_bound(pool, ptr);
+    return (i == 0) ? NULL : pool->chunks[i - 1];
+}
+
+static void _link_partial(bpf_pool_t *pool, bpf_pool_chunk_t *chunk)
+{
+    chunk->prev = NULL;
+    chunk->next = pool->partial;
+    if (pool->partial) {
+        pool->partial->prev = chunk;
+    }
+    pool->partial = chunk;
+}
+
+static void _unlink_partial(bpf_pool_t *pool, bpf_pool_chunk_t *chunk)
+{
+    if (chunk->prev) {
+        chunk->prev->next = chunk->next;
+    }
+    else {
+        pool->partial = chunk->next;
+    }
+    if (chunk->next) {
+        chunk->next->prev = chunk->prev;
+    }
+}
+
+static bool _grow(bpf_pool_t *pool)
+{
+    if (pool->chunk_len == 0) {
+        return false;
+    }
+    if (pool->max != 0 && pool->stats.capacity + pool->chunk_len > pool->max) {
+        return false;
+    }
+    if (pool->stats.chunks == pool->chunks_alloc) {
+        size_t len = pool->chunks_alloc ? 2 * pool->chunks_alloc : 4;
+        bpf_pool_chunk_t **chunks = realloc(pool->chunks, len * sizeof(*chunks));
+        if (chunks == NULL) {
+            return false;
+        }
+        pool->chunks = chunks;
+        pool->chunks_alloc = len;
+    }
+    bpf_pool_chunk_t *chunk = malloc(sizeof(bpf_pool_chunk_t) + pool->chunk_len * pool->stats.size);
+    if (chunk == NULL) {
+        return false;
+    }
+    memarray_init(&chunk->array, chunk->data, pool->stats.size, pool->chunk_len);
+    chunk->in_use = 0;
+    _link_partial(pool, chunk);
+
+    size_t i = _upper_bound(pool, chunk);
+    memmove(&pool->chunks[i + 1], &pool->chunks[i], (pool->stats.chunks - i) * sizeof(*pool->chunks));
+    pool->chunks[i] = chunk;
+
+    pool->stats.capacity += pool->chunk_len;
+    bpf_atomic_add(&pool->stats.free, pool->chunk_len);
+    pool->stats.chunks++;
+    debug_d("[BPF] Pool %u: grow to %u", (unsigned)pool->stats.size,
+            (unsigned)pool->stats.capacity);
+    return true;
+}
+
+static void _release(bpf_pool_t *pool, bpf_pool_chunk_t *chunk)
+{
+    _unlink_partial(pool, chunk);
+
+    size_t i = _upper_bound(pool, chunk) - 1;
+    pool->stats.chunks--;
+    memmove(&pool->chunks[i], &pool->chunks[i + 1], (pool->stats.chunks - i) * sizeof(*pool->chunks));
+    if (pool->stats.chunks == 0) {
+        free(pool->chunks);
+        pool->chunks = NULL;
+        pool->chunks_alloc = 0;
+    }
+
+    free(chunk);
+    pool->stats.capacity -= pool->chunk_len;
+    bpf_atomic_sub(&pool->stats.free, pool->chunk_len);
+    debug_d("[BPF] Pool %u: shrink to %u", (unsigned)pool->stats.size,
+            (unsigned)pool->stats.capacity);
+}
+
+#if CONFIG_BPF_CONCURRENT
+
+/*
+ * The static region free list is a stack of element indices, linked through
+ * the first word of each free element. The head carries an update count so a
+ * pop cannot succeed against a head which was popped and pushed back meanwhile.
+ * A stale link may be read from an element another thread has just popped, but
+ * the static region is never released and the exchange then fails.
+ */
+static inline uint32_t *_link(const bpf_pool_t *pool, uint32_t index)
+{
+    return (uint32_t *)((uint8_t *)pool->data + (index - 1) * pool->stats.size);
+}
+
+static void *_static_alloc(bpf_pool_t *pool)
+{
+    uint64_t head = __atomic_load_n(&pool->free_head, __ATOMIC_ACQUIRE);
+    for (;;) {
+        uint32_t index = (uint32_t)head;
+        if (index == 0) {
+            return NULL;
+        }
+        uint32_t *elem = _link(pool, index);
+        uint64_t next = (((head >> 32) + 1) << 32) | __atomic_load_n(elem, __ATOMIC_RELAXED);
+        if (__atomic_compare_exchange_n(&pool->free_head, &head, next, true, __ATOMIC_ACQUIRE,
+                                        __ATOMIC_ACQUIRE)) {
+            return elem;
+        }
+    }
+}
+
+static void _static_free(bpf_pool_t *pool, void *ptr)
+{
+    uint32_t index = 1 + ((const uint8_t *)ptr - (const uint8_t *)pool->data) / pool->stats.size;
+    uint64_t head = __atomic_load_n(&pool->free_head, __ATOMIC_RELAXED);
+    uint64_t next;
+    do {
+        __atomic_store_n((uint32_t *)ptr, (uint32_t)head, __ATOMIC_RELAXED);
+        next = (((head >> 32) + 1) << 32) | index;
+    } while (!__atomic_compare_exchange_n(&pool->free_head, &head, next, true, __ATOMIC_RELEASE,
+                                          __ATOMIC_RELAXED));
+}
+
+static inline void _lock_chunks(bpf_pool_t *pool)
+{
+    bpf_mutex_lock(&pool->mutex);
+}
+
+static inline void _unlock_chunks(bpf_pool_t *pool)
+{
+    bpf_mutex_unlock(&pool->mutex);
+}
+
+static void _static_init(bpf_pool_t *pool)
+{
+    bpf_mutex_init(&pool->mutex);
+    for (uint32_t index = 1; index <= pool->num; index++) {
+        *_link(pool, index) = (index < pool->num) ? index + 1 : 0;
+    }
+    pool->free_head = pool->num ? 1 : 0;
+}
+
+#else
+
+static inline void *_static_alloc(bpf_pool_t *pool)
+{
+    return memarray_alloc(&pool->array);
+}
+
+static inline void _static_free(bpf_pool_t *pool, void *ptr)
+{
+    memarray_free(&pool->array, ptr);
+}
+
+static inline void _lock_chunks(bpf_pool_t *pool)
+{
+    (void)pool;
+}
+
+static inline void _unlock_chunks(bpf_pool_t *pool)
+{
+    (void)pool;
+}
+
+static void _static_init(bpf_pool_t *pool)
+{
+    pool->array.size = pool->stats.size;
+    if (pool->data && pool->num) {
+        memarray_extend(&pool->array, (void *)pool->data, pool->num);
+    }
+}
+
+#endif /* CONFIG_BPF_CONCURRENT */
+
+void bpf_pool_init(bpf_pool_t *pool, size_t size, void *data, size_t num,
+                   size_t chunk_len, size_t max)
+{
+    bpf_pool_t init = {
+        .data = data,
+        .num = num,
+        .chunk_len = chunk_len,
+        .max = max,
+        .stats = { .size = size, .capacity = num, .free = num },
+    };
+    *pool = init;
+    _static_init(pool);
+}
+
+/* Allocate from a heap chunk, growing the pool if necessary. Called with the chunks locked. */
+static void *_chunk_alloc(bpf_pool_t *pool)
+{
+    if (pool->partial == NULL && !_grow(pool)) {
+        pool->stats.failures++;
+        return NULL;
+    }
+    bpf_pool_chunk_t *chunk = pool->partial;
+    void *ptr = memarray_alloc(&chunk->array);
+    if (++chunk->in_use == pool->chunk_len) {
+        _unlink_partial(pool, chunk);
+    }
+    return ptr;
+}
+
+void *bpf_pool_alloc(bpf_pool_t *pool)
+{
+    void *ptr = _static_alloc(pool);
+    if (ptr == NULL) {
+        _lock_chunks(pool);
+        ptr = _chunk_alloc(pool);
+        _unlock_chunks(pool);
+        if (ptr == NULL) {
+            return NULL;
+        }
+    }
+
+    bpf_atomic_sub(&pool->stats.free, 1);
+    size_t in_use = bpf_atomic_fetch_add(&pool->stats.in_use, 1) + 1;
+    size_t high_water = bpf_atomic_load(&pool->stats.high_water);
+    while (in_use > high_water && !bpf_atomic_cas(&pool->stats.high_water, &high_water, in_use)) {
+    }
+    return ptr;
+}
+
+void bpf_pool_free(bpf_pool_t *pool, void *ptr)
+{
+    if (_contains(pool, pool->data, pool->num, ptr)) {
+        _static_free(pool, ptr);
+        bpf_atomic_add(&pool->stats.free, 1);
+        bpf_atomic_sub(&pool->stats.in_use, 1);
+        return;
+    }
+
+    _lock_chunks(pool);
+    bpf_atomic_add(&pool->stats.free, 1);
+    bpf_atomic_sub(&pool->stats.in_use, 1);
+    bpf_pool_chunk_t *chunk = _find_chunk(pool, ptr);
+    memarray_free(&chunk->array, ptr);
+    if (chunk->in_use-- == pool->chunk_len) {
+        _link_partial(pool, chunk);
+    }
+    /* Keep one chunk's worth of slack to avoid thrashing */
+    if (chunk->in_use == 0 && bpf_atomic_load(&pool->stats.free) >= 2 * pool->chunk_len) {
+        _release(pool, chunk);
+    }
+    _unlock_chunks(pool);
+}
+
+void bpf_pool_reset_stats(bpf_pool_t *pool)
+{
+    bpf_atomic_store(&pool->stats.high_water, bpf_atomic_load(&pool->stats.in_use));
+    pool->stats.failures = 0;
+}
@@ -0,0 +1,59 @@
+#include <stdint.h>
+#include <stddef.h>
+#include <stdbool.h>
+#include <string.h>
+#include "include/bpf/queue.h"
+#include "include/bpf/sync.h"
+
+static uint8_t *_slot(const spsc_queue_t *queue, uint32_t index)
+{
+    return queue->slots + (size_t)(index & (queue->capacity - 1)) * queue->record_size;
+}
+
+void spsc_queue_init(spsc_queue_t *queue, void *mem, uint32_t record_size, uint32_t capacity)
+{
+    queue->slots = mem;
+    queue->record_size = record_size;
+    queue->capacity = capacity;
+    queue->head = 0;
+    queue->tail = 0;
+}
+
+bool spsc_queue_push(spsc_queue_t *queue, const void *record, bool *was_empty)
+{
+    uint32_t tail = queue->tail;
+    /* Acquire ensures the consumer has finished with the slot */
+    if (tail - bpf_atomic_load_acquire(&queue->head) >= queue->capacity) {
+        return false;
+    }
+    memcpy(_slot(queue, tail), record, queue->record_size);
+    /*
+     * Publish the record, then check whether the consumer had caught up.
+     * Sequential consistency ensures either this sees the consumer's final position
+     * or the consumer sees the record.
+     */
+    bpf_atomic_store_seq_cst(&queue->tail, tail + 1);
+    *was_empty = bpf_atomic_load_seq_cst(&queue->head) == tail;
+    return true;
+}
+
+bool spsc_queue_pop(spsc_queue_t *queue, void *record)
+{
+    uint32_t head = queue->head;
+    if (head == bpf_atomic_load_seq_cst(&queue->tail)) {
+        return false;
+    }
+    memcpy(record, _slot(queue, head), queue->record_size);
+    bpf_atomic_store_seq_cst(&queue->head, head + 1);
+    return true;
+}
+
+void spsc_queue_drain(spsc_queue_t *queue)
+{
+    bpf_atomic_store_seq_cst(&queue->head, bpf_atomic_load_acquire(&queue->tail));
+}
+
+uint32_t spsc_queue_count(const spsc_queue_t *queue)
+{
+    return bpf_atomic_load_acquire(&queue->tail) - bpf_atomic_load_acquire(&queue->head);
+}
@@ -0,0 +1,109 @@
+#include <stdint.h>
+#include <stddef.h>
+#include <stdbool.h>
+#include <string.h>
+#include "include/bpf/ringbuf.h"
+#include "include/bpf/sync.h"
+
+#define PAD_FLAG 0x80000000U
+
+typedef struct {
+    uint32_t len;               ///< Bytes of data, or of padding with PAD_FLAG set
+    uint32_t reserved;
+} header_t;
+
+static uint32_t _record_size(uint32_t len)
+{
+    return (sizeof(header_t) + len + 7) & ~7U;
+}
+
+static header_t *_header(const ringbuf_t *ring, uint32_t pos)
+{
+    return (header_t *)(ring->data + (pos & (ring->size - 1)));
+}
+
+void ringbuf_init(ringbuf_t *ring, void *mem, uint32_t size)
+{
+    memset(ring, 0, sizeof(*ring));
+    ring->data = mem;
+    ring->size = size;
+}
+
+void *ringbuf_reserve(ringbuf_t *ring, uint32_t len)
+{
+    ring->reserved_len = 0;
+    if (len == 0 || len > ring->size - sizeof(header_t)) {
+        return NULL;
+    }
+    uint32_t need = _record_size(len);
+    uint32_t pos = ring->producer;
+    uint32_t tail = ring->size - (pos & (ring->size - 1));
+    uint32_t pad = (need > tail) ? tail : 0;
+    /* Acquire ensures the consumer has finished with the space */
+    uint32_t used = pos - bpf_atomic_load_acquire(&ring->consumer);
+    if (used + pad + need > ring->size) {
+        bpf_atomic_add(&ring->dropped, 1);
+        return NULL;
+    }
+    ring->reserved_len = len;
+    ring->reserved_pad = pad;
+    return _header(ring, pos + pad) + 1;
+}
+
+bool ringbuf_submit(ringbuf_t *ring)
+{
+    if (ring->reserved_len == 0) {
+        return false;
+    }
+    uint32_t pos = ring->producer;
+    if (ring->reserved_pad != 0) {
+        _header(ring, pos)->len = PAD_FLAG | (ring->reserved_pad - sizeof(header_t));
+    }
+    _header(ring, pos + ring->reserved_pad)->len = ring->reserved_len;
+    uint32_t next = pos + ring->reserved_pad + _record_size(ring->reserved_len);
+    ring->reserved_len = 0;
+    bpf_atomic_add(&ring->submitted, 1);
+    /*
+     * Publish the record, then check whether the consumer had caught up.
+     * Sequential consistency ensures either this sees the consumer's final position
+     * or the consumer sees the record.
+     */
+    bpf_atomic_store_seq_cst(&ring->producer, next);
+    return bpf_atomic_load_seq_cst(&ring->consumer) == pos;
+}
+
+void ringbuf_discard(ringbuf_t *ring)
+{
+    ring->reserved_len = 0;
+}
+
+const void *ringbuf_peek(ringbuf_t *ring, uint32_t *len)
+{
+    uint32_t pos = ring->consumer;
+    while (pos != bpf_atomic_load_seq_cst(&ring->producer)) {
+        const header_t *hdr = _header(ring, pos);
+        if ((hdr->len & PAD_FLAG) == 0) {
+            *len = hdr->len;
+            return hdr + 1;
+        }
+        pos += sizeof(header_t) + (hdr->len & ~PAD_FLAG);
+        bpf_atomic_store_seq_cst(&ring->consumer, pos);
+    }
+    return NULL;
+}
+
+void ringbuf_consume(ringbuf_t *ring)
+{
+    uint32_t pos = ring->consumer;
+    if (pos == bpf_atomic_load_acquire(&ring->producer)) {
+        return;
+    }
+    pos += _record_size(_header(ring, pos)->len);
+    /* Hands the space back once reading is complete */
+    bpf_atomic_store_seq_cst(&ring->consumer, pos);
+}
+
+uint32_t ringbuf_used(const ringbuf_t *ring)
+{
+    return bpf_atomic_load_acquire(&ring->producer) - bpf_atomic_load_acquire(&ring->consumer);
+}
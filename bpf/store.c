@@ -9,50 +9,1155 @@
 
 #include <stdint.h>
 #include <stddef.h>
+#include <stdbool.h>
+#include <stdlib.h>
+#include <string.h>
 #include "include/bpf.h"
 #include "include/bpf/store.h"
-#include "memarray.h"
+#include "include/bpf/clock.h"
+#include <debug_progmem.h>
 
-static btree_t _global;
+static bpf_store_t _global;
 
-/* Singleton mem array */
-static memarray_t _array;
-static bpf_store_keyval_t _vals[CONFIG_BPF_STORE_NUM_VALUES];
+/*
+ * With CONFIG_BPF_CONCURRENT the global store may be used from several threads.
+ * Readers share the lock, as do updates to the values of existing keys, which
+ * are made atomically. Adding or removing keys takes the lock exclusively.
+ * Local stores belong to one container so are not locked.
+ */
+static bpf_rwlock_t _global_lock = BPF_RWLOCK_INIT;
+
+typedef enum {
+    LOCK_NONE,
+    LOCK_SHARED,
+    LOCK_EXCLUSIVE,
+} lock_mode_t;
+
+static lock_mode_t _lock(const bpf_store_t *store, lock_mode_t mode)
+{
+#if CONFIG_BPF_CONCURRENT
+    if (store == &_global) {
+        if (mode == LOCK_SHARED) {
+            bpf_rwlock_read_lock(&_global_lock);
+        }
+        else {
+            bpf_rwlock_write_lock(&_global_lock);
+        }
+        return mode;
+    }
+#else
+    (void)store;
+    (void)mode;
+#endif
+    return LOCK_NONE;
+}
+
+static void _unlock(lock_mode_t mode)
+{
+    if (mode == LOCK_SHARED) {
+        bpf_rwlock_read_unlock(&_global_lock);
+    }
+    else if (mode == LOCK_EXCLUSIVE) {
+        bpf_rwlock_write_unlock(&_global_lock);
+    }
+}
+
+/* Exchange a shared lock for an exclusive one. Other threads may run in between. */
+static lock_mode_t _upgrade(lock_mode_t mode)
+{
+    if (mode != LOCK_SHARED) {
+        return mode;
+    }
+    bpf_rwlock_read_unlock(&_global_lock);
+    bpf_rwlock_write_lock(&_global_lock);
+    return LOCK_EXCLUSIVE;
+}
+
+/* Lock for access to entries, which bounded stores reorder on every access */
+static lock_mode_t _lock_entries(const bpf_store_t *store)
+{
+    lock_mode_t mode = _lock(store, LOCK_SHARED);
+    if (mode == LOCK_SHARED && store->cache) {
+        mode = _upgrade(mode);
+    }
+    return mode;
+}
+
+/* Size-classed pools, tree entries start with a static region */
+static bpf_pool_t _pools[BPF_STORE_POOL_CLASSES];
+static bpf_store_entry_t _vals[BPF_STORE_POOL_SIZE];
+
+#if CONFIG_BPF_STORE_COMPACT
+#define POOL_ENTRY_CHUNK    0
+#define POOL_ENTRY_MAX      BPF_STORE_POOL_SIZE
+#else
+#define POOL_ENTRY_CHUNK    CONFIG_BPF_STORE_POOL_CHUNK
+#define POOL_ENTRY_MAX      CONFIG_BPF_STORE_POOL_MAX
+#endif
+
+static const uint8_t _class_sizes[BPF_STORE_POOL_CLASSES] = {
+    [BPF_STORE_POOL_ENTRY] = sizeof(bpf_store_entry_t),
+    [BPF_STORE_POOL_16] = 16,
+    [BPF_STORE_POOL_32] = 32,
+    [BPF_STORE_POOL_64] = 64,
+};
+
+void bpf_store_init(void)
+{
+    bpf_pool_init(&_pools[BPF_STORE_POOL_ENTRY], sizeof(bpf_store_entry_t), _vals,
+                  BPF_STORE_POOL_SIZE, POOL_ENTRY_CHUNK, POOL_ENTRY_MAX);
+    for (unsigned cls = BPF_STORE_POOL_16; cls < BPF_STORE_POOL_CLASSES; cls++) {
+        bpf_pool_init(&_pools[cls], _class_sizes[cls], NULL, 0, CONFIG_BPF_STORE_POOL_CHUNK, 0);
+    }
+    _global.type = CONFIG_BPF_STORE_GLOBAL_TYPE;
+    _global.quota = CONFIG_BPF_STORE_GLOBAL_QUOTA;
+}
+
+static void *_pool_alloc(void)
+{
+    return bpf_pool_alloc(&_pools[BPF_STORE_POOL_ENTRY]);
+}
+
+static void _pool_free(void *entry)
+{
+    bpf_pool_free(&_pools[BPF_STORE_POOL_ENTRY], entry);
+}
+
+/*
+ * Local stores may not use pool entries reserved for a global tree store
+ */
+static bool _pool_allowed(const bpf_store_t *store)
+{
+    if (store == &_global || _global.type != BPF_STORE_TYPE_TREE) {
+        return true;
+    }
+    size_t limit = POOL_ENTRY_MAX;
+    if (limit == 0) {
+        /* Limited only by the heap */
+        return true;
+    }
+    size_t reserved = 0;
+    uint32_t global_count = bpf_atomic_load(&_global.count);
+    if (global_count < CONFIG_BPF_STORE_GLOBAL_RESERVE) {
+        reserved = CONFIG_BPF_STORE_GLOBAL_RESERVE - global_count;
+    }
+    return bpf_atomic_load(&_pools[BPF_STORE_POOL_ENTRY].stats.in_use) + reserved < limit;
+}
+
+static int _pool_class(size_t size)
+{
+    for (unsigned cls = BPF_STORE_POOL_16; cls < BPF_STORE_POOL_CLASSES; cls++) {
+        if (size <= _class_sizes[cls]) {
+            return cls;
+        }
+    }
+    return -1;
+}
+
+void *bpf_store_pool_alloc(size_t size)
+{
+    int cls = _pool_class(size);
+    return (cls < 0) ? NULL : bpf_pool_alloc(&_pools[cls]);
+}
+
+void bpf_store_pool_free(void *ptr, size_t size)
+{
+    int cls = _pool_class(size);
+    if (ptr && cls >= 0) {
+        bpf_pool_free(&_pools[cls], ptr);
+    }
+}
+
+int bpf_store_get_pool_stats(bpf_store_pool_class_t cls, bpf_pool_stats_t *stats)
+{
+    if ((unsigned)cls >= BPF_STORE_POOL_CLASSES) {
+        return -1;
+    }
+    bpf_pool_get_stats(&_pools[cls], stats);
+    return 0;
+}
+
+void bpf_store_reset_pool_stats(void)
+{
+    for (unsigned cls = 0; cls < BPF_STORE_POOL_CLASSES; cls++) {
+        bpf_pool_reset_stats(&_pools[cls]);
+    }
+}
+
+/*
+ * Tree backend, using either the compact or the pointer-based layout
+ */
+#if CONFIG_BPF_STORE_COMPACT
+
+static bool _tree_empty(const bpf_store_tree_t *tree)
+{
+    return tree->root == 0;
+}
+
+static uint16_t _tree_alloc(void *ctx)
+{
+    (void)ctx;
+    ctree_node_t *node = _pool_alloc();
+    return node ? node - _vals + 1 : 0;
+}
+
+static uint32_t *_tree_upsert(bpf_store_tree_t *tree, uint32_t key, bool insert, bool *inserted)
+{
+    tree->nodes = _vals;
+    ctree_node_t *node = ctree_find_or_insert(tree, key, insert ? _tree_alloc : NULL, NULL, inserted);
+    return node ? &node->value : NULL;
+}
+
+static uint32_t *_tree_find(bpf_store_tree_t *tree, uint32_t key)
+{
+    ctree_node_t *node = ctree_find(tree, key);
+    return node ? &node->value : NULL;
+}
+
+static int _tree_remove(bpf_store_tree_t *tree, uint32_t key)
+{
+    uint16_t index = ctree_remove(tree, key, NULL);
+    if (index == 0) {
+        return -1;
+    }
+    _pool_free(ctree_node(tree, index));
+    return 0;
+}
+
+/* No parent links, so each step searches from the root */
+static size_t _tree_scan(bpf_store_tree_t *tree, uint32_t key, bpf_store_kv_t *items, size_t max,
+                         bool reverse)
+{
+    const uint32_t last = reverse ? 0 : UINT32_MAX;
+    size_t count = 0;
+    while (count < max) {
+        ctree_node_t *node = reverse ? ctree_find_floor(tree, key) : ctree_find_ceil(tree, key);
+        if (node == NULL) {
+            break;
+        }
+        items[count].key = node->key;
+        items[count].value = bpf_atomic_load(&node->value);
+        count++;
+        if (node->key == last) {
+            break;
+        }
+        key = reverse ? node->key - 1 : node->key + 1;
+    }
+    return count;
+}
+
+static void _tree_free_node(ctree_node_t *node, void *ctx)
+{
+    (void)ctx;
+    _pool_free(node);
+}
+
+static void _tree_clear(bpf_store_tree_t *tree)
+{
+    ctree_clear(tree, _tree_free_node, NULL);
+}
+
+#else
+
+static bool _tree_empty(const bpf_store_tree_t *tree)
+{
+    return tree->start == NULL;
+}
+
+static btree_node_t *_tree_alloc(void *ctx)
+{
+    (void)ctx;
+    bpf_store_keyval_t *keyval = _pool_alloc();
+    if (keyval == NULL) {
+        return NULL;
+    }
+    keyval->value = 0;
+    return &keyval->node;
+}
+
+static uint32_t *_tree_upsert(bpf_store_tree_t *tree, uint32_t key, bool insert, bool *inserted)
+{
+    btree_node_t *node = btree_find_or_insert(tree, key, insert ? _tree_alloc : NULL, NULL, inserted);
+    return node ? &((bpf_store_keyval_t*)node)->value : NULL;
+}
+
+static uint32_t *_tree_find(bpf_store_tree_t *tree, uint32_t key)
+{
+    bpf_store_keyval_t *keyval = (bpf_store_keyval_t*)btree_find_key(tree, key);
+    return keyval ? &keyval->value : NULL;
+}
+
+static int _tree_remove(bpf_store_tree_t *tree, uint32_t key)
+{
+    bpf_store_keyval_t *keyval = (bpf_store_keyval_t*)btree_remove(tree, key);
+    if (!keyval) {
+        return -1;
+    }
+    _pool_free(keyval);
+    return 0;
+}
+
+static size_t _tree_scan(bpf_store_tree_t *tree, uint32_t key, bpf_store_kv_t *items, size_t max,
+                         bool reverse)
+{
+    btree_node_t *node = reverse ? btree_find_floor(tree, key) : btree_find_ceil(tree, key);
+    size_t count = 0;
+    for (; node && count < max; count++) {
+        items[count].key = node->key;
+        items[count].value = bpf_atomic_load(&((bpf_store_keyval_t*)node)->value);
+        node = reverse ? btree_prev(node) : btree_next(node);
+    }
+    return count;
+}
+
+static void _tree_free_node(btree_node_t *node, size_t depth, void *ctx)
+{
+    (void)depth;
+    (void)ctx;
+    _pool_free(node);
+}
+
+static void _tree_clear(bpf_store_tree_t *tree)
+{
+    btree_clear(tree, _tree_free_node, NULL);
+}
+
+#endif /* CONFIG_BPF_STORE_COMPACT */
+
+/*
+ * Wide variants: 64-bit keys with either 64-bit values or blobs
+ */
+typedef struct {
+    uint8_t len;
+    uint8_t data[];
+} blob_t;
+
+static size_t _blob_size(size_t len)
+{
+    return sizeof(blob_t) + len;
+}
+
+static void _free_blob(hashmap64_entry_t *entry, void *ctx)
+{
+    (void)ctx;
+    blob_t *blob = (blob_t*)(uintptr_t)entry->value;
+    bpf_store_pool_free(blob, _blob_size(blob->len));
+}
+
+static void _wide_clear(bpf_store_t *store)
+{
+    hashmap64_foreach(&store->blobs, _free_blob, NULL);
+    hashmap64_clear(&store->blobs);
+    hashmap64_clear(&store->wide);
+}
+
+static bool _wide_may_insert(const bpf_store_t *store, const hashmap64_t *map)
+{
+    if (store->quota != 0 && map->count >= store->quota) {
+        return false;
+    }
+    return map->count < CONFIG_BPF_STORE_HASH_MAX_ENTRIES;
+}
+
+static hashmap64_entry_t *_wide_upsert(bpf_store_t *store, hashmap64_t *map, uint64_t key)
+{
+    bool inserted;
+    hashmap64_entry_t *entry = hashmap64_find_or_insert(map, key, _wide_may_insert(store, map),
+                                                        &inserted);
+    if (entry == NULL) {
+        debug_d("[BPF] Wide store full");
+    }
+    return entry;
+}
+
+/* As _access(), for wide values */
+static hashmap64_entry_t *_access64(bpf_store_t *store, uint64_t key, lock_mode_t *mode)
+{
+    *mode = _lock(store, LOCK_SHARED);
+    if (*mode == LOCK_SHARED) {
+        hashmap64_entry_t *entry = hashmap64_find(&store->wide, key);
+        if (entry) {
+            return entry;
+        }
+        *mode = _upgrade(*mode);
+    }
+    return _wide_upsert(store, &store->wide, key);
+}
+
+static int _update64(bpf_store_t *store, uint64_t key, uint64_t value)
+{
+    lock_mode_t mode;
+    hashmap64_entry_t *entry = _access64(store, key, &mode);
+    if (entry) {
+        bpf_atomic_store(&entry->value, value);
+    }
+    _unlock(mode);
+    return entry ? 0 : -1;
+}
+
+static int _lookup64(bpf_store_t *store, uint64_t key, uint64_t *value)
+{
+    lock_mode_t mode = _lock(store, LOCK_SHARED);
+    hashmap64_entry_t *entry = hashmap64_find(&store->wide, key);
+    *value = entry ? bpf_atomic_load(&entry->value) : 0;
+    _unlock(mode);
+    return entry ? 0 : -1;
+}
+
+static int _fetch_add64(bpf_store_t *store, uint64_t key, uint64_t delta, uint64_t *old)
+{
+    lock_mode_t mode;
+    hashmap64_entry_t *entry = _access64(store, key, &mode);
+    *old = entry ? bpf_atomic_fetch_add(&entry->value, delta) : 0;
+    _unlock(mode);
+    return entry ? 0 : -1;
+}
+
+static int _remove64(bpf_store_t *store, uint64_t key)
+{
+    lock_mode_t mode = _lock(store, LOCK_EXCLUSIVE);
+    int res = hashmap64_remove(&store->wide, key, NULL) == HASHMAP_OK ? 0 : -1;
+    _unlock(mode);
+    return res;
+}
+
+static int _set_blob_locked(bpf_store_t *store, uint64_t key, const void *data, size_t len)
+{
+    hashmap64_entry_t *entry = hashmap64_find(&store->blobs, key);
+    blob_t *old = entry ? (blob_t*)(uintptr_t)entry->value : NULL;
+
+    /* Reuse the existing allocation if it is in the right size class */
+    blob_t *blob = old;
+    if (old == NULL || _pool_class(_blob_size(old->len)) != _pool_class(_blob_size(len))) {
+        blob = bpf_store_pool_alloc(_blob_size(len));
+        if (blob == NULL) {
+            return -1;
+        }
+    }
+    if (entry == NULL) {
+        entry = _wide_upsert(store, &store->blobs, key);
+        if (entry == NULL) {
+            bpf_store_pool_free(blob, _blob_size(len));
+            return -1;
+        }
+    }
+    if (old && old != blob) {
+        bpf_store_pool_free(old, _blob_size(old->len));
+    }
+    blob->len = len;
+    memcpy(blob->data, data, len);
+    entry->value = (uintptr_t)blob;
+    return 0;
+}
+
+static int _set_blob(bpf_store_t *store, uint64_t key, const void *data, size_t len)
+{
+    if (len > CONFIG_BPF_STORE_BLOB_MAX) {
+        return -1;
+    }
+    lock_mode_t mode = _lock(store, LOCK_EXCLUSIVE);
+    int res = _set_blob_locked(store, key, data, len);
+    _unlock(mode);
+    return res;
+}
+
+static int _get_blob(bpf_store_t *store, uint64_t key, void *buf, size_t size)
+{
+    lock_mode_t mode = _lock(store, LOCK_SHARED);
+    hashmap64_entry_t *entry = hashmap64_find(&store->blobs, key);
+    int res = -1;
+    if (entry) {
+        const blob_t *blob = (const blob_t*)(uintptr_t)entry->value;
+        memcpy(buf, blob->data, (blob->len < size) ? blob->len : size);
+        res = blob->len;
+    }
+    _unlock(mode);
+    return res;
+}
+
+static int _remove_blob(bpf_store_t *store, uint64_t key)
+{
+    lock_mode_t mode = _lock(store, LOCK_EXCLUSIVE);
+    uint64_t value;
+    int res = -1;
+    if (hashmap64_remove(&store->blobs, key, &value) == HASHMAP_OK) {
+        blob_t *blob = (blob_t*)(uintptr_t)value;
+        bpf_store_pool_free(blob, _blob_size(blob->len));
+        res = 0;
+    }
+    _unlock(mode);
+    return res;
+}
+
+/*
+ * Bounded stores
+ *
+ * Each entry has a tracking record, found through a key index, which is
+ * linked into a recency list and, if it has a lifetime, a timer wheel slot.
+ * Records are allocated with the cache and referenced by 1-based index,
+ * 0 meaning none.
+ */
+typedef struct {
+    uint32_t key;
+    uint32_t expires;           ///< Expiry time in ms, if timed
+    uint32_t lru_prev;          ///< Towards most recently used
+    uint32_t lru_next;          ///< Towards least recently used, or next free record
+    uint32_t wheel_prev;
+    uint32_t wheel_next;
+    bool timed;                 ///< Linked into the timer wheel
+} cache_entry_t;
+
+struct bpf_store_cache {
+    hashmap_t index;            ///< Key to record index
+    bpf_store_cache_stats_t stats;
+    uint32_t lru_head;          ///< Most recently used
+    uint32_t lru_tail;          ///< Least recently used, evicted first
+    uint32_t free_list;         ///< Unused records
+    uint32_t sweep_tick;        ///< Timer wheel tick being swept
+    uint32_t sweep_next;        ///< Next record to examine in that slot, 0 when done
+    uint32_t wheel[CONFIG_BPF_STORE_TTL_SLOTS];
+    cache_entry_t entries[];
+};
+
+#define WHEEL_MASK  (CONFIG_BPF_STORE_TTL_SLOTS - 1)
+
+static int _remove_value(bpf_store_t *store, uint32_t key);
+
+static inline cache_entry_t *_cache_entry(bpf_store_cache_t *cache, uint32_t index)
+{
+    return &cache->entries[index - 1];
+}
+
+static inline bool _cache_expired(const cache_entry_t *entry, uint32_t now)
+{
+    return entry->timed && (int32_t)(now - entry->expires) >= 0;
+}
+
+static void _cache_reset(bpf_store_cache_t *cache)
+{
+    hashmap_clear(&cache->index);
+    cache->lru_head = 0;
+    cache->lru_tail = 0;
+    cache->sweep_next = 0;
+    memset(cache->wheel, 0, sizeof(cache->wheel));
+    cache->free_list = 1;
+    for (uint32_t i = 1; i <= cache->stats.capacity; i++) {
+        _cache_entry(cache, i)->lru_next = (i < cache->stats.capacity) ? i + 1 : 0;
+    }
+}
+
+static void _lru_unlink(bpf_store_cache_t *cache, uint32_t index)
+{
+    cache_entry_t *entry = _cache_entry(cache, index);
+    if (entry->lru_prev) {
+        _cache_entry(cache, entry->lru_prev)->lru_next = entry->lru_next;
+    }
+    else {
+        cache->lru_head = entry->lru_next;
+    }
+    if (entry->lru_next) {
+        _cache_entry(cache, entry->lru_next)->lru_prev = entry->lru_prev;
+    }
+    else {
+        cache->lru_tail = entry->lru_prev;
+    }
+}
+
+static void _lru_push(bpf_store_cache_t *cache, uint32_t index)
+{
+    cache_entry_t *entry = _cache_entry(cache, index);
+    entry->lru_prev = 0;
+    entry->lru_next = cache->lru_head;
+    if (cache->lru_head) {
+        _cache_entry(cache, cache->lru_head)->lru_prev = index;
+    }
+    else {
+        cache->lru_tail = index;
+    }
+    cache->lru_head = index;
+}
+
+static void _wheel_unlink(bpf_store_cache_t *cache, uint32_t index)
+{
+    cache_entry_t *entry = _cache_entry(cache, index);
+    if (!entry->timed) {
+        return;
+    }
+    if (cache->sweep_next == index) {
+        cache->sweep_next = entry->wheel_next;
+    }
+    if (entry->wheel_prev) {
+        _cache_entry(cache, entry->wheel_prev)->wheel_next = entry->wheel_next;
+    }
+    else {
+        cache->wheel[(entry->expires / CONFIG_BPF_STORE_TTL_TICK_MS) & WHEEL_MASK] = entry->wheel_next;
+    }
+    if (entry->wheel_next) {
+        _cache_entry(cache, entry->wheel_next)->wheel_prev = entry->wheel_prev;
+    }
+    entry->timed = false;
+}
+
+static void _wheel_link(bpf_store_cache_t *cache, uint32_t index, uint32_t ttl, uint32_t now)
+{
+    if (ttl == 0) {
+        return;
+    }
+    cache_entry_t *entry = _cache_entry(cache, index);
+    entry->expires = now + ttl;
+    entry->timed = true;
+    uint32_t *head = &cache->wheel[(entry->expires / CONFIG_BPF_STORE_TTL_TICK_MS) & WHEEL_MASK];
+    entry->wheel_prev = 0;
+    entry->wheel_next = *head;
+    if (*head) {
+        _cache_entry(cache, *head)->wheel_prev = index;
+    }
+    *head = index;
+}
+
+static uint32_t _cache_find(const bpf_store_cache_t *cache, uint32_t key)
+{
+    hashmap_entry_t *entry = hashmap_find(&cache->index, key);
+    return entry ? entry->value : 0;
+}
+
+/* Start tracking a key newly added to the store */
+static bool _cache_add(bpf_store_cache_t *cache, uint32_t key, uint32_t now)
+{
+    uint32_t index = cache->free_list;
+    if (index == 0 || hashmap_insert(&cache->index, key, index) != HASHMAP_OK) {
+        return false;
+    }
+    cache_entry_t *entry = _cache_entry(cache, index);
+    cache->free_list = entry->lru_next;
+    entry->key = key;
+    entry->timed = false;
+    _lru_push(cache, index);
+    _wheel_link(cache, index, cache->stats.ttl, now);
+    return true;
+}
+
+/* Stop tracking a key removed from the store */
+static void _cache_forget(bpf_store_cache_t *cache, uint32_t key)
+{
+    uint32_t index = _cache_find(cache, key);
+    if (index == 0) {
+        return;
+    }
+    hashmap_remove(&cache->index, key, NULL);
+    _lru_unlink(cache, index);
+    _wheel_unlink(cache, index);
+    _cache_entry(cache, index)->lru_next = cache->free_list;
+    cache->free_list = index;
+}
+
+/*
+ * Examine a few timer wheel entries, advancing through slots as time passes.
+ * Slots for the current tick are left until it has elapsed, when all their
+ * entries which belong to this round of the wheel have expired.
+ */
+static void _cache_sweep(bpf_store_t *store, uint32_t now)
+{
+    bpf_store_cache_t *cache = store->cache;
+    uint32_t now_tick = now / CONFIG_BPF_STORE_TTL_TICK_MS;
+    if ((int32_t)(now_tick - cache->sweep_tick) > (int32_t)CONFIG_BPF_STORE_TTL_SLOTS) {
+        /* Idle for over a round, so sweep each slot once */
+        cache->sweep_tick = now_tick - CONFIG_BPF_STORE_TTL_SLOTS;
+        cache->sweep_next = 0;
+    }
+    for (unsigned budget = CONFIG_BPF_STORE_TTL_SWEEP; budget != 0; budget--) {
+        if (cache->sweep_next == 0) {
+            if ((int32_t)(now_tick - cache->sweep_tick) <= 1) {
+                break;
+            }
+            cache->sweep_tick++;
+            cache->sweep_next = cache->wheel[cache->sweep_tick & WHEEL_MASK];
+            continue;
+        }
+        cache_entry_t *entry = _cache_entry(cache, cache->sweep_next);
+        cache->sweep_next = entry->wheel_next;
+        if (_cache_expired(entry, now)) {
+            cache->stats.expirations++;
+            _remove_value(store, entry->key);
+        }
+    }
+}
+
+/*
+ * Called before accessing key in a bounded store. Removes the key if it has
+ * expired, otherwise marks it as most recently used.
+ * Returns true if the key is present.
+ */
+static bool _cache_access(bpf_store_t *store, uint32_t key, uint32_t now)
+{
+    bpf_store_cache_t *cache = store->cache;
+    _cache_sweep(store, now);
+    uint32_t index = _cache_find(cache, key);
+    if (index == 0) {
+        return false;
+    }
+    if (_cache_expired(_cache_entry(cache, index), now)) {
+        cache->stats.expirations++;
+        _remove_value(store, key);
+        return false;
+    }
+    _lru_unlink(cache, index);
+    _lru_push(cache, index);
+    return true;
+}
+
+/* Check whether key in a bounded store has expired, without removing it */
+static bool _cache_live(const bpf_store_cache_t *cache, uint32_t key, uint32_t now)
+{
+    uint32_t index = _cache_find(cache, key);
+    return index == 0 || !_cache_expired(&cache->entries[index - 1], now);
+}
+
+/*
+ * Remove any expired entries from scan results.
+ * Returns true if the scan needs repeating.
+ */
+static bool _cache_purge(bpf_store_t *store, const bpf_store_kv_t *items, size_t count)
+{
+    uint32_t now = bpf_clock_ms();
+    bool purged = false;
+    for (size_t i = 0; i < count; i++) {
+        if (!_cache_live(store->cache, items[i].key, now)) {
+            store->cache->stats.expirations++;
+            _remove_value(store, items[i].key);
+            purged = true;
+        }
+    }
+    return purged;
+}
+
+static bool _may_insert(const bpf_store_t *store);
+
+/* Evict least recently used entries until a new key may be inserted */
+static void _cache_make_room(bpf_store_t *store)
+{
+    bpf_store_cache_t *cache = store->cache;
+    while (cache->lru_tail && (store->count >= cache->stats.capacity || !_may_insert(store))) {
+        cache->stats.evictions++;
+        _remove_value(store, _cache_entry(cache, cache->lru_tail)->key);
+    }
+}
+
+static int _set_cache(bpf_store_t *store, uint32_t capacity, uint32_t ttl)
+{
+    if (capacity != 0 && store->count != 0) {
+        return -1;
+    }
+    if (store->cache) {
+        hashmap_clear(&store->cache->index);
+        free(store->cache);
+        store->cache = NULL;
+    }
+    if (capacity == 0) {
+        return 0;
+    }
+    if (capacity > (SIZE_MAX - sizeof(bpf_store_cache_t)) / sizeof(cache_entry_t)) {
+        return -1;
+    }
+    bpf_store_cache_t *cache = calloc(1, sizeof(bpf_store_cache_t) + capacity * sizeof(cache_entry_t));
+    if (cache == NULL) {
+        return -1;
+    }
+    cache->stats.capacity = capacity;
+    cache->stats.ttl = ttl;
+    cache->sweep_tick = bpf_clock_ms() / CONFIG_BPF_STORE_TTL_TICK_MS;
+    _cache_reset(cache);
+    store->cache = cache;
+    return 0;
+}
+
+static int _set_ttl(bpf_store_t *store, uint32_t key, uint32_t ttl)
+{
+    if (store->cache == NULL) {
+        return -1;
+    }
+    uint32_t now = bpf_clock_ms();
+    if (!_cache_access(store, key, now)) {
+        return -1;
+    }
+    uint32_t index = _cache_find(store->cache, key);
+    _wheel_unlink(store->cache, index);
+    _wheel_link(store->cache, index, ttl, now);
+    return 0;
+}
+
+static int _get_cache_stats(const bpf_store_t *store, bpf_store_cache_stats_t *stats)
+{
+    if (store->cache == NULL) {
+        return -1;
+    }
+    *stats = store->cache->stats;
+    return 0;
+}
+
+static bool _is_empty(const bpf_store_t *store)
+{
+    return (store->type == BPF_STORE_TYPE_HASH) ? store->hash.count == 0
+                                                : _tree_empty(&store->tree);
+}
+
+static int _set_type(bpf_store_t *store, bpf_store_type_t type)
+{
+    if (!_is_empty(store)) {
+        return -1;
+    }
+    bpf_store_t init = {
+        .wide = store->wide,
+        .blobs = store->blobs,
+        .cache = store->cache,
+        .quota = store->quota,
+        .type = type,
+    };
+    *store = init;
+    return 0;
+}
+
+static void _clear(bpf_store_t *store)
+{
+    if (store->type == BPF_STORE_TYPE_HASH) {
+        hashmap_clear(&store->hash);
+    }
+    else {
+        _tree_clear(&store->tree);
+    }
+    store->count = 0;
+    if (store->cache) {
+        _cache_reset(store->cache);
+    }
+    _wide_clear(store);
+}
+
+/*
+ * Check whether the store may grow by one entry
+ */
+static bool _may_insert(const bpf_store_t *store)
+{
+    if (store->quota != 0 && store->count >= store->quota) {
+        return false;
+    }
+    if (store->type == BPF_STORE_TYPE_HASH) {
+        return store->hash.count < CONFIG_BPF_STORE_HASH_MAX_ENTRIES;
+    }
+    return _pool_allowed(store);
+}
+
+/*
+ * Locate key using a single traversal. If absent and insert is set, add it
+ * with a value of 0 where the traversal stopped.
+ * Returns NULL if the key is absent and was not added.
+ */
+static uint32_t *_upsert(bpf_store_t *store, uint32_t key, bool insert, bool *inserted)
+{
+    uint32_t now = 0;
+    if (store->cache) {
+        now = bpf_clock_ms();
+        if (!_cache_access(store, key, now) && insert) {
+            _cache_make_room(store);
+        }
+    }
+
+    bool allowed = insert && _may_insert(store);
+    uint32_t *value;
+    for (;;) {
+        if (store->type == BPF_STORE_TYPE_HASH) {
+            hashmap_entry_t *entry = hashmap_find_or_insert(&store->hash, key, allowed, inserted);
+            value = entry ? &entry->value : NULL;
+        }
+        else {
+            value = _tree_upsert(&store->tree, key, allowed, inserted);
+        }
+        if (value || !allowed || !store->cache || !store->cache->lru_tail) {
+            break;
+        }
+        /* Out of memory, so a bounded store gives up its own least recently used entry */
+        store->cache->stats.evictions++;
+        _remove_value(store, _cache_entry(store->cache, store->cache->lru_tail)->key);
+    }
+
+    if (*inserted) {
+        bpf_atomic_add(&store->count, 1);
+        if (store->cache && !_cache_add(store->cache, key, now)) {
+            _remove_value(store, key);
+            *inserted = false;
+            return NULL;
+        }
+    }
+    else if (value == NULL && insert) {
+        debug_d("[BPF] Store %p full, %u entries", store, (unsigned)store->count);
+    }
+    return value;
+}
+
+/* Locate key without affecting recency or expiry */
+static uint32_t *_stored_value(bpf_store_t *store, uint32_t key)
+{
+    if (store->type == BPF_STORE_TYPE_HASH) {
+        hashmap_entry_t *entry = hashmap_find(&store->hash, key);
+        return entry ? &entry->value : NULL;
+    }
+
+    return _tree_find(&store->tree, key);
+}
+
+static uint32_t *_find_value(bpf_store_t *store, uint32_t key)
+{
+    if (store->cache && !_cache_access(store, key, bpf_clock_ms())) {
+        return NULL;
+    }
+
+    return _stored_value(store, key);
+}
+
+/*
+ * Locate key for access to its value, adding it if insert is set. Existing
+ * keys need only a shared lock, in which case the value must be accessed
+ * atomically. Release the lock when done.
+ */
+static uint32_t *_access(bpf_store_t *store, uint32_t key, bool insert, bool *inserted,
+                         lock_mode_t *mode)
+{
+    *mode = _lock_entries(store);
+    if (*mode == LOCK_SHARED) {
+        uint32_t *value = _find_value(store, key);
+        if (value || !insert) {
+            *inserted = false;
+            return value;
+        }
+        *mode = _upgrade(*mode);
+    }
+    return _upsert(store, key, insert, inserted);
+}
+
+/*
+ * Watches on the global store. Writers first test the key against the range
+ * spanned by all watches, read without locking, so changes to keys outside it
+ * cost two loads. The list and range are changed only with _watch_lock held.
+ *
+ * A writer to a watched key locks each watch on it, in list order, before
+ * locking the store, and holds it until its change has been reported. Changes
+ * to a key are therefore reported in the order they were made and one at a time
+ * to each watch, while changes to keys under other watches proceed independently.
+ * bpf_store_unwatch_global() unlinks a watch then takes its lock to wait for a
+ * callback in progress.
+ */
+static bpf_store_watch_t *_watches;
+static uint32_t _watch_first = UINT32_MAX;
+static uint32_t _watch_last;
+static bpf_mutex_t _watch_lock = BPF_MUTEX_INIT;
+
+/*
+ * Call before locking a store to change a key. Returns the watches on the key,
+ * locked and chained through their held links, to pass to _notify().
+ */
+static bpf_store_watch_t *_watch_begin(const bpf_store_t *store, uint32_t key)
+{
+    if (store != &_global || key < bpf_atomic_load_acquire(&_watch_first) ||
+        key > bpf_atomic_load_acquire(&_watch_last)) {
+        return NULL;
+    }
+    bpf_store_watch_t *held = NULL;
+    bpf_mutex_lock(&_watch_lock);
+    for (bpf_store_watch_t *watch = _watches; watch; watch = watch->next) {
+        if (key >= watch->first && key <= watch->last) {
+#if CONFIG_BPF_CONCURRENT
+            bpf_mutex_lock(&watch->lock);
+#endif
+            watch->held = held;
+            held = watch;
+        }
+    }
+    bpf_mutex_unlock(&_watch_lock);
+    return held;
+}
+
+/* Report a change to the value of a key once the store is unlocked, releasing the watches */
+static void _notify(bpf_store_watch_t *held, uint32_t key, uint32_t old_value, uint32_t new_value)
+{
+    const bpf_store_change_t change = {
+        .key = key,
+        .old_value = old_value,
+        .new_value = new_value,
+    };
+    while (held) {
+        /* Another writer may reuse the link once the watch is unlocked */
+        bpf_store_watch_t *watch = held;
+        held = watch->held;
+        if (old_value != new_value) {
+            watch->cb(&change, watch->param);
+        }
+#if CONFIG_BPF_CONCURRENT
+        bpf_mutex_unlock(&watch->lock);
+#endif
+    }
+}
+
+/*
+ * Store the range spanned by all watches. A writer may see one bound before and one
+ * after, which still spans every watch present both before and after.
+ */
+static void _watch_span(void)
+{
+    uint32_t first = UINT32_MAX;
+    uint32_t last = 0;
+    for (const bpf_store_watch_t *watch = _watches; watch; watch = watch->next) {
+        first = (watch->first < first) ? watch->first : first;
+        last = (watch->last > last) ? watch->last : last;
+    }
+    bpf_atomic_store_seq_cst(&_watch_first, first);
+    bpf_atomic_store_seq_cst(&_watch_last, last);
+}
+
+int bpf_store_watch_global(bpf_store_watch_t *watch, uint32_t first, uint32_t last,
+                           bpf_store_watch_cb_t cb, void *param)
+{
+    if (first > last || cb == NULL) {
+        return -1;
+    }
+    watch->first = first;
+    watch->last = last;
+    watch->cb = cb;
+    watch->param = param;
+    watch->held = NULL;
+#if CONFIG_BPF_CONCURRENT
+    bpf_mutex_init(&watch->lock);
+#endif
+    bpf_mutex_lock(&_watch_lock);
+    watch->next = _watches;
+    _watches = watch;
+    _watch_span();
+    bpf_mutex_unlock(&_watch_lock);
+    return 0;
+}
 
-void bpf_store_init(void)
+void bpf_store_unwatch_global(bpf_store_watch_t *watch)
+{
+    bpf_mutex_lock(&_watch_lock);
+    for (bpf_store_watch_t **link = &_watches; *link; link = &(*link)->next) {
+        if (*link == watch) {
+            *link = watch->next;
+            _watch_span();
+            break;
+        }
+    }
+    bpf_mutex_unlock(&_watch_lock);
+#if CONFIG_BPF_CONCURRENT
+    bpf_mutex_lock(&watch->lock);
+    bpf_mutex_unlock(&watch->lock);
+#endif
+}
+
+static int _fetch_value(bpf_store_t *store, uint32_t key, uint32_t *value)
 {
-    memarray_init(&_array, _vals, sizeof(bpf_store_keyval_t), CONFIG_BPF_STORE_NUM_VALUES);
+    bool inserted;
+    lock_mode_t mode;
+    uint32_t *stored = _access(store, key, true, &inserted, &mode);
+    *value = stored ? bpf_atomic_load(stored) : 0;
+    _unlock(mode);
+    return stored ? 0 : -1;
 }
 
-static int _alloc_value(btree_t *tree, uint32_t key, uint32_t value)
+static int _store_value(bpf_store_t *store, uint32_t key, uint32_t value)
 {
-    bpf_store_keyval_t *keyval = memarray_alloc(&_array);
-    if(keyval == NULL) {
+    bpf_store_watch_t *held = _watch_begin(store, key);
+    bool inserted;
+    lock_mode_t mode;
+    uint32_t *stored = _access(store, key, true, &inserted, &mode);
+    if (stored == NULL) {
+        _unlock(mode);
+        _notify(held, key, 0, 0);
         return -1;
     }
-    keyval->value = value;
-    btree_insert(tree, &keyval->node, key);
+    uint32_t old = bpf_atomic_exchange(stored, value);
+    _unlock(mode);
+    _notify(held, key, old, value);
     return 0;
 }
 
-static int _fetch_value(btree_t *tree, uint32_t key, uint32_t *value)
+static int _lookup_value(bpf_store_t *store, uint32_t key, uint32_t *value)
 {
-    bpf_store_keyval_t *keyval = (bpf_store_keyval_t*)btree_find_key(tree, key);
-    if (!keyval) {
-        *value = 0;
-        return _alloc_value(tree, key, *value);
+    lock_mode_t mode = _lock_entries(store);
+    uint32_t *stored = _find_value(store, key);
+    *value = stored ? bpf_atomic_load(stored) : 0;
+    _unlock(mode);
+    return stored ? 0 : -1;
+}
+
+static int _fetch_add(bpf_store_t *store, uint32_t key, uint32_t delta, uint32_t *old)
+{
+    bpf_store_watch_t *held = _watch_begin(store, key);
+    bool inserted;
+    lock_mode_t mode;
+    uint32_t *stored = _access(store, key, true, &inserted, &mode);
+    if (stored == NULL) {
+        _unlock(mode);
+        _notify(held, key, 0, 0);
+        return -1;
+    }
+    uint32_t prev = bpf_atomic_fetch_add(stored, delta);
+    _unlock(mode);
+    if (old) {
+        *old = prev;
     }
-    *value = keyval->value;
+    _notify(held, key, prev, prev + delta);
     return 0;
 }
 
-static int _store_value(btree_t *tree, uint32_t key, uint32_t value)
+static int _compare_exchange(bpf_store_t *store, uint32_t key, uint32_t expected,
+                             uint32_t desired, uint32_t *actual)
 {
-    bpf_store_keyval_t *keyval = (bpf_store_keyval_t*)btree_find_key(tree, key);
-    if (!keyval) {
-        return _alloc_value(tree, key, value);
+    /* An absent key reads as 0, so only needs adding if that is expected */
+    bpf_store_watch_t *held = _watch_begin(store, key);
+    bool inserted;
+    lock_mode_t mode;
+    uint32_t *stored = _access(store, key, expected == 0, &inserted, &mode);
+    int res;
+    if (!stored) {
+        res = (expected == 0) ? -1 : 1;
+        if (actual && res > 0) {
+            *actual = 0;
+        }
+    }
+    else {
+        uint32_t current = expected;
+        res = bpf_atomic_cas(stored, &current, desired) ? 0 : 1;
+        if (actual) {
+            *actual = current;
+        }
+    }
+    _unlock(mode);
+    _notify(held, key, expected, (res == 0) ? desired : expected);
+    return res;
+}
+
+static int _update_limit(bpf_store_t *store, uint32_t key, uint32_t value, bool max)
+{
+    bpf_store_watch_t *held = _watch_begin(store, key);
+    bool inserted;
+    lock_mode_t mode;
+    uint32_t *stored = _access(store, key, true, &inserted, &mode);
+    if (stored == NULL) {
+        _unlock(mode);
+        _notify(held, key, 0, 0);
+        return -1;
     }
-    keyval->value = value;
+    uint32_t current = 0;
+    if (inserted) {
+        bpf_atomic_store(stored, value);
+    }
+    else {
+        current = bpf_atomic_load(stored);
+        while ((max ? value > current : value < current) &&
+               !bpf_atomic_cas(stored, &current, value)) {
+        }
+    }
+    _unlock(mode);
+    bool changed = inserted || (max ? value > current : value < current);
+    _notify(held, key, current, changed ? value : current);
     return 0;
 }
 
@@ -63,7 +1168,26 @@ int bpf_store_update_global(uint32_t key, uint32_t value)
 
 int bpf_store_update_local(bpf_t *bpf, uint32_t key, uint32_t value)
 {
-    return _store_value(&bpf->btree, key, value);
+    return _store_value(&bpf->store, key, value);
+}
+
+static int _remove_value(bpf_store_t *store, uint32_t key)
+{
+    int res;
+    if (store->type == BPF_STORE_TYPE_HASH) {
+        res = (hashmap_remove(&store->hash, key, NULL) == HASHMAP_OK) ? 0 : -1;
+    }
+    else {
+        res = _tree_remove(&store->tree, key);
+    }
+
+    if (res == 0) {
+        bpf_atomic_sub(&store->count, 1);
+        if (store->cache) {
+            _cache_forget(store->cache, key);
+        }
+    }
+    return res;
 }
 
 int bpf_store_fetch_global(uint32_t key, uint32_t *value)
@@ -73,10 +1197,541 @@ int bpf_store_fetch_global(uint32_t key, uint32_t *value)
 
 int bpf_store_fetch_local(bpf_t *bpf, uint32_t key, uint32_t *value)
 {
-    return _fetch_value(&bpf->btree, key, value);
+    return _fetch_value(&bpf->store, key, value);
+}
+
+int bpf_store_remove_global(uint32_t key)
+{
+    bpf_store_watch_t *held = _watch_begin(&_global, key);
+    lock_mode_t mode = _lock(&_global, LOCK_EXCLUSIVE);
+    uint32_t old = 0;
+    if (held) {
+        const uint32_t *stored = _stored_value(&_global, key);
+        old = stored ? *stored : 0;
+    }
+    int res = _remove_value(&_global, key);
+    _unlock(mode);
+    /* A removed key reads as 0 */
+    _notify(held, key, old, (res == 0) ? 0 : old);
+    return res;
+}
+
+int bpf_store_remove_local(bpf_t *bpf, uint32_t key)
+{
+    return _remove_value(&bpf->store, key);
+}
+
+/* Batches up to this size are sorted on the stack */
+#define BATCH_STACK_ITEMS   16
+
+/*
+ * Sort batch items, each holding a key in the upper 32 bits and its position
+ * in the lower 32 bits. Duplicate keys therefore stay in their original order,
+ * so the last update wins. Shell sort keeps the code small and needs no
+ * comparison callback.
+ */
+static void _sort_items(uint64_t *items, size_t count)
+{
+    static const uint16_t gaps[] = {701, 301, 132, 57, 23, 10, 4, 1};
+    for (unsigned g = 0; g < sizeof(gaps) / sizeof(gaps[0]); g++) {
+        size_t gap = gaps[g];
+        for (size_t i = gap; i < count; i++) {
+            uint64_t item = items[i];
+            size_t j = i;
+            for (; j >= gap && items[j - gap] > item; j -= gap) {
+                items[j] = items[j - gap];
+            }
+            items[j] = item;
+        }
+    }
+}
+
+/*
+ * Fetch or update a set of keys. Tree stores visit keys in ascending order so
+ * successive descents share the upper levels of the tree, which stay cached.
+ * Hashing scatters keys regardless, so hash stores are visited as given.
+ */
+static int _batch(bpf_store_t *store, const uint32_t *keys, uint32_t *values, size_t count,
+                  bool update)
+{
+    uint64_t stack_items[BATCH_STACK_ITEMS];
+    uint64_t *items = NULL;
+    if (store->type == BPF_STORE_TYPE_TREE && count > 1) {
+        items = (count <= BATCH_STACK_ITEMS) ? stack_items : malloc(count * sizeof(*items));
+    }
+    if (items) {
+        for (size_t i = 0; i < count; i++) {
+            items[i] = ((uint64_t)keys[i] << 32) | i;
+        }
+        _sort_items(items, count);
+    }
+
+    int res = 0;
+    for (size_t i = 0; i < count; i++) {
+        size_t idx = items ? (uint32_t)items[i] : i;
+        int err = update ? _store_value(store, keys[idx], values[idx])
+                         : _fetch_value(store, keys[idx], &values[idx]);
+        if (err < 0) {
+            res = -1;
+        }
+    }
+
+    if (items != stack_items) {
+        free(items);
+    }
+    return res;
+}
+
+int bpf_store_fetch_many_global(const uint32_t *keys, uint32_t *values, size_t count)
+{
+    return _batch(&_global, keys, values, count, false);
+}
+
+int bpf_store_fetch_many_local(bpf_t *bpf, const uint32_t *keys, uint32_t *values, size_t count)
+{
+    return _batch(&bpf->store, keys, values, count, false);
+}
+
+int bpf_store_update_many_global(const uint32_t *keys, const uint32_t *values, size_t count)
+{
+    return _batch(&_global, keys, (uint32_t *)values, count, true);
+}
+
+int bpf_store_update_many_local(bpf_t *bpf, const uint32_t *keys, const uint32_t *values,
+                                size_t count)
+{
+    return _batch(&bpf->store, keys, (uint32_t *)values, count, true);
+}
+
+typedef struct {
+    bpf_store_kv_t *items;
+    size_t max;
+    size_t count;
+    uint32_t key;
+    bool reverse;
+} scan_ctx_t;
+
+/* Distance of key from the scan start, in scan direction */
+static uint32_t _scan_distance(const scan_ctx_t *sctx, uint32_t key)
+{
+    return sctx->reverse ? sctx->key - key : key - sctx->key;
+}
+
+/*
+ * Keep the closest entries seen so far in the caller's buffer, sorted by
+ * distance from the start key. Hashing scatters keys through the table so
+ * few entries displace others.
+ */
+static void _hash_scan(hashmap_entry_t *entry, void *ctx)
+{
+    scan_ctx_t *sctx = ctx;
+    if (sctx->reverse ? entry->key > sctx->key : entry->key < sctx->key) {
+        return;
+    }
+    uint32_t dist = _scan_distance(sctx, entry->key);
+    size_t count = sctx->count;
+    if (count == sctx->max && dist >= _scan_distance(sctx, sctx->items[count - 1].key)) {
+        return;
+    }
+    size_t lo = 0;
+    size_t hi = count;
+    while (lo < hi) {
+        size_t mid = (lo + hi) / 2;
+        if (_scan_distance(sctx, sctx->items[mid].key) < dist) {
+            lo = mid + 1;
+        }
+        else {
+            hi = mid;
+        }
+    }
+    if (count < sctx->max) {
+        sctx->count = ++count;
+    }
+    memmove(&sctx->items[lo + 1], &sctx->items[lo], (count - 1 - lo) * sizeof(bpf_store_kv_t));
+    sctx->items[lo].key = entry->key;
+    sctx->items[lo].value = bpf_atomic_load(&entry->value);
+}
+
+static size_t _scan_entries(bpf_store_t *store, uint32_t key, bpf_store_kv_t *items, size_t max,
+                            bool reverse)
+{
+    if (store->type == BPF_STORE_TYPE_HASH) {
+        scan_ctx_t sctx = {
+            .items = items,
+            .max = max,
+            .key = key,
+            .reverse = reverse,
+        };
+        hashmap_foreach(&store->hash, _hash_scan, &sctx);
+        return sctx.count;
+    }
+
+    return _tree_scan(&store->tree, key, items, max, reverse);
+}
+
+static size_t _scan(bpf_store_t *store, uint32_t key, bpf_store_kv_t *items, size_t max,
+                    bool reverse)
+{
+    if (max == 0) {
+        return 0;
+    }
+
+    /* Expired entries may not have been swept yet, so remove any found and try again */
+    lock_mode_t mode = _lock_entries(store);
+    size_t count;
+    do {
+        count = _scan_entries(store, key, items, max, reverse);
+    } while (store->cache && _cache_purge(store, items, count));
+    _unlock(mode);
+    return count;
+}
+
+size_t bpf_store_scan_global(uint32_t key, bpf_store_kv_t *items, size_t max, bool reverse)
+{
+    return _scan(&_global, key, items, max, reverse);
+}
+
+size_t bpf_store_scan_local(bpf_t *bpf, uint32_t key, bpf_store_kv_t *items, size_t max,
+                            bool reverse)
+{
+    return _scan(&bpf->store, key, items, max, reverse);
+}
+
+int bpf_store_update64_global(uint64_t key, uint64_t value)
+{
+    return _update64(&_global, key, value);
+}
+
+int bpf_store_lookup64_global(uint64_t key, uint64_t *value)
+{
+    return _lookup64(&_global, key, value);
+}
+
+int bpf_store_fetch_add64_global(uint64_t key, uint64_t delta, uint64_t *old)
+{
+    return _fetch_add64(&_global, key, delta, old);
+}
+
+int bpf_store_remove64_global(uint64_t key)
+{
+    return _remove64(&_global, key);
+}
+
+int bpf_store_set_blob_global(uint64_t key, const void *data, size_t len)
+{
+    return _set_blob(&_global, key, data, len);
+}
+
+int bpf_store_get_blob_global(uint64_t key, void *buf, size_t size)
+{
+    return _get_blob(&_global, key, buf, size);
+}
+
+int bpf_store_remove_blob_global(uint64_t key)
+{
+    return _remove_blob(&_global, key);
+}
+
+int bpf_store_update64_local(bpf_t *bpf, uint64_t key, uint64_t value)
+{
+    return _update64(&bpf->store, key, value);
+}
+
+int bpf_store_lookup64_local(bpf_t *bpf, uint64_t key, uint64_t *value)
+{
+    return _lookup64(&bpf->store, key, value);
+}
+
+int bpf_store_fetch_add64_local(bpf_t *bpf, uint64_t key, uint64_t delta, uint64_t *old)
+{
+    return _fetch_add64(&bpf->store, key, delta, old);
+}
+
+int bpf_store_remove64_local(bpf_t *bpf, uint64_t key)
+{
+    return _remove64(&bpf->store, key);
+}
+
+int bpf_store_set_blob_local(bpf_t *bpf, uint64_t key, const void *data, size_t len)
+{
+    return _set_blob(&bpf->store, key, data, len);
+}
+
+int bpf_store_get_blob_local(bpf_t *bpf, uint64_t key, void *buf, size_t size)
+{
+    return _get_blob(&bpf->store, key, buf, size);
+}
+
+int bpf_store_remove_blob_local(bpf_t *bpf, uint64_t key)
+{
+    return _remove_blob(&bpf->store, key);
+}
+
+int bpf_store_lookup_global(uint32_t key, uint32_t *value)
+{
+    return _lookup_value(&_global, key, value);
+}
+
+int bpf_store_lookup_local(bpf_t *bpf, uint32_t key, uint32_t *value)
+{
+    return _lookup_value(&bpf->store, key, value);
+}
+
+int bpf_store_fetch_add_global(uint32_t key, uint32_t delta, uint32_t *old)
+{
+    return _fetch_add(&_global, key, delta, old);
+}
+
+int bpf_store_fetch_add_local(bpf_t *bpf, uint32_t key, uint32_t delta, uint32_t *old)
+{
+    return _fetch_add(&bpf->store, key, delta, old);
+}
+
+int bpf_store_cas_global(uint32_t key, uint32_t expected, uint32_t desired, uint32_t *actual)
+{
+    return _compare_exchange(&_global, key, expected, desired, actual);
+}
+
+int bpf_store_cas_local(bpf_t *bpf, uint32_t key, uint32_t expected, uint32_t desired,
+                        uint32_t *actual)
+{
+    return _compare_exchange(&bpf->store, key, expected, desired, actual);
+}
+
+int bpf_store_min_global(uint32_t key, uint32_t value)
+{
+    return _update_limit(&_global, key, value, false);
+}
+
+int bpf_store_min_local(bpf_t *bpf, uint32_t key, uint32_t value)
+{
+    return _update_limit(&bpf->store, key, value, false);
+}
+
+int bpf_store_max_global(uint32_t key, uint32_t value)
+{
+    return _update_limit(&_global, key, value, true);
+}
+
+int bpf_store_max_local(bpf_t *bpf, uint32_t key, uint32_t value)
+{
+    return _update_limit(&bpf->store, key, value, true);
+}
+
+int bpf_store_set_global_cache(uint32_t capacity, uint32_t ttl)
+{
+    lock_mode_t mode = _lock(&_global, LOCK_EXCLUSIVE);
+    int res = _set_cache(&_global, capacity, ttl);
+    _unlock(mode);
+    return res;
+}
+
+int bpf_store_set_local_cache(bpf_t *bpf, uint32_t capacity, uint32_t ttl)
+{
+    return _set_cache(&bpf->store, capacity, ttl);
+}
+
+int bpf_store_set_ttl_global(uint32_t key, uint32_t ttl)
+{
+    lock_mode_t mode = _lock(&_global, LOCK_EXCLUSIVE);
+    int res = _set_ttl(&_global, key, ttl);
+    _unlock(mode);
+    return res;
+}
+
+int bpf_store_set_ttl_local(bpf_t *bpf, uint32_t key, uint32_t ttl)
+{
+    return _set_ttl(&bpf->store, key, ttl);
+}
+
+int bpf_store_get_global_cache_stats(bpf_store_cache_stats_t *stats)
+{
+    lock_mode_t mode = _lock(&_global, LOCK_SHARED);
+    int res = _get_cache_stats(&_global, stats);
+    _unlock(mode);
+    return res;
+}
+
+int bpf_store_get_local_cache_stats(const bpf_t *bpf, bpf_store_cache_stats_t *stats)
+{
+    return _get_cache_stats(&bpf->store, stats);
+}
+
+int bpf_store_set_global_type(bpf_store_type_t type)
+{
+    lock_mode_t mode = _lock(&_global, LOCK_EXCLUSIVE);
+    int res = _set_type(&_global, type);
+    _unlock(mode);
+    return res;
+}
+
+int bpf_store_set_local_type(bpf_t *bpf, bpf_store_type_t type)
+{
+    return _set_type(&bpf->store, type);
+}
+
+void bpf_store_clear_global(void)
+{
+    lock_mode_t mode = _lock(&_global, LOCK_EXCLUSIVE);
+    _clear(&_global);
+    _unlock(mode);
+}
+
+void bpf_store_clear_local(bpf_t *bpf)
+{
+    _clear(&bpf->store);
+}
+
+void bpf_store_set_global_quota(uint32_t quota)
+{
+    lock_mode_t mode = _lock(&_global, LOCK_EXCLUSIVE);
+    _global.quota = quota;
+    _unlock(mode);
+}
+
+void bpf_store_set_local_quota(bpf_t *bpf, uint32_t quota)
+{
+    bpf->store.quota = quota;
+}
+
+size_t bpf_store_count_global(void)
+{
+    return bpf_atomic_load(&_global.count);
+}
+
+size_t bpf_store_count_local(const bpf_t *bpf)
+{
+    return bpf->store.count;
+}
+
+const bpf_store_t *bpf_store_get_global(void)
+{
+    return &_global;
+}
+
+typedef struct {
+    bpf_store_iter_cb_t cb;
+    void *ctx;
+    const bpf_store_cache_t *cache; ///< Set to skip expired entries
+    uint32_t now;
+} iter_ctx_t;
+
+static inline void _iter_visit(const iter_ctx_t *ictx, uint32_t key, uint32_t value)
+{
+    if (ictx->cache == NULL || _cache_live(ictx->cache, key, ictx->now)) {
+        ictx->cb(key, value, ictx->ctx);
+    }
+}
+
+#if CONFIG_BPF_STORE_COMPACT
+static void _tree_iter(ctree_node_t *node, void *ctx)
+{
+    iter_ctx_t *ictx = ctx;
+    _iter_visit(ictx, node->key, bpf_atomic_load(&node->value));
+}
+#else
+static void _tree_iter(btree_node_t *node, size_t depth, void *ctx)
+{
+    (void)depth;
+    iter_ctx_t *ictx = ctx;
+    _iter_visit(ictx, node->key, bpf_atomic_load(&((bpf_store_keyval_t*)node)->value));
+}
+#endif
+
+static void _hash_iter(hashmap_entry_t *entry, void *ctx)
+{
+    iter_ctx_t *ictx = ctx;
+    _iter_visit(ictx, entry->key, bpf_atomic_load(&entry->value));
+}
+
+static void _iter(bpf_store_t *store, bpf_store_iter_cb_t cb, void *ctx)
+{
+    iter_ctx_t ictx = {cb, ctx, store->cache, store->cache ? bpf_clock_ms() : 0};
+    if (store->type == BPF_STORE_TYPE_HASH) {
+        hashmap_foreach(&store->hash, _hash_iter, &ictx);
+    }
+    else {
+#if CONFIG_BPF_STORE_COMPACT
+        ctree_traverse(&store->tree, _tree_iter, &ictx);
+#else
+        btree_traverse(&store->tree, _tree_iter, &ictx);
+#endif
+    }
+}
+
+typedef struct {
+    bpf_store_kv_t *items;
+    size_t count;
+} collect_ctx_t;
+
+static void _collect(uint32_t key, uint32_t value, void *ctx)
+{
+    collect_ctx_t *cctx = ctx;
+    cctx->items[cctx->count].key = key;
+    cctx->items[cctx->count].value = value;
+    cctx->count++;
+}
+
+static int _compare_keys(const void *a, const void *b)
+{
+    uint32_t ka = ((const bpf_store_kv_t *)a)->key;
+    uint32_t kb = ((const bpf_store_kv_t *)b)->key;
+    return (ka > kb) - (ka < kb);
+}
+
+/* Without memory for a copy, read batches in key order, each under the lock */
+static void _iter_scan(bpf_store_iter_cb_t cb, void *ctx)
+{
+    bpf_store_kv_t items[16];
+    const size_t max = sizeof(items) / sizeof(items[0]);
+    uint32_t key = 0;
+    for (;;) {
+        size_t count = bpf_store_scan_global(key, items, max, false);
+        for (size_t i = 0; i < count; i++) {
+            cb(items[i].key, items[i].value, ctx);
+        }
+        if (count < max || items[count - 1].key == UINT32_MAX) {
+            break;
+        }
+        key = items[count - 1].key + 1;
+    }
+}
+
+/*
+ * The callback may itself change the global store, which needs the lock exclusively.
+ * Entries are therefore copied under the lock and visited after releasing it.
+ */
+void bpf_store_iter_global(bpf_store_iter_cb_t cb, void *ctx)
+{
+    lock_mode_t mode = _lock(&_global, LOCK_SHARED);
+    collect_ctx_t cctx = {
+        .items = (_global.count == 0) ? NULL : malloc(_global.count * sizeof(bpf_store_kv_t)),
+    };
+    if (cctx.items != NULL) {
+        _iter(&_global, _collect, &cctx);
+    }
+    bool sort = (_global.type == BPF_STORE_TYPE_HASH);
+    size_t count = _global.count;
+    _unlock(mode);
+
+    if (count == 0) {
+        return;
+    }
+    if (cctx.items == NULL) {
+        debug_w("[BPF] No memory to copy global store, iterating in batches");
+        _iter_scan(cb, ctx);
+        return;
+    }
+    if (sort) {
+        qsort(cctx.items, cctx.count, sizeof(bpf_store_kv_t), _compare_keys);
+    }
+    for (size_t i = 0; i < cctx.count; i++) {
+        cb(cctx.items[i].key, cctx.items[i].value, ctx);
+    }
+    free(cctx.items);
 }
 
-void bpf_store_iter_global(btree_cb_t cb, void *ctx)
+void bpf_store_iter_local(bpf_t *bpf, bpf_store_iter_cb_t cb, void *ctx)
 {
-    btree_traverse(&_global, cb, ctx);
+    _iter(&bpf->store, cb, ctx);
 }
@@ -0,0 +1,278 @@
+/**
+ * Switch-case interpreter
+ *
+ * Instructions are decoded by class, then by operation. Register and
+ * immediate variants, 32 and 64-bit ALU operations and the four memory access
+ * sizes share a single implementation, trading some dispatch speed for a much
+ * smaller footprint than the computed jump table in jumptable.c.
+ *
+ * Selected by building with CONFIG_BPF_USE_JUMPTABLE=0.
+ */
+
+#include <stdint.h>
+#include <stdlib.h>
+#include <stdbool.h>
+
+#include "bpf.h"
+#include "bpf/instruction.h"
+#include "bpf/call.h"
+
+#if !CONFIG_BPF_USE_JUMPTABLE
+
+static bool _alu(uint64_t *dst, uint64_t src, uint8_t op, bool alu32, int *res)
+{
+    uint64_t d = *dst;
+    if (alu32) {
+        d = (uint32_t)d;
+        src = (uint32_t)src;
+    }
+
+    switch (op) {
+    case BPF_INSTRUCTION_ALU_ADD:
+        d += src;
+        break;
+    case BPF_INSTRUCTION_ALU_SUB:
+        d -= src;
+        break;
+    case BPF_INSTRUCTION_ALU_MUL:
+        d *= src;
+        break;
+    case BPF_INSTRUCTION_ALU_DIV:
+    case BPF_INSTRUCTION_ALU_MOD:
+        if (src == 0) {
+            *res = BPF_ILLEGAL_DIV;
+            return false;
+        }
+        d = (op == BPF_INSTRUCTION_ALU_DIV) ? d / src : d % src;
+        break;
+    case BPF_INSTRUCTION_ALU_OR:
+        d |= src;
+        break;
+    case BPF_INSTRUCTION_ALU_AND:
+        d &= src;
+        break;
+    case BPF_INSTRUCTION_ALU_LSH:
+        d <<= src;
+        break;
+    case BPF_INSTRUCTION_ALU_RSH:
+        d >>= src;
+        break;
+    case BPF_INSTRUCTION_ALU_NEG:
+        d = -d;
+        break;
+    case BPF_INSTRUCTION_ALU_XOR:
+        d ^= src;
+        break;
+    case BPF_INSTRUCTION_ALU_MOV:
+        d = src;
+        break;
+    case BPF_INSTRUCTION_ALU_ARSH:
+        d = alu32 ? (uint64_t)((int32_t)d >> src) : (uint64_t)((int64_t)d >> src);
+        break;
+    default:
+        *res = BPF_ILLEGAL_INSTRUCTION;
+        return false;
+    }
+
+    *dst = alu32 ? (uint32_t)d : d;
+    return true;
+}
+
+static int _branch(uint64_t dst, uint64_t src, uint8_t op)
+{
+    switch (op) {
+    case BPF_INSTRUCTION_BRANCH_JA:
+        return 1;
+    case BPF_INSTRUCTION_BRANCH_JEQ:
+        return dst == src;
+    case BPF_INSTRUCTION_BRANCH_JGT:
+        return dst > src;
+    case BPF_INSTRUCTION_BRANCH_JGE:
+        return dst >= src;
+    case BPF_INSTRUCTION_BRANCH_JLT:
+        return dst < src;
+    case BPF_INSTRUCTION_BRANCH_JLE:
+        return dst <= src;
+    case BPF_INSTRUCTION_BRANCH_JSET:
+        return (dst & src) != 0;
+    case BPF_INSTRUCTION_BRANCH_JNE:
+        return dst != src;
+    case BPF_INSTRUCTION_BRANCH_JSGT:
+        return (int64_t)dst > (int64_t)src;
+    case BPF_INSTRUCTION_BRANCH_JSGE:
+        return (int64_t)dst >= (int64_t)src;
+    case BPF_INSTRUCTION_BRANCH_JSLT:
+        return (int64_t)dst < (int64_t)src;
+    case BPF_INSTRUCTION_BRANCH_JSLE:
+        return (int64_t)dst <= (int64_t)src;
+    default:
+        return -1;
+    }
+}
+
+int bpf_run(bpf_t *bpf, const void *ctx, int64_t *result)
+{
+    int res = BPF_OK;
+    bpf->branches_remaining = CONFIG_BPF_BRANCHES_ALLOWED;
+    uint64_t regmap[11] = { 0 };
+    regmap[1] = (uint64_t)(uintptr_t)ctx;
+    regmap[10] = (uint64_t)(uintptr_t)(bpf->stack + bpf->stack_size);
+
+    const volatile bpf_instruction_t *pc = (const volatile bpf_instruction_t*)bpf->text;
+
+    res = bpf_verify_preflight(bpf);
+    if (res < 0) {
+        return res;
+    }
+
+    for (;; pc++) {
+        bpf_instruction_t instr = GET_INSTRUCTION(pc);
+        uint64_t *dst = &regmap[instr.dst];
+        uint8_t cls = instr.opcode & BPF_INSTRUCTION_CLS_MASK;
+
+        switch (cls) {
+        case BPF_INSTRUCTION_CLS_ALU32:
+            if (!CONFIG_BPF_ENABLE_ALU32) {
+                res = BPF_ILLEGAL_INSTRUCTION;
+                goto exit;
+            }
+            /* fall through */
+        case BPF_INSTRUCTION_CLS_ALU64: {
+            uint8_t op = instr.opcode & BPF_INSTRUCTION_ALU_OP_MASK;
+            bool reg = instr.opcode & BPF_INSTRUCTION_ALU_S_MASK;
+            /* NEG only has a register form */
+            if (op == BPF_INSTRUCTION_ALU_NEG && !reg) {
+                res = BPF_ILLEGAL_INSTRUCTION;
+                goto exit;
+            }
+            uint64_t src = reg ? regmap[instr.src] : (uint64_t)(int64_t)instr.immediate;
+            if (!_alu(dst, src, op, cls == BPF_INSTRUCTION_CLS_ALU32, &res)) {
+                goto exit;
+            }
+            continue;
+        }
+
+        case BPF_INSTRUCTION_CLS_BRANCH: {
+            if (instr.opcode == (BPF_INSTRUCTION_BRANCH_CALL | BPF_INSTRUCTION_CLS_BRANCH)) {
+                bpf_call_t call = bpf_get_call(instr.immediate);
+                if (!call) {
+                    res = BPF_ILLEGAL_CALL;
+                    goto exit;
+                }
+                regmap[0] = call(bpf, regmap[1], regmap[2], regmap[3], regmap[4], regmap[5]);
+                continue;
+            }
+            if (instr.opcode == (BPF_INSTRUCTION_BRANCH_EXIT | BPF_INSTRUCTION_CLS_BRANCH)) {
+                goto exit;
+            }
+            bool reg = instr.opcode & BPF_INSTRUCTION_ALU_S_MASK;
+            uint8_t op = instr.opcode & BPF_INSTRUCTION_ALU_OP_MASK;
+            /* Unconditional jump only has the immediate form */
+            if (op == BPF_INSTRUCTION_BRANCH_JA && reg) {
+                res = BPF_ILLEGAL_INSTRUCTION;
+                goto exit;
+            }
+            uint64_t src = reg ? regmap[instr.src] : (uint64_t)(int64_t)instr.immediate;
+            int cond = _branch(*dst, src, op);
+            if (cond < 0) {
+                res = BPF_ILLEGAL_INSTRUCTION;
+                goto exit;
+            }
+            if (cond) {
+                pc += instr.offset;
+                if ((!(bpf->flags & BPF_CONFIG_NO_RETURN)) &&
+                        bpf->branches_remaining-- == 0) {
+                    res = BPF_OUT_OF_BRANCHES;
+                    goto exit;
+                }
+            }
+            continue;
+        }
+
+        case BPF_INSTRUCTION_CLS_LD: {
+            const uint8_t *base;
+            switch (instr.opcode) {
+            case BPF_INSTRUCTION_LDDW:
+                base = NULL;
+                break;
+            case BPF_INSTRUCTION_LDDWD:
+                base = bpf->data_region.phys_start;
+                break;
+            case BPF_INSTRUCTION_LDDWR:
+                base = bpf->rodata_region.phys_start;
+                break;
+            default:
+                res = BPF_ILLEGAL_INSTRUCTION;
+                goto exit;
+            }
+            *dst = (uintptr_t)base + (uint64_t)(uint32_t)instr.immediate;
+            *dst += (uint64_t)(GET_INSTRUCTION(pc + 1).immediate) << 32;
+            pc++;
+            continue;
+        }
+
+        case BPF_INSTRUCTION_CLS_LDX:
+        case BPF_INSTRUCTION_CLS_ST:
+        case BPF_INSTRUCTION_CLS_STX: {
+            if ((instr.opcode & BPF_INSTRUCTION_MEM_MDE_MASK) != BPF_INSTRUCTION_LDX_LDX) {
+                res = BPF_ILLEGAL_INSTRUCTION;
+                goto exit;
+            }
+            static const uint8_t sizes[] = {4, 2, 1, 8};
+            uint8_t size = sizes[(instr.opcode & BPF_INSTRUCTION_MEM_SZ_MASK) >> 3];
+            bool load = (cls == BPF_INSTRUCTION_CLS_LDX);
+            intptr_t addr = (load ? regmap[instr.src] : *dst) + instr.offset;
+            void *memptr = bpf_get_mem(bpf, size, addr,
+                                       load ? BPF_MEM_REGION_READ : BPF_MEM_REGION_WRITE);
+            if (memptr == NULL) {
+                res = BPF_ILLEGAL_MEM;
+                goto exit;
+            }
+            if (load) {
+                switch (size) {
+                case 1:
+                    *dst = *(const uint8_t*)memptr;
+                    break;
+                case 2:
+                    *dst = *(const uint16_t*)memptr;
+                    break;
+                case 4:
+                    *dst = *(const uint32_t*)memptr;
+                    break;
+                default:
+                    *dst = *(const uint64_t*)memptr;
+                    break;
+                }
+                continue;
+            }
+            uint64_t value = (cls == BPF_INSTRUCTION_CLS_STX)
+                ? regmap[instr.src] : (uint64_t)(int64_t)instr.immediate;
+            switch (size) {
+            case 1:
+                *(uint8_t*)memptr = value;
+                break;
+            case 2:
+                *(uint16_t*)memptr = value;
+                break;
+            case 4:
+                *(uint32_t*)memptr = value;
+                break;
+            default:
+                *(uint64_t*)memptr = value;
+                break;
+            }
+            continue;
+        }
+
+        default:
+            res = BPF_ILLEGAL_INSTRUCTION;
+            goto exit;
+        }
+    }
+
+exit:
+    *result = regmap[0];
+    return res;
+}
+
+#endif /* !CONFIG_BPF_USE_JUMPTABLE */
@@ -0,0 +1,66 @@
+#include "bpf/sync.h"
+
+#if CONFIG_BPF_CONCURRENT
+
+#include <sched.h>
+
+/* Threads are numbered in turn as they first need it */
+static uint32_t _next_index;
+static _Thread_local uint32_t _index = UINT32_MAX;
+
+uint32_t bpf_sync_thread_index(void)
+{
+    if (_index == UINT32_MAX) {
+        _index = __atomic_fetch_add(&_next_index, 1, __ATOMIC_RELAXED);
+    }
+    return _index;
+}
+
+static uint32_t *_readers(bpf_rwlock_t *lock)
+{
+    return &lock->slots[bpf_sync_thread_index() % CONFIG_BPF_SYNC_READER_SLOTS].readers;
+}
+
+/*
+ * Readers announce themselves before checking for a writer, and writers the
+ * reverse, both with sequentially consistent operations. So either the reader
+ * sees the writer and backs off, or the writer sees the reader and waits.
+ */
+void bpf_rwlock_read_lock(bpf_rwlock_t *lock)
+{
+    uint32_t *readers = _readers(lock);
+    for (;;) {
+        __atomic_add_fetch(readers, 1, __ATOMIC_SEQ_CST);
+        if (!__atomic_load_n(&lock->writer, __ATOMIC_SEQ_CST)) {
+            return;
+        }
+        __atomic_sub_fetch(readers, 1, __ATOMIC_RELEASE);
+        while (__atomic_load_n(&lock->writer, __ATOMIC_RELAXED)) {
+            sched_yield();
+        }
+    }
+}
+
+void bpf_rwlock_read_unlock(bpf_rwlock_t *lock)
+{
+    __atomic_sub_fetch(_readers(lock), 1, __ATOMIC_RELEASE);
+}
+
+void bpf_rwlock_write_lock(bpf_rwlock_t *lock)
+{
+    bpf_mutex_lock(&lock->mutex);
+    __atomic_store_n(&lock->writer, 1, __ATOMIC_SEQ_CST);
+    for (unsigned i = 0; i < CONFIG_BPF_SYNC_READER_SLOTS; i++) {
+        while (__atomic_load_n(&lock->slots[i].readers, __ATOMIC_SEQ_CST) != 0) {
+            sched_yield();
+        }
+    }
+}
+
+void bpf_rwlock_write_unlock(bpf_rwlock_t *lock)
+{
+    __atomic_store_n(&lock->writer, 0, __ATOMIC_RELEASE);
+    bpf_mutex_unlock(&lock->mutex);
+}
+
+#endif /* CONFIG_BPF_CONCURRENT */
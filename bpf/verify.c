@@ -37,7 +37,12 @@ int bpf_verify_preflight(bpf_t *bpf)
         }
 
         /* Double length instruction */
-        if (inst.opcode == 0x18) {
+        if (inst.opcode == BPF_INSTRUCTION_LDDW || inst.opcode == BPF_INSTRUCTION_LDDWD ||
+            inst.opcode == BPF_INSTRUCTION_LDDWR) {
+            /* Second half must be present */
+            if (i + 1 >= (bpf_instruction_t*)((uint8_t*)application + length)) {
+                return BPF_ILLEGAL_LEN;
+            }
             i++;
             continue;
         }
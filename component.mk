@@ -11,6 +11,58 @@ COMPONENT_RELINK_VARS := BPF_STORE_NUM_VALUES
 BPF_STORE_NUM_VALUES ?= 16
 COMPONENT_CFLAGS := -DCONFIG_BPF_STORE_NUM_VALUES=$(BPF_STORE_NUM_VALUES)
 
+COMPONENT_RELINK_VARS += BPF_STORE_COMPACT
+BPF_STORE_COMPACT ?= 0
+COMPONENT_CFLAGS += -DCONFIG_BPF_STORE_COMPACT=$(BPF_STORE_COMPACT)
+
+# $1 -> Store type variable
+define BpfStoreType
+$(if $(filter hash,$($1)),BPF_STORE_TYPE_HASH,BPF_STORE_TYPE_TREE)
+endef
+
+COMPONENT_RELINK_VARS += BPF_STORE_GLOBAL_TYPE BPF_STORE_LOCAL_TYPE
+BPF_STORE_GLOBAL_TYPE ?= tree
+BPF_STORE_LOCAL_TYPE ?= tree
+COMPONENT_CFLAGS += \
+	-DCONFIG_BPF_STORE_GLOBAL_TYPE=$(call BpfStoreType,BPF_STORE_GLOBAL_TYPE) \
+	-DCONFIG_BPF_STORE_LOCAL_TYPE=$(call BpfStoreType,BPF_STORE_LOCAL_TYPE)
+
+COMPONENT_RELINK_VARS += BPF_STORE_LOCAL_QUOTA BPF_STORE_GLOBAL_QUOTA BPF_STORE_GLOBAL_RESERVE
+BPF_STORE_LOCAL_QUOTA ?= 0
+BPF_STORE_GLOBAL_QUOTA ?= 0
+BPF_STORE_GLOBAL_RESERVE ?= 0
+COMPONENT_CFLAGS += \
+	-DCONFIG_BPF_STORE_LOCAL_QUOTA=$(BPF_STORE_LOCAL_QUOTA) \
+	-DCONFIG_BPF_STORE_GLOBAL_QUOTA=$(BPF_STORE_GLOBAL_QUOTA) \
+	-DCONFIG_BPF_STORE_GLOBAL_RESERVE=$(BPF_STORE_GLOBAL_RESERVE)
+
+# Empty BPF_STORE_POOL_MAX keeps the tree pool at its static size
+COMPONENT_RELINK_VARS += BPF_STORE_POOL_CHUNK BPF_STORE_POOL_MAX
+BPF_STORE_POOL_CHUNK ?= 8
+BPF_STORE_POOL_MAX ?=
+COMPONENT_CFLAGS += \
+	-DCONFIG_BPF_STORE_POOL_CHUNK=$(BPF_STORE_POOL_CHUNK) \
+	$(if $(BPF_STORE_POOL_MAX),-DCONFIG_BPF_STORE_POOL_MAX=$(BPF_STORE_POOL_MAX))
+
+COMPONENT_RELINK_VARS += BPF_STORE_BLOB_MAX
+BPF_STORE_BLOB_MAX ?= 32
+COMPONENT_CFLAGS += -DCONFIG_BPF_STORE_BLOB_MAX=$(BPF_STORE_BLOB_MAX)
+
+COMPONENT_RELINK_VARS += BPF_CONCURRENT
+BPF_CONCURRENT ?= 0
+COMPONENT_CFLAGS += -DCONFIG_BPF_CONCURRENT=$(BPF_CONCURRENT)
+
+COMPONENT_RELINK_VARS += BPF_USE_JUMPTABLE
+BPF_USE_JUMPTABLE ?= 1
+COMPONENT_CFLAGS += -DCONFIG_BPF_USE_JUMPTABLE=$(BPF_USE_JUMPTABLE)
+
+COMPONENT_RELINK_VARS += BPF_CODE_CACHE_SIZE BPF_CODE_CACHE_THRESHOLD
+BPF_CODE_CACHE_SIZE ?= 0
+BPF_CODE_CACHE_THRESHOLD ?= 4
+COMPONENT_CFLAGS += \
+	-DCONFIG_BPF_CODE_CACHE_SIZE=$(BPF_CODE_CACHE_SIZE) \
+	-DCONFIG_BPF_CODE_CACHE_THRESHOLD=$(BPF_CODE_CACHE_THRESHOLD)
+
 COMPONENT_SRCDIRS := \
 	src \
 	bpf
@@ -0,0 +1,165 @@
+#include "include/rbpf/Executor.h"
+
+#if CONFIG_BPF_CONCURRENT
+
+#include "init.h"
+#include <algorithm>
+
+namespace rBPF
+{
+Executor::Executor(unsigned threads, size_t stackSize) : stackSize(stackSize)
+{
+	check_init();
+
+	if(threads == 0) {
+		threads = std::max(1U, std::thread::hardware_concurrency());
+	}
+	// Create all workers before starting any, since they steal from each other
+	for(unsigned i = 0; i < threads; ++i) {
+		workers.emplace_back(new Worker);
+	}
+	for(auto& worker : workers) {
+		worker->thread = std::thread(&Executor::run, this, std::ref(*worker));
+	}
+}
+
+Executor::~Executor()
+{
+	{
+		std::lock_guard<std::mutex> lock(mutex);
+		stopping = true;
+	}
+	available.notify_all();
+	for(auto& worker : workers) {
+		worker->thread.join();
+	}
+}
+
+void Executor::submit(const Container& container, Context context, Callback callback)
+{
+	auto& worker = *workers[nextWorker++ % workers.size()];
+	{
+		std::lock_guard<std::mutex> lock(worker.mutex);
+		worker.jobs.push_back(Job{&container, std::move(context), std::move(callback)});
+	}
+	{
+		std::lock_guard<std::mutex> lock(mutex);
+		++queued;
+		++outstanding;
+	}
+	available.notify_one();
+}
+
+std::future<Executor::Result> Executor::submit(const Container& container, Context context)
+{
+	// std::function must be copyable, so share the promise
+	auto promise = std::make_shared<std::promise<Result>>();
+	auto future = promise->get_future();
+	submit(container, std::move(context), [promise](Result& result) { promise->set_value(std::move(result)); });
+	return future;
+}
+
+void Executor::wait()
+{
+	std::unique_lock<std::mutex> lock(mutex);
+	idle.wait(lock, [this] { return outstanding == 0; });
+}
+
+void Executor::run(Worker& worker)
+{
+	Job job;
+	while(take(worker, job)) {
+		execute(worker, job);
+		job = Job{};
+
+		std::lock_guard<std::mutex> lock(mutex);
+		if(--outstanding == 0) {
+			idle.notify_all();
+		}
+	}
+	worker.machines.clear();
+}
+
+/*
+ * Claiming one of the queued count guarantees a job is present in some queue,
+ * although another worker may take the first one found, so search until successful.
+ */
+bool Executor::take(Worker& worker, Job& job)
+{
+	{
+		std::unique_lock<std::mutex> lock(mutex);
+		available.wait(lock, [this] { return queued != 0 || stopping; });
+		if(queued == 0) {
+			return false;
+		}
+		--queued;
+	}
+
+	for(;;) {
+		{
+			std::lock_guard<std::mutex> lock(worker.mutex);
+			if(!worker.jobs.empty()) {
+				job = std::move(worker.jobs.front());
+				worker.jobs.pop_front();
+				return true;
+			}
+		}
+		for(auto& other : workers) {
+			if(other.get() == &worker) {
+				continue;
+			}
+			std::lock_guard<std::mutex> lock(other->mutex);
+			if(!other->jobs.empty()) {
+				job = std::move(other->jobs.back());
+				other->jobs.pop_back();
+				++stolen;
+				return true;
+			}
+		}
+		std::this_thread::yield();
+	}
+}
+
+/*
+ * A queue has one producer and one consumer, so cannot be used by the
+ * instances of a container on each worker
+ */
+static bool usesQueue(const VirtualMachine& vm)
+{
+	for(unsigned i = 0; i < vm.getMapCount(); ++i) {
+		if(vm.getMap(i).type() == Map::Type::queue) {
+			return true;
+		}
+	}
+	return false;
+}
+
+void Executor::execute(Worker& worker, Job& job)
+{
+	auto& vm = worker.machines[job.container];
+	if(!vm) {
+		vm.reset(new VirtualMachine(*job.container, stackSize));
+	}
+
+	Result result;
+	if(usesQueue(*vm)) {
+		result.error = RBPF_NOT_SUPPORTED;
+	} else {
+		if(job.context.empty()) {
+			result.value = vm->execute();
+		} else {
+			result.value = vm->execute(job.context.data(), job.context.size());
+		}
+		result.error = vm->getLastError();
+	}
+	result.context = std::move(job.context);
+	++executed;
+
+	if(job.callback) {
+		job.callback(result);
+	}
+}
+
+} // namespace rBPF
+
+#endif
@@ -0,0 +1,16 @@
+#include "include/rbpf/Map.h"
+#include <bpf/clock.h>
+
+namespace rBPF
+{
+uint32_t Window::add(uint32_t delta)
+{
+	return map ? bpf_map_window_add(map, bpf_clock_ms(), delta) : 0;
+}
+
+uint32_t Window::read(uint32_t* counts, size_t maxCounts) const
+{
+	return map ? bpf_map_window_read(map, bpf_clock_ms(), counts, maxCounts) : 0;
+}
+
+} // namespace rBPF
@@ -6,6 +6,12 @@
 
 namespace rBPF
 {
+static_assert(sizeof(Store::KeyValue) == sizeof(bpf_store_kv_t), "Store::KeyValue layout mismatch");
+static_assert(unsigned(PerThreadStore::Merge::sum) == BPF_PERCPU_SUM &&
+				  unsigned(PerThreadStore::Merge::min) == BPF_PERCPU_MIN &&
+				  unsigned(PerThreadStore::Merge::max) == BPF_PERCPU_MAX,
+			  "PerThreadStore::Merge mismatch");
+
 bool LocalStore::update(Key key, Value value)
 {
 	return bpf_store_update_local(reinterpret_cast<bpf_t*>(vm.inst.get()), key, value) == 0;
@@ -16,6 +22,89 @@ bool LocalStore::fetch(Key key, Value& value)
 	return bpf_store_fetch_local(reinterpret_cast<bpf_t*>(vm.inst.get()), key, &value) == 0;
 }
 
+bool LocalStore::fetchMany(const Key* keys, Value* values, size_t count)
+{
+	return vm.inst && bpf_store_fetch_many_local(vm.inst.get(), keys, values, count) == 0;
+}
+
+bool LocalStore::updateMany(const Key* keys, const Value* values, size_t count)
+{
+	return vm.inst && bpf_store_update_many_local(vm.inst.get(), keys, values, count) == 0;
+}
+
+int LocalStore::scan(Key key, KeyValue* items, size_t max, bool reverse)
+{
+	if(!vm.inst) {
+		return -1;
+	}
+	return bpf_store_scan_local(vm.inst.get(), key, reinterpret_cast<bpf_store_kv_t*>(items), max, reverse);
+}
+
+bool LocalStore::lookup(Key key, Value& value)
+{
+	value = 0;
+	return vm.inst && bpf_store_lookup_local(vm.inst.get(), key, &value) == 0;
+}
+
+bool LocalStore::remove(Key key)
+{
+	return vm.inst && bpf_store_remove_local(vm.inst.get(), key) == 0;
+}
+
+bool LocalStore::setTtl(Key key, uint32_t ttl)
+{
+	return vm.inst && bpf_store_set_ttl_local(vm.inst.get(), key, ttl) == 0;
+}
+
+bool LocalStore::fetchAdd(Key key, Value delta, Value& old)
+{
+	return vm.inst && bpf_store_fetch_add_local(vm.inst.get(), key, delta, &old) == 0;
+}
+
+bool LocalStore::compareExchange(Key key, Value& expected, Value desired)
+{
+	return vm.inst && bpf_store_cas_local(vm.inst.get(), key, expected, desired, &expected) == 0;
+}
+
+bool LocalStore::updateMin(Key key, Value value)
+{
+	return vm.inst && bpf_store_min_local(vm.inst.get(), key, value) == 0;
+}
+
+bool LocalStore::updateMax(Key key, Value value)
+{
+	return vm.inst && bpf_store_max_local(vm.inst.get(), key, value) == 0;
+}
+
+void LocalStore::clear()
+{
+	if(vm.inst) {
+		bpf_store_clear_local(vm.inst.get());
+	}
+}
+
+size_t LocalStore::count() const
+{
+	return vm.inst ? bpf_store_count_local(vm.inst.get()) : 0;
+}
+
+void LocalStore::setQuota(size_t quota)
+{
+	if(vm.inst) {
+		bpf_store_set_local_quota(vm.inst.get(), quota);
+	}
+}
+
+bool LocalStore::setCache(size_t capacity, uint32_t ttl)
+{
+	return vm.inst && bpf_store_set_local_cache(vm.inst.get(), capacity, ttl) == 0;
+}
+
+bool LocalStore::getCacheStats(StoreCacheStats& stats) const
+{
+	return vm.inst && bpf_store_get_local_cache_stats(vm.inst.get(), &stats) == 0;
+}
+
 bool GlobalStore::update(Key key, Value value)
 {
 	return bpf_store_update_global(key, value) == 0;
@@ -26,6 +115,185 @@ bool GlobalStore::fetch(Key key, Value& value)
 	return bpf_store_fetch_global(key, &value) == 0;
 }
 
-// void bpf_store_iter_global(btree_cb_t cb, void* ctx);
+bool GlobalStore::fetchMany(const Key* keys, Value* values, size_t count)
+{
+	return bpf_store_fetch_many_global(keys, values, count) == 0;
+}
+
+bool GlobalStore::updateMany(const Key* keys, const Value* values, size_t count)
+{
+	return bpf_store_update_many_global(keys, values, count) == 0;
+}
+
+int GlobalStore::scan(Key key, KeyValue* items, size_t max, bool reverse)
+{
+	return bpf_store_scan_global(key, reinterpret_cast<bpf_store_kv_t*>(items), max, reverse);
+}
+
+bool GlobalStore::lookup(Key key, Value& value)
+{
+	return bpf_store_lookup_global(key, &value) == 0;
+}
+
+bool GlobalStore::remove(Key key)
+{
+	return bpf_store_remove_global(key) == 0;
+}
+
+bool GlobalStore::setTtl(Key key, uint32_t ttl)
+{
+	return bpf_store_set_ttl_global(key, ttl) == 0;
+}
+
+bool GlobalStore::fetchAdd(Key key, Value delta, Value& old)
+{
+	return bpf_store_fetch_add_global(key, delta, &old) == 0;
+}
+
+bool GlobalStore::compareExchange(Key key, Value& expected, Value desired)
+{
+	return bpf_store_cas_global(key, expected, desired, &expected) == 0;
+}
+
+bool GlobalStore::updateMin(Key key, Value value)
+{
+	return bpf_store_min_global(key, value) == 0;
+}
+
+bool GlobalStore::updateMax(Key key, Value value)
+{
+	return bpf_store_max_global(key, value) == 0;
+}
+
+void GlobalStore::clear()
+{
+	check_init();
+	bpf_store_clear_global();
+}
+
+size_t GlobalStore::count() const
+{
+	return bpf_store_count_global();
+}
+
+void GlobalStore::setQuota(size_t quota)
+{
+	check_init();
+	bpf_store_set_global_quota(quota);
+}
+
+bool GlobalStore::setCache(size_t capacity, uint32_t ttl)
+{
+	check_init();
+	return bpf_store_set_global_cache(capacity, ttl) == 0;
+}
+
+bool GlobalStore::getCacheStats(StoreCacheStats& stats) const
+{
+	return bpf_store_get_global_cache_stats(&stats) == 0;
+}
+
+bool LocalWideStore::update(Key key, Value value)
+{
+	return vm.inst && bpf_store_update64_local(vm.inst.get(), key, value) == 0;
+}
+
+bool LocalWideStore::lookup(Key key, Value& value)
+{
+	value = 0;
+	return vm.inst && bpf_store_lookup64_local(vm.inst.get(), key, &value) == 0;
+}
+
+bool LocalWideStore::remove(Key key)
+{
+	return vm.inst && bpf_store_remove64_local(vm.inst.get(), key) == 0;
+}
+
+bool LocalWideStore::fetchAdd(Key key, Value delta, Value& old)
+{
+	return vm.inst && bpf_store_fetch_add64_local(vm.inst.get(), key, delta, &old) == 0;
+}
+
+bool LocalWideStore::setBlob(Key key, const void* data, size_t len)
+{
+	return vm.inst && bpf_store_set_blob_local(vm.inst.get(), key, data, len) == 0;
+}
+
+int LocalWideStore::getBlob(Key key, void* buf, size_t size)
+{
+	return vm.inst ? bpf_store_get_blob_local(vm.inst.get(), key, buf, size) : -1;
+}
+
+bool LocalWideStore::removeBlob(Key key)
+{
+	return vm.inst && bpf_store_remove_blob_local(vm.inst.get(), key) == 0;
+}
+
+bool GlobalWideStore::update(Key key, Value value)
+{
+	return bpf_store_update64_global(key, value) == 0;
+}
+
+bool GlobalWideStore::lookup(Key key, Value& value)
+{
+	return bpf_store_lookup64_global(key, &value) == 0;
+}
+
+bool GlobalWideStore::remove(Key key)
+{
+	return bpf_store_remove64_global(key) == 0;
+}
+
+bool GlobalWideStore::fetchAdd(Key key, Value delta, Value& old)
+{
+	return bpf_store_fetch_add64_global(key, delta, &old) == 0;
+}
+
+bool GlobalWideStore::setBlob(Key key, const void* data, size_t len)
+{
+	return bpf_store_set_blob_global(key, data, len) == 0;
+}
+
+int GlobalWideStore::getBlob(Key key, void* buf, size_t size)
+{
+	return bpf_store_get_blob_global(key, buf, size);
+}
+
+bool GlobalWideStore::removeBlob(Key key)
+{
+	return bpf_store_remove_blob_global(key) == 0;
+}
+
+bool GlobalPerThreadStore::add(Key key, Value delta)
+{
+	return bpf_percpu_add(key, delta) == 0;
+}
+
+bool GlobalPerThreadStore::update(Key key, Value value)
+{
+	return bpf_percpu_update(key, value) == 0;
+}
+
+bool GlobalPerThreadStore::lookup(Key key, Merge merge, uint64_t& value)
+{
+	return bpf_percpu_lookup(key, bpf_percpu_merge_t(merge), &value) == 0;
+}
+
+int GlobalPerThreadStore::lookupAll(Key key, Value* values, size_t max)
+{
+	return bpf_percpu_lookup_all(key, values, max);
+}
+
+bool GlobalPerThreadStore::remove(Key key)
+{
+	return bpf_percpu_remove(key) == 0;
+}
+
+void GlobalPerThreadStore::clear()
+{
+	bpf_percpu_clear();
+}
+
+// void bpf_store_iter_global(bpf_store_iter_cb_t cb, void* ctx);
 
 } // namespace rBPF
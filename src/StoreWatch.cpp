@@ -0,0 +1,115 @@
+#include "include/rbpf/StoreWatch.h"
+#include "init.h"
+#include <cstring>
+
+namespace rBPF
+{
+static_assert(sizeof(Store::Change) == sizeof(bpf_store_change_t), "Store::Change layout mismatch");
+
+StoreWatch::StoreWatch(VirtualMachine& vm, Store::Key first, Store::Key last, size_t maxPending)
+	: vm(vm), maxPending(maxPending)
+{
+	check_init();
+
+	if(maxPending == 0) {
+		return;
+	}
+	changes.reset(new Change[maxPending]);
+	if(bpf_store_watch_global(&watch, first, last, changed, this) < 0) {
+		changes.reset();
+	}
+}
+
+StoreWatch::~StoreWatch()
+{
+	if(changes) {
+		bpf_store_unwatch_global(&watch);
+	}
+}
+
+void StoreWatch::setNotify(Notify callback, void* param)
+{
+	bpf_mutex_lock(&mutex);
+	notify = callback;
+	notifyParam = param;
+	bpf_mutex_unlock(&mutex);
+}
+
+void StoreWatch::changed(const bpf_store_change_t* change, void* param)
+{
+	static_cast<StoreWatch*>(param)->add(Change{change->key, change->old_value, change->new_value});
+}
+
+void StoreWatch::add(const Change& change)
+{
+	bpf_mutex_lock(&mutex);
+	++stats.changes;
+	bool first{false};
+	size_t i;
+	for(i = 0; i < count && changes[i].key != change.key; ++i) {
+	}
+	if(i < count) {
+		++stats.coalesced;
+		changes[i].newValue = change.newValue;
+		if(changes[i].newValue == changes[i].oldValue) {
+			--count;
+			memmove(&changes[i], &changes[i + 1], (count - i) * sizeof(Change));
+		}
+	} else if(count < maxPending) {
+		changes[count++] = change;
+		first = (count == 1);
+	} else {
+		++stats.dropped;
+	}
+	// Only the first pending change needs the consumer scheduling
+	auto callback = first ? notify : nullptr;
+	auto param = notifyParam;
+	bpf_mutex_unlock(&mutex);
+
+	if(callback) {
+		callback(*this, param);
+	}
+}
+
+bool StoreWatch::take(Change& change)
+{
+	bpf_mutex_lock(&mutex);
+	bool found = (count != 0);
+	if(found) {
+		change = changes[0];
+		--count;
+		memmove(&changes[0], &changes[1], count * sizeof(Change));
+		++stats.executed;
+	}
+	bpf_mutex_unlock(&mutex);
+	return found;
+}
+
+size_t StoreWatch::run(size_t maxChanges)
+{
+	size_t n{0};
+	Change change;
+	while(n < maxChanges && take(change)) {
+		vm.execute(change);
+		++n;
+	}
+	return n;
+}
+
+size_t StoreWatch::pending() const
+{
+	bpf_mutex_lock(&mutex);
+	size_t n = count;
+	bpf_mutex_unlock(&mutex);
+	return n;
+}
+
+StoreWatch::Stats StoreWatch::getStats() const
+{
+	bpf_mutex_lock(&mutex);
+	Stats s = stats;
+	bpf_mutex_unlock(&mutex);
+	return s;
+}
+
+} // namespace rBPF
@@ -5,11 +5,9 @@
 
 namespace rBPF
 {
-enum {
-	RBPF_NO_MEMORY = -100,
-};
-
 GlobalStore VirtualMachine::globals;
+GlobalWideStore VirtualMachine::wideGlobals;
+GlobalPerThreadStore VirtualMachine::perThreadGlobals;
 
 String getErrorString(int error)
 {
@@ -36,12 +34,14 @@ String getErrorString(int error)
 		return F("ILLEGAL_DIV");
 	case RBPF_NO_MEMORY:
 		return F("NO_MEMORY");
+	case RBPF_NOT_SUPPORTED:
+		return F("NOT_SUPPORTED");
 	default:
 		return F("ERROR ") + String(error);
 	}
 };
 
-VirtualMachine::VirtualMachine() : locals(*this)
+VirtualMachine::VirtualMachine() : locals(*this), wideLocals(*this)
 {
 }
 
@@ -94,6 +94,7 @@ void VirtualMachine::unload()
 int64_t VirtualMachine::execute(void* ctx, size_t ctxLength)
 {
 	if(!inst) {
+		lastError = RBPF_NO_MEMORY;
 		return RBPF_NO_MEMORY;
 	}
 
@@ -106,4 +107,19 @@ int64_t VirtualMachine::execute(void* ctx, size_t ctxLength)
 	return result;
 }
 
+size_t VirtualMachine::getMapCount() const
+{
+	return inst ? bpf_map_count(inst.get()) : 0;
+}
+
+Map VirtualMachine::getMap(unsigned index) const
+{
+	return inst ? bpf_map_get(inst.get(), index) : nullptr;
+}
+
+Map VirtualMachine::getMap(const char* name) const
+{
+	return (inst && name) ? bpf_map_find(inst.get(), name) : nullptr;
+}
+
 } // namespace rBPF
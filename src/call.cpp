@@ -10,6 +10,9 @@
 #include <debug_progmem.h>
 #include <bpf.h>
 #include "bpf/store.h"
+#include "bpf/percpu.h"
+#include "bpf/map.h"
+#include "bpf/clock.h"
 #include "bpf/call.h"
 
 namespace rBPF
@@ -61,6 +64,529 @@ int bpf_fetch_global(bpf_t* bpf, uint32_t key, uint32_t* value)
 	return bpf_store_fetch_global(key, value);
 }
 
+int bpf_lookup_local(bpf_t* bpf, uint32_t key, uint32_t* value)
+{
+	if(bpf_store_allowed(bpf, value, sizeof(*value)) < 0) {
+		return -1;
+	}
+	return bpf_store_lookup_local(bpf, key, value);
+}
+
+int bpf_lookup_global(bpf_t* bpf, uint32_t key, uint32_t* value)
+{
+	if(bpf_store_allowed(bpf, value, sizeof(*value)) < 0) {
+		return -1;
+	}
+	return bpf_store_lookup_global(key, value);
+}
+
+int bpf_delete_local(bpf_t* bpf, uint32_t key)
+{
+	return bpf_store_remove_local(bpf, key);
+}
+
+int bpf_delete_global(bpf_t* bpf, uint32_t key)
+{
+	return bpf_store_remove_global(key);
+}
+
+int bpf_set_ttl_local(bpf_t* bpf, uint32_t key, uint32_t ttl)
+{
+	return bpf_store_set_ttl_local(bpf, key, ttl);
+}
+
+int bpf_set_ttl_global(bpf_t* bpf, uint32_t key, uint32_t ttl)
+{
+	return bpf_store_set_ttl_global(key, ttl);
+}
+
+int bpf_fetch_add_local(bpf_t* bpf, uint32_t key, uint32_t delta, uint32_t* old)
+{
+	if(old && bpf_store_allowed(bpf, old, sizeof(*old)) < 0) {
+		return -1;
+	}
+	return bpf_store_fetch_add_local(bpf, key, delta, old);
+}
+
+int bpf_fetch_add_global(bpf_t* bpf, uint32_t key, uint32_t delta, uint32_t* old)
+{
+	if(old && bpf_store_allowed(bpf, old, sizeof(*old)) < 0) {
+		return -1;
+	}
+	return bpf_store_fetch_add_global(key, delta, old);
+}
+
+int bpf_cas_local(bpf_t* bpf, uint32_t key, uint32_t expected, uint32_t desired, uint32_t* actual)
+{
+	if(actual && bpf_store_allowed(bpf, actual, sizeof(*actual)) < 0) {
+		return -1;
+	}
+	return bpf_store_cas_local(bpf, key, expected, desired, actual);
+}
+
+int bpf_cas_global(bpf_t* bpf, uint32_t key, uint32_t expected, uint32_t desired, uint32_t* actual)
+{
+	if(actual && bpf_store_allowed(bpf, actual, sizeof(*actual)) < 0) {
+		return -1;
+	}
+	return bpf_store_cas_global(key, expected, desired, actual);
+}
+
+int bpf_min_local(bpf_t* bpf, uint32_t key, uint32_t value)
+{
+	return bpf_store_min_local(bpf, key, value);
+}
+
+int bpf_min_global(bpf_t* bpf, uint32_t key, uint32_t value)
+{
+	return bpf_store_min_global(key, value);
+}
+
+int bpf_max_local(bpf_t* bpf, uint32_t key, uint32_t value)
+{
+	return bpf_store_max_local(bpf, key, value);
+}
+
+int bpf_max_global(bpf_t* bpf, uint32_t key, uint32_t value)
+{
+	return bpf_store_max_global(key, value);
+}
+
+namespace
+{
+/*
+ * Validate key and value arrays for batch operations, each with a single range check
+ */
+bool batchAllowed(bpf_t* bpf, const uint32_t* keys, const uint32_t* values, uint32_t count, bool writeValues)
+{
+	if(count > SIZE_MAX / sizeof(uint32_t)) {
+		return false;
+	}
+	size_t len = count * sizeof(uint32_t);
+	if(bpf_load_allowed(bpf, const_cast<uint32_t*>(keys), len) < 0) {
+		return false;
+	}
+	auto vals = const_cast<uint32_t*>(values);
+	return (writeValues ? bpf_store_allowed(bpf, vals, len) : bpf_load_allowed(bpf, vals, len)) == 0;
+}
+
+/*
+ * Validate a scan buffer of key/value pairs
+ */
+bpf_store_kv_t* scanItems(bpf_t* bpf, uint32_t* items, uint32_t max)
+{
+	if(max > SIZE_MAX / sizeof(bpf_store_kv_t)) {
+		return nullptr;
+	}
+	if(bpf_store_allowed(bpf, items, max * sizeof(bpf_store_kv_t)) < 0) {
+		return nullptr;
+	}
+	return reinterpret_cast<bpf_store_kv_t*>(items);
+}
+
+/*
+ * Calls take pointer-sized arguments, so 64-bit values are passed by reference
+ */
+bool read64(bpf_t* bpf, const uint64_t* ptr, uint64_t& value)
+{
+	if(bpf_load_allowed(bpf, const_cast<uint64_t*>(ptr), sizeof(value)) < 0) {
+		return false;
+	}
+	memcpy(&value, ptr, sizeof(value));
+	return true;
+}
+
+bool write64(bpf_t* bpf, uint64_t* ptr, uint64_t value)
+{
+	if(bpf_store_allowed(bpf, ptr, sizeof(value)) < 0) {
+		return false;
+	}
+	memcpy(ptr, &value, sizeof(value));
+	return true;
+}
+
+} // namespace
+
+int bpf_fetch_many_local(bpf_t* bpf, const uint32_t* keys, uint32_t* values, uint32_t count)
+{
+	if(!batchAllowed(bpf, keys, values, count, true)) {
+		return -1;
+	}
+	return bpf_store_fetch_many_local(bpf, keys, values, count);
+}
+
+int bpf_fetch_many_global(bpf_t* bpf, const uint32_t* keys, uint32_t* values, uint32_t count)
+{
+	if(!batchAllowed(bpf, keys, values, count, true)) {
+		return -1;
+	}
+	return bpf_store_fetch_many_global(keys, values, count);
+}
+
+int bpf_update_many_local(bpf_t* bpf, const uint32_t* keys, const uint32_t* values, uint32_t count)
+{
+	if(!batchAllowed(bpf, keys, values, count, false)) {
+		return -1;
+	}
+	return bpf_store_update_many_local(bpf, keys, values, count);
+}
+
+int bpf_update_many_global(bpf_t* bpf, const uint32_t* keys, const uint32_t* values, uint32_t count)
+{
+	if(!batchAllowed(bpf, keys, values, count, false)) {
+		return -1;
+	}
+	return bpf_store_update_many_global(keys, values, count);
+}
+
+int bpf_scan_local(bpf_t* bpf, uint32_t key, uint32_t* items, uint32_t max, uint32_t reverse)
+{
+	auto kv = scanItems(bpf, items, max);
+	if(kv == nullptr) {
+		return -1;
+	}
+	return bpf_store_scan_local(bpf, key, kv, max, reverse != 0);
+}
+
+int bpf_scan_global(bpf_t* bpf, uint32_t key, uint32_t* items, uint32_t max, uint32_t reverse)
+{
+	auto kv = scanItems(bpf, items, max);
+	if(kv == nullptr) {
+		return -1;
+	}
+	return bpf_store_scan_global(key, kv, max, reverse != 0);
+}
+
+int bpf_store64_local(bpf_t* bpf, const uint64_t* key, const uint64_t* value)
+{
+	uint64_t k, v;
+	if(!read64(bpf, key, k) || !read64(bpf, value, v)) {
+		return -1;
+	}
+	return bpf_store_update64_local(bpf, k, v);
+}
+
+int bpf_lookup64_local(bpf_t* bpf, const uint64_t* key, uint64_t* value)
+{
+	uint64_t k, v;
+	if(!read64(bpf, key, k) || bpf_store_allowed(bpf, value, sizeof(*value)) < 0) {
+		return -1;
+	}
+	int res = bpf_store_lookup64_local(bpf, k, &v);
+	write64(bpf, value, v);
+	return res;
+}
+
+int bpf_fetch_add64_local(bpf_t* bpf, const uint64_t* key, const uint64_t* delta, uint64_t* old)
+{
+	uint64_t k, d, v;
+	if(!read64(bpf, key, k) || !read64(bpf, delta, d) || bpf_store_allowed(bpf, old, sizeof(*old)) < 0) {
+		return -1;
+	}
+	int res = bpf_store_fetch_add64_local(bpf, k, d, &v);
+	write64(bpf, old, v);
+	return res;
+}
+
+int bpf_delete64_local(bpf_t* bpf, const uint64_t* key)
+{
+	uint64_t k;
+	if(!read64(bpf, key, k)) {
+		return -1;
+	}
+	return bpf_store_remove64_local(bpf, k);
+}
+
+int bpf_set_blob_local(bpf_t* bpf, const uint64_t* key, const void* data, uint32_t len)
+{
+	uint64_t k;
+	if(!read64(bpf, key, k) || bpf_load_allowed(bpf, const_cast<void*>(data), len) < 0) {
+		return -1;
+	}
+	return bpf_store_set_blob_local(bpf, k, data, len);
+}
+
+int bpf_get_blob_local(bpf_t* bpf, const uint64_t* key, void* buf, uint32_t size)
+{
+	uint64_t k;
+	if(!read64(bpf, key, k) || bpf_store_allowed(bpf, buf, size) < 0) {
+		return -1;
+	}
+	return bpf_store_get_blob_local(bpf, k, buf, size);
+}
+
+int bpf_delete_blob_local(bpf_t* bpf, const uint64_t* key)
+{
+	uint64_t k;
+	if(!read64(bpf, key, k)) {
+		return -1;
+	}
+	return bpf_store_remove_blob_local(bpf, k);
+}
+
+int bpf_store64_global(bpf_t* bpf, const uint64_t* key, const uint64_t* value)
+{
+	uint64_t k, v;
+	if(!read64(bpf, key, k) || !read64(bpf, value, v)) {
+		return -1;
+	}
+	return bpf_store_update64_global(k, v);
+}
+
+int bpf_lookup64_global(bpf_t* bpf, const uint64_t* key, uint64_t* value)
+{
+	uint64_t k, v;
+	if(!read64(bpf, key, k) || bpf_store_allowed(bpf, value, sizeof(*value)) < 0) {
+		return -1;
+	}
+	int res = bpf_store_lookup64_global(k, &v);
+	write64(bpf, value, v);
+	return res;
+}
+
+int bpf_fetch_add64_global(bpf_t* bpf, const uint64_t* key, const uint64_t* delta, uint64_t* old)
+{
+	uint64_t k, d, v;
+	if(!read64(bpf, key, k) || !read64(bpf, delta, d) || bpf_store_allowed(bpf, old, sizeof(*old)) < 0) {
+		return -1;
+	}
+	int res = bpf_store_fetch_add64_global(k, d, &v);
+	write64(bpf, old, v);
+	return res;
+}
+
+int bpf_delete64_global(bpf_t* bpf, const uint64_t* key)
+{
+	uint64_t k;
+	if(!read64(bpf, key, k)) {
+		return -1;
+	}
+	return bpf_store_remove64_global(k);
+}
+
+int bpf_set_blob_global(bpf_t* bpf, const uint64_t* key, const void* data, uint32_t len)
+{
+	uint64_t k;
+	if(!read64(bpf, key, k) || bpf_load_allowed(bpf, const_cast<void*>(data), len) < 0) {
+		return -1;
+	}
+	return bpf_store_set_blob_global(k, data, len);
+}
+
+int bpf_get_blob_global(bpf_t* bpf, const uint64_t* key, void* buf, uint32_t size)
+{
+	uint64_t k;
+	if(!read64(bpf, key, k) || bpf_store_allowed(bpf, buf, size) < 0) {
+		return -1;
+	}
+	return bpf_store_get_blob_global(k, buf, size);
+}
+
+int bpf_delete_blob_global(bpf_t* bpf, const uint64_t* key)
+{
+	uint64_t k;
+	if(!read64(bpf, key, k)) {
+		return -1;
+	}
+	return bpf_store_remove_blob_global(k);
+}
+
+int bpf_add_percpu(bpf_t* bpf, uint32_t key, uint32_t delta)
+{
+	return bpf_percpu_add(key, delta);
+}
+
+int bpf_store_percpu(bpf_t* bpf, uint32_t key, uint32_t value)
+{
+	return bpf_percpu_update(key, value);
+}
+
+int bpf_lookup_percpu(bpf_t* bpf, uint32_t key, uint32_t merge, uint64_t* value)
+{
+	if(bpf_store_allowed(bpf, value, sizeof(*value)) < 0) {
+		return -1;
+	}
+	uint64_t v;
+	int res = bpf_percpu_lookup(key, bpf_percpu_merge_t(merge), &v);
+	write64(bpf, value, v);
+	return res;
+}
+
+int bpf_lookup_all_percpu(bpf_t* bpf, uint32_t key, uint32_t* values, uint32_t max)
+{
+	if(max > SIZE_MAX / sizeof(uint32_t)) {
+		return -1;
+	}
+	if(max != 0 && bpf_store_allowed(bpf, values, max * sizeof(uint32_t)) < 0) {
+		return -1;
+	}
+	return bpf_percpu_lookup_all(key, values, max);
+}
+
+namespace
+{
+/*
+ * Containers refer to maps by index, which rbf.py substitutes for each declaration address.
+ */
+bpf_map_t* getMap(bpf_t* bpf, const void* map)
+{
+	return bpf_map_get(bpf, uintptr_t(map));
+}
+
+/*
+ * Returns map with validated key.
+ */
+bpf_map_t* mapAccess(bpf_t* bpf, const void* map, const void* key)
+{
+	auto m = getMap(bpf, map);
+	if(m == nullptr || bpf_load_allowed(bpf, const_cast<void*>(key), bpf_map_key_size(m)) < 0) {
+		return nullptr;
+	}
+	return m;
+}
+
+} // namespace
+
+/*
+ * Calls return 32 bits, so the value pointer is passed back by reference
+ */
+int bpf_lookup_map(bpf_t* bpf, const void* map, const void* key, uint64_t* value)
+{
+	auto m = mapAccess(bpf, map, key);
+	if(m == nullptr || bpf_store_allowed(bpf, value, sizeof(*value)) < 0) {
+		return -1;
+	}
+	auto ptr = bpf_map_lookup(m, key);
+	write64(bpf, value, uintptr_t(ptr));
+	return ptr ? 0 : -1;
+}
+
+int bpf_update_map(bpf_t* bpf, const void* map, const void* key, const void* value)
+{
+	auto m = mapAccess(bpf, map, key);
+	if(m == nullptr || bpf_load_allowed(bpf, const_cast<void*>(value), bpf_map_value_size(m)) < 0) {
+		return -1;
+	}
+	return bpf_map_update(m, key, value);
+}
+
+int bpf_delete_map(bpf_t* bpf, const void* map, const void* key)
+{
+	auto m = mapAccess(bpf, map, key);
+	return m ? bpf_map_remove(m, key) : -1;
+}
+
+int bpf_add_map(bpf_t* bpf, const void* map, const void* key, const uint64_t* delta)
+{
+	auto m = mapAccess(bpf, map, key);
+	uint64_t d;
+	if(m == nullptr || !read64(bpf, delta, d)) {
+		return -1;
+	}
+	return bpf_map_add(m, key, d);
+}
+
+int bpf_bloom_add(bpf_t* bpf, const void* map, const void* key)
+{
+	auto m = mapAccess(bpf, map, key);
+	return m ? bpf_map_bloom_add(m, key) : -1;
+}
+
+int bpf_bloom_test(bpf_t* bpf, const void* map, const void* key)
+{
+	auto m = mapAccess(bpf, map, key);
+	return m ? bpf_map_bloom_test(m, key) : -1;
+}
+
+uint32_t bpf_sketch_add(bpf_t* bpf, const void* map, const void* key, uint32_t count)
+{
+	auto m = mapAccess(bpf, map, key);
+	return m ? bpf_map_sketch_add(m, key, count) : 0;
+}
+
+uint32_t bpf_sketch_estimate(bpf_t* bpf, const void* map, const void* key)
+{
+	auto m = mapAccess(bpf, map, key);
+	return m ? bpf_map_sketch_estimate(m, key) : 0;
+}
+
+int bpf_histogram_add(bpf_t* bpf, const void* map, uint32_t value)
+{
+	auto m = getMap(bpf, map);
+	return m ? bpf_map_histogram_add(m, value) : -1;
+}
+
+uint32_t bpf_window_add(bpf_t* bpf, const void* map, uint32_t delta)
+{
+	auto m = getMap(bpf, map);
+	return m ? bpf_map_window_add(m, bpf_now_ms(bpf), delta) : 0;
+}
+
+uint32_t bpf_window_total(bpf_t* bpf, const void* map)
+{
+	auto m = getMap(bpf, map);
+	return m ? bpf_map_window_read(m, bpf_now_ms(bpf), nullptr, 0) : 0;
+}
+
+/*
+ * Calls return 32 bits, so the record pointer is passed back by reference
+ */
+int bpf_ringbuf_reserve(bpf_t* bpf, const void* map, uint32_t size, uint64_t* record)
+{
+	auto m = getMap(bpf, map);
+	if(m == nullptr || bpf_store_allowed(bpf, record, sizeof(*record)) < 0) {
+		return -1;
+	}
+	auto ptr = bpf_map_ringbuf_reserve(m, size);
+	write64(bpf, record, uintptr_t(ptr));
+	return ptr ? 0 : -1;
+}
+
+int bpf_ringbuf_submit(bpf_t* bpf, const void* map, const void* record)
+{
+	auto m = getMap(bpf, map);
+	return m ? bpf_map_ringbuf_submit(m, record) : -1;
+}
+
+int bpf_ringbuf_discard(bpf_t* bpf, const void* map, const void* record)
+{
+	auto m = getMap(bpf, map);
+	return m ? bpf_map_ringbuf_discard(m, record) : -1;
+}
+
+int bpf_ringbuf_output(bpf_t* bpf, const void* map, const void* data, uint32_t size)
+{
+	auto m = getMap(bpf, map);
+	if(m == nullptr || bpf_load_allowed(bpf, const_cast<void*>(data), size) < 0) {
+		return -1;
+	}
+	return bpf_map_ringbuf_output(m, data, size);
+}
+
+int bpf_queue_push(bpf_t* bpf, const void* map, const void* record)
+{
+	auto m = getMap(bpf, map);
+	if(m == nullptr || bpf_load_allowed(bpf, const_cast<void*>(record), bpf_map_value_size(m)) < 0) {
+		return -1;
+	}
+	return bpf_map_queue_push(m, record);
+}
+
+int bpf_queue_pop(bpf_t* bpf, const void* map, void* record)
+{
+	auto m = getMap(bpf, map);
+	if(m == nullptr || bpf_store_allowed(bpf, record, bpf_map_value_size(m)) < 0) {
+		return -1;
+	}
+	return bpf_map_queue_pop(m, record);
+}
+
+uint32_t bpf_queue_count(bpf_t* bpf, const void* map)
+{
+	auto m = getMap(bpf, map);
+	return (m && bpf_map_type(m) == BPF_MAP_TYPE_QUEUE) ? bpf_map_entries(m) : 0;
+}
+
 void bpf_memcpy(bpf_t* bpf, void* dest, const void* src, size_t size)
 {
 	if(bpf_store_allowed(bpf, dest, size) < 0) {
@@ -74,7 +600,7 @@ void bpf_memcpy(bpf_t* bpf, void* dest, const void* src, size_t size)
 
 uint32_t bpf_now_ms(bpf_t* bpf)
 {
-	return system_get_time() / 1000;
+	return bpf_clock_ms();
 }
 
 } // namespace VM
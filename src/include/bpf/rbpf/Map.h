@@ -0,0 +1,296 @@
+#pragma once
+
+#include <bpf/bpfapi/helpers.h>
+
+namespace rBPF
+{
+/**
+ * @brief Typed access to a map declared using BPF_MAP()
+ *
+ * For example:
+ *
+ * 	BPF_MAP(stats, BPF_MAP_TYPE_HASH, uint32_t, Stats, 16);
+ *
+ * 	Map<uint32_t, Stats> map(stats);
+ * 	auto value = map.lookup(key);
+ */
+template <typename Key, typename Value> class Map
+{
+public:
+	Map(bpf_map_def_t& def) : def(def)
+	{
+	}
+
+	/**
+	 * @brief Find a value
+	 * @retval Value* Points into the map, nullptr if not found
+	 */
+	Value* lookup(const Key& key)
+	{
+		uint64_t ptr;
+		return bpf_lookup_map(&def, &key, &ptr) == 0 ? reinterpret_cast<Value*>(ptr) : nullptr;
+	}
+
+	/**
+	 * @brief Set a value, inserting the key if required
+	 */
+	bool update(const Key& key, const Value& value)
+	{
+		return bpf_update_map(&def, &key, &value) == 0;
+	}
+
+	/**
+	 * @brief Remove a key, not supported by arrays
+	 */
+	bool remove(const Key& key)
+	{
+		return bpf_delete_map(&def, &key) == 0;
+	}
+
+	/**
+	 * @brief Add to a value, for maps with uint64_t values
+	 *
+	 * Values wrap, so adding `uint64_t(-1)` decrements.
+	 */
+	bool add(const Key& key, uint64_t delta)
+	{
+		return bpf_add_map(&def, &key, &delta) == 0;
+	}
+
+private:
+	bpf_map_def_t& def;
+};
+
+/**
+ * @brief Access to a Bloom filter declared using BPF_BLOOM_FILTER()
+ *
+ * For example:
+ *
+ * 	BPF_BLOOM_FILTER(seen, uint32_t, 256, 4);
+ *
+ * 	BloomFilter<uint32_t> filter(seen);
+ * 	if(!filter.test(address)) {
+ * 		filter.add(address);
+ * 	}
+ */
+template <typename Key> class BloomFilter
+{
+public:
+	BloomFilter(bpf_map_def_t& def) : def(def)
+	{
+	}
+
+	bool add(const Key& key)
+	{
+		return bpf_bloom_add(&def, &key) == 0;
+	}
+
+	/**
+	 * @brief Test for a key
+	 * @retval bool true if the key may have been added, false if it has not
+	 */
+	bool test(const Key& key)
+	{
+		return bpf_bloom_test(&def, &key) > 0;
+	}
+
+private:
+	bpf_map_def_t& def;
+};
+
+/**
+ * @brief Access to a count-min sketch declared using BPF_COUNT_MIN_SKETCH()
+ */
+template <typename Key> class CountMinSketch
+{
+public:
+	CountMinSketch(bpf_map_def_t& def) : def(def)
+	{
+	}
+
+	/**
+	 * @brief Count occurrences of a key
+	 * @retval uint32_t New estimate for key
+	 */
+	uint32_t add(const Key& key, uint32_t count = 1)
+	{
+		return bpf_sketch_add(&def, &key, count);
+	}
+
+	/**
+	 * @brief Estimate occurrences of a key, never less than the true count
+	 */
+	uint32_t estimate(const Key& key)
+	{
+		return bpf_sketch_estimate(&def, &key);
+	}
+
+private:
+	bpf_map_def_t& def;
+};
+
+/**
+ * @brief Access to a histogram declared using BPF_HISTOGRAM_LOG2() or BPF_HISTOGRAM_LINEAR()
+ *
+ * For example:
+ *
+ * 	BPF_HISTOGRAM_LOG2(latency, 16);
+ *
+ * 	Histogram hist(latency);
+ * 	hist.add(elapsed);
+ */
+class Histogram
+{
+public:
+	Histogram(bpf_map_def_t& def) : def(def)
+	{
+	}
+
+	bool add(uint32_t value)
+	{
+		return bpf_histogram_add(&def, value) == 0;
+	}
+
+private:
+	bpf_map_def_t& def;
+};
+
+/**
+ * @brief Access to a sliding time-window counter declared using BPF_WINDOW()
+ */
+class Window
+{
+public:
+	Window(bpf_map_def_t& def) : def(def)
+	{
+	}
+
+	/**
+	 * @brief Add to the current slot
+	 * @retval uint32_t New window total
+	 */
+	uint32_t add(uint32_t delta = 1)
+	{
+		return bpf_window_add(&def, delta);
+	}
+
+	uint32_t total()
+	{
+		return bpf_window_total(&def);
+	}
+
+private:
+	bpf_map_def_t& def;
+};
+
+/**
+ * @brief Access to a ring buffer declared using BPF_RINGBUF()
+ *
+ * For example:
+ *
+ * 	BPF_RINGBUF(events, 1024);
+ *
+ * 	RingBuffer ring(events);
+ * 	if(auto event = ring.reserve<Event>()) {
+ * 		event->time = bpf_now_ms();
+ * 		ring.submit(event);
+ * 	}
+ */
+class RingBuffer
+{
+public:
+	RingBuffer(bpf_map_def_t& def) : def(def)
+	{
+	}
+
+	/**
+	 * @brief Reserve a record to be written in place
+	 * @retval T* nullptr if the ring is full
+	 *
+	 * Only one record may be reserved at a time, any previous reservation is discarded.
+	 */
+	template <typename T> T* reserve(uint32_t size = sizeof(T))
+	{
+		uint64_t ptr;
+		return bpf_ringbuf_reserve(&def, size, &ptr) == 0 ? reinterpret_cast<T*>(ptr) : nullptr;
+	}
+
+	bool submit(const void* record)
+	{
+		return bpf_ringbuf_submit(&def, record) == 0;
+	}
+
+	bool discard(const void* record)
+	{
+		return bpf_ringbuf_discard(&def, record) == 0;
+	}
+
+	/**
+	 * @brief Copy a record into the ring
+	 */
+	bool output(const void* data, uint32_t size)
+	{
+		return bpf_ringbuf_output(&def, data, size) == 0;
+	}
+
+	template <typename T> bool output(const T& record)
+	{
+		return output(&record, sizeof(record));
+	}
+
+private:
+	bpf_map_def_t& def;
+};
+
+/**
+ * @brief Access to a queue declared using BPF_QUEUE()
+ *
+ * For example, one container forwards requests to another:
+ *
+ * 	BPF_QUEUE(requests, Request, 16);
+ *
+ * 	Queue<Request> queue(requests);
+ * 	queue.push(request);
+ *
+ * and the other declares the same queue and handles them:
+ *
+ * 	Request request;
+ * 	while(queue.pop(request)) {
+ * 		...
+ * 	}
+ */
+template <typename Record> class Queue
+{
+public:
+	Queue(bpf_map_def_t& def) : def(def)
+	{
+	}
+
+	/**
+	 * @brief Copy a record into the queue
+	 * @retval bool false if the queue is full
+	 */
+	bool push(const Record& record)
+	{
+		return bpf_queue_push(&def, &record) == 0;
+	}
+
+	/**
+	 * @brief Copy the first record out of the queue and remove it
+	 * @retval bool false if the queue is empty
+	 */
+	bool pop(Record& record)
+	{
+		return bpf_queue_pop(&def, &record) == 0;
+	}
+
+	uint32_t count()
+	{
+		return bpf_queue_count(&def);
+	}
+
+private:
+	bpf_map_def_t& def;
+};
+
+} // namespace rBPF
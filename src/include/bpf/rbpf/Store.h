@@ -17,6 +17,56 @@ public:
 	{
 		return bpf_fetch_local(key, &value) == 0;
 	}
+
+	bool fetchMany(const Key* keys, Value* values, size_t count) override
+	{
+		return bpf_fetch_many_local(keys, values, count) == 0;
+	}
+
+	bool updateMany(const Key* keys, const Value* values, size_t count) override
+	{
+		return bpf_update_many_local(keys, values, count) == 0;
+	}
+
+	int scan(Key key, KeyValue* items, size_t max, bool reverse) override
+	{
+		return bpf_scan_local(key, reinterpret_cast<uint32_t*>(items), max, reverse);
+	}
+
+	bool lookup(Key key, Value& value) override
+	{
+		return bpf_lookup_local(key, &value) == 0;
+	}
+
+	bool remove(Key key) override
+	{
+		return bpf_delete_local(key) == 0;
+	}
+
+	bool setTtl(Key key, uint32_t ttl) override
+	{
+		return bpf_set_ttl_local(key, ttl) == 0;
+	}
+
+	bool fetchAdd(Key key, Value delta, Value& old) override
+	{
+		return bpf_fetch_add_local(key, delta, &old) == 0;
+	}
+
+	bool compareExchange(Key key, Value& expected, Value desired) override
+	{
+		return bpf_cas_local(key, expected, desired, &expected) == 0;
+	}
+
+	bool updateMin(Key key, Value value) override
+	{
+		return bpf_min_local(key, value) == 0;
+	}
+
+	bool updateMax(Key key, Value value) override
+	{
+		return bpf_max_local(key, value) == 0;
+	}
 };
 
 class GlobalStore : public Store
@@ -31,6 +81,164 @@ public:
 	{
 		return bpf_fetch_global(key, &value) == 0;
 	}
+
+	bool fetchMany(const Key* keys, Value* values, size_t count) override
+	{
+		return bpf_fetch_many_global(keys, values, count) == 0;
+	}
+
+	bool updateMany(const Key* keys, const Value* values, size_t count) override
+	{
+		return bpf_update_many_global(keys, values, count) == 0;
+	}
+
+	int scan(Key key, KeyValue* items, size_t max, bool reverse) override
+	{
+		return bpf_scan_global(key, reinterpret_cast<uint32_t*>(items), max, reverse);
+	}
+
+	bool lookup(Key key, Value& value) override
+	{
+		return bpf_lookup_global(key, &value) == 0;
+	}
+
+	bool remove(Key key) override
+	{
+		return bpf_delete_global(key) == 0;
+	}
+
+	bool setTtl(Key key, uint32_t ttl) override
+	{
+		return bpf_set_ttl_global(key, ttl) == 0;
+	}
+
+	bool fetchAdd(Key key, Value delta, Value& old) override
+	{
+		return bpf_fetch_add_global(key, delta, &old) == 0;
+	}
+
+	bool compareExchange(Key key, Value& expected, Value desired) override
+	{
+		return bpf_cas_global(key, expected, desired, &expected) == 0;
+	}
+
+	bool updateMin(Key key, Value value) override
+	{
+		return bpf_min_global(key, value) == 0;
+	}
+
+	bool updateMax(Key key, Value value) override
+	{
+		return bpf_max_global(key, value) == 0;
+	}
+};
+
+class LocalWideStore : public WideStore
+{
+public:
+	using WideStore::getBlob;
+	using WideStore::setBlob;
+
+	bool update(Key key, Value value) override
+	{
+		return bpf_store64_local(&key, &value) == 0;
+	}
+
+	bool lookup(Key key, Value& value) override
+	{
+		return bpf_lookup64_local(&key, &value) == 0;
+	}
+
+	bool remove(Key key) override
+	{
+		return bpf_delete64_local(&key) == 0;
+	}
+
+	bool fetchAdd(Key key, Value delta, Value& old) override
+	{
+		return bpf_fetch_add64_local(&key, &delta, &old) == 0;
+	}
+
+	bool setBlob(Key key, const void* data, size_t len) override
+	{
+		return bpf_set_blob_local(&key, data, len) == 0;
+	}
+
+	int getBlob(Key key, void* buf, size_t size) override
+	{
+		return bpf_get_blob_local(&key, buf, size);
+	}
+
+	bool removeBlob(Key key) override
+	{
+		return bpf_delete_blob_local(&key) == 0;
+	}
+};
+
+class GlobalWideStore : public WideStore
+{
+public:
+	using WideStore::getBlob;
+	using WideStore::setBlob;
+
+	bool update(Key key, Value value) override
+	{
+		return bpf_store64_global(&key, &value) == 0;
+	}
+
+	bool lookup(Key key, Value& value) override
+	{
+		return bpf_lookup64_global(&key, &value) == 0;
+	}
+
+	bool remove(Key key) override
+	{
+		return bpf_delete64_global(&key) == 0;
+	}
+
+	bool fetchAdd(Key key, Value delta, Value& old) override
+	{
+		return bpf_fetch_add64_global(&key, &delta, &old) == 0;
+	}
+
+	bool setBlob(Key key, const void* data, size_t len) override
+	{
+		return bpf_set_blob_global(&key, data, len) == 0;
+	}
+
+	int getBlob(Key key, void* buf, size_t size) override
+	{
+		return bpf_get_blob_global(&key, buf, size);
+	}
+
+	bool removeBlob(Key key) override
+	{
+		return bpf_delete_blob_global(&key) == 0;
+	}
+};
+
+class GlobalPerThreadStore : public PerThreadStore
+{
+public:
+	bool add(Key key, Value delta) override
+	{
+		return bpf_add_percpu(key, delta) == 0;
+	}
+
+	bool update(Key key, Value value) override
+	{
+		return bpf_store_percpu(key, value) == 0;
+	}
+
+	bool lookup(Key key, Merge merge, uint64_t& value) override
+	{
+		return bpf_lookup_percpu(key, uint32_t(merge), &value) == 0;
+	}
+
+	int lookupAll(Key key, Value* values, size_t max) override
+	{
+		return bpf_lookup_all_percpu(key, values, max);
+	}
 };
 
 } // namespace rBPF
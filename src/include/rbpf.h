@@ -1,4 +1,5 @@
 #pragma once
 
 #include "rbpf/VirtualMachine.h"
+#include "rbpf/CodeCache.h"
 #include <rbpf/containers.h>
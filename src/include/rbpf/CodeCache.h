@@ -0,0 +1,29 @@
+#pragma once
+
+#include <bpf/codecache.h>
+
+namespace rBPF
+{
+using CodeCacheStats = bpf_code_cache_stats_t;
+
+/**
+ * @brief Get code cache statistics
+ *
+ * All values are zero if the cache is disabled (BPF_CODE_CACHE_SIZE=0).
+ */
+inline CodeCacheStats getCodeCacheStats()
+{
+	CodeCacheStats stats;
+	bpf_code_cache_get_stats(&stats);
+	return stats;
+}
+
+/**
+ * @brief Zero code cache counters
+ */
+inline void resetCodeCacheStats()
+{
+	bpf_code_cache_reset_stats();
+}
+
+} // namespace rBPF
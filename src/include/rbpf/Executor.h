@@ -0,0 +1,130 @@
+#pragma once
+
+#include "VirtualMachine.h"
+#include <bpf/sync.h>
+
+#if CONFIG_BPF_CONCURRENT
+
+#include <atomic>
+#include <condition_variable>
+#include <deque>
+#include <functional>
+#include <future>
+#include <map>
+#include <mutex>
+#include <thread>
+#include <vector>
+
+namespace rBPF
+{
+/**
+ * @brief Runs containers on a pool of worker threads
+ *
+ * Requires BPF_CONCURRENT, so is only available on hosts with POSIX threads.
+ *
+ * Each worker loads its own VirtualMachine instance for every container it runs,
+ * so containers executed through an Executor have one local store per worker.
+ * The global stores are shared by all workers.
+ *
+ * Jobs are queued on the workers in turn. A worker with no jobs of its own takes
+ * the most recently queued job from another worker, so the load stays balanced
+ * when execution times vary.
+ */
+class Executor
+{
+public:
+	using Container = VirtualMachine::Container;
+	using Context = std::vector<uint8_t>;
+
+	struct Result {
+		int64_t value{-1}; ///< Value returned from container
+		int error{0};	   ///< Error code, see getErrorString()
+		Context context;   ///< Context as modified by the container
+	};
+
+	/**
+	 * @brief Invoked on the worker thread when a job completes
+	 */
+	using Callback = std::function<void(Result& result)>;
+
+	struct Stats {
+		uint64_t executed; ///< Jobs completed
+		uint64_t stolen;   ///< Jobs taken from another worker's queue
+	};
+
+	/**
+	 * @brief Start worker threads
+	 * @param threads Number of workers, defaults to one per processor
+	 * @param stackSize Stack size for each VM instance
+	 */
+	Executor(unsigned threads = 0, size_t stackSize = VirtualMachine::defaultStackSize);
+
+	/**
+	 * @brief Completes all queued jobs then stops the workers
+	 */
+	~Executor();
+
+	/**
+	 * @brief Queue a job, invoking a callback when it completes
+	 * @param container Must remain valid until the Executor is destroyed
+	 * @param context Passed to the container, may be empty
+	 * @param callback
+	 */
+	void submit(const Container& container, Context context, Callback callback);
+
+	/**
+	 * @brief Queue a job
+	 * @retval std::future<Result> Becomes ready when the job completes
+	 */
+	std::future<Result> submit(const Container& container, Context context = {});
+
+	/**
+	 * @brief Block until all submitted jobs have completed
+	 */
+	void wait();
+
+	unsigned threads() const
+	{
+		return workers.size();
+	}
+
+	Stats getStats() const
+	{
+		return Stats{executed, stolen};
+	}
+
+private:
+	struct Job {
+		const Container* container;
+		Context context;
+		Callback callback;
+	};
+
+	struct Worker {
+		std::mutex mutex; ///< Guards jobs
+		std::deque<Job> jobs;
+		std::map<const Container*, std::unique_ptr<VirtualMachine>> machines;
+		std::thread thread;
+	};
+
+	void run(Worker& worker);
+	bool take(Worker& worker, Job& job);
+	void execute(Worker& worker, Job& job);
+
+	std::vector<std::unique_ptr<Worker>> workers;
+	size_t stackSize;
+	std::atomic<unsigned> nextWorker{0};
+	std::atomic<uint64_t> executed{0};
+	std::atomic<uint64_t> stolen{0};
+
+	std::mutex mutex;					///< Guards the counts below
+	std::condition_variable available;	///< Signalled when a job is queued or on shutdown
+	std::condition_variable idle;		///< Signalled when all jobs have completed
+	size_t queued{0};					///< Jobs queued but not yet taken by a worker
+	size_t outstanding{0};				///< Jobs submitted but not yet completed
+	bool stopping{false};
+};
+
+} // namespace rBPF
+
+#endif
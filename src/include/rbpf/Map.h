@@ -0,0 +1,647 @@
+#pragma once
+
+#include <bpf/map.h>
+
+namespace rBPF
+{
+/**
+ * @brief Access a map declared by a loaded container
+ *
+ * Obtain using VirtualMachine::getMap(). Valid until the container is unloaded.
+ *
+ * Typed methods check the key and value sizes match the declaration and fail if not.
+ */
+class Map
+{
+public:
+	enum class Type {
+		array = BPF_MAP_TYPE_ARRAY,
+		hash = BPF_MAP_TYPE_HASH,
+		counter = BPF_MAP_TYPE_COUNTER,
+		lpmTrie = BPF_MAP_TYPE_LPM_TRIE,
+		bloomFilter = BPF_MAP_TYPE_BLOOM_FILTER,
+		countMin = BPF_MAP_TYPE_COUNT_MIN,
+		histogram = BPF_MAP_TYPE_HISTOGRAM,
+		window = BPF_MAP_TYPE_WINDOW,
+		ringbuf = BPF_MAP_TYPE_RINGBUF,
+		queue = BPF_MAP_TYPE_QUEUE,
+	};
+
+	Map() = default;
+
+	Map(bpf_map_t* map) : map(map)
+	{
+	}
+
+	explicit operator bool() const
+	{
+		return map != nullptr;
+	}
+
+	/**
+	 * @brief Get map name
+	 * @note Points into the container image, which may be in flash
+	 */
+	const char* name() const
+	{
+		return map ? bpf_map_name(map) : nullptr;
+	}
+
+	Type type() const
+	{
+		return map ? Type(bpf_map_type(map)) : Type();
+	}
+
+	size_t keySize() const
+	{
+		return map ? bpf_map_key_size(map) : 0;
+	}
+
+	size_t valueSize() const
+	{
+		return map ? bpf_map_value_size(map) : 0;
+	}
+
+	/**
+	 * @brief Get array length, or maximum number of keys
+	 */
+	size_t maxEntries() const
+	{
+		return map ? bpf_map_max_entries(map) : 0;
+	}
+
+	/**
+	 * @brief Get number of keys in use, the length for arrays
+	 */
+	size_t count() const
+	{
+		return map ? bpf_map_entries(map) : 0;
+	}
+
+	/**
+	 * @brief Find a value
+	 * @retval void* Value in container memory, nullptr if not found
+	 */
+	void* lookup(const void* key)
+	{
+		return map ? bpf_map_lookup(map, key) : nullptr;
+	}
+
+	template <typename Value, typename Key> Value* lookup(const Key& key)
+	{
+		return checkSizes<Key, Value>() ? static_cast<Value*>(bpf_map_lookup(map, &key)) : nullptr;
+	}
+
+	/**
+	 * @brief Set a value, inserting the key if required
+	 * @retval bool false if full or array index out of range
+	 */
+	bool update(const void* key, const void* value)
+	{
+		return map && bpf_map_update(map, key, value) == 0;
+	}
+
+	template <typename Key, typename Value> bool update(const Key& key, const Value& value)
+	{
+		return checkSizes<Key, Value>() && bpf_map_update(map, &key, &value) == 0;
+	}
+
+	/**
+	 * @brief Remove a key, not supported by arrays
+	 */
+	bool remove(const void* key)
+	{
+		return map && bpf_map_remove(map, key) == 0;
+	}
+
+	template <typename Key> bool remove(const Key& key)
+	{
+		return sizeof(Key) == keySize() && bpf_map_remove(map, &key) == 0;
+	}
+
+	/**
+	 * @brief Add to a uint64_t value, inserting the key if required
+	 */
+	bool add(const void* key, uint64_t delta)
+	{
+		return map && bpf_map_add(map, key, delta) == 0;
+	}
+
+	template <typename Key> bool add(const Key& key, uint64_t delta)
+	{
+		return sizeof(Key) == keySize() && bpf_map_add(map, &key, delta) == 0;
+	}
+
+	/**
+	 * @brief Get the key following another, for iteration
+	 * @param key Previous key, nullptr to get the first
+	 * @param next Receives next key, may be the same as key
+	 * @retval bool false at the end
+	 */
+	bool nextKey(const void* key, void* next) const
+	{
+		return map && bpf_map_next_key(map, key, next) == 0;
+	}
+
+	/**
+	 * @brief Remove all keys, or zero all values of an array
+	 */
+	void clear()
+	{
+		if(map) {
+			bpf_map_clear(map);
+		}
+	}
+
+private:
+	template <typename Key, typename Value> bool checkSizes() const
+	{
+		return sizeof(Key) == keySize() && sizeof(Value) == valueSize();
+	}
+
+	friend class BloomFilter;
+	friend class CountMinSketch;
+	friend class Histogram;
+	friend class Window;
+	friend class RingBuffer;
+	friend class Queue;
+
+	bpf_map_t* map{nullptr};
+};
+
+/**
+ * @brief Access a Bloom filter declared by a loaded container
+ *
+ * For example:
+ *
+ * 	BloomFilter seen(vm.getMap("seen"));
+ * 	if(!seen.test(address)) { ... }
+ *
+ * Operations fail if the map is not a Bloom filter or the key size does not match.
+ */
+class BloomFilter
+{
+public:
+	BloomFilter(const Map& map) : map(map.type() == Map::Type::bloomFilter ? map.map : nullptr)
+	{
+	}
+
+	explicit operator bool() const
+	{
+		return map != nullptr;
+	}
+
+	/**
+	 * @brief Get number of distinct keys added, less any which were reported as present
+	 */
+	size_t count() const
+	{
+		return map ? bpf_map_entries(map) : 0;
+	}
+
+	template <typename Key> bool add(const Key& key)
+	{
+		return checkSize<Key>() && bpf_map_bloom_add(map, &key) == 0;
+	}
+
+	/**
+	 * @brief Test for a key
+	 * @retval bool true if the key may have been added, false if it has not
+	 */
+	template <typename Key> bool test(const Key& key) const
+	{
+		return checkSize<Key>() && bpf_map_bloom_test(map, &key) > 0;
+	}
+
+	void clear()
+	{
+		if(map) {
+			bpf_map_clear(map);
+		}
+	}
+
+private:
+	template <typename Key> bool checkSize() const
+	{
+		return map && sizeof(Key) == bpf_map_key_size(map);
+	}
+
+	bpf_map_t* map;
+};
+
+/**
+ * @brief Access a count-min sketch declared by a loaded container
+ *
+ * Operations fail if the map is not a count-min sketch or the key size does not match.
+ */
+class CountMinSketch
+{
+public:
+	CountMinSketch(const Map& map) : map(map.type() == Map::Type::countMin ? map.map : nullptr)
+	{
+	}
+
+	explicit operator bool() const
+	{
+		return map != nullptr;
+	}
+
+	/**
+	 * @brief Get sum of all counts
+	 */
+	size_t total() const
+	{
+		return map ? bpf_map_entries(map) : 0;
+	}
+
+	/**
+	 * @brief Count occurrences of a key
+	 * @retval uint32_t New estimate for key, 0 on failure
+	 */
+	template <typename Key> uint32_t add(const Key& key, uint32_t count = 1)
+	{
+		return checkSize<Key>() ? bpf_map_sketch_add(map, &key, count) : 0;
+	}
+
+	/**
+	 * @brief Estimate occurrences of a key
+	 * @retval uint32_t Never less than the true count
+	 */
+	template <typename Key> uint32_t estimate(const Key& key) const
+	{
+		return checkSize<Key>() ? bpf_map_sketch_estimate(map, &key) : 0;
+	}
+
+	void clear()
+	{
+		if(map) {
+			bpf_map_clear(map);
+		}
+	}
+
+private:
+	template <typename Key> bool checkSize() const
+	{
+		return map && sizeof(Key) == bpf_map_key_size(map);
+	}
+
+	bpf_map_t* map;
+};
+
+/**
+ * @brief Access a histogram declared by a loaded container
+ *
+ * For example:
+ *
+ * 	Histogram latency(vm.getMap("latency"));
+ * 	Histogram::Stats stats;
+ * 	uint32_t buckets[16];
+ * 	auto n = latency.read(stats, buckets, 16);
+ * 	for(unsigned i = 0; i < n; ++i) {
+ * 		Serial << latency.bucketBase(i) << ": " << buckets[i] << endl;
+ * 	}
+ */
+class Histogram
+{
+public:
+	using Stats = bpf_map_histogram_t;
+
+	Histogram(const Map& map) : map(map.type() == Map::Type::histogram ? map.map : nullptr)
+	{
+	}
+
+	explicit operator bool() const
+	{
+		return map != nullptr;
+	}
+
+	size_t bucketCount() const
+	{
+		return map ? bpf_map_max_entries(map) : 0;
+	}
+
+	/**
+	 * @brief Get smallest value counted by a bucket
+	 */
+	uint32_t bucketBase(unsigned index) const
+	{
+		return map ? bpf_map_histogram_bucket_base(map, index) : 0;
+	}
+
+	bool add(uint32_t value)
+	{
+		return map && bpf_map_histogram_add(map, value) == 0;
+	}
+
+	/**
+	 * @brief Take a snapshot
+	 * @param stats Receives summary
+	 * @param buckets Receives bucket counts, may be nullptr
+	 * @param maxBuckets Size of buckets array
+	 * @retval size_t Number of buckets in the histogram
+	 */
+	size_t read(Stats& stats, uint32_t* buckets = nullptr, size_t maxBuckets = 0) const
+	{
+		if(map == nullptr) {
+			stats = {};
+			return 0;
+		}
+		return bpf_map_histogram_read(map, &stats, buckets, maxBuckets);
+	}
+
+	void clear()
+	{
+		if(map) {
+			bpf_map_clear(map);
+		}
+	}
+
+private:
+	bpf_map_t* map;
+};
+
+/**
+ * @brief Access a sliding time-window counter declared by a loaded container
+ *
+ * Uses the same clock as the container's bpf_now_ms() helper.
+ */
+class Window
+{
+public:
+	Window(const Map& map) : map(map.type() == Map::Type::window ? map.map : nullptr)
+	{
+	}
+
+	explicit operator bool() const
+	{
+		return map != nullptr;
+	}
+
+	size_t slotCount() const
+	{
+		return map ? bpf_map_max_entries(map) : 0;
+	}
+
+	/**
+	 * @brief Add to the current slot
+	 * @retval uint32_t New window total
+	 */
+	uint32_t add(uint32_t delta = 1);
+
+	/**
+	 * @brief Get total for the window
+	 */
+	uint32_t total() const
+	{
+		return read(nullptr, 0);
+	}
+
+	/**
+	 * @brief Take a snapshot
+	 * @param counts Receives slot counts, oldest first and ending with the current slot
+	 * @param maxCounts Size of counts array
+	 * @retval uint32_t Window total
+	 */
+	uint32_t read(uint32_t* counts, size_t maxCounts) const;
+
+	void clear()
+	{
+		if(map) {
+			bpf_map_clear(map);
+		}
+	}
+
+private:
+	bpf_map_t* map;
+};
+
+/**
+ * @brief Consume records from a ring buffer declared by a loaded container
+ *
+ * Records are read in place. The consumer may run on a different thread to the container,
+ * but only one thread may consume from a ring.
+ *
+ * For example, to read records from the task queue as they arrive:
+ *
+ * 	RingBuffer events(vm.getMap("events"));
+ * 	events.setNotify([](bpf_map_t*, void* param) {
+ * 		System.queueCallback([](void* param) {
+ * 			RingBuffer(static_cast<bpf_map_t*>(param)).poll([](const void* data, size_t size) {
+ * 				...
+ * 			});
+ * 		}, param);
+ * 	}, events.get());
+ */
+class RingBuffer
+{
+public:
+	RingBuffer(const Map& map) : map(map.type() == Map::Type::ringbuf ? map.map : nullptr)
+	{
+	}
+
+	explicit operator bool() const
+	{
+		return map != nullptr;
+	}
+
+	bpf_map_t* get() const
+	{
+		return map;
+	}
+
+	/**
+	 * @brief Get the first record
+	 * @param size Receives size of record
+	 * @retval const void* The record, valid until consume() is called. nullptr if there are none.
+	 */
+	const void* peek(size_t& size)
+	{
+		uint32_t len{0};
+		auto record = map ? bpf_map_ringbuf_peek(map, &len) : nullptr;
+		size = len;
+		return record;
+	}
+
+	/**
+	 * @brief Release the record returned by peek()
+	 */
+	void consume()
+	{
+		if(map) {
+			bpf_map_ringbuf_consume(map);
+		}
+	}
+
+	/**
+	 * @brief Pass records to a callback, then release them
+	 * @param callback Invoked as `callback(const void* data, size_t size)`
+	 * @param maxRecords Limit on records to read
+	 * @retval size_t Number of records read
+	 */
+	template <typename Callback> size_t poll(Callback callback, size_t maxRecords = SIZE_MAX)
+	{
+		size_t count{0};
+		size_t size;
+		const void* record;
+		while(count < maxRecords && (record = peek(size)) != nullptr) {
+			callback(record, size);
+			consume();
+			++count;
+		}
+		return count;
+	}
+
+	/**
+	 * @brief Get number of records submitted
+	 */
+	size_t submitted() const
+	{
+		return map ? bpf_map_entries(map) : 0;
+	}
+
+	/**
+	 * @brief Get number of records lost because the ring was full
+	 */
+	size_t dropped() const
+	{
+		return map ? bpf_map_ringbuf_dropped(map) : 0;
+	}
+
+	/**
+	 * @brief Set a callback for when a record is submitted to an empty ring
+	 *
+	 * The callback runs on the container's thread during execution, so would typically
+	 * queue a task which calls poll(). It is not called again until the ring has been emptied.
+	 */
+	void setNotify(bpf_map_notify_t callback, void* param)
+	{
+		if(map) {
+			bpf_map_set_notify(map, callback, param);
+		}
+	}
+
+	/**
+	 * @brief Discard all records
+	 * @note Not safe while the container is running
+	 */
+	void clear()
+	{
+		if(map) {
+			bpf_map_clear(map);
+		}
+	}
+
+private:
+	bpf_map_t* map;
+};
+
+/**
+ * @brief Access a queue declared by a loaded container
+ *
+ * A queue is shared by all containers declaring one with the same name, so the host
+ * can use the map of either end. Only one thread may push and one thread pop at a time.
+ *
+ * For example, to run a consumer only when it has records waiting:
+ *
+ * 	Queue queue(consumer.getMap("requests"));
+ * 	queue.setNotify([](bpf_map_t*, void* param) {
+ * 		System.queueCallback([](void* param) {
+ * 			auto& vm = *static_cast<rBPF::VirtualMachine*>(param);
+ * 			vm.execute();
+ * 		}, param);
+ * 	}, &consumer);
+ */
+class Queue
+{
+public:
+	Queue(const Map& map) : map(map.type() == Map::Type::queue ? map.map : nullptr)
+	{
+	}
+
+	explicit operator bool() const
+	{
+		return map != nullptr;
+	}
+
+	size_t recordSize() const
+	{
+		return map ? bpf_map_value_size(map) : 0;
+	}
+
+	size_t capacity() const
+	{
+		return map ? bpf_map_max_entries(map) : 0;
+	}
+
+	/**
+	 * @brief Get number of records waiting
+	 */
+	size_t count() const
+	{
+		return map ? bpf_map_entries(map) : 0;
+	}
+
+	bool empty() const
+	{
+		return count() == 0;
+	}
+
+	/**
+	 * @brief Copy a record into the queue
+	 * @param record Of recordSize() bytes
+	 * @retval bool false if the queue is full
+	 */
+	bool push(const void* record)
+	{
+		return map && bpf_map_queue_push(map, record) == 0;
+	}
+
+	template <typename Record> bool push(const Record& record)
+	{
+		return sizeof(Record) == recordSize() && push(static_cast<const void*>(&record));
+	}
+
+	/**
+	 * @brief Copy the first record out of the queue and remove it
+	 * @retval bool false if the queue is empty
+	 */
+	bool pop(void* record)
+	{
+		return map && bpf_map_queue_pop(map, record) == 0;
+	}
+
+	template <typename Record> bool pop(Record& record)
+	{
+		return sizeof(Record) == recordSize() && pop(static_cast<void*>(&record));
+	}
+
+	/**
+	 * @brief Set a callback for when a record is pushed to an empty queue
+	 *
+	 * The callback runs on the producer's thread, so would typically schedule the consumer,
+	 * which should then pop until the queue is empty. A queue has one callback, which is
+	 * removed when this map is destroyed.
+	 */
+	void setNotify(bpf_map_notify_t callback, void* param)
+	{
+		if(map) {
+			bpf_map_set_notify(map, callback, param);
+		}
+	}
+
+	/**
+	 * @brief Discard all records
+	 * @note Not safe while the consumer is running
+	 */
+	void clear()
+	{
+		if(map) {
+			bpf_map_clear(map);
+		}
+	}
+
+private:
+	bpf_map_t* map;
+};
+
+} // namespace rBPF
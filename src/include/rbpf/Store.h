@@ -1,11 +1,16 @@
 #pragma once
 
 #include "common/Store.h"
+#include <bpf/store.h>
+#include <bpf/percpu.h>
+#include <cstddef>
 
 namespace rBPF
 {
 class VirtualMachine;
 
+using StoreCacheStats = bpf_store_cache_stats_t;
+
 class LocalStore : public Store
 {
 public:
@@ -15,6 +20,53 @@ public:
 
 	bool update(Key key, Value value) override;
 	bool fetch(Key key, Value& value) override;
+	bool fetchMany(const Key* keys, Value* values, size_t count) override;
+	bool updateMany(const Key* keys, const Value* values, size_t count) override;
+	int scan(Key key, KeyValue* items, size_t max, bool reverse) override;
+	bool lookup(Key key, Value& value) override;
+	bool remove(Key key) override;
+	bool setTtl(Key key, uint32_t ttl) override;
+	bool fetchAdd(Key key, Value delta, Value& old) override;
+	bool compareExchange(Key key, Value& expected, Value desired) override;
+	bool updateMin(Key key, Value value) override;
+	bool updateMax(Key key, Value value) override;
+
+	/**
+	 * @brief Remove all entries, returning them to the shared pool
+	 *
+	 * Done automatically when the container is unloaded.
+	 */
+	void clear();
+
+	/**
+	 * @brief Get number of entries
+	 */
+	size_t count() const;
+
+	/**
+	 * @brief Limit number of entries
+	 * @param quota 0 for no limit
+	 *
+	 * Reset to BPF_STORE_LOCAL_QUOTA when a container is loaded.
+	 */
+	void setQuota(size_t quota);
+
+	/**
+	 * @brief Bound the number of entries, evicting the least recently used when full
+	 * @param capacity Maximum number of entries, 0 to remove the bound
+	 * @param ttl Default lifetime of new entries in milliseconds, 0 for no expiry
+	 * @retval bool false if the store is not empty, or no memory
+	 *
+	 * The lifetime of individual entries may be changed using setTtl().
+	 * The bound is removed when the container is unloaded.
+	 */
+	bool setCache(size_t capacity, uint32_t ttl = 0);
+
+	/**
+	 * @brief Get capacity, default lifetime, eviction and expiration counts
+	 * @retval bool false if the store is not bounded
+	 */
+	bool getCacheStats(StoreCacheStats& stats) const;
 
 private:
 	VirtualMachine& vm;
@@ -25,6 +77,134 @@ class GlobalStore : public Store
 public:
 	bool update(Key key, Value value) override;
 	bool fetch(Key key, Value& value) override;
+	bool fetchMany(const Key* keys, Value* values, size_t count) override;
+	bool updateMany(const Key* keys, const Value* values, size_t count) override;
+	int scan(Key key, KeyValue* items, size_t max, bool reverse) override;
+	bool lookup(Key key, Value& value) override;
+	bool remove(Key key) override;
+	bool setTtl(Key key, uint32_t ttl) override;
+	bool fetchAdd(Key key, Value delta, Value& old) override;
+	bool compareExchange(Key key, Value& expected, Value desired) override;
+	bool updateMin(Key key, Value value) override;
+	bool updateMax(Key key, Value value) override;
+
+	/**
+	 * @brief Remove all entries
+	 */
+	void clear();
+
+	/**
+	 * @brief Get number of entries
+	 */
+	size_t count() const;
+
+	/**
+	 * @brief Limit number of entries
+	 * @param quota 0 for no limit
+	 */
+	void setQuota(size_t quota);
+
+	/**
+	 * @brief Bound the number of entries, evicting the least recently used when full
+	 * @param capacity Maximum number of entries, 0 to remove the bound
+	 * @param ttl Default lifetime of new entries in milliseconds, 0 for no expiry
+	 * @retval bool false if the store is not empty, or no memory
+	 *
+	 * The lifetime of individual entries may be changed using setTtl().
+	 */
+	bool setCache(size_t capacity, uint32_t ttl = 0);
+
+	/**
+	 * @brief Get capacity, default lifetime, eviction and expiration counts
+	 * @retval bool false if the store is not bounded
+	 */
+	bool getCacheStats(StoreCacheStats& stats) const;
+};
+
+class LocalWideStore : public WideStore
+{
+public:
+	LocalWideStore(VirtualMachine& vm) : vm(vm)
+	{
+	}
+
+	bool update(Key key, Value value) override;
+	bool lookup(Key key, Value& value) override;
+	bool remove(Key key) override;
+	bool fetchAdd(Key key, Value delta, Value& old) override;
+	bool setBlob(Key key, const void* data, size_t len) override;
+	int getBlob(Key key, void* buf, size_t size) override;
+	bool removeBlob(Key key) override;
+	using WideStore::getBlob;
+	using WideStore::setBlob;
+
+private:
+	VirtualMachine& vm;
+};
+
+class GlobalWideStore : public WideStore
+{
+public:
+	bool update(Key key, Value value) override;
+	bool lookup(Key key, Value& value) override;
+	bool remove(Key key) override;
+	bool fetchAdd(Key key, Value delta, Value& old) override;
+	bool setBlob(Key key, const void* data, size_t len) override;
+	int getBlob(Key key, void* buf, size_t size) override;
+	bool removeBlob(Key key) override;
+	using WideStore::getBlob;
+	using WideStore::setBlob;
 };
 
+class GlobalPerThreadStore : public PerThreadStore
+{
+public:
+	bool add(Key key, Value delta) override;
+	bool update(Key key, Value value) override;
+	bool lookup(Key key, Merge merge, uint64_t& value) override;
+	int lookupAll(Key key, Value* values, size_t max) override;
+
+	/**
+	 * @brief Remove key for all threads
+	 * @retval bool true on success, false if key was not found
+	 */
+	bool remove(Key key);
+
+	/**
+	 * @brief Remove all entries
+	 */
+	void clear();
+
+	/**
+	 * @brief Get number of shards, the largest count returned by lookupAll()
+	 */
+	static constexpr size_t shards()
+	{
+		return CONFIG_BPF_PERCPU_SHARDS;
+	}
+};
+
+using StorePoolStats = bpf_pool_stats_t;
+
+/**
+ * @brief Get store pool statistics
+ * @param cls Size class, tree entries by default
+ *
+ * Use the high water mark to size BPF_STORE_NUM_VALUES and BPF_STORE_POOL_MAX.
+ */
+inline StorePoolStats getStorePoolStats(bpf_store_pool_class_t cls = BPF_STORE_POOL_ENTRY)
+{
+	StorePoolStats stats{};
+	bpf_store_get_pool_stats(cls, &stats);
+	return stats;
+}
+
+/**
+ * @brief Reset store pool high water marks and failure counts
+ */
+inline void resetStorePoolStats()
+{
+	bpf_store_reset_pool_stats();
+}
+
 } // namespace rBPF
@@ -0,0 +1,117 @@
+#pragma once
+
+#include "VirtualMachine.h"
+#include <bpf/store.h>
+#include <bpf/sync.h>
+#include <memory>
+
+namespace rBPF
+{
+/**
+ * @brief Runs a container when values in the global store change
+ *
+ * Each change to a watched key is queued, and run() executes the container once for each
+ * with a Store::Change as its context. If a key changes again before the container has seen it,
+ * the changes are coalesced: the container gets the value before the first change and the latest value,
+ * and nothing at all if the value has returned to where it was. So a container which is slower than
+ * the writes sees the latest state of each key without a backlog building up.
+ *
+ * For example, to run a container from the task queue when any configuration key changes:
+ *
+ * 	VirtualMachine vm(container);
+ * 	StoreWatch watch(vm, CONFIG_FIRST, CONFIG_LAST);
+ * 	watch.setNotify([](StoreWatch& watch, void*) {
+ * 		System.queueCallback([](void* param) {
+ * 			static_cast<StoreWatch*>(param)->run();
+ * 		}, &watch);
+ * 	}, nullptr);
+ *
+ * Changes are added on the thread which made them, so with BPF_CONCURRENT run() may be called
+ * from another thread, but only one thread may call run() at a time.
+ */
+class StoreWatch
+{
+public:
+	using Change = Store::Change;
+
+	/**
+	 * @brief Callback for when a change is queued and none were pending
+	 *
+	 * It is called with the store watch lock held, so must not change the global store or
+	 * create or destroy a StoreWatch. Typically it schedules a call to run().
+	 */
+	using Notify = void (*)(StoreWatch& watch, void* param);
+
+	static constexpr size_t defaultMaxPending{16};
+
+	struct Stats {
+		uint32_t changes;	///< Changes reported by the store
+		uint32_t coalesced; ///< Changes merged into one already pending
+		uint32_t dropped;	///< Changes lost because maxPending keys were already pending
+		uint32_t executed;	///< Times the container was run
+	};
+
+	/**
+	 * @brief Watch a range of keys
+	 * @param vm Loaded container to run, which must remain valid
+	 * @param first First key to watch
+	 * @param last Last key to watch
+	 * @param maxPending Number of keys which may have changes pending
+	 */
+	StoreWatch(VirtualMachine& vm, Store::Key first, Store::Key last, size_t maxPending = defaultMaxPending);
+
+	/**
+	 * @brief Watch a single key
+	 */
+	StoreWatch(VirtualMachine& vm, Store::Key key) : StoreWatch(vm, key, key, 1)
+	{
+	}
+
+	~StoreWatch();
+
+	StoreWatch(const StoreWatch&) = delete;
+	StoreWatch& operator=(const StoreWatch&) = delete;
+
+	/**
+	 * @brief Determine whether the watch is registered with the store
+	 */
+	explicit operator bool() const
+	{
+		return changes != nullptr;
+	}
+
+	void setNotify(Notify callback, void* param);
+
+	/**
+	 * @brief Run the container for pending changes, oldest first
+	 * @param maxChanges Limit on the number of changes handled
+	 * @retval size_t Number of times the container was run
+	 *
+	 * Changes made while this is running are also handled, up to maxChanges.
+	 */
+	size_t run(size_t maxChanges = SIZE_MAX);
+
+	/**
+	 * @brief Get number of keys with changes waiting to be handled by run()
+	 */
+	size_t pending() const;
+
+	Stats getStats() const;
+
+private:
+	static void changed(const bpf_store_change_t* change, void* param);
+	void add(const Change& change);
+	bool take(Change& change);
+
+	VirtualMachine& vm;
+	bpf_store_watch_t watch{};
+	std::unique_ptr<Change[]> changes; ///< Pending changes, oldest first
+	size_t maxPending;
+	size_t count{0};
+	Notify notify{nullptr};
+	void* notifyParam{nullptr};
+	Stats stats{};
+	mutable bpf_mutex_t mutex = BPF_MUTEX_INIT; ///< Guards the pending changes and stats
+};
+
+} // namespace rBPF
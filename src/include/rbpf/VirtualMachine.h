@@ -3,12 +3,21 @@
 #include <FlashString/Array.hpp>
 #include <rbpf/containers.h>
 #include "Store.h"
+#include "Map.h"
 #include <memory>
 
 struct bpf_s;
 
 namespace rBPF
 {
+/**
+ * @brief Error codes in addition to those from the VM (bpf_error_t)
+ */
+enum {
+	RBPF_NO_MEMORY = -100,
+	RBPF_NOT_SUPPORTED = -101, ///< Container cannot be run this way
+};
+
 /**
  * @brief Get text for an error code
  */
@@ -75,11 +84,29 @@ public:
 		return lastError;
 	}
 
+	/**
+	 * @brief Get number of maps declared by the container
+	 */
+	size_t getMapCount() const;
+
+	/**
+	 * @name Get a map declared by the container
+	 * @retval Map Invalid if not found or no container is loaded
+	 * @{
+	 */
+	Map getMap(unsigned index) const;
+	Map getMap(const char* name) const;
+	/** @} */
+
 	static GlobalStore globals;
 	LocalStore locals;
+	static GlobalWideStore wideGlobals;
+	LocalWideStore wideLocals;
+	static GlobalPerThreadStore perThreadGlobals;
 
 private:
 	friend class LocalStore;
+	friend class LocalWideStore;
 
 	const Container* container{nullptr};
 	std::unique_ptr<struct bpf_s> inst;
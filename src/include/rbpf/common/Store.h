@@ -1,6 +1,7 @@
 #pragma once
 
 #include <stdint.h>
+#include <stddef.h>
 
 namespace rBPF
 {
@@ -10,6 +11,20 @@ public:
 	using Key = uint32_t;
 	using Value = uint32_t;
 
+	struct KeyValue {
+		Key key;
+		Value value;
+	};
+
+	/**
+	 * @brief Context passed to a container run by a StoreWatch
+	 */
+	struct Change {
+		Key key;
+		Value oldValue; ///< 0 if the key was added
+		Value newValue; ///< 0 if the key was removed
+	};
+
 	class Entry
 	{
 	public:
@@ -59,6 +74,106 @@ public:
 	 */
 	virtual bool fetch(Key key, Value& value) = 0;
 
+	/**
+	 * @brief Fetch several values from store in one operation
+	 * @param keys
+	 * @param values Receives values, in the same order as keys
+	 * @param count Number of keys
+	 * @retval bool true on success, false if store is full
+	 *
+	 * Keys not found in the store are added and set to 0.
+	 */
+	virtual bool fetchMany(const Key* keys, Value* values, size_t count) = 0;
+
+	/**
+	 * @brief Update several values in store in one operation
+	 * @param keys
+	 * @param values New values, in the same order as keys
+	 * @param count Number of keys
+	 * @retval bool true on success, false if store is full
+	 */
+	virtual bool updateMany(const Key* keys, const Value* values, size_t count) = 0;
+
+	/**
+	 * @brief Read entries in key order
+	 * @param key First key to read
+	 * @param items Receives entries
+	 * @param max Size of items
+	 * @param reverse false for keys >= key in ascending order, true for keys <= key in descending order
+	 * @retval int Number of entries read, -1 on error
+	 *
+	 * To read the following range, call again with the key after the last one returned.
+	 * Hash table stores examine every entry on each call, so use the largest buffer practical.
+	 */
+	virtual int scan(Key key, KeyValue* items, size_t max, bool reverse) = 0;
+
+	/**
+	 * @brief Read value from store without adding it
+	 * @param key
+	 * @param value Set to 0 if key is not found
+	 * @retval bool true if key was found
+	 */
+	virtual bool lookup(Key key, Value& value) = 0;
+
+	/**
+	 * @brief Remove key from store
+	 * @param key
+	 * @retval bool true on success, false if key was not found
+	 */
+	virtual bool remove(Key key) = 0;
+
+	/**
+	 * @brief Set lifetime of an entry in a bounded store
+	 * @param key
+	 * @param ttl Milliseconds from now until the entry expires, 0 for no expiry
+	 * @retval bool true on success, false if key was not found or store is not bounded
+	 */
+	virtual bool setTtl(Key key, uint32_t ttl) = 0;
+
+	/**
+	 * @brief Add to value, returning the previous value
+	 * @param key
+	 * @param delta Amount to add, wraps on overflow
+	 * @param old Value before addition
+	 * @retval bool true on success, false if store is full
+	 *
+	 * If key is not found in the store then it's added and set to delta.
+	 */
+	virtual bool fetchAdd(Key key, Value delta, Value& old) = 0;
+
+	/**
+	 * @brief Add to value
+	 * @see fetchAdd
+	 */
+	bool add(Key key, Value delta)
+	{
+		Value old;
+		return fetchAdd(key, delta, old);
+	}
+
+	/**
+	 * @brief Replace value if it matches an expected value
+	 * @param key
+	 * @param expected Value to compare with, updated with the actual value on mismatch
+	 * @param desired Value to store on match
+	 * @retval bool true if value was replaced
+	 *
+	 * A key which is not found reads as 0.
+	 */
+	virtual bool compareExchange(Key key, Value& expected, Value desired) = 0;
+
+	/**
+	 * @brief Store value if less than the current value, or if key is not found
+	 * @retval bool true on success, false if store is full
+	 */
+	virtual bool updateMin(Key key, Value value) = 0;
+
+	/**
+	 * @brief Store value if greater than the current value, or if key is not found
+	 * @retval bool true on success, false if store is full
+	 */
+	virtual bool updateMax(Key key, Value value) = 0;
+
 	/**
 	 * @brief Fetch value from store
 	 * @param key
@@ -74,6 +189,265 @@ public:
 	{
 		return Entry(*this, key);
 	}
+
+	/**
+	 * @brief Ordered cursor over a store
+	 *
+	 * The cursor holds a copy of the current entry rather than a reference into the store,
+	 * so the store may be modified between steps. Each step reads one entry using scan().
+	 */
+	class Cursor
+	{
+	public:
+		Cursor(Store& store) : store(store)
+		{
+		}
+
+		/**
+		 * @brief Move to first entry with key greater than or equal to key
+		 * @retval bool true if an entry was found
+		 */
+		bool seek(Key key = 0)
+		{
+			return read(key, false);
+		}
+
+		/**
+		 * @brief Move to last entry with key less than or equal to key
+		 * @retval bool true if an entry was found
+		 */
+		bool seekLast(Key key = UINT32_MAX)
+		{
+			return read(key, true);
+		}
+
+		/**
+		 * @brief Move to the entry with the next higher key
+		 * @retval bool true if an entry was found, false at end (or if cursor is stopped)
+		 */
+		bool next()
+		{
+			if(!valid || entry.key == UINT32_MAX) {
+				return stop();
+			}
+			return read(entry.key + 1, false);
+		}
+
+		/**
+		 * @brief Move to the entry with the next lower key
+		 * @retval bool true if an entry was found, false at start (or if cursor is stopped)
+		 */
+		bool prev()
+		{
+			if(!valid || entry.key == 0) {
+				return stop();
+			}
+			return read(entry.key - 1, true);
+		}
+
+		/**
+		 * @brief Invalidate cursor
+		 * @retval bool Always false
+		 */
+		bool stop()
+		{
+			valid = false;
+			return false;
+		}
+
+		explicit operator bool() const
+		{
+			return valid;
+		}
+
+		Key key() const
+		{
+			return entry.key;
+		}
+
+		Value value() const
+		{
+			return entry.value;
+		}
+
+	private:
+		bool read(Key key, bool reverse)
+		{
+			valid = store.scan(key, &entry, 1, reverse) == 1;
+			return valid;
+		}
+
+		Store& store;
+		KeyValue entry{};
+		bool valid{false};
+	};
+
+	Cursor cursor()
+	{
+		return Cursor(*this);
+	}
+};
+
+/**
+ * @brief Store with 64-bit keys, holding 64-bit values or small blobs
+ *
+ * Entries are separate from those in the corresponding Store.
+ * Values and blobs with the same key are also separate.
+ */
+class WideStore
+{
+public:
+	using Key = uint64_t;
+	using Value = uint64_t;
+
+	/**
+	 * @brief Update value in store
+	 * @retval bool true on success, false if store is full
+	 */
+	virtual bool update(Key key, Value value) = 0;
+
+	/**
+	 * @brief Read value from store
+	 * @param key
+	 * @param value Set to 0 if key is not found
+	 * @retval bool true if key was found
+	 */
+	virtual bool lookup(Key key, Value& value) = 0;
+
+	/**
+	 * @brief Remove value from store
+	 * @retval bool true on success, false if key was not found
+	 */
+	virtual bool remove(Key key) = 0;
+
+	/**
+	 * @brief Add to value, returning the previous value
+	 * @param key
+	 * @param delta Amount to add, wraps on overflow
+	 * @param old Value before addition
+	 * @retval bool true on success, false if store is full
+	 *
+	 * If key is not found in the store then it's added and set to delta.
+	 */
+	virtual bool fetchAdd(Key key, Value delta, Value& old) = 0;
+
+	/**
+	 * @brief Add to value
+	 * @see fetchAdd
+	 */
+	bool add(Key key, Value delta)
+	{
+		Value old;
+		return fetchAdd(key, delta, old);
+	}
+
+	/**
+	 * @brief Store a blob, replacing any existing blob with the same key
+	 * @param key
+	 * @param data
+	 * @param len At most BPF_STORE_BLOB_MAX bytes
+	 * @retval bool true on success, false if too long or store is full
+	 */
+	virtual bool setBlob(Key key, const void* data, size_t len) = 0;
+
+	/**
+	 * @brief Read a blob
+	 * @param key
+	 * @param buf Receives data, truncated to size
+	 * @param size Size of buf
+	 * @retval int Length of blob, -1 if key is not found
+	 */
+	virtual int getBlob(Key key, void* buf, size_t size) = 0;
+
+	/**
+	 * @brief Remove a blob
+	 * @retval bool true on success, false if key was not found
+	 */
+	virtual bool removeBlob(Key key) = 0;
+
+	/**
+	 * @brief Store an object as a blob
+	 */
+	template <typename T> bool setBlob(Key key, const T& obj)
+	{
+		return setBlob(key, &obj, sizeof(obj));
+	}
+
+	/**
+	 * @brief Read an object stored with setBlob()
+	 * @retval bool true if blob was found and has the size of T
+	 */
+	template <typename T> bool getBlob(Key key, T& obj)
+	{
+		return getBlob(key, &obj, sizeof(obj)) == int(sizeof(obj));
+	}
+};
+
+/**
+ * @brief Global values held separately for each thread
+ *
+ * Each thread updates its own copy, so frequently updated counters do not contend.
+ * Reads combine the copies from all threads.
+ * Entries are separate from those in the global Store.
+ */
+class PerThreadStore
+{
+public:
+	using Key = uint32_t;
+	using Value = uint32_t;
+
+	/**
+	 * @brief How the values from each thread are combined
+	 */
+	enum class Merge {
+		sum,
+		min,
+		max,
+	};
+
+	/**
+	 * @brief Add to this thread's value
+	 * @param key
+	 * @param delta Amount to add, wraps on overflow
+	 * @retval bool true on success, false if store is full
+	 */
+	virtual bool add(Key key, Value delta) = 0;
+
+	/**
+	 * @brief Set this thread's value
+	 * @retval bool true on success, false if store is full
+	 */
+	virtual bool update(Key key, Value value) = 0;
+
+	/**
+	 * @brief Read value combined across all threads
+	 * @param key
+	 * @param merge
+	 * @param value Set to 0 if key is not found. Minimum and maximum consider only threads holding the key.
+	 * @retval bool true if key was found
+	 */
+	virtual bool lookup(Key key, Merge merge, uint64_t& value) = 0;
+
+	/**
+	 * @brief Read the value held for each thread
+	 * @param key
+	 * @param values Receives one value per shard, 0 where key is not found
+	 * @param max Size of values
+	 * @retval int Number of shards, which may exceed max, -1 if key is not found
+	 *
+	 * Threads are assigned shards in turn, so may share one if there are more threads than shards.
+	 */
+	virtual int lookupAll(Key key, Value* values, size_t max) = 0;
+
+	/**
+	 * @brief Get total of the values for all threads
+	 */
+	uint64_t sum(Key key)
+	{
+		uint64_t value;
+		lookup(key, Merge::sum, value);
+		return value;
+	}
 };
 
 } // namespace rBPF
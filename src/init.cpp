@@ -1,19 +1,31 @@
 #include "init.h"
 #include <bpf.h>
+#include <bpf/sync.h>
+#if CONFIG_BPF_CONCURRENT
+#include <mutex>
+#endif
 
 namespace rBPF
 {
 namespace
 {
+#if CONFIG_BPF_CONCURRENT
+std::once_flag initialised;
+#else
 bool initialised;
+#endif
 };
 
 void check_init()
 {
+#if CONFIG_BPF_CONCURRENT
+	std::call_once(initialised, bpf_init);
+#else
 	if(!initialised) {
 		bpf_init();
 		initialised = true;
 	}
+#endif
 }
 
 } // namespace rBPF
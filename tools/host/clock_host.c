@@ -0,0 +1,14 @@
+/*
+ * Microsecond system timer for programs which run containers on the host.
+ *
+ * storebench supplies its own so the tests control the clock.
+ */
+
+#include <debug_progmem.h>
+
+uint32_t system_get_time(void)
+{
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return (uint32_t)(ts.tv_sec * 1000000ULL + ts.tv_nsec / 1000);
+}
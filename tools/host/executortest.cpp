@@ -0,0 +1,338 @@
+/*
+ * Test of rBPF::Executor, running small containers assembled here on a pool
+ * of worker threads.
+ *
+ * Checks results through futures and callbacks, that idle workers steal jobs
+ * queued behind a blocked one, that wait() returns only once every job has
+ * completed, that destroying the executor completes the jobs still queued, and
+ * that containers declaring a queue are refused.
+ */
+
+#include <rbpf/Executor.h>
+#include <bpf.h>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <getopt.h>
+
+using namespace rBPF;
+
+namespace
+{
+unsigned threads{4};
+unsigned jobs{20000};
+
+/*
+ * Container images
+ */
+class Image
+{
+public:
+	void emit(uint8_t op, uint8_t dst = 0, uint8_t src = 0, int16_t off = 0, int32_t imm = 0)
+	{
+		uint8_t insn[8] = {op, uint8_t((src << 4) | dst)};
+		memcpy(&insn[2], &off, sizeof(off));
+		memcpy(&insn[4], &imm, sizeof(imm));
+		text.insert(text.end(), insn, insn + sizeof(insn));
+	}
+
+	void addMap(const char* name, bpf_map_type_t type, uint32_t keySize, uint32_t valueSize,
+				uint32_t maxEntries)
+	{
+		rbpf_map_t def{};
+		def.name_offset = addString(name);
+		def.type = type;
+		def.key_size = keySize;
+		def.value_size = valueSize;
+		def.max_entries = maxEntries;
+		maps.push_back(def);
+	}
+
+	/*
+	 * Header, rodata holding the names, text, one function at the start of text,
+	 * then the map table if there are any maps
+	 */
+	const VirtualMachine::Container& build()
+	{
+		uint16_t entry = addString("main");
+		std::vector<uint8_t> rodata(strings);
+		rodata.resize((rodata.size() + 7) & ~7U);
+
+		rbpf_header_t header{};
+		header.magic = RBPF_MAGIC_NO;
+		header.flags = maps.empty() ? 0 : RBPF_FLAG_MAPS;
+		header.rodata_len = rodata.size();
+		header.text_len = text.size();
+		header.functions = 1;
+		rbpf_function_t function{entry, 0, 0};
+
+		append(&header, sizeof(header));
+		append(rodata.data(), rodata.size());
+		append(text.data(), text.size());
+		append(&function, sizeof(function));
+		if(!maps.empty()) {
+			uint32_t count = maps.size();
+			append(&count, sizeof(count));
+			append(maps.data(), maps.size() * sizeof(rbpf_map_t));
+		}
+		container.reset(new VirtualMachine::Container(blob.data(), blob.size()));
+		return *container;
+	}
+
+private:
+	uint16_t addString(const char* str)
+	{
+		uint16_t offset = strings.size();
+		strings.insert(strings.end(), str, str + strlen(str) + 1);
+		return offset;
+	}
+
+	void append(const void* data, size_t length)
+	{
+		auto bytes = static_cast<const uint8_t*>(data);
+		blob.insert(blob.end(), bytes, bytes + length);
+	}
+
+	std::vector<uint8_t> text;
+	std::vector<uint8_t> strings;
+	std::vector<rbpf_map_t> maps;
+	std::vector<uint8_t> blob;
+	std::unique_ptr<VirtualMachine::Container> container;
+};
+
+/* Increments the uint64_t context, returning the new value */
+void emitIncrement(Image& image)
+{
+	image.emit(0x79, 0, 1);		  // r0 = *(uint64_t*)(r1 + 0)
+	image.emit(0x07, 0, 0, 0, 1); // r0 += 1
+	image.emit(0x7b, 1, 0);		  // *(uint64_t*)(r1 + 0) = r0
+	image.emit(0x95);			  // exit
+}
+
+Executor::Context makeContext(uint64_t value)
+{
+	Executor::Context context(sizeof(value));
+	memcpy(context.data(), &value, sizeof(value));
+	return context;
+}
+
+uint64_t readContext(const Executor::Result& result)
+{
+	uint64_t value{0};
+	if(result.context.size() == sizeof(value)) {
+		memcpy(&value, result.context.data(), sizeof(value));
+	}
+	return value;
+}
+
+bool checkResult(const Executor::Result& result, uint64_t input)
+{
+	return result.error == 0 && result.value == int64_t(input + 1) && readContext(result) == input + 1;
+}
+
+/* Wait up to 5 seconds for a count to be reached */
+bool waitFor(const std::atomic<unsigned>& count, unsigned target)
+{
+	for(unsigned ms = 0; ms < 5000 && count != target; ++ms) {
+		std::this_thread::sleep_for(std::chrono::milliseconds(1));
+	}
+	return count == target;
+}
+
+bool report(bool ok)
+{
+	printf("%s\n", ok ? "OK" : "FAILED");
+	return ok;
+}
+
+/*
+ * Tests
+ */
+bool testFutures(const VirtualMachine::Container& container)
+{
+	printf("\nfutures: %u jobs on %u threads... ", jobs, threads);
+	fflush(stdout);
+
+	Executor executor(threads);
+	std::vector<std::future<Executor::Result>> futures;
+	for(unsigned i = 0; i < jobs; ++i) {
+		futures.push_back(executor.submit(container, makeContext(i)));
+	}
+	bool ok = true;
+	for(unsigned i = 0; ok && i < jobs; ++i) {
+		auto result = futures[i].get();
+		if(!checkResult(result, i)) {
+			printf("job %u returned %lld, error %d, context %llu\n", i, (long long)result.value, result.error,
+				   (unsigned long long)readContext(result));
+			ok = false;
+		}
+	}
+	executor.wait();
+	auto stats = executor.getStats();
+	if(ok && stats.executed != jobs) {
+		printf("executed %llu of %u jobs\n", (unsigned long long)stats.executed, jobs);
+		ok = false;
+	}
+	return report(ok);
+}
+
+/* Callbacks, with wait() returning only once all have run */
+bool testCallbacks(const VirtualMachine::Container& container)
+{
+	printf("\ncallbacks: %u jobs on %u threads, then wait... ", jobs, threads);
+	fflush(stdout);
+
+	Executor executor(threads);
+	std::atomic<unsigned> completed{0};
+	std::atomic<unsigned> failed{0};
+	for(unsigned i = 0; i < jobs; ++i) {
+		executor.submit(container, makeContext(i), [&completed, &failed, i](Executor::Result& result) {
+			if(!checkResult(result, i)) {
+				++failed;
+			}
+			++completed;
+		});
+	}
+	executor.wait();
+	unsigned done = completed;
+	bool ok = (done == jobs && failed == 0);
+	if(!ok) {
+		printf("%u of %u callbacks run on return from wait(), %u failed\n", done, jobs, unsigned(failed));
+	}
+	return report(ok);
+}
+
+/*
+ * Two workers, one blocked in a callback. The other must run every job queued
+ * on either of them, taking those of the blocked worker.
+ */
+bool testStealing(const VirtualMachine::Container& container)
+{
+	printf("\nstealing: %u jobs queued behind a blocked worker... ", jobs);
+	fflush(stdout);
+
+	Executor executor(2);
+	std::mutex mutex;
+	std::condition_variable released;
+	bool release{false};
+	std::atomic<unsigned> blocked{0};
+	std::atomic<unsigned> completed{0};
+
+	executor.submit(container, makeContext(0), [&](Executor::Result&) {
+		++blocked;
+		std::unique_lock<std::mutex> lock(mutex);
+		released.wait(lock, [&release] { return release; });
+	});
+	bool ok = waitFor(blocked, 1);
+	for(unsigned i = 0; ok && i < jobs; ++i) {
+		executor.submit(container, makeContext(i), [&completed](Executor::Result&) { ++completed; });
+	}
+	ok = ok && waitFor(completed, jobs);
+	auto stats = executor.getStats();
+	unsigned done = completed;
+	{
+		std::lock_guard<std::mutex> lock(mutex);
+		release = true;
+	}
+	released.notify_all();
+	executor.wait();
+
+	// Half of the jobs were queued on the blocked worker
+	if(!ok || stats.stolen < jobs / 2) {
+		printf("%u of %u jobs completed with a worker blocked, %llu stolen\n", done, jobs,
+			   (unsigned long long)stats.stolen);
+		ok = false;
+	} else {
+		printf("%llu stolen... ", (unsigned long long)stats.stolen);
+	}
+	return report(ok);
+}
+
+/* The destructor completes queued jobs before stopping the workers */
+bool testShutdown(const VirtualMachine::Container& container)
+{
+	printf("\nshutdown: destroy with %u jobs queued... ", jobs);
+	fflush(stdout);
+
+	std::atomic<unsigned> completed{0};
+	{
+		Executor executor(threads);
+		for(unsigned i = 0; i < jobs; ++i) {
+			executor.submit(container, makeContext(i), [&completed](Executor::Result&) { ++completed; });
+		}
+	}
+	bool ok = (completed == jobs);
+	if(!ok) {
+		printf("%u of %u jobs completed\n", unsigned(completed), jobs);
+	}
+	return report(ok);
+}
+
+/* A queue has one consumer and one producer, so cannot be shared by the instances on each worker */
+bool testQueueRefused(const VirtualMachine::Container& container)
+{
+	printf("\nqueue: container declaring a queue... ");
+	fflush(stdout);
+
+	Executor executor(threads);
+	std::vector<std::future<Executor::Result>> futures;
+	for(unsigned i = 0; i < 2 * threads; ++i) {
+		futures.push_back(executor.submit(container, makeContext(i)));
+	}
+	// The container is not run, so the context is returned unchanged
+	bool ok = true;
+	for(unsigned i = 0; ok && i < futures.size(); ++i) {
+		auto result = futures[i].get();
+		if(result.error != RBPF_NOT_SUPPORTED || readContext(result) != i) {
+			printf("error %d, expected %d (%s)\n", result.error, RBPF_NOT_SUPPORTED,
+				   getErrorString(RBPF_NOT_SUPPORTED).c_str());
+			ok = false;
+		}
+	}
+	return report(ok);
+}
+
+void usage(const char* prog)
+{
+	printf("Usage: %s [options]\n"
+		   "  -t THREADS  Worker threads (default %u)\n"
+		   "  -n JOBS     Jobs for each test (default %u)\n",
+		   prog, threads, jobs);
+}
+
+} // namespace
+
+int main(int argc, char* argv[])
+{
+	int opt;
+	while((opt = getopt(argc, argv, "t:n:h")) != -1) {
+		switch(opt) {
+		case 't':
+			threads = strtoul(optarg, nullptr, 0);
+			break;
+		case 'n':
+			jobs = strtoul(optarg, nullptr, 0);
+			break;
+		default:
+			usage(argv[0]);
+			return opt == 'h' ? 0 : 1;
+		}
+	}
+
+	Image increment;
+	emitIncrement(increment);
+	auto& incrementContainer = increment.build();
+
+	Image queue;
+	emitIncrement(queue);
+	queue.addMap("jobs", BPF_MAP_TYPE_QUEUE, 0, sizeof(uint64_t), 4);
+	auto& queueContainer = queue.build();
+
+	bool ok = testFutures(incrementContainer);
+	ok &= testCallbacks(incrementContainer);
+	ok &= testStealing(incrementContainer);
+	ok &= testShutdown(incrementContainer);
+	ok &= testQueueRefused(queueContainer);
+
+	return ok ? 0 : 1;
+}
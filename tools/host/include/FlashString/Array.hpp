@@ -0,0 +1,41 @@
+/*
+ * Minimal stand-in for the Sming FlashString Array so containers can be
+ * built in memory by host programs. Unlike the real class, it refers to
+ * data held elsewhere, which must outlive it.
+ */
+
+#pragma once
+
+#include <WString.h>
+#include <cstddef>
+
+namespace FSTR
+{
+template <typename ElementType> class Array
+{
+public:
+	Array(const ElementType* data, size_t length) : ptr(data), len(length)
+	{
+	}
+
+	const ElementType* data() const
+	{
+		return ptr;
+	}
+
+	size_t length() const
+	{
+		return len;
+	}
+
+	size_t size() const
+	{
+		return len * sizeof(ElementType);
+	}
+
+private:
+	const ElementType* ptr;
+	size_t len;
+};
+
+} // namespace FSTR
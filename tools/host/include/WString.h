@@ -0,0 +1,30 @@
+/*
+ * Minimal stand-in for the Sming String class so the rBPF C++ API in src/
+ * can be compiled as a plain native Linux program.
+ */
+
+#pragma once
+
+#include <string>
+
+class String : public std::string
+{
+public:
+	using std::string::string;
+
+	String(const std::string& str) : std::string(str)
+	{
+	}
+
+	String(int value) : std::string(std::to_string(value))
+	{
+	}
+};
+
+inline String operator+(const String& lhs, const String& rhs)
+{
+	return String(static_cast<const std::string&>(lhs) + static_cast<const std::string&>(rhs));
+}
+
+/* Flash strings are ordinary memory on the host */
+#define F(str) String(str)
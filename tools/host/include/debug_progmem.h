@@ -0,0 +1,56 @@
+/*
+ * Minimal stand-in for the Sming debug/flash support header so the rBPF
+ * core in bpf/ can be compiled as a plain native Linux program.
+ *
+ * Flash is ordinary memory on the host, so the PROGMEM attribute and the
+ * *_P accessors are no-ops.
+ */
+
+#pragma once
+
+#include <stdarg.h>
+#include <stdbool.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+#ifndef PROGMEM
+#define PROGMEM
+#endif
+
+#define ALIGNUP4(n) (((n) + 3) & ~3)
+
+#define isFlashPtr(ptr) false
+#define strlen_P(s) strlen(s)
+#define strcmp_P(s1, s2) strcmp(s1, s2)
+#define memcpy_P(dest, src, n) memcpy(dest, src, n)
+
+#ifdef DEBUG_VERBOSE_LEVEL
+#define debug_e(fmt, ...) fprintf(stderr, fmt "\n", ##__VA_ARGS__)
+#define debug_w(fmt, ...) fprintf(stderr, fmt "\n", ##__VA_ARGS__)
+#define debug_i(fmt, ...) fprintf(stderr, fmt "\n", ##__VA_ARGS__)
+#define debug_d(fmt, ...) fprintf(stderr, fmt "\n", ##__VA_ARGS__)
+#else
+#define debug_e(fmt, ...) fprintf(stderr, fmt "\n", ##__VA_ARGS__)
+#define debug_w(fmt, ...) do {} while (0)
+#define debug_i(fmt, ...) do {} while (0)
+#define debug_d(fmt, ...) do {} while (0)
+#endif
+
+static inline int m_vprintf(const char *fmt, va_list args)
+{
+    return vprintf(fmt, args);
+}
+
+/* Microsecond system timer, defined by each host program */
+uint32_t system_get_time(void);
+
+#ifdef __cplusplus
+}
+#endif
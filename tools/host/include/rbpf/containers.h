@@ -0,0 +1,6 @@
+/*
+ * Stand-in for the header generated by rbpf.inc.mk. Host programs build
+ * their containers in memory, so none are declared here.
+ */
+
+#pragma once
@@ -0,0 +1,499 @@
+/*
+ * Standalone runner for rBPF container images (.bin files produced by gen_rbf.py).
+ *
+ * Loads one or more images from disk, executes each one N times with a context
+ * read from a binary or hex file and reports results, errors, throughput and
+ * latency percentiles.
+ */
+
+#include <ctype.h>
+#include <getopt.h>
+#include <stdbool.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+
+#include "bpf.h"
+#include "bpf/store.h"
+#include "bpf/map.h"
+#include "bpf/clock.h"
+#include <debug_progmem.h>
+
+#define MAX_GLOBALS 64
+
+typedef struct {
+    uint32_t key;
+    uint32_t value;
+} keyval_t;
+
+/* Command-line options */
+static unsigned _iterations = 1;
+static size_t _stack_size = BPF_STACK_SIZE;
+static const char *_ctx_file;
+static bool _ctx_hex;
+static size_t _ctx_size;
+static bool _map_ctx = true;
+static bool _dump_ctx;
+static bool _dump_globals;
+static bool _dump_maps;
+static bool _quiet;
+static keyval_t _globals[MAX_GLOBALS];
+static unsigned _num_globals;
+
+static uint64_t _now_ns(void)
+{
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return ts.tv_sec * 1000000000ULL + ts.tv_nsec;
+}
+
+static const char *_error_string(int error)
+{
+    switch (error) {
+    case BPF_OK:
+        return "OK";
+    case BPF_ILLEGAL_INSTRUCTION:
+        return "ILLEGAL_INSTRUCTION";
+    case BPF_ILLEGAL_MEM:
+        return "ILLEGAL_MEM";
+    case BPF_ILLEGAL_JUMP:
+        return "ILLEGAL_JUMP";
+    case BPF_ILLEGAL_CALL:
+        return "ILLEGAL_CALL";
+    case BPF_ILLEGAL_LEN:
+        return "ILLEGAL_LEN";
+    case BPF_ILLEGAL_REGISTER:
+        return "ILLEGAL_REGISTER";
+    case BPF_NO_RETURN:
+        return "NO_RETURN";
+    case BPF_OUT_OF_BRANCHES:
+        return "OUT_OF_BRANCHES";
+    case BPF_ILLEGAL_DIV:
+        return "ILLEGAL_DIV";
+    default:
+        return "ERROR";
+    }
+}
+
+static uint8_t *_read_file(const char *filename, size_t *len)
+{
+    FILE *f = fopen(filename, "rb");
+    if (!f) {
+        perror(filename);
+        return NULL;
+    }
+    fseek(f, 0, SEEK_END);
+    long size = ftell(f);
+    fseek(f, 0, SEEK_SET);
+    /* Instructions are read as aligned 64-bit words */
+    uint8_t *buf = aligned_alloc(8, (size + 7) & ~7);
+    if (buf && fread(buf, 1, size, f) != (size_t)size) {
+        perror(filename);
+        free(buf);
+        buf = NULL;
+    }
+    fclose(f);
+    *len = size;
+    return buf;
+}
+
+/*
+ * Parse a hex file into binary. Whitespace, commas and 0x prefixes are ignored
+ * so output from hexdump-style tools and C initialisers can be used directly.
+ */
+static uint8_t *_read_hex_file(const char *filename, size_t *len)
+{
+    size_t text_len;
+    uint8_t *text = _read_file(filename, &text_len);
+    if (!text) {
+        return NULL;
+    }
+    uint8_t *buf = malloc(text_len / 2 + 1);
+    size_t n = 0;
+    int hi = -1;
+    for (size_t i = 0; i < text_len; i++) {
+        char c = text[i];
+        if (c == '0' && i + 1 < text_len && (text[i + 1] == 'x' || text[i + 1] == 'X')) {
+            i++;
+            continue;
+        }
+        if (!isxdigit((unsigned char)c)) {
+            if (isspace((unsigned char)c) || c == ',') {
+                continue;
+            }
+            fprintf(stderr, "%s: invalid character '%c' at offset %zu\n", filename, c, i);
+            free(buf);
+            free(text);
+            return NULL;
+        }
+        int nibble = isdigit((unsigned char)c) ? c - '0' : (tolower((unsigned char)c) - 'a' + 10);
+        if (hi < 0) {
+            hi = nibble;
+        }
+        else {
+            buf[n++] = (hi << 4) | nibble;
+            hi = -1;
+        }
+    }
+    free(text);
+    if (hi >= 0) {
+        fprintf(stderr, "%s: odd number of hex digits\n", filename);
+        free(buf);
+        return NULL;
+    }
+    *len = n;
+    return buf;
+}
+
+/*
+ * Check the image is complete before handing it to the VM, which trusts the header
+ */
+static bool _check_image(const char *filename, const uint8_t *image, size_t len)
+{
+    if (len < sizeof(rbpf_header_t)) {
+        fprintf(stderr, "%s: too short for header\n", filename);
+        return false;
+    }
+    rbpf_header_t hdr;
+    memcpy(&hdr, image, sizeof(hdr));
+    if (hdr.magic != RBPF_MAGIC_NO) {
+        fprintf(stderr, "%s: bad magic 0x%08x\n", filename, (unsigned)hdr.magic);
+        return false;
+    }
+    uint64_t required = sizeof(rbpf_header_t) + (uint64_t)hdr.data_len + hdr.rodata_len +
+                        hdr.text_len + (uint64_t)hdr.functions * sizeof(rbpf_function_t);
+    if (required > len) {
+        fprintf(stderr, "%s: truncated, header requires %llu bytes but file has %zu\n",
+                filename, (unsigned long long)required, len);
+        return false;
+    }
+    if (hdr.text_len == 0) {
+        fprintf(stderr, "%s: no code\n", filename);
+        return false;
+    }
+    return true;
+}
+
+static int _compare_u64(const void *a, const void *b)
+{
+    uint64_t x = *(const uint64_t *)a;
+    uint64_t y = *(const uint64_t *)b;
+    return (x > y) - (x < y);
+}
+
+static uint64_t _percentile(const uint64_t *sorted, size_t n, unsigned pct)
+{
+    size_t index = (n * pct + 99) / 100;
+    return sorted[index ? index - 1 : 0];
+}
+
+static void _hexdump(const uint8_t *data, size_t len)
+{
+    for (size_t i = 0; i < len; i += 16) {
+        printf("  %04zx:", i);
+        for (size_t j = i; j < i + 16 && j < len; j++) {
+            printf(" %02x", data[j]);
+        }
+        printf("\n");
+    }
+}
+
+static void _print_global(uint32_t key, uint32_t value, void *ctx)
+{
+    (void)ctx;
+    printf("  %u = %u\n", (unsigned)key, (unsigned)value);
+}
+
+static void _print_bytes(const uint8_t *data, size_t len)
+{
+    for (size_t i = 0; i < len; i++) {
+        printf("%02x", data[i]);
+    }
+}
+
+static void _print_histogram(const bpf_map_t *map)
+{
+    bpf_map_histogram_t stats;
+    uint32_t buckets[64];
+    size_t count = bpf_map_histogram_read(map, &stats, buckets, 64);
+    printf("    count %u, sum %llu, min %u, max %u\n", (unsigned)stats.count,
+           (unsigned long long)stats.sum, (unsigned)stats.min, (unsigned)stats.max);
+    for (size_t i = 0; i < count && i < 64; i++) {
+        if (buckets[i] != 0) {
+            printf("    >= %u: %u\n", (unsigned)bpf_map_histogram_bucket_base(map, i),
+                   (unsigned)buckets[i]);
+        }
+    }
+}
+
+/* Records are consumed, as at the end of a real run */
+static void _print_records(bpf_map_t *map)
+{
+    printf("    dropped %u\n", (unsigned)bpf_map_ringbuf_dropped(map));
+    const void *record;
+    uint32_t len;
+    while ((record = bpf_map_ringbuf_peek(map, &len)) != NULL) {
+        printf("    ");
+        _print_bytes(record, len);
+        printf("\n");
+        bpf_map_ringbuf_consume(map);
+    }
+}
+
+static void _print_queue(bpf_map_t *map)
+{
+    uint8_t *record = malloc(bpf_map_value_size(map));
+    while (record && bpf_map_queue_pop(map, record) == 0) {
+        printf("    ");
+        _print_bytes(record, bpf_map_value_size(map));
+        printf("\n");
+    }
+    free(record);
+}
+
+static void _print_maps(const bpf_t *bpf)
+{
+    static const char *types[] = {"?", "array", "hash", "counter", "lpm",
+                                  "bloom", "count-min", "histogram", "window", "ringbuf",
+                                  "queue"};
+    for (uint32_t i = 0; i < bpf_map_count(bpf); i++) {
+        bpf_map_t *map = bpf_map_get(bpf, i);
+        unsigned type = bpf_map_type(map);
+        printf("  map %u \"%s\" %s, %u of %u entries:\n", (unsigned)i, bpf_map_name(map),
+               types[type < sizeof(types) / sizeof(types[0]) ? type : 0],
+               (unsigned)bpf_map_entries(map), (unsigned)bpf_map_max_entries(map));
+        if (type == BPF_MAP_TYPE_HISTOGRAM) {
+            _print_histogram(map);
+            continue;
+        }
+        if (type == BPF_MAP_TYPE_WINDOW) {
+            printf("    total %u\n", (unsigned)bpf_map_window_read(map, bpf_clock_ms(), NULL, 0));
+            continue;
+        }
+        if (type == BPF_MAP_TYPE_RINGBUF) {
+            _print_records(map);
+            continue;
+        }
+        if (type == BPF_MAP_TYPE_QUEUE) {
+            _print_queue(map);
+            continue;
+        }
+        uint8_t key[CONFIG_BPF_MAP_KEY_MAX];
+        for (int res = bpf_map_next_key(map, NULL, key); res == 0;
+             res = bpf_map_next_key(map, key, key)) {
+            printf("    ");
+            _print_bytes(key, bpf_map_key_size(map));
+            printf(" = ");
+            _print_bytes(bpf_map_lookup(map, key), bpf_map_value_size(map));
+            printf("\n");
+        }
+    }
+}
+
+static bool _run(const char *filename, const uint8_t *ctx_init, size_t ctx_len)
+{
+    size_t image_len;
+    uint8_t *image = _read_file(filename, &image_len);
+    if (!image) {
+        return false;
+    }
+    if (!_check_image(filename, image, image_len)) {
+        free(image);
+        return false;
+    }
+
+    uint8_t *stack = aligned_alloc(8, _stack_size);
+    bpf_t bpf = {
+        .application = image,
+        .application_len = image_len,
+        .stack = stack,
+        .stack_size = _stack_size,
+    };
+    if (bpf_setup(&bpf) < 0) {
+        fprintf(stderr, "%s: setup failed\n", filename);
+        free(stack);
+        free(image);
+        return false;
+    }
+
+    uint8_t *ctx = ctx_len ? malloc(ctx_len) : NULL;
+    uint64_t *times = malloc(_iterations * sizeof(uint64_t));
+    unsigned error_count = 0;
+    int first_error = BPF_OK;
+    int64_t result = 0;
+
+    uint64_t total_start = _now_ns();
+    for (unsigned i = 0; i < _iterations; i++) {
+        /* Each run sees the same input */
+        if (ctx) {
+            memcpy(ctx, ctx_init, ctx_len);
+        }
+        uint64_t start = _now_ns();
+        int err = _map_ctx ? bpf_execute_ctx(&bpf, ctx, ctx_len, &result)
+                           : bpf_execute(&bpf, ctx, ctx_len, &result);
+        times[i] = _now_ns() - start;
+        if (err != BPF_OK) {
+            if (error_count++ == 0) {
+                first_error = err;
+            }
+        }
+    }
+    double total = (double)(_now_ns() - total_start) / 1e9;
+
+    qsort(times, _iterations, sizeof(uint64_t), _compare_u64);
+    uint64_t sum = 0;
+    for (unsigned i = 0; i < _iterations; i++) {
+        sum += times[i];
+    }
+
+    rbpf_header_t hdr = rbpf_header(&bpf);
+    printf("%s: text %u B, data %u B, bss %u B, rodata %u B\n", filename,
+           (unsigned)hdr.text_len, (unsigned)hdr.data_len, (unsigned)hdr.bss_len,
+           (unsigned)hdr.rodata_len);
+    printf("  result %lld (0x%llx)\n", (long long)result, (unsigned long long)result);
+    if (error_count) {
+        printf("  errors %u of %u runs, first %d %s\n", error_count, _iterations, first_error,
+               _error_string(first_error));
+    }
+    if (!_quiet) {
+        printf("  runs %u in %.3f s, %.0f runs/s\n", _iterations, total,
+               total > 0 ? _iterations / total : 0);
+        printf("  latency ns: mean %.0f, min %llu, p50 %llu, p90 %llu, p99 %llu, max %llu\n",
+               (double)sum / _iterations, (unsigned long long)times[0],
+               (unsigned long long)_percentile(times, _iterations, 50),
+               (unsigned long long)_percentile(times, _iterations, 90),
+               (unsigned long long)_percentile(times, _iterations, 99),
+               (unsigned long long)times[_iterations - 1]);
+    }
+    if (_dump_ctx && ctx) {
+        printf("  context:\n");
+        _hexdump(ctx, ctx_len);
+    }
+    if (_dump_maps) {
+        _print_maps(&bpf);
+    }
+
+    free(times);
+    free(ctx);
+    bpf_destroy(&bpf);
+    free(stack);
+    free(image);
+    return error_count == 0;
+}
+
+static void _usage(const char *prog)
+{
+    printf("Usage: %s [options] FILE.bin...\n"
+           "  -n COUNT      Number of runs per container (default 1)\n"
+           "  -c FILE       Read context from binary file\n"
+           "  -x FILE       Read context from hex file\n"
+           "  -z SIZE       Use zero-filled context of SIZE bytes\n"
+           "  -u            Don't map context as a memory region\n"
+           "  -s SIZE       Stack size in bytes (default %u)\n"
+           "  -g KEY=VALUE  Set value in global store before running\n"
+           "  -d            Dump context after final run\n"
+           "  -G            Dump global store after all runs\n"
+           "  -M            Dump maps after final run\n"
+           "  -q            Only report results and errors\n",
+           prog, BPF_STACK_SIZE);
+}
+
+int main(int argc, char *argv[])
+{
+    int opt;
+    while ((opt = getopt(argc, argv, "n:c:x:z:us:g:dGMqh")) != -1) {
+        switch (opt) {
+        case 'n':
+            _iterations = strtoul(optarg, NULL, 0);
+            break;
+        case 'c':
+            _ctx_file = optarg;
+            _ctx_hex = false;
+            break;
+        case 'x':
+            _ctx_file = optarg;
+            _ctx_hex = true;
+            break;
+        case 'z':
+            _ctx_size = strtoul(optarg, NULL, 0);
+            break;
+        case 'u':
+            _map_ctx = false;
+            break;
+        case 's':
+            _stack_size = (strtoul(optarg, NULL, 0) + 7) & ~7;
+            break;
+        case 'g': {
+            char *sep;
+            if (_num_globals == MAX_GLOBALS || !(sep = strchr(optarg, '='))) {
+                _usage(argv[0]);
+                return 1;
+            }
+            _globals[_num_globals].key = strtoul(optarg, NULL, 0);
+            _globals[_num_globals].value = strtoul(sep + 1, NULL, 0);
+            _num_globals++;
+            break;
+        }
+        case 'd':
+            _dump_ctx = true;
+            break;
+        case 'G':
+            _dump_globals = true;
+            break;
+        case 'M':
+            _dump_maps = true;
+            break;
+        case 'q':
+            _quiet = true;
+            break;
+        default:
+            _usage(argv[0]);
+            return opt == 'h' ? 0 : 1;
+        }
+    }
+    if (optind >= argc || _iterations == 0) {
+        _usage(argv[0]);
+        return 1;
+    }
+
+    uint8_t *ctx = NULL;
+    size_t ctx_len = 0;
+    if (_ctx_file) {
+        ctx = _ctx_hex ? _read_hex_file(_ctx_file, &ctx_len) : _read_file(_ctx_file, &ctx_len);
+        if (!ctx) {
+            return 1;
+        }
+    }
+    else if (_ctx_size) {
+        ctx = calloc(1, _ctx_size);
+        ctx_len = _ctx_size;
+    }
+
+    bpf_init();
+    for (unsigned i = 0; i < _num_globals; i++) {
+        bpf_store_update_global(_globals[i].key, _globals[i].value);
+    }
+
+    bool ok = true;
+    for (int i = optind; i < argc; i++) {
+        ok &= _run(argv[i], ctx, ctx_len);
+    }
+
+    if (CONFIG_BPF_CODE_CACHE_SIZE) {
+        bpf_code_cache_stats_t stats;
+        bpf_code_cache_get_stats(&stats);
+        printf("code cache: %u hits, %u misses, %u insertions, %u evictions, %u rejections\n",
+               (unsigned)stats.hits, (unsigned)stats.misses, (unsigned)stats.insertions,
+               (unsigned)stats.evictions, (unsigned)stats.rejections);
+    }
+
+    if (_dump_globals) {
+        printf("global store:\n");
+        bpf_store_iter_global(_print_global, NULL);
+    }
+
+    free(ctx);
+    return ok ? 0 : 1;
+}
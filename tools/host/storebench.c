@@ -0,0 +1,3170 @@
+/*
+ * Scaling benchmark and randomised stress test for the rBPF key-value store.
+ *
+ * Runs natively against bpf/store.c and its backends.
+ * For each store (global and local), backend (tree and hash), key count and
+ * key pattern it measures the average latency of insert, fetch, update, remove,
+ * a full traversal and a full ordered scan, and reports the resulting tree
+ * depth (longest probe sequence for hash tables) and memory used per entry.
+ *
+ * The stress test applies random operations against a shadow copy of the
+ * store and verifies the backend invariants after every one: ordering, parent
+ * links and AVL balance for trees, probe distances and Robin Hood ordering
+ * for hash tables.
+ *
+ * Built with CONFIG_BPF_CONCURRENT, it also measures how global store lookup
+ * throughput scales with the number of threads, compares counters shared in
+ * the global store with per-thread counters, and runs a multi-threaded stress
+ * test mixing shared counters, per-thread keys in the global store and
+ * per-thread local stores, which all allocate from the shared pool.
+ */
+
+#include <getopt.h>
+#include <math.h>
+#include <stdbool.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#if CONFIG_BPF_CONCURRENT
+#include <pthread.h>
+#include <sched.h>
+#endif
+
+#include "bpf.h"
+#include "bpf/store.h"
+#include "bpf/percpu.h"
+#include "bpf/lpm.h"
+#include "bpf/clock.h"
+#include "bpf/ringbuf.h"
+#include "bpf/map.h"
+
+typedef enum {
+    PATTERN_SEQUENTIAL,
+    PATTERN_RANDOM,
+    PATTERN_ZIPF,
+    PATTERN_COUNT,
+} pattern_t;
+
+static const char *const _pattern_names[PATTERN_COUNT] = {
+    "sequential", "random", "zipf",
+};
+
+typedef struct {
+    const char *name;
+    bpf_t *bpf;         /* NULL for the global store */
+    bpf_store_type_t type;
+} store_t;
+
+typedef struct {
+    double insert;
+    double fetch;
+    double batch;
+    double update;
+    double remove;
+    double traverse;
+    double scan;
+    size_t depth;
+} result_t;
+
+/* Command-line options */
+static size_t _max_keys = 100000;
+static unsigned _seed = 1;
+static double _budget = 10.0;       /* Seconds per phase before giving up on larger sizes */
+static unsigned _stress_ops = 20000;
+static unsigned _stress_keys = 512;
+static double _zipf_s = 0.99;
+#if CONFIG_BPF_CONCURRENT
+static unsigned _threads = 4;
+#endif
+
+static uint64_t _rng_state;
+
+static uint64_t _rand(void)
+{
+    /* xorshift64* */
+    _rng_state ^= _rng_state >> 12;
+    _rng_state ^= _rng_state << 25;
+    _rng_state ^= _rng_state >> 27;
+    return _rng_state * 0x2545F4914F6CDD1DULL;
+}
+
+static uint32_t _rand_below(uint32_t n)
+{
+    return (uint32_t)(_rand() % n);
+}
+
+static uint64_t _now_ns(void)
+{
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return ts.tv_sec * 1000000000ULL + ts.tv_nsec;
+}
+
+static void _shuffle(uint32_t *keys, size_t n)
+{
+    for (size_t i = n - 1; i > 0; i--) {
+        size_t j = _rand_below(i + 1);
+        uint32_t tmp = keys[i];
+        keys[i] = keys[j];
+        keys[j] = tmp;
+    }
+}
+
+/*
+ * Zipfian sampler over ranks [0, n) using a precomputed cumulative distribution
+ */
+typedef struct {
+    double *cdf;
+    size_t n;
+} zipf_t;
+
+static void _zipf_init(zipf_t *zipf, size_t n, double s)
+{
+    zipf->cdf = malloc(n * sizeof(double));
+    zipf->n = n;
+    double sum = 0;
+    for (size_t i = 0; i < n; i++) {
+        sum += 1.0 / pow((double)(i + 1), s);
+        zipf->cdf[i] = sum;
+    }
+    for (size_t i = 0; i < n; i++) {
+        zipf->cdf[i] /= sum;
+    }
+}
+
+static size_t _zipf_next(const zipf_t *zipf)
+{
+    double u = (double)(_rand() >> 11) / (double)(1ULL << 53);
+    size_t lo = 0;
+    size_t hi = zipf->n - 1;
+    while (lo < hi) {
+        size_t mid = (lo + hi) / 2;
+        if (zipf->cdf[mid] < u) {
+            lo = mid + 1;
+        }
+        else {
+            hi = mid;
+        }
+    }
+    return lo;
+}
+
+static void _zipf_free(zipf_t *zipf)
+{
+    free(zipf->cdf);
+}
+
+/*
+ * Store access wrappers so global and local stores share the same code
+ */
+static int _update(const store_t *store, uint32_t key, uint32_t value)
+{
+    return store->bpf ? bpf_store_update_local(store->bpf, key, value)
+                      : bpf_store_update_global(key, value);
+}
+
+static int _fetch(const store_t *store, uint32_t key, uint32_t *value)
+{
+    return store->bpf ? bpf_store_fetch_local(store->bpf, key, value)
+                      : bpf_store_fetch_global(key, value);
+}
+
+static int _remove(const store_t *store, uint32_t key)
+{
+    return store->bpf ? bpf_store_remove_local(store->bpf, key)
+                      : bpf_store_remove_global(key);
+}
+
+static int _fetch_many(const store_t *store, const uint32_t *keys, uint32_t *values, size_t count)
+{
+    return store->bpf ? bpf_store_fetch_many_local(store->bpf, keys, values, count)
+                      : bpf_store_fetch_many_global(keys, values, count);
+}
+
+static int _lookup(const store_t *store, uint32_t key, uint32_t *value)
+{
+    return store->bpf ? bpf_store_lookup_local(store->bpf, key, value)
+                      : bpf_store_lookup_global(key, value);
+}
+
+static int _fetch_add(const store_t *store, uint32_t key, uint32_t delta, uint32_t *old)
+{
+    return store->bpf ? bpf_store_fetch_add_local(store->bpf, key, delta, old)
+                      : bpf_store_fetch_add_global(key, delta, old);
+}
+
+static int _cas(const store_t *store, uint32_t key, uint32_t expected, uint32_t desired,
+                uint32_t *actual)
+{
+    return store->bpf ? bpf_store_cas_local(store->bpf, key, expected, desired, actual)
+                      : bpf_store_cas_global(key, expected, desired, actual);
+}
+
+static int _max(const store_t *store, uint32_t key, uint32_t value)
+{
+    return store->bpf ? bpf_store_max_local(store->bpf, key, value)
+                      : bpf_store_max_global(key, value);
+}
+
+static size_t _scan(const store_t *store, uint32_t key, bpf_store_kv_t *items, size_t max,
+                    bool reverse)
+{
+    return store->bpf ? bpf_store_scan_local(store->bpf, key, items, max, reverse)
+                      : bpf_store_scan_global(key, items, max, reverse);
+}
+
+static int _set_cache(const store_t *store, uint32_t capacity, uint32_t ttl)
+{
+    return store->bpf ? bpf_store_set_local_cache(store->bpf, capacity, ttl)
+                      : bpf_store_set_global_cache(capacity, ttl);
+}
+
+static int _set_ttl(const store_t *store, uint32_t key, uint32_t ttl)
+{
+    return store->bpf ? bpf_store_set_ttl_local(store->bpf, key, ttl)
+                      : bpf_store_set_ttl_global(key, ttl);
+}
+
+static bpf_store_cache_stats_t _cache_stats(const store_t *store)
+{
+    bpf_store_cache_stats_t stats = {0};
+    if (store->bpf) {
+        bpf_store_get_local_cache_stats(store->bpf, &stats);
+    }
+    else {
+        bpf_store_get_global_cache_stats(&stats);
+    }
+    return stats;
+}
+
+static void _set_quota(const store_t *store, uint32_t quota)
+{
+    if (store->bpf) {
+        bpf_store_set_local_quota(store->bpf, quota);
+    }
+    else {
+        bpf_store_set_global_quota(quota);
+    }
+}
+
+static size_t _count(const store_t *store)
+{
+    return store->bpf ? bpf_store_count_local(store->bpf) : bpf_store_count_global();
+}
+
+static void _clear(const store_t *store)
+{
+    if (store->bpf) {
+        bpf_store_clear_local(store->bpf);
+    }
+    else {
+        bpf_store_clear_global();
+    }
+}
+
+#define SCAN_SIZE 8
+
+/* Compare a scan against the shadow copy */
+static bool _check_scan(const store_t *store, const uint32_t *shadow, const bool *present,
+                        uint32_t nkeys, uint32_t key, bool reverse)
+{
+    bpf_store_kv_t items[SCAN_SIZE];
+    size_t count = _scan(store, key, items, SCAN_SIZE, reverse);
+    size_t n = 0;
+    for (int64_t k = key; k >= 0 && k < nkeys && n < SCAN_SIZE; k += reverse ? -1 : 1) {
+        if (!present[k]) {
+            continue;
+        }
+        if (n >= count || items[n].key != k || items[n].value != shadow[k]) {
+            return false;
+        }
+        n++;
+    }
+    return n == count;
+}
+
+static const bpf_store_t *_store(const store_t *store)
+{
+    return store->bpf ? &store->bpf->store : bpf_store_get_global();
+}
+
+static bool _select(const store_t *store)
+{
+    int res = store->bpf ? bpf_store_set_local_type(store->bpf, store->type)
+                         : bpf_store_set_global_type(store->type);
+    return res == 0;
+}
+
+typedef struct {
+    size_t count;
+    uint64_t sum;
+} traverse_ctx_t;
+
+static void _traverse_cb(uint32_t key, uint32_t value, void *ctx)
+{
+    (void)key;
+    traverse_ctx_t *tctx = ctx;
+    tctx->count++;
+    tctx->sum += value;
+}
+
+static void _traverse(const store_t *store, traverse_ctx_t *ctx)
+{
+    memset(ctx, 0, sizeof(*ctx));
+    if (store->bpf) {
+        bpf_store_iter_local(store->bpf, _traverse_cb, ctx);
+    }
+    else {
+        bpf_store_iter_global(_traverse_cb, ctx);
+    }
+}
+
+static size_t _depth(const store_t *store)
+{
+    const bpf_store_t *st = _store(store);
+    if (st->type == BPF_STORE_TYPE_HASH) {
+        return hashmap_max_probe(&st->hash);
+    }
+#if CONFIG_BPF_STORE_COMPACT
+    return ctree_max_depth(&st->tree);
+#else
+    return btree_max_depth((btree_t *)&st->tree);
+#endif
+}
+
+static size_t _capacity(const store_t *store)
+{
+    if (store->type == BPF_STORE_TYPE_HASH) {
+        return CONFIG_BPF_STORE_HASH_MAX_ENTRIES;
+    }
+#if CONFIG_BPF_STORE_COMPACT
+    return BPF_STORE_POOL_SIZE;
+#else
+    return CONFIG_BPF_STORE_POOL_MAX ? CONFIG_BPF_STORE_POOL_MAX : SIZE_MAX;
+#endif
+}
+
+/*
+ * Build the key insertion order and the access sequence used for fetch/update
+ */
+static void _make_keys(pattern_t pattern, size_t n, uint32_t *keys, uint32_t *access,
+                       const zipf_t *zipf)
+{
+    if (pattern == PATTERN_SEQUENTIAL) {
+        for (size_t i = 0; i < n; i++) {
+            keys[i] = i;
+            access[i] = i;
+        }
+        return;
+    }
+
+    /* Distinct random keys spread over the full 32-bit range */
+    for (size_t i = 0; i < n; i++) {
+        keys[i] = (uint32_t)(i * 2654435761U);
+    }
+    _shuffle(keys, n);
+
+    for (size_t i = 0; i < n; i++) {
+        size_t rank = (pattern == PATTERN_ZIPF) ? _zipf_next(zipf) : _rand_below(n);
+        access[i] = keys[rank];
+    }
+}
+
+#define TIMED(res, n, expr)                             \
+    do {                                                \
+        uint64_t _start = _now_ns();                    \
+        expr;                                           \
+        res = (double)(_now_ns() - _start) / (n);       \
+    } while (0)
+
+/* Keys per batched fetch */
+#define BATCH_SIZE 64
+
+static bool _run(const store_t *store, pattern_t pattern, size_t n, result_t *res)
+{
+    uint32_t *keys = malloc(n * sizeof(uint32_t));
+    uint32_t *access = malloc(n * sizeof(uint32_t));
+    zipf_t zipf = {0};
+    if (pattern == PATTERN_ZIPF) {
+        _zipf_init(&zipf, n, _zipf_s);
+    }
+    _make_keys(pattern, n, keys, access, &zipf);
+
+    bool ok = true;
+    uint32_t value;
+
+    TIMED(res->insert, n, {
+        for (size_t i = 0; i < n; i++) {
+            if (_update(store, keys[i], i) < 0) {
+                ok = false;
+            }
+        }
+    });
+
+    TIMED(res->fetch, n, {
+        for (size_t i = 0; i < n; i++) {
+            _fetch(store, access[i], &value);
+        }
+    });
+
+    uint32_t values[BATCH_SIZE];
+    TIMED(res->batch, n, {
+        for (size_t i = 0; i < n; i += BATCH_SIZE) {
+            size_t len = (n - i < BATCH_SIZE) ? n - i : BATCH_SIZE;
+            _fetch_many(store, &access[i], values, len);
+        }
+    });
+
+    TIMED(res->update, n, {
+        for (size_t i = 0; i < n; i++) {
+            _update(store, access[i], i);
+        }
+    });
+
+    traverse_ctx_t ctx;
+    TIMED(res->traverse, n, _traverse(store, &ctx));
+    if (ctx.count != n) {
+        ok = false;
+    }
+
+    bpf_store_kv_t items[BATCH_SIZE];
+    size_t scanned = 0;
+    TIMED(res->scan, n, {
+        uint32_t key = 0;
+        size_t len;
+        do {
+            len = _scan(store, key, items, BATCH_SIZE, false);
+            scanned += len;
+            key = len ? items[len - 1].key + 1 : 0;
+        } while (len == BATCH_SIZE && key != 0);
+    });
+    if (scanned != n) {
+        ok = false;
+    }
+
+    res->depth = _depth(store);
+
+    if (pattern != PATTERN_SEQUENTIAL) {
+        _shuffle(keys, n);
+    }
+    TIMED(res->remove, n, {
+        for (size_t i = 0; i < n; i++) {
+            if (_remove(store, keys[i]) < 0) {
+                ok = false;
+            }
+        }
+    });
+
+    if (pattern == PATTERN_ZIPF) {
+        _zipf_free(&zipf);
+    }
+    free(access);
+    free(keys);
+    return ok;
+}
+
+static void _benchmark(const store_t *store)
+{
+    static const size_t sizes[] = {16, 64, 256, 1024, 4096, 16384, 65536, 100000};
+
+    if (store->type == BPF_STORE_TYPE_HASH) {
+        printf("\n%s store (hash), %u bytes per slot, at most 3/4 full\n", store->name,
+               (unsigned)sizeof(hashmap_entry_t) + 1);
+    }
+    else {
+        printf("\n%s store (%s), %u bytes per entry\n", store->name,
+               CONFIG_BPF_STORE_COMPACT ? "compact tree" : "tree",
+               (unsigned)sizeof(bpf_store_entry_t));
+    }
+    printf("%-10s %7s %6s %10s %10s %10s %10s %10s %10s %10s\n", "pattern", "keys", "depth",
+           "insert", "fetch", "batch64", "update", "remove", "traverse", "scan64");
+
+    for (pattern_t pattern = 0; pattern < PATTERN_COUNT; pattern++) {
+        for (unsigned i = 0; i < sizeof(sizes) / sizeof(sizes[0]); i++) {
+            size_t n = sizes[i];
+            if (n > _max_keys || n > _capacity(store)) {
+                break;
+            }
+            uint64_t start = _now_ns();
+            result_t res;
+            bool ok = _run(store, pattern, n, &res);
+            printf("%-10s %7zu %6zu %8.0fns %8.0fns %8.0fns %8.0fns %8.0fns %8.1fns %8.1fns%s\n",
+                   _pattern_names[pattern], n, res.depth, res.insert, res.fetch, res.batch,
+                   res.update, res.remove, res.traverse, res.scan, ok ? "" : "  FAILED");
+            fflush(stdout);
+            if ((double)(_now_ns() - start) / 1e9 > _budget) {
+                printf("%-10s (time budget exceeded, skipping larger sizes)\n", "");
+                break;
+            }
+        }
+    }
+}
+
+/*
+ * Invariant checks
+ */
+
+#if CONFIG_BPF_STORE_COMPACT
+
+/* Returns subtree height, or -1 on violation */
+static int _check_node(const ctree_t *tree, uint16_t index, uint64_t lower, uint64_t upper,
+                       size_t *count)
+{
+    if (index == 0) {
+        return 0;
+    }
+    if (index > BPF_STORE_POOL_SIZE) {
+        printf("bad node index %u\n", index);
+        return -1;
+    }
+    const ctree_node_t *node = ctree_node(tree, index);
+    if (node->key < lower || node->key > upper) {
+        printf("node %u: out of order\n", (unsigned)node->key);
+        return -1;
+    }
+    (*count)++;
+    int lh = _check_node(tree, node->link[0] & 0x7FFF, lower, (uint64_t)node->key - 1, count);
+    if (lh < 0) {
+        return -1;
+    }
+    int rh = _check_node(tree, node->link[1] & 0x7FFF, (uint64_t)node->key + 1, upper, count);
+    if (rh < 0) {
+        return -1;
+    }
+    int balance = (node->link[1] >> 15) - (node->link[0] >> 15);
+    if (rh - lh != balance) {
+        printf("node %u: balance %d, but left height %d, right height %d\n",
+               (unsigned)node->key, balance, lh, rh);
+        return -1;
+    }
+    return 1 + (lh > rh ? lh : rh);
+}
+
+static int _check_tree(const ctree_t *tree, size_t *count)
+{
+    return _check_node(tree, tree->root, 0, UINT32_MAX, count);
+}
+
+#else
+
+/* Returns subtree height, or -1 on violation */
+static int _check_node(const btree_node_t *node, const btree_node_t *parent,
+                       uint64_t lower, uint64_t upper, size_t *count)
+{
+    if (!node) {
+        return 0;
+    }
+    if (node->parent != parent) {
+        printf("node %u: bad parent link\n", (unsigned)node->key);
+        return -1;
+    }
+    if (node->key < lower || node->key > upper) {
+        printf("node %u: out of order\n", (unsigned)node->key);
+        return -1;
+    }
+    (*count)++;
+    int lh = _check_node(node->left, node, lower, (uint64_t)node->key - 1, count);
+    if (lh < 0) {
+        return -1;
+    }
+    int rh = _check_node(node->right, node, (uint64_t)node->key + 1, upper, count);
+    if (rh < 0) {
+        return -1;
+    }
+    if (lh - rh > 1 || rh - lh > 1) {
+        printf("node %u: unbalanced, left height %d, right height %d\n",
+               (unsigned)node->key, lh, rh);
+        return -1;
+    }
+    return 1 + (lh > rh ? lh : rh);
+}
+
+static int _check_tree(const btree_t *tree, size_t *count)
+{
+    return _check_node(tree->start, NULL, 0, UINT32_MAX, count);
+}
+
+#endif /* CONFIG_BPF_STORE_COMPACT */
+
+static bool _check_hash(const hashmap_t *map, size_t *count)
+{
+    if (map->capacity == 0) {
+        return true;
+    }
+    const uint8_t *dist = (const uint8_t *)(map->slots + map->capacity);
+    uint32_t mask = map->capacity - 1;
+    for (uint32_t i = 0; i < map->capacity; i++) {
+        if (dist[i] == 0) {
+            continue;
+        }
+        (*count)++;
+        uint32_t key = map->slots[i].key;
+        uint32_t home = hashmap_home(map, key);
+        if (dist[i] != ((i - home) & mask) + 1) {
+            printf("key %u: slot %u has wrong probe distance %u\n", (unsigned)key,
+                   (unsigned)i, dist[i]);
+            return false;
+        }
+        /* Robin Hood: an entry may only follow one at most one step closer to home */
+        uint32_t next = (i + 1) & mask;
+        if (dist[next] > dist[i] + 1) {
+            printf("key %u: followed by entry with probe distance %u\n", (unsigned)key,
+                   dist[next]);
+            return false;
+        }
+        if (hashmap_find(map, key) != &map->slots[i]) {
+            printf("key %u: lookup failed\n", (unsigned)key);
+            return false;
+        }
+    }
+    if (*count != map->count) {
+        printf("map count %u, found %zu entries\n", (unsigned)map->count, *count);
+        return false;
+    }
+    return true;
+}
+
+static bool _check_store(const store_t *store, size_t expected)
+{
+    const bpf_store_t *st = _store(store);
+    size_t count = 0;
+    if (st->type == BPF_STORE_TYPE_HASH) {
+        if (!_check_hash(&st->hash, &count)) {
+            return false;
+        }
+    }
+    else if (_check_tree(&st->tree, &count) < 0) {
+        return false;
+    }
+    if (count != expected) {
+        printf("store has %zu entries, expected %zu\n", count, expected);
+        return false;
+    }
+    return true;
+}
+
+typedef struct {
+    const store_t *store;
+    uint32_t *shadow;
+    bool *present;
+    size_t count;
+    uint32_t nkeys;
+    uint32_t last;
+    size_t visited;
+    bool ok;
+} modify_ctx_t;
+
+/*
+ * Global iteration callbacks may change the store. Each key visited is removed, rewritten
+ * or has a missing key added after it. Only keys present when iteration began are visited,
+ * with their values at that time.
+ */
+static void _modify_cb(uint32_t key, uint32_t value, void *ctx)
+{
+    modify_ctx_t *mctx = ctx;
+    if (key >= mctx->nkeys || !mctx->present[key] || mctx->shadow[key] != value ||
+        (mctx->visited != 0 && key <= mctx->last)) {
+        printf("iteration visited %u = %u out of order or not in shadow\n", (unsigned)key,
+               (unsigned)value);
+        mctx->ok = false;
+    }
+    mctx->last = key;
+    mctx->visited++;
+
+    uint32_t added = key + 1 + _rand_below(mctx->nkeys - key);
+    switch (_rand_below(3)) {
+    case 0:
+        if (_remove(mctx->store, key) < 0) {
+            mctx->ok = false;
+        }
+        mctx->present[key] = false;
+        mctx->count--;
+        break;
+    case 1:
+        value = (uint32_t)_rand();
+        if (_update(mctx->store, key, value) < 0) {
+            mctx->ok = false;
+        }
+        mctx->shadow[key] = value;
+        break;
+    default:
+        if (added < mctx->nkeys && !mctx->present[added]) {
+            value = (uint32_t)_rand();
+            if (_update(mctx->store, added, value) < 0) {
+                mctx->ok = false;
+            }
+            mctx->present[added] = true;
+            mctx->shadow[added] = value;
+            mctx->count++;
+        }
+        break;
+    }
+}
+
+static bool _stress(const store_t *store)
+{
+    unsigned nkeys = _stress_keys;
+    if (nkeys > _capacity(store)) {
+        nkeys = _capacity(store);
+    }
+    uint32_t *shadow = calloc(nkeys, sizeof(uint32_t));
+    bool *present = calloc(nkeys, sizeof(bool));
+    size_t count = 0;
+    bool ok = true;
+
+    printf("\n%s store (%s): %u random operations over %u keys... ", store->name,
+           store->type == BPF_STORE_TYPE_HASH ? "hash" : "tree", _stress_ops, nkeys);
+    fflush(stdout);
+
+    for (unsigned op = 0; ok && op < _stress_ops; op++) {
+        uint32_t key = _rand_below(nkeys);
+        uint32_t value;
+        uint32_t current = present[key] ? shadow[key] : 0;
+        switch (_rand_below(10)) {
+        case 9: {
+            if (store->bpf) {
+                break;
+            }
+            modify_ctx_t mctx = {store, shadow, present, count, nkeys, 0, 0, true};
+            bpf_store_iter_global(_modify_cb, &mctx);
+            if (!mctx.ok || mctx.visited != count) {
+                printf("op %u: modifying iteration visited %zu of %zu keys\n", op, mctx.visited,
+                       count);
+                ok = false;
+            }
+            count = mctx.count;
+            break;
+        }
+        case 8: {
+            bool reverse = _rand_below(2);
+            if (!_check_scan(store, shadow, present, nkeys, key, reverse)) {
+                printf("op %u: %s scan from %u disagrees with shadow\n", op,
+                       reverse ? "reverse" : "forward", (unsigned)key);
+                ok = false;
+            }
+            break;
+        }
+        case 4:
+            /* Lookup never creates a key */
+            if ((_lookup(store, key, &value) == 0) != present[key] || value != current) {
+                printf("op %u: lookup %u disagrees with shadow\n", op, (unsigned)key);
+                ok = false;
+            }
+            break;
+        case 5:
+            value = _rand_below(1000);
+            if (_fetch_add(store, key, value, &current) < 0 || current != shadow[key] * present[key]) {
+                printf("op %u: fetch_add %u failed\n", op, (unsigned)key);
+                ok = false;
+            }
+            count += !present[key];
+            present[key] = true;
+            shadow[key] = current + value;
+            break;
+        case 6: {
+            /* Half the time expect the right value */
+            uint32_t expected = _rand_below(2) ? current : (uint32_t)_rand();
+            value = (uint32_t)_rand();
+            uint32_t actual;
+            int res = _cas(store, key, expected, value, &actual);
+            if (res != (expected == current ? 0 : 1) || actual != current) {
+                printf("op %u: cas %u returned %d\n", op, (unsigned)key, res);
+                ok = false;
+            }
+            if (res == 0) {
+                count += !present[key];
+                present[key] = true;
+                shadow[key] = value;
+            }
+            break;
+        }
+        case 7:
+            value = (uint32_t)_rand();
+            if (_max(store, key, value) < 0) {
+                printf("op %u: max %u failed\n", op, (unsigned)key);
+                ok = false;
+            }
+            if (!present[key] || value > shadow[key]) {
+                shadow[key] = value;
+            }
+            count += !present[key];
+            present[key] = true;
+            break;
+        case 0:
+        case 1:
+            value = (uint32_t)_rand();
+            if (_update(store, key, value) < 0) {
+                printf("op %u: update %u failed\n", op, (unsigned)key);
+                ok = false;
+            }
+            count += !present[key];
+            present[key] = true;
+            shadow[key] = value;
+            break;
+        case 2:
+            if (_fetch(store, key, &value) < 0) {
+                printf("op %u: fetch %u failed\n", op, (unsigned)key);
+                ok = false;
+            }
+            else if (present[key] && value != shadow[key]) {
+                printf("op %u: fetch %u returned %u, expected %u\n", op, (unsigned)key,
+                       (unsigned)value, (unsigned)shadow[key]);
+                ok = false;
+            }
+            /* Fetching a missing key creates it */
+            count += !present[key];
+            present[key] = true;
+            shadow[key] = value;
+            break;
+        case 3:
+            if ((_remove(store, key) == 0) != present[key]) {
+                printf("op %u: remove %u disagrees with shadow\n", op, (unsigned)key);
+                ok = false;
+            }
+            count -= present[key];
+            present[key] = false;
+            break;
+        }
+        if (ok && !_check_store(store, count)) {
+            printf("op %u: invariant violated\n", op);
+            ok = false;
+        }
+    }
+
+    for (uint32_t key = 0; key < nkeys; key++) {
+        if (present[key]) {
+            _remove(store, key);
+        }
+    }
+
+    printf("%s\n", ok ? "OK" : "FAILED");
+    free(present);
+    free(shadow);
+    return ok;
+}
+
+/*
+ * Bounded stores use the millisecond clock, which comes from this timer.
+ * It only moves when a test advances it, starting shortly before it wraps.
+ */
+static uint32_t _clock_us = UINT32_MAX - 3000000;
+
+uint32_t system_get_time(void)
+{
+    return _clock_us;
+}
+
+static void _advance_ms(uint32_t ms)
+{
+    _clock_us += ms * 1000;
+}
+
+#define CACHE_CAPACITY  64
+#define CACHE_QUOTA     48
+#define CACHE_KEYS      (4 * CACHE_CAPACITY)
+#define CACHE_TTL       1000
+
+/* Compare iteration against the shadow copy */
+static bool _check_iter(const store_t *store, const uint32_t *shadow, const bool *present)
+{
+    traverse_ctx_t expected = {0};
+    for (uint32_t key = 0; key < CACHE_KEYS; key++) {
+        if (present[key]) {
+            expected.count++;
+            expected.sum += shadow[key];
+        }
+    }
+    traverse_ctx_t ctx;
+    _traverse(store, &ctx);
+    return ctx.count == expected.count && ctx.sum == expected.sum;
+}
+
+/*
+ * Least recently used order with no lifetimes, so the shadow is exact.
+ * The bound alternates between the capacity and a lower quota.
+ */
+static bool _cache_lru_stress(const store_t *store)
+{
+    uint32_t shadow[CACHE_KEYS] = {0};
+    bool present[CACHE_KEYS] = {false};
+    uint64_t used[CACHE_KEYS] = {0};    /* Recency, larger is more recent */
+    uint64_t uses = 0;
+    size_t count = 0;
+    uint32_t evictions = 0;
+    bool ok = _set_cache(store, CACHE_CAPACITY, 0) == 0;
+    if (!ok) {
+        printf("cannot bound store\n");
+    }
+
+    for (unsigned op = 0; ok && op < _stress_ops; op++) {
+        size_t bound = ((op / 1000) % 2) ? CACHE_QUOTA : CACHE_CAPACITY;
+        if (op % 1000 == 0) {
+            _set_quota(store, (bound < CACHE_CAPACITY) ? bound : 0);
+        }
+
+        uint32_t key = _rand_below(CACHE_KEYS);
+        uint32_t current = present[key] ? shadow[key] : 0;
+        uint32_t value = (uint32_t)_rand();
+        uint32_t result = 0;
+        bool use = true;                /* Operation accesses the key */
+        bool insert = true;             /* and adds it if absent */
+        bool match;
+        switch (_rand_below(9)) {
+        case 0:
+            insert = false;
+            match = (_lookup(store, key, &result) == 0) == present[key] && result == current;
+            value = current;
+            break;
+        case 1:
+            match = _fetch(store, key, &result) == 0 && result == current;
+            value = current;
+            break;
+        case 2:
+            match = _update(store, key, value) == 0;
+            break;
+        case 3:
+            value = _rand_below(1000);
+            match = _fetch_add(store, key, value, &result) == 0 && result == current;
+            value += current;
+            break;
+        case 4: {
+            /* Absent keys are only added if 0 is expected */
+            uint32_t expected = _rand_below(2) ? current : _rand_below(3);
+            int res = _cas(store, key, expected, value, &result);
+            match = res == (expected == current ? 0 : 1) && result == current;
+            insert = (expected == 0);
+            if (res != 0) {
+                value = current;
+            }
+            break;
+        }
+        case 5:
+            match = _max(store, key, value) == 0;
+            if (present[key] && current > value) {
+                value = current;
+            }
+            break;
+        case 6:
+            /* Removal, scans and iteration do not count as use */
+            use = false;
+            match = (_remove(store, key) == 0) == present[key];
+            count -= present[key];
+            present[key] = false;
+            break;
+        case 7:
+            use = false;
+            match = _check_scan(store, shadow, present, CACHE_KEYS, key, _rand_below(2));
+            break;
+        default:
+            use = false;
+            match = _check_iter(store, shadow, present);
+            break;
+        }
+        if (!match) {
+            printf("op %u: key %u disagrees with shadow\n", op, (unsigned)key);
+            ok = false;
+            break;
+        }
+
+        if (use && insert && !present[key]) {
+            while (count >= bound) {
+                uint32_t victim = CACHE_KEYS;
+                for (uint32_t k = 0; k < CACHE_KEYS; k++) {
+                    if (present[k] && (victim == CACHE_KEYS || used[k] < used[victim])) {
+                        victim = k;
+                    }
+                }
+                present[victim] = false;
+                count--;
+                evictions++;
+            }
+            present[key] = true;
+            count++;
+        }
+        if (use && present[key]) {
+            used[key] = ++uses;
+            shadow[key] = value;
+        }
+
+        bpf_store_cache_stats_t stats = _cache_stats(store);
+        if (stats.evictions != evictions || stats.expirations != 0) {
+            printf("op %u: %u evictions, expected %u\n", op, (unsigned)stats.evictions,
+                   (unsigned)evictions);
+            ok = false;
+        }
+        if (ok && !_check_store(store, count)) {
+            printf("op %u: invariant violated\n", op);
+            ok = false;
+        }
+    }
+
+    _set_quota(store, 0);
+    _set_cache(store, 0, 0);
+    _clear(store);
+    return ok;
+}
+
+/*
+ * Lifetimes with a store large enough never to evict. Expired entries are
+ * swept a few at a time, so each may or may not still be stored until its key
+ * is next used. The store and expiration counts must account for them exactly.
+ */
+static bool _cache_ttl_stress(const store_t *store)
+{
+    uint32_t shadow[CACHE_KEYS] = {0};
+    bool present[CACHE_KEYS] = {false};
+    uint32_t expires[CACHE_KEYS] = {0}; /* 0 for no expiry */
+    uint32_t confirmed = 0;             /* Expired entries known to have been removed */
+    bool ok = _set_cache(store, CACHE_KEYS, CACHE_TTL) == 0;
+    if (!ok) {
+        printf("cannot bound store\n");
+    }
+
+    for (unsigned op = 0; ok && op <= _stress_ops; op++) {
+        if (op == _stress_ops) {
+            /* Let every lifetime end, then each expired entry is swept without using its key */
+            _advance_ms(25 * CACHE_TTL);
+            unsigned steps = CACHE_KEYS + CONFIG_BPF_STORE_TTL_SLOTS;
+            for (unsigned i = 0; i <= steps / CONFIG_BPF_STORE_TTL_SWEEP + 1; i++) {
+                uint32_t value;
+                _lookup(store, CACHE_KEYS, &value);
+            }
+        }
+
+        uint32_t now = bpf_clock_ms();
+        bool live[CACHE_KEYS];
+        size_t live_count = 0;
+        size_t expired = 0;
+        for (uint32_t k = 0; k < CACHE_KEYS; k++) {
+            live[k] = present[k] && (expires[k] == 0 || (int32_t)(now - expires[k]) < 0);
+            live_count += live[k];
+            expired += present[k] && !live[k];
+        }
+
+        size_t count = _count(store);
+        bpf_store_cache_stats_t stats = _cache_stats(store);
+        size_t unswept = count - live_count;
+        if (count < live_count || unswept > expired || (op == _stress_ops && unswept != 0) ||
+            stats.expirations != confirmed + (expired - unswept) || stats.evictions != 0) {
+            printf("op %u: %zu entries with %zu live and %zu expired, %u expirations, expected %u\n",
+                   op, count, live_count, expired, (unsigned)stats.expirations,
+                   (unsigned)(confirmed + expired - unswept));
+            ok = false;
+            break;
+        }
+        if (op == _stress_ops) {
+            break;
+        }
+
+        uint32_t key = _rand_below(CACHE_KEYS);
+        uint32_t current = live[key] ? shadow[key] : 0;
+        uint32_t value = current;
+        uint32_t result = 0;
+        bool use = true;                /* Operation accesses the key */
+        bool insert = false;            /* and adds it if absent */
+        bool match;
+        switch (_rand_below(8)) {
+        case 0:
+            match = (_lookup(store, key, &result) == 0) == live[key] && result == current;
+            break;
+        case 1:
+            insert = true;
+            match = _fetch(store, key, &result) == 0 && result == current;
+            break;
+        case 2:
+            insert = true;
+            value = (uint32_t)_rand();
+            match = _update(store, key, value) == 0;
+            break;
+        case 3:
+            insert = true;
+            value = current + 1;
+            match = _fetch_add(store, key, 1, &result) == 0 && result == current;
+            break;
+        case 4: {
+            /* Some lifetimes run for more than one round of the timer wheel */
+            uint32_t ttl = _rand_below(4) ? _rand_below(3 * CACHE_TTL) : _rand_below(20 * CACHE_TTL);
+            match = (_set_ttl(store, key, ttl) == 0) == live[key];
+            if (live[key]) {
+                expires[key] = ttl ? now + ttl : 0;
+            }
+            break;
+        }
+        case 5: {
+            use = false;
+            int res = _remove(store, key);
+            if (live[key]) {
+                match = (res == 0);
+            }
+            else {
+                /* Unless already swept */
+                match = present[key] || res < 0;
+                confirmed += present[key] && res < 0;
+            }
+            present[key] = false;
+            break;
+        }
+        case 6:
+            use = false;
+            match = _check_scan(store, shadow, live, CACHE_KEYS, key, _rand_below(2));
+            break;
+        default:
+            use = false;
+            match = _check_iter(store, shadow, live);
+            break;
+        }
+        if (!match) {
+            printf("op %u: key %u disagrees with shadow\n", op, (unsigned)key);
+            ok = false;
+            break;
+        }
+
+        if (use && present[key] && !live[key]) {
+            /* Using an expired key removes it */
+            confirmed++;
+            present[key] = false;
+        }
+        if (use && insert && !present[key]) {
+            present[key] = true;
+            expires[key] = now + CACHE_TTL;
+        }
+        if (use && present[key]) {
+            shadow[key] = value;
+        }
+        if (_rand_below(2)) {
+            _advance_ms(_rand_below(CACHE_TTL / 8));
+        }
+    }
+
+    _set_cache(store, 0, 0);
+    _clear(store);
+    return ok;
+}
+
+static bool _cache_stress(const store_t *store)
+{
+    printf("\n%s store (%s): %u random operations on a bounded store... ", store->name,
+           store->type == BPF_STORE_TYPE_HASH ? "hash" : "tree", _stress_ops);
+    fflush(stdout);
+    bool ok = _cache_lru_stress(store) && _cache_ttl_stress(store);
+    printf("%s\n", ok ? "OK" : "FAILED");
+    return ok;
+}
+
+/*
+ * Longest-prefix-match trie against a list of prefixes searched by brute force
+ */
+#define LPM_PREFIXES 64
+
+typedef struct {
+    uint32_t addr;                  /* Prefix bits, the rest cleared */
+    unsigned len;
+    int value;
+} lpm_prefix_t;
+
+static uint32_t _lpm_mask(unsigned len)
+{
+    return len ? ~0U << (32 - len) : 0;
+}
+
+static void _lpm_bytes(uint32_t addr, uint8_t *data)
+{
+    data[0] = addr >> 24;
+    data[1] = addr >> 16;
+    data[2] = addr >> 8;
+    data[3] = addr;
+}
+
+/* Addresses from a few networks, so prefixes nest and share leading bits */
+static uint32_t _lpm_addr(void)
+{
+    return (_rand_below(4) << 30) | (_rand_below(4) << 22) | ((uint32_t)_rand() & 0x3FFFFF);
+}
+
+static int _lpm_shadow_find(const lpm_prefix_t *shadow, size_t count, uint32_t addr, unsigned len)
+{
+    for (size_t i = 0; i < count; i++) {
+        if (shadow[i].len == len && shadow[i].addr == (addr & _lpm_mask(len))) {
+            return i;
+        }
+    }
+    return -1;
+}
+
+static bool _lpm_check(const lpm_trie_t *trie, const lpm_prefix_t *shadow, size_t count)
+{
+    if (trie->count != count) {
+        printf("trie has %u prefixes, expected %zu\n", (unsigned)trie->count, count);
+        return false;
+    }
+    size_t nodes = lpm_trie_nodes_used(trie);
+    if (nodes > (count ? 2 * count - 1 : 0)) {
+        printf("%zu nodes in use for %zu prefixes\n", nodes, count);
+        return false;
+    }
+
+    /* Each prefix visited once, with its own value */
+    bool seen[LPM_PREFIXES] = {false};
+    size_t visited = 0;
+    uint8_t data[4];
+    unsigned len;
+    for (int res = lpm_trie_next(trie, NULL, 0, data, &len); res == 0;
+         res = lpm_trie_next(trie, data, len, data, &len)) {
+        uint32_t addr = ((uint32_t)data[0] << 24) | (data[1] << 16) | (data[2] << 8) | data[3];
+        int i = _lpm_shadow_find(shadow, count, addr, len);
+        if (i < 0 || addr != shadow[i].addr || seen[i] || ++visited > count) {
+            printf("iteration returned %08x/%u unexpectedly\n", (unsigned)addr, len);
+            return false;
+        }
+        seen[i] = true;
+    }
+    if (visited != count) {
+        printf("iteration visited %zu of %zu prefixes\n", visited, count);
+        return false;
+    }
+    return true;
+}
+
+static bool _lpm_stress(void)
+{
+    size_t size = lpm_trie_mem_size(4, LPM_PREFIXES);
+    void *mem = malloc(size);
+    lpm_trie_t trie;
+    lpm_trie_init(&trie, mem, 4, LPM_PREFIXES);
+    lpm_prefix_t shadow[LPM_PREFIXES];
+    size_t count = 0;
+    unsigned full = 0;
+    bool ok = true;
+
+    printf("\nlpm trie: %u random operations over %u prefixes... ", _stress_ops, LPM_PREFIXES);
+    fflush(stdout);
+
+    for (unsigned op = 0; ok && op < _stress_ops; op++) {
+        uint32_t addr = _lpm_addr();
+        unsigned len = _rand_below(33);
+        uint8_t data[4];
+        _lpm_bytes(addr, data);
+        int i = _lpm_shadow_find(shadow, count, addr, len);
+        switch (_rand_below(4)) {
+        case 0: {
+            /* Insert, or when full make room first so the trie is exercised at capacity */
+            if (count == LPM_PREFIXES && i < 0) {
+                bool inserted;
+                if (lpm_trie_insert(&trie, data, len, &inserted) >= 0) {
+                    printf("op %u: insert %08x/%u into full trie succeeded\n", op, (unsigned)addr, len);
+                    ok = false;
+                    break;
+                }
+                full++;
+                size_t victim = _rand_below(count);
+                _lpm_bytes(shadow[victim].addr, data);
+                if (lpm_trie_remove(&trie, data, shadow[victim].len) != shadow[victim].value) {
+                    printf("op %u: remove from full trie failed\n", op);
+                    ok = false;
+                    break;
+                }
+                shadow[victim] = shadow[--count];
+                _lpm_bytes(addr, data);
+            }
+            bool inserted;
+            int value = lpm_trie_insert(&trie, data, len, &inserted);
+            if (value < 0 || value >= LPM_PREFIXES || inserted != (i < 0) ||
+                (i >= 0 && value != shadow[i].value)) {
+                printf("op %u: insert %08x/%u returned %d\n", op, (unsigned)addr, len, value);
+                ok = false;
+                break;
+            }
+            for (size_t j = 0; inserted && j < count; j++) {
+                if (shadow[j].value == value) {
+                    printf("op %u: value %d given to two prefixes\n", op, value);
+                    ok = false;
+                }
+            }
+            if (inserted) {
+                shadow[count++] = (lpm_prefix_t){addr & _lpm_mask(len), len, value};
+            }
+            break;
+        }
+        case 1:
+            /* Usually remove a present prefix */
+            if (count && _rand_below(4)) {
+                i = _rand_below(count);
+                addr = shadow[i].addr;
+                len = shadow[i].len;
+                _lpm_bytes(addr, data);
+            }
+            if (lpm_trie_remove(&trie, data, len) != (i < 0 ? -1 : shadow[i].value)) {
+                printf("op %u: remove %08x/%u disagrees with shadow\n", op, (unsigned)addr, len);
+                ok = false;
+            }
+            if (i >= 0) {
+                shadow[i] = shadow[--count];
+            }
+            break;
+        case 2:
+            if (lpm_trie_find(&trie, data, len) != (i < 0 ? -1 : shadow[i].value)) {
+                printf("op %u: find %08x/%u disagrees with shadow\n", op, (unsigned)addr, len);
+                ok = false;
+            }
+            break;
+        case 3: {
+            /* Longest match among prefixes no longer than the lookup */
+            int expected = -1;
+            unsigned best = 0;
+            for (size_t j = 0; j < count; j++) {
+                if (shadow[j].len <= len && (expected < 0 || shadow[j].len > best) &&
+                    shadow[j].addr == (addr & _lpm_mask(shadow[j].len))) {
+                    expected = shadow[j].value;
+                    best = shadow[j].len;
+                }
+            }
+            int value = lpm_trie_lookup(&trie, data, len);
+            if (value != expected) {
+                printf("op %u: lookup %08x/%u returned %d, expected %d\n", op, (unsigned)addr, len,
+                       value, expected);
+                ok = false;
+            }
+            break;
+        }
+        }
+        if (ok && !_lpm_check(&trie, shadow, count)) {
+            printf("op %u: invariant violated\n", op);
+            ok = false;
+        }
+    }
+
+    lpm_trie_clear(&trie);
+    if (ok && (trie.count != 0 || lpm_trie_nodes_used(&trie) != 0)) {
+        printf("clear left %u prefixes\n", (unsigned)trie.count);
+        ok = false;
+    }
+    printf("%s\n", ok ? "OK" : "FAILED");
+    if (ok) {
+        printf("Trie was full %u times\n", full);
+    }
+    free(mem);
+    return ok;
+}
+
+/*
+ * Record ring: each record holds its sequence number then a pattern derived from it,
+ * so reordering, loss and damage are all detected. Records are placed up to the end
+ * of the ring or after padding, so sizes vary to exercise both.
+ */
+#define RING_SIZE           1024
+#define RING_RECORD_MAX     200
+#define RING_GUARD          0x5a5a5a5a5a5a5a5aULL
+
+/* Records must stay within the ring, so the guard words after it must survive */
+typedef struct {
+    uint64_t data[RING_SIZE / 8];
+    uint64_t guard[RING_RECORD_MAX / 8];
+} ring_mem_t;
+
+static void _ring_guard_init(ring_mem_t *mem)
+{
+    for (unsigned i = 0; i < sizeof(mem->guard) / sizeof(mem->guard[0]); i++) {
+        mem->guard[i] = RING_GUARD;
+    }
+}
+
+static bool _ring_guard_check(const ring_mem_t *mem)
+{
+    for (unsigned i = 0; i < sizeof(mem->guard) / sizeof(mem->guard[0]); i++) {
+        if (mem->guard[i] != RING_GUARD) {
+            printf("record written past the end of the ring\n");
+            return false;
+        }
+    }
+    return true;
+}
+
+static void _ring_fill(uint8_t *record, uint32_t seq, uint32_t len)
+{
+    memcpy(record, &seq, sizeof(seq));
+    for (uint32_t i = sizeof(seq); i < len; i++) {
+        record[i] = (uint8_t)((seq + i) * 7);
+    }
+}
+
+static bool _ring_check(const uint8_t *record, uint32_t len, uint32_t seq)
+{
+    uint32_t stored;
+    memcpy(&stored, record, sizeof(stored));
+    if (stored != seq || ((uintptr_t)record & 7) != 0) {
+        return false;
+    }
+    for (uint32_t i = sizeof(seq); i < len; i++) {
+        if (record[i] != (uint8_t)((seq + i) * 7)) {
+            return false;
+        }
+    }
+    return true;
+}
+
+/* Single thread, so the ring state is known exactly at every step */
+static bool _ringbuf_stress(void)
+{
+    static ring_mem_t mem;
+    ringbuf_t ring;
+    _ring_guard_init(&mem);
+    ringbuf_init(&ring, mem.data, RING_SIZE);
+    uint32_t produced = 0;
+    uint32_t consumed = 0;
+    uint32_t dropped = 0;
+    unsigned wraps = 0;
+    size_t last_offset = 0;
+    bool ok = true;
+
+    printf("\nring buffer: %u random operations on %u bytes... ", _stress_ops, RING_SIZE);
+    fflush(stdout);
+
+    for (unsigned op = 0; ok && op < _stress_ops; op++) {
+        if (_rand_below(2)) {
+            uint32_t len = sizeof(uint32_t) + _rand_below(RING_RECORD_MAX - sizeof(uint32_t));
+            bool empty = ringbuf_used(&ring) == 0;
+            uint8_t *record = ringbuf_reserve(&ring, len);
+            if (record == NULL) {
+                dropped++;
+                if (empty) {
+                    printf("op %u: reserving %u bytes in an empty ring failed\n", op, (unsigned)len);
+                    ok = false;
+                }
+            }
+            else if (_rand_below(8) == 0) {
+                ringbuf_discard(&ring);
+            }
+            else {
+                size_t offset = record - (uint8_t *)mem.data;
+                wraps += offset < last_offset;
+                last_offset = offset;
+                _ring_fill(record, produced, len);
+                /* The consumer is told only when the ring was empty */
+                if (ringbuf_submit(&ring) != empty) {
+                    printf("op %u: submit reported %s ring\n", op, empty ? "non-empty" : "empty");
+                    ok = false;
+                }
+                produced++;
+            }
+        }
+        else {
+            uint32_t len;
+            const uint8_t *record = ringbuf_peek(&ring, &len);
+            if (record == NULL) {
+                if (consumed != produced || ringbuf_used(&ring) != 0) {
+                    printf("op %u: ring empty after %u of %u records\n", op, (unsigned)consumed,
+                           (unsigned)produced);
+                    ok = false;
+                }
+            }
+            else {
+                if (!_ring_check(record, len, consumed)) {
+                    printf("op %u: record %u damaged or out of order\n", op, (unsigned)consumed);
+                    ok = false;
+                }
+                ringbuf_consume(&ring);
+                consumed++;
+            }
+        }
+        if (ok && (ring.dropped != dropped || ring.submitted != produced)) {
+            printf("op %u: ring counts %u dropped, %u submitted, expected %u, %u\n", op,
+                   (unsigned)ring.dropped, (unsigned)ring.submitted, (unsigned)dropped,
+                   (unsigned)produced);
+            ok = false;
+        }
+        ok = ok && _ring_guard_check(&mem);
+    }
+
+    printf("%s\n", ok ? "OK" : "FAILED");
+    if (ok) {
+        printf("%u records, %u dropped, wrapped %u times\n", (unsigned)produced, (unsigned)dropped,
+               wraps);
+    }
+    return ok;
+}
+
+/*
+ * Maps are created from the map table of a container image, here one declaring a
+ * single map. The VM is not linked in, so value regions are recorded here instead.
+ */
+void bpf_add_region(bpf_t *bpf, bpf_mem_region_t *region, void *start, size_t len, uint8_t flags)
+{
+    (void)bpf;
+    region->start = region->phys_start = start;
+    region->len = len;
+    region->flag = flags;
+}
+
+typedef struct __attribute__((packed)) {
+    rbpf_header_t header;
+    char rodata[8];
+    uint32_t num_maps;
+    rbpf_map_t def;
+} map_image_t;
+
+typedef struct {
+    map_image_t image;
+    bpf_t bpf;
+} map_container_t;
+
+static bpf_map_t *_map_create(map_container_t *container, const char *name, bpf_map_type_t type,
+                              uint32_t key_size, uint32_t value_size, uint32_t max_entries)
+{
+    memset(container, 0, sizeof(*container));
+    map_image_t *image = &container->image;
+    image->header.magic = RBPF_MAGIC_NO;
+    image->header.flags = RBPF_FLAG_MAPS;
+    image->header.rodata_len = sizeof(image->rodata);
+    strncpy(image->rodata, name, sizeof(image->rodata) - 1);
+    image->num_maps = 1;
+    image->def.type = type;
+    image->def.key_size = key_size;
+    image->def.value_size = value_size;
+    image->def.max_entries = max_entries;
+    container->bpf.application = (const uint8_t *)image;
+    container->bpf.application_len = sizeof(*image);
+    return (bpf_map_setup(&container->bpf) == 0) ? bpf_map_get(&container->bpf, 0) : NULL;
+}
+
+#define MAP_ENTRIES     48
+#define MAP_KEYS        (3 * MAP_ENTRIES)
+#define MAP_KEY_SIZE    6
+#define MAP_VALUE_SIZE  12
+
+/* Odd-sized keys, all differing in their first bytes */
+static void _map_key(uint32_t id, uint8_t *key)
+{
+    uint64_t h = (id + 1) * 0x9E3779B97F4A7C15ULL;
+    memcpy(key, &h, MAP_KEY_SIZE);
+}
+
+static uint32_t _map_key_id(const uint8_t *key)
+{
+    uint8_t k[MAP_KEY_SIZE];
+    uint32_t id;
+    for (id = 0; id < MAP_KEYS; id++) {
+        _map_key(id, k);
+        if (memcmp(k, key, MAP_KEY_SIZE) == 0) {
+            break;
+        }
+    }
+    return id;
+}
+
+/* Iteration must visit each key present exactly once */
+static bool _map_check_iter(const bpf_map_t *map, const bool *present, unsigned count)
+{
+    bool seen[MAP_KEYS] = {false};
+    unsigned visited = 0;
+    uint8_t key[MAP_KEY_SIZE];
+    for (int res = bpf_map_next_key(map, NULL, key); res == 0; res = bpf_map_next_key(map, key, key)) {
+        uint32_t id = _map_key_id(key);
+        if (id >= MAP_KEYS || !present[id] || seen[id] || visited == count) {
+            return false;
+        }
+        seen[id] = true;
+        visited++;
+    }
+    return visited == count;
+}
+
+static bool _map_array_stress(void)
+{
+    map_container_t container;
+    bpf_map_t *map = _map_create(&container, "array", BPF_MAP_TYPE_ARRAY, sizeof(uint32_t),
+                                 sizeof(uint64_t), MAP_ENTRIES);
+    uint64_t shadow[MAP_ENTRIES] = {0};
+    bool ok = (map != NULL);
+
+    printf("\narray map: %u random operations over %u indices... ", _stress_ops, MAP_ENTRIES + 8);
+    fflush(stdout);
+
+    for (unsigned op = 0; ok && op < _stress_ops; op++) {
+        /* Some indices are out of range */
+        uint32_t index = _rand_below(MAP_ENTRIES + 8);
+        bool valid = index < MAP_ENTRIES;
+        const uint64_t *ptr;
+        switch (_rand_below(6)) {
+        case 0:
+        case 1: {
+            uint64_t value = _rand();
+            if ((bpf_map_update(map, &index, &value) == 0) != valid) {
+                printf("op %u: update %u disagrees with shadow\n", op, (unsigned)index);
+                ok = false;
+            }
+            if (valid) {
+                shadow[index] = value;
+            }
+            break;
+        }
+        case 2:
+            ptr = bpf_map_lookup(map, &index);
+            if ((ptr != NULL) != valid || (valid && *ptr != shadow[index])) {
+                printf("op %u: lookup %u disagrees with shadow\n", op, (unsigned)index);
+                ok = false;
+            }
+            break;
+        case 3:
+            if (bpf_map_add(map, &index, 1) == 0) {
+                shadow[index]++;
+            }
+            else if (valid) {
+                printf("op %u: add %u failed\n", op, (unsigned)index);
+                ok = false;
+            }
+            break;
+        case 4:
+            /* Array values cannot be removed */
+            if (bpf_map_remove(map, &index) == 0) {
+                printf("op %u: removed %u\n", op, (unsigned)index);
+                ok = false;
+            }
+            break;
+        default: {
+            if (_rand_below(16) == 0) {
+                bpf_map_clear(map);
+                memset(shadow, 0, sizeof(shadow));
+            }
+            uint32_t next = 0;
+            unsigned visited = 0;
+            for (int res = bpf_map_next_key(map, NULL, &next); res == 0;
+                 res = bpf_map_next_key(map, &next, &next)) {
+                ptr = bpf_map_lookup(map, &next);
+                if (next != visited || ptr == NULL || *ptr != shadow[next]) {
+                    break;
+                }
+                visited++;
+            }
+            if (visited != MAP_ENTRIES) {
+                printf("op %u: iteration stopped at %u\n", op, visited);
+                ok = false;
+            }
+            break;
+        }
+        }
+        if (ok && bpf_map_entries(map) != MAP_ENTRIES) {
+            printf("op %u: array has %zu entries\n", op, bpf_map_entries(map));
+            ok = false;
+        }
+    }
+
+    bpf_map_destroy(&container.bpf);
+    printf("%s\n", ok ? "OK" : "FAILED");
+    return ok;
+}
+
+/*
+ * Hash and counter maps against a shadow, with three times as many keys as the map
+ * holds so it is often full and keys are constantly removed and added. A value found
+ * by lookup is watched until its key is removed, as it must not move.
+ */
+static bool _map_hash_stress(bpf_map_type_t type)
+{
+    bool counter = (type == BPF_MAP_TYPE_COUNTER);
+    uint32_t value_size = counter ? sizeof(uint64_t) : MAP_VALUE_SIZE;
+    map_container_t container;
+    bpf_map_t *map = _map_create(&container, "hash", type, MAP_KEY_SIZE, value_size, MAP_ENTRIES);
+    static uint8_t shadow[MAP_KEYS][MAP_VALUE_SIZE];
+    bool present[MAP_KEYS] = {false};
+    unsigned count = 0;
+    int watched = -1;
+    const uint8_t *watched_value = NULL;
+    unsigned full = 0;
+    bool ok = (map != NULL);
+
+    printf("\n%s map: %u random operations over %u keys... ", counter ? "counter" : "hash",
+           _stress_ops, MAP_KEYS);
+    fflush(stdout);
+
+    for (unsigned op = 0; ok && op < _stress_ops; op++) {
+        uint32_t id = _rand_below(MAP_KEYS);
+        uint8_t key[MAP_KEY_SIZE];
+        _map_key(id, key);
+        bool fits = present[id] || count < MAP_ENTRIES;
+        switch (_rand_below(8)) {
+        case 0:
+        case 1:
+        case 2: {
+            uint8_t value[MAP_VALUE_SIZE];
+            int res;
+            if (counter) {
+                /* Sometimes decrement, which wraps */
+                uint64_t delta = _rand_below(4) ? _rand_below(1000) : (uint64_t)-1;
+                res = bpf_map_add(map, key, delta);
+                uint64_t total = present[id] ? *(uint64_t *)shadow[id] : 0;
+                total += delta;
+                memcpy(value, &total, sizeof(total));
+            }
+            else {
+                for (unsigned i = 0; i < MAP_VALUE_SIZE; i++) {
+                    value[i] = _rand();
+                }
+                res = bpf_map_update(map, key, value);
+            }
+            if ((res == 0) != fits) {
+                printf("op %u: %s %u disagrees with shadow, %u keys\n", op,
+                       counter ? "add" : "update", (unsigned)id, count);
+                ok = false;
+            }
+            if (res == 0) {
+                count += !present[id];
+                present[id] = true;
+                memcpy(shadow[id], value, value_size);
+            }
+            else {
+                full++;
+            }
+            break;
+        }
+        case 3: {
+            const uint8_t *ptr = bpf_map_lookup(map, key);
+            if ((ptr != NULL) != present[id] || (ptr && memcmp(ptr, shadow[id], value_size) != 0)) {
+                printf("op %u: lookup %u disagrees with shadow\n", op, (unsigned)id);
+                ok = false;
+            }
+            if (ptr && watched < 0) {
+                watched = id;
+                watched_value = ptr;
+            }
+            break;
+        }
+        case 4:
+        case 5:
+            if ((bpf_map_remove(map, key) == 0) != present[id]) {
+                printf("op %u: remove %u disagrees with shadow\n", op, (unsigned)id);
+                ok = false;
+            }
+            count -= present[id];
+            present[id] = false;
+            if (watched == (int)id) {
+                watched = -1;
+            }
+            break;
+        case 6:
+            if (!_map_check_iter(map, present, count)) {
+                printf("op %u: iteration disagrees with shadow\n", op);
+                ok = false;
+            }
+            break;
+        default:
+            if (_rand_below(32) == 0) {
+                bpf_map_clear(map);
+                memset(present, 0, sizeof(present));
+                count = 0;
+                watched = -1;
+            }
+            break;
+        }
+        if (ok && watched >= 0 && memcmp(watched_value, shadow[watched], value_size) != 0) {
+            printf("op %u: value of %u moved\n", op, (unsigned)watched);
+            ok = false;
+        }
+        if (ok && bpf_map_entries(map) != count) {
+            printf("op %u: map has %zu keys, expected %u\n", op, bpf_map_entries(map), count);
+            ok = false;
+        }
+    }
+
+    bpf_map_destroy(&container.bpf);
+    printf("%s\n", ok ? "OK" : "FAILED");
+    if (ok) {
+        printf("Map was full %u times\n", full);
+    }
+    return ok;
+}
+
+/* Distinct keys for sketch tests, varying with the seed */
+static uint32_t _sketch_key(uint32_t id)
+{
+    return (id + _seed * 0x10000000U) * 0x9E3779B1U;
+}
+
+/*
+ * A Bloom filter sized for n keys gets at least n * hashes / ln(2) bits, giving a false
+ * positive rate of about 2^-hashes when full. n is chosen so the bits are not rounded up,
+ * and the rate is measured on keys which were never added.
+ */
+static bool _bloom_check(unsigned hashes)
+{
+    const uint32_t bits = 8192;
+    const uint32_t n = bits * 1000 / (hashes * 1443);
+    const uint32_t samples = 200000;
+    map_container_t container;
+    bpf_map_t *map = _map_create(&container, "bloom", BPF_MAP_TYPE_BLOOM_FILTER, sizeof(uint32_t),
+                                 hashes, n);
+    if (map == NULL) {
+        printf("cannot create filter\n");
+        return false;
+    }
+
+    bool ok = true;
+    for (uint32_t id = 0; id < n; id++) {
+        uint32_t key = _sketch_key(id);
+        bpf_map_bloom_add(map, &key);
+        /* Adding a key never removes another */
+        if (id % 64 == 0) {
+            for (uint32_t i = 0; ok && i <= id; i++) {
+                key = _sketch_key(i);
+                if (bpf_map_bloom_test(map, &key) != 1) {
+                    printf("%u hashes: key %u lost after adding %u\n", hashes, (unsigned)i,
+                           (unsigned)id + 1);
+                    ok = false;
+                }
+            }
+        }
+    }
+    /* Keys reported as present when added are not counted */
+    if (bpf_map_entries(map) > n) {
+        printf("%u hashes: %zu keys counted, %u added\n", hashes, bpf_map_entries(map), (unsigned)n);
+        ok = false;
+    }
+
+    uint32_t positives = 0;
+    for (uint32_t id = n; id < n + samples; id++) {
+        uint32_t key = _sketch_key(id);
+        positives += bpf_map_bloom_test(map, &key);
+    }
+    double rate = (double)positives / samples;
+    double expected = ldexp(1.0, -(int)hashes);
+    printf("%u hashes, %u keys in %u bits: false positive rate %.4f, about %.4f expected\n",
+           hashes, (unsigned)n, (unsigned)bits, rate, expected);
+    if (rate > expected * 1.25) {
+        ok = false;
+    }
+
+    bpf_map_clear(map);
+    uint32_t key = _sketch_key(0);
+    if (bpf_map_entries(map) != 0 || bpf_map_bloom_test(map, &key) != 0) {
+        printf("%u hashes: filter not empty after clear\n", hashes);
+        ok = false;
+    }
+    bpf_map_destroy(&container.bpf);
+    return ok;
+}
+
+#define SKETCH_WIDTH    256
+#define SKETCH_ROWS     4
+#define SKETCH_KEYS     2000
+
+/*
+ * Count-min sketch against exact counts of a skewed stream. Estimates may be high but
+ * never low. Each row over-counts by more than 2N/width with probability at most 1/2,
+ * so with four rows that should happen for roughly 1/16 of keys.
+ */
+static bool _sketch_check(void)
+{
+    map_container_t container;
+    bpf_map_t *map = _map_create(&container, "sketch", BPF_MAP_TYPE_COUNT_MIN, sizeof(uint32_t),
+                                 SKETCH_ROWS, SKETCH_WIDTH);
+    uint32_t *counts = calloc(SKETCH_KEYS, sizeof(uint32_t));
+    uint64_t total = 0;
+    bool ok = (map != NULL);
+
+    for (unsigned op = 0; ok && op < _stress_ops; op++) {
+        uint32_t id = _rand_below(_rand_below(SKETCH_KEYS) + 1);
+        uint32_t key = _sketch_key(id);
+        uint32_t count = 1 + _rand_below(4);
+        counts[id] += count;
+        total += count;
+        uint32_t estimate = bpf_map_sketch_add(map, &key, count);
+        if (estimate < counts[id] || estimate != bpf_map_sketch_estimate(map, &key)) {
+            printf("op %u: key %u estimated at %u, count %u\n", op, (unsigned)id, (unsigned)estimate,
+                   (unsigned)counts[id]);
+            ok = false;
+        }
+    }
+    if (ok && bpf_map_entries(map) != total) {
+        printf("sketch total %zu, expected %llu\n", bpf_map_entries(map), (unsigned long long)total);
+        ok = false;
+    }
+
+    unsigned high = 0;
+    uint64_t bound = 2 * total / SKETCH_WIDTH;
+    for (uint32_t id = 0; ok && id < SKETCH_KEYS; id++) {
+        uint32_t key = _sketch_key(id);
+        uint32_t estimate = bpf_map_sketch_estimate(map, &key);
+        if (estimate < counts[id]) {
+            printf("key %u estimated at %u, count %u\n", (unsigned)id, (unsigned)estimate,
+                   (unsigned)counts[id]);
+            ok = false;
+        }
+        high += (estimate - counts[id] > bound);
+    }
+    if (ok) {
+        printf("%u of %u keys over-counted by more than %llu\n", high, SKETCH_KEYS,
+               (unsigned long long)bound);
+        ok = high * 8 <= SKETCH_KEYS;
+    }
+
+    /* Counters and the total saturate rather than wrap */
+    bpf_map_clear(map);
+    uint32_t key = _sketch_key(0);
+    uint32_t other = _sketch_key(1);
+    if (ok && (bpf_map_sketch_add(map, &key, UINT32_MAX - 5) != UINT32_MAX - 5 ||
+               bpf_map_sketch_add(map, &key, 10) != UINT32_MAX ||
+               bpf_map_sketch_add(map, &key, UINT32_MAX) != UINT32_MAX ||
+               bpf_map_sketch_estimate(map, &key) != UINT32_MAX ||
+               bpf_map_sketch_add(map, &other, 1) == 0 || bpf_map_entries(map) != UINT32_MAX)) {
+        printf("sketch counts do not saturate\n");
+        ok = false;
+    }
+
+    bpf_map_destroy(&container.bpf);
+    free(counts);
+    return ok;
+}
+
+static bool _sketch_stress(void)
+{
+    printf("\nsketch maps: Bloom filters and a count-min sketch of %u random additions...\n",
+           _stress_ops);
+    bool ok = true;
+    static const unsigned hashes[] = {1, 4, 8};
+    for (unsigned i = 0; ok && i < sizeof(hashes) / sizeof(hashes[0]); i++) {
+        ok = _bloom_check(hashes[i]);
+    }
+    ok = ok && _sketch_check();
+    printf("%s\n", ok ? "OK" : "FAILED");
+    return ok;
+}
+
+/* Bucket for a value, found by comparing against each bucket's base */
+static unsigned _histogram_bucket(const bpf_map_t *map, unsigned buckets, uint32_t value)
+{
+    unsigned bucket = 0;
+    while (bucket + 1 < buckets && value >= bpf_map_histogram_bucket_base(map, bucket + 1)) {
+        bucket++;
+    }
+    return bucket;
+}
+
+/*
+ * Values at each side of every bucket edge, then random values of all magnitudes,
+ * against an exact count. Values beyond the last bucket are counted in it.
+ */
+static bool _histogram_check(const char *name, uint32_t width, uint32_t buckets)
+{
+    map_container_t container;
+    bpf_map_t *map = _map_create(&container, "hist", BPF_MAP_TYPE_HISTOGRAM, 0, width, buckets);
+    if (map == NULL) {
+        printf("%s: cannot create histogram\n", name);
+        return false;
+    }
+
+    uint32_t expected[BPF_MAP_LOG2_BUCKETS_MAX] = {0};
+    bpf_map_histogram_t stats = {0};
+    bool ok = true;
+
+    /* Log2 bucket n starts at 2^(n-1), linear buckets at multiples of the width */
+    for (unsigned i = 1; ok && i < buckets; i++) {
+        uint32_t base = bpf_map_histogram_bucket_base(map, i);
+        uint32_t expected_base = width ? i * width : 1U << (i - 1);
+        if (base != expected_base) {
+            printf("%s: bucket %u starts at %u, expected %u\n", name, i, (unsigned)base,
+                   (unsigned)expected_base);
+            ok = false;
+        }
+    }
+
+    unsigned samples = 0;
+    for (unsigned op = 0; ok && op < 4 * buckets + _stress_ops; op++) {
+        uint32_t value;
+        unsigned bucket;
+        if (op < 4 * buckets) {
+            /* Last value of the bucket below, first value of this one */
+            unsigned i = op / 4;
+            uint32_t base = bpf_map_histogram_bucket_base(map, i);
+            switch (op % 4) {
+            case 0:
+                value = base - (i != 0);
+                bucket = i - (i != 0);
+                break;
+            case 1:
+                value = base;
+                bucket = i;
+                break;
+            case 2:
+                /* Last value of this bucket, or clamped into the last bucket */
+                value = (i + 1 == buckets) ? UINT32_MAX : bpf_map_histogram_bucket_base(map, i + 1) - 1;
+                bucket = i;
+                break;
+            default:
+                value = (i + 1 == buckets) ? (width ? (buckets + 3) * width : UINT32_MAX - 1) : base;
+                bucket = i;
+                break;
+            }
+        }
+        else {
+            value = (uint32_t)_rand() >> _rand_below(32);
+            bucket = _histogram_bucket(map, buckets, value);
+        }
+        if (bpf_map_histogram_add(map, value) != 0) {
+            printf("%s: add %u failed\n", name, (unsigned)value);
+            ok = false;
+        }
+        expected[bucket]++;
+        stats.min = (samples == 0 || value < stats.min) ? value : stats.min;
+        stats.max = (value > stats.max) ? value : stats.max;
+        stats.sum += value;
+        stats.count = ++samples;
+
+        uint32_t counts[BPF_MAP_LOG2_BUCKETS_MAX];
+        bpf_map_histogram_t actual;
+        if (ok && (bpf_map_histogram_read(map, &actual, counts, buckets) != buckets ||
+                   counts[bucket] != expected[bucket])) {
+            printf("%s: %u counted in the wrong bucket, expected %u\n", name, (unsigned)value,
+                   bucket);
+            ok = false;
+        }
+        if (ok && memcmp(&actual, &stats, sizeof(stats)) != 0) {
+            printf("%s: summary disagrees after adding %u\n", name, (unsigned)value);
+            ok = false;
+        }
+    }
+
+    bpf_map_destroy(&container.bpf);
+    return ok;
+}
+
+#define WINDOW_SLOTS    8
+#define WINDOW_MS       100
+
+typedef struct {
+    uint32_t time;
+    uint32_t delta;
+} window_event_t;
+
+/* Exact counts for the slots of the window ending at now, oldest first */
+static uint32_t _window_expected(const window_event_t *events, size_t count, uint32_t now,
+                                 uint32_t *slots)
+{
+    int64_t first = (int64_t)(now / WINDOW_MS) - (WINDOW_SLOTS - 1);
+    uint64_t total = 0;
+    memset(slots, 0, WINDOW_SLOTS * sizeof(uint32_t));
+    for (size_t i = count; i-- > 0;) {
+        int64_t slot = (int64_t)(events[i].time / WINDOW_MS) - first;
+        if (slot < 0) {
+            break;
+        }
+        slots[slot] += events[i].delta;
+        total += events[i].delta;
+    }
+    return (total > UINT32_MAX) ? UINT32_MAX : (uint32_t)total;
+}
+
+/*
+ * Window counts against a log of every addition, on the millisecond clock driven by the
+ * test. Steps are mostly within a slot or two, sometimes longer than the whole window.
+ */
+static bool _window_check(void)
+{
+    map_container_t container;
+    bpf_map_t *map = _map_create(&container, "window", BPF_MAP_TYPE_WINDOW, 0, WINDOW_MS,
+                                 WINDOW_SLOTS);
+    window_event_t *events = calloc(_stress_ops, sizeof(window_event_t));
+    uint64_t all = 0;
+    unsigned expired = 0;
+    bool ok = (map != NULL);
+
+    for (unsigned op = 0; ok && op < _stress_ops; op++) {
+        if (_rand_below(64) == 0) {
+            _advance_ms(WINDOW_SLOTS * WINDOW_MS + _rand_below(4 * WINDOW_SLOTS * WINDOW_MS));
+            expired++;
+        }
+        else {
+            _advance_ms(_rand_below(2 * WINDOW_MS));
+        }
+        uint32_t now = bpf_clock_ms();
+        uint32_t delta = _rand_below(100);
+        events[op].time = now;
+        events[op].delta = delta;
+        all += delta;
+
+        uint32_t expected[WINDOW_SLOTS];
+        uint32_t total = _window_expected(events, op + 1, now, expected);
+        uint32_t counts[WINDOW_SLOTS];
+        if (bpf_map_window_add(map, now, delta) != total ||
+            bpf_map_window_read(map, now, counts, WINDOW_SLOTS) != total ||
+            memcmp(counts, expected, sizeof(counts)) != 0) {
+            printf("op %u: window at %u ms disagrees with log\n", op, (unsigned)now);
+            ok = false;
+        }
+        /* Reading later only drops slots which have passed */
+        uint32_t later = now + _rand_below(2 * WINDOW_SLOTS * WINDOW_MS);
+        if (ok && bpf_map_window_read(map, later, counts, WINDOW_SLOTS) !=
+                      _window_expected(events, op + 1, later, expected)) {
+            printf("op %u: window at %u ms disagrees with log\n", op, (unsigned)later);
+            ok = false;
+        }
+    }
+    if (ok && bpf_map_entries(map) != (all > UINT32_MAX ? UINT32_MAX : all)) {
+        printf("window total %zu, expected %llu\n", bpf_map_entries(map), (unsigned long long)all);
+        ok = false;
+    }
+
+    /* Slot counts and totals saturate */
+    uint32_t now = bpf_clock_ms();
+    if (ok && (bpf_map_window_add(map, now, UINT32_MAX - 5) < UINT32_MAX - 5 ||
+               bpf_map_window_add(map, now, 10) != UINT32_MAX ||
+               bpf_map_window_add(map, now + WINDOW_MS, UINT32_MAX) != UINT32_MAX ||
+               bpf_map_entries(map) != UINT32_MAX)) {
+        printf("window counts do not saturate\n");
+        ok = false;
+    }
+    if (ok) {
+        printf("window: %u additions, window passed %u times\n", _stress_ops, expired);
+    }
+
+    bpf_map_destroy(&container.bpf);
+    free(events);
+    return ok;
+}
+
+static bool _aggregate_stress(void)
+{
+    printf("\naggregate maps: histogram bucket edges and %u random values, windows over %u slots...\n",
+           _stress_ops, WINDOW_SLOTS);
+    bool ok = _histogram_check("log2", 0, BPF_MAP_LOG2_BUCKETS_MAX);
+    ok = ok && _histogram_check("short log2", 0, 8);
+    ok = ok && _histogram_check("linear", 10, 5);
+    ok = ok && _window_check();
+    printf("%s\n", ok ? "OK" : "FAILED");
+    return ok;
+}
+
+#define QUEUE_RECORDS   16
+
+typedef struct {
+    uint32_t seq;
+    uint32_t check;
+} queue_record_t;
+
+typedef struct {
+    const bpf_map_t *map;
+    unsigned calls;
+} queue_notify_t;
+
+static void _queue_notify(bpf_map_t *map, void *param)
+{
+    queue_notify_t *notify = param;
+    notify->map = map;
+    notify->calls++;
+}
+
+static int _queue_push(bpf_map_t *map, uint32_t seq)
+{
+    queue_record_t record = {seq, ~seq};
+    return bpf_map_queue_push(map, &record);
+}
+
+/* Pop one record, which must be the next in sequence */
+static bool _queue_pop(bpf_map_t *map, uint32_t seq)
+{
+    queue_record_t record;
+    if (bpf_map_queue_pop(map, &record) != 0 || record.seq != seq || record.check != ~seq) {
+        printf("queue record %u missing or damaged\n", (unsigned)seq);
+        return false;
+    }
+    return true;
+}
+
+/*
+ * Three maps sharing a queue by name: the first to push and the first to pop keep
+ * those roles until destroyed, the queue outlives any one of them, and the consumer
+ * is notified only when a record lands in an empty queue.
+ */
+static bool _queue_stress(void)
+{
+    printf("\nshared queue: %u random operations on %u records...\n", _stress_ops, QUEUE_RECORDS);
+    /* Mismatched maps are reported on stderr */
+    fflush(stdout);
+
+    static map_container_t containers[3];
+    bpf_map_t *producer = _map_create(&containers[0], "queue", BPF_MAP_TYPE_QUEUE, 0,
+                                      sizeof(queue_record_t), QUEUE_RECORDS);
+    bpf_map_t *other = _map_create(&containers[1], "queue", BPF_MAP_TYPE_QUEUE, 0,
+                                   sizeof(queue_record_t), QUEUE_RECORDS);
+    bpf_map_t *consumer = _map_create(&containers[2], "queue", BPF_MAP_TYPE_QUEUE, 0,
+                                      sizeof(queue_record_t), QUEUE_RECORDS - 1);
+    bool ok = producer != NULL && other != NULL && consumer != NULL;
+    if (!ok) {
+        printf("cannot create queue maps\n");
+    }
+
+    /* A queue of the same name must match in record size and capacity */
+    map_container_t mismatch;
+    if (ok && (_map_create(&mismatch, "queue", BPF_MAP_TYPE_QUEUE, 0, sizeof(uint32_t),
+                           QUEUE_RECORDS) != NULL ||
+               _map_create(&mismatch, "queue", BPF_MAP_TYPE_QUEUE, 0, sizeof(queue_record_t),
+                           2 * QUEUE_RECORDS) != NULL)) {
+        printf("mismatched queue attached\n");
+        ok = false;
+    }
+
+    queue_notify_t notify = {NULL, 0};
+    if (ok) {
+        bpf_map_set_notify(consumer, _queue_notify, &notify);
+    }
+
+    /* Roles are claimed by the first push and pop, so other is refused both */
+    uint32_t head = 0;
+    uint32_t tail = 0;
+    unsigned notifications = 0;
+    if (ok) {
+        ok = _queue_push(producer, tail++) == 0 && _queue_pop(consumer, head++);
+        notifications++;
+    }
+    for (unsigned op = 0; ok && op < _stress_ops; op++) {
+        uint32_t count = tail - head;
+        if (_rand_below(2) == 0) {
+            int res = _queue_push(producer, tail);
+            if (res != ((count < QUEUE_RECORDS) ? 0 : -1)) {
+                printf("op %u: push with %u records returned %d\n", op, (unsigned)count, res);
+                ok = false;
+            }
+            if (res == 0) {
+                tail++;
+                notifications += (count == 0);
+            }
+        }
+        else if (count == 0) {
+            queue_record_t record;
+            if (bpf_map_queue_pop(consumer, &record) == 0) {
+                printf("op %u: popped from empty queue\n", op);
+                ok = false;
+            }
+        }
+        else {
+            ok = _queue_pop(consumer, head++);
+        }
+        queue_record_t record;
+        if (ok && (_queue_push(other, 0) == 0 || bpf_map_queue_pop(other, &record) == 0 ||
+                   bpf_map_queue_pop(producer, &record) == 0 || _queue_push(consumer, 0) == 0)) {
+            printf("op %u: queue role taken by a second map\n", op);
+            ok = false;
+        }
+        if (ok && (bpf_map_entries(other) != tail - head || notify.calls != notifications ||
+                   (notifications != 0 && notify.map != consumer))) {
+            printf("op %u: %zu records, %u notifications, expected %u, %u\n", op,
+                   bpf_map_entries(other), notify.calls, (unsigned)(tail - head), notifications);
+            ok = false;
+        }
+    }
+
+    /* Destroying the producer releases its role, leaving the records for the consumer */
+    if (ok && tail - head == QUEUE_RECORDS) {
+        ok = _queue_pop(consumer, head++);
+    }
+    bpf_map_destroy(&containers[0].bpf);
+    if (ok && (bpf_map_entries(consumer) != tail - head ||
+               _queue_push(other, tail++) != 0 || _queue_push(consumer, 0) == 0)) {
+        printf("producer role not released\n");
+        ok = false;
+    }
+    while (ok && head != tail) {
+        ok = _queue_pop(consumer, head++);
+    }
+
+    /* And destroying the consumer removes its callback */
+    bpf_map_destroy(&containers[2].bpf);
+    if (ok) {
+        bpf_map_clear(other);
+        unsigned calls = notify.calls;
+        ok = bpf_map_entries(other) == 0 && _queue_push(other, 0) == 0 && _queue_pop(other, 0) &&
+             notify.calls == calls;
+        if (!ok) {
+            printf("consumer role or callback not released\n");
+        }
+    }
+
+    /* The last reference frees the queue, so a differently sized one can take its name */
+    bpf_map_destroy(&containers[1].bpf);
+    bpf_map_t *map = _map_create(&mismatch, "queue", BPF_MAP_TYPE_QUEUE, 0, sizeof(uint32_t), 4);
+    if (ok && (map == NULL || bpf_map_entries(map) != 0)) {
+        printf("queue not freed with its last map\n");
+        ok = false;
+    }
+    if (map != NULL) {
+        bpf_map_destroy(&mismatch.bpf);
+    }
+
+    printf("%s\n", ok ? "OK" : "FAILED");
+    if (ok) {
+        printf("%u records, %u notifications\n", (unsigned)tail, notifications);
+    }
+    return ok;
+}
+
+static bool _map_stress(void)
+{
+    bool ok = _map_array_stress();
+    ok = ok && _map_hash_stress(BPF_MAP_TYPE_HASH);
+    ok = ok && _map_hash_stress(BPF_MAP_TYPE_COUNTER);
+    ok = ok && _sketch_stress();
+    ok = ok && _aggregate_stress();
+    ok = ok && _queue_stress();
+    return ok;
+}
+
+#if CONFIG_BPF_CONCURRENT
+
+/*
+ * Multi-threaded tests, global store only
+ */
+
+#define THREAD_KEYS         256     /* Private global keys per stress thread */
+#define SHARED_COUNTERS     16
+
+typedef struct {
+    pthread_t thread;
+    unsigned id;
+    uint64_t rng;
+    unsigned ops;
+    size_t keys;                    /* Key range for lookups */
+    unsigned update_pct;            /* Proportion of lookups replaced by fetch_add */
+    bool percpu;                    /* Counters: use per-thread store */
+    uint64_t adds;                  /* Stress: shared counter increments made */
+    unsigned changes;               /* Watch: changes made to the range watched */
+    bool ok;
+} worker_t;
+
+static pthread_barrier_t _start_barrier;
+
+static uint32_t _worker_rand(worker_t *w, uint32_t n)
+{
+    w->rng ^= w->rng >> 12;
+    w->rng ^= w->rng << 25;
+    w->rng ^= w->rng >> 27;
+    return (uint32_t)((w->rng * 0x2545F4914F6CDD1DULL) % n);
+}
+
+static void *_read_worker(void *arg)
+{
+    worker_t *w = arg;
+    uint32_t value;
+    pthread_barrier_wait(&_start_barrier);
+    for (unsigned op = 0; op < w->ops; op++) {
+        uint32_t key = _worker_rand(w, w->keys);
+        if (w->update_pct && _worker_rand(w, 100) < w->update_pct) {
+            bpf_store_fetch_add_global(key, 1, &value);
+        }
+        else if (bpf_store_lookup_global(key, &value) < 0) {
+            w->ok = false;
+        }
+    }
+    return NULL;
+}
+
+/* Returns operations per second */
+static double _run_workers(worker_t *workers, unsigned count, void *(*fn)(void *))
+{
+    pthread_barrier_init(&_start_barrier, NULL, count + 1);
+    for (unsigned i = 0; i < count; i++) {
+        pthread_create(&workers[i].thread, NULL, fn, &workers[i]);
+    }
+    pthread_barrier_wait(&_start_barrier);
+    uint64_t start = _now_ns();
+    uint64_t ops = 0;
+    for (unsigned i = 0; i < count; i++) {
+        pthread_join(workers[i].thread, NULL);
+        ops += workers[i].ops;
+    }
+    double elapsed = (double)(_now_ns() - start) / 1e9;
+    pthread_barrier_destroy(&_start_barrier);
+    return ops / elapsed;
+}
+
+static void _scaling(bpf_store_type_t type)
+{
+    const size_t nkeys = (_max_keys < 16384) ? _max_keys : 16384;
+    const unsigned ops = 1000000;
+    bpf_store_set_global_type(type);
+    for (uint32_t key = 0; key < nkeys; key++) {
+        bpf_store_update_global(key, key);
+    }
+
+    printf("\nglobal store (%s), %zu keys, %u operations per thread\n", 
+           type == BPF_STORE_TYPE_HASH ? "hash" : "tree", nkeys, ops);
+    printf("%-8s %14s %8s %14s %8s\n", "threads", "lookup/s", "scaling", "5% update/s", "scaling");
+    worker_t *workers = calloc(_threads, sizeof(worker_t));
+    double base[2] = {0};
+    /* Powers of 2 up to the maximum, then the maximum */
+    for (unsigned count = 1;; count = (count * 2 < _threads) ? count * 2 : _threads) {
+        double rate[2];
+        for (unsigned mix = 0; mix < 2; mix++) {
+            for (unsigned i = 0; i < count; i++) {
+                workers[i] = (worker_t){
+                    .id = i, .rng = _seed + i + 1, .ops = ops, .keys = nkeys,
+                    .update_pct = mix ? 5 : 0, .ok = true,
+                };
+            }
+            rate[mix] = _run_workers(workers, count, _read_worker);
+            if (count == 1) {
+                base[mix] = rate[mix];
+            }
+        }
+        printf("%-8u %12.2fM %7.2fx %12.2fM %7.2fx\n", count, rate[0] / 1e6, rate[0] / base[0],
+               rate[1] / 1e6, rate[1] / base[1]);
+        if (count == _threads) {
+            break;
+        }
+    }
+    free(workers);
+    bpf_store_clear_global();
+}
+
+static void *_counter_worker(void *arg)
+{
+    worker_t *w = arg;
+    uint32_t value;
+    pthread_barrier_wait(&_start_barrier);
+    for (unsigned op = 0; op < w->ops; op++) {
+        uint32_t key = op % SHARED_COUNTERS;
+        int res = w->percpu ? bpf_percpu_add(key, 1) : bpf_store_fetch_add_global(key, 1, &value);
+        if (res < 0) {
+            w->ok = false;
+        }
+    }
+    return NULL;
+}
+
+/* Every thread increments the same few counters */
+static bool _counter_scaling(void)
+{
+    const unsigned ops = 1000000;
+    printf("\n%u counters, %u increments per thread\n", SHARED_COUNTERS, ops);
+    printf("%-8s %14s %8s %14s %8s\n", "threads", "global/s", "scaling", "per-thread/s", "scaling");
+    worker_t *workers = calloc(_threads, sizeof(worker_t));
+    double base[2] = {0};
+    bool ok = true;
+    for (unsigned count = 1;; count = (count * 2 < _threads) ? count * 2 : _threads) {
+        double rate[2];
+        for (unsigned percpu = 0; percpu < 2; percpu++) {
+            for (unsigned i = 0; i < count; i++) {
+                workers[i] = (worker_t){.id = i, .ops = ops, .percpu = percpu, .ok = true};
+            }
+            rate[percpu] = _run_workers(workers, count, _counter_worker);
+            if (count == 1) {
+                base[percpu] = rate[percpu];
+            }
+            uint64_t total = 0;
+            for (uint32_t key = 0; key < SHARED_COUNTERS; key++) {
+                uint64_t value = 0;
+                if (percpu) {
+                    bpf_percpu_lookup(key, BPF_PERCPU_SUM, &value);
+                }
+                else {
+                    uint32_t v;
+                    bpf_store_lookup_global(key, &v);
+                    value = v;
+                }
+                total += value;
+            }
+            for (unsigned i = 0; i < count; i++) {
+                ok &= workers[i].ok;
+            }
+            ok &= (total == (uint64_t)count * ops);
+            bpf_store_clear_global();
+            bpf_percpu_clear();
+        }
+        printf("%-8u %12.2fM %7.2fx %12.2fM %7.2fx\n", count, rate[0] / 1e6, rate[0] / base[0],
+               rate[1] / 1e6, rate[1] / base[1]);
+        if (count == _threads) {
+            break;
+        }
+    }
+    if (!ok) {
+        printf("counter totals incorrect\n");
+    }
+    free(workers);
+    return ok;
+}
+
+static void *_stress_worker(void *arg)
+{
+    worker_t *w = arg;
+    bpf_t bpf = {0};
+    uint32_t base = (w->id + 1) * 0x10000;
+    bool present[THREAD_KEYS] = {0};
+    uint32_t shadow[THREAD_KEYS];
+    uint32_t value;
+
+    pthread_barrier_wait(&_start_barrier);
+    for (unsigned op = 0; w->ok && op < w->ops; op++) {
+        uint32_t index = _worker_rand(w, THREAD_KEYS);
+        uint32_t key = base + index;
+        switch (_worker_rand(w, 6)) {
+        case 0:
+            index = _worker_rand(w, SHARED_COUNTERS);
+            if (bpf_store_fetch_add_global(index, 1, &value) == 0) {
+                w->adds++;
+            }
+            if (bpf_percpu_add(index, 1) < 0) {
+                printf("thread %u: per-thread add failed\n", w->id);
+                w->ok = false;
+            }
+            break;
+        case 1:
+            value = _worker_rand(w, 1000000);
+            if (bpf_store_update_global(key, value) < 0) {
+                printf("thread %u: update %u failed\n", w->id, (unsigned)key);
+                w->ok = false;
+            }
+            present[index] = true;
+            shadow[index] = value;
+            break;
+        case 2:
+            if ((bpf_store_remove_global(key) == 0) != present[index]) {
+                printf("thread %u: remove %u disagrees with shadow\n", w->id, (unsigned)key);
+                w->ok = false;
+            }
+            present[index] = false;
+            break;
+        case 3:
+            if ((bpf_store_lookup_global(key, &value) == 0) != present[index] ||
+                (present[index] && value != shadow[index])) {
+                printf("thread %u: lookup %u disagrees with shadow\n", w->id, (unsigned)key);
+                w->ok = false;
+            }
+            break;
+        case 4:
+            /* Local stores allocate from the same pool */
+            if (bpf_store_fetch_add_local(&bpf, index, 1, &value) < 0) {
+                printf("thread %u: local fetch_add failed\n", w->id);
+                w->ok = false;
+            }
+            break;
+        case 5:
+            bpf_store_remove_local(&bpf, index);
+            break;
+        }
+    }
+
+    for (uint32_t index = 0; index < THREAD_KEYS; index++) {
+        if (present[index]) {
+            bpf_store_remove_global(base + index);
+        }
+    }
+    bpf_store_clear_local(&bpf);
+    return NULL;
+}
+
+static bool _concurrent_stress(bpf_store_type_t type)
+{
+    bpf_store_set_global_type(type);
+    bpf_pool_stats_t before;
+    bpf_store_get_pool_stats(BPF_STORE_POOL_ENTRY, &before);
+
+    printf("\nglobal store (%s): %u threads, %u random operations each... ",
+           type == BPF_STORE_TYPE_HASH ? "hash" : "tree", _threads, _stress_ops);
+    fflush(stdout);
+
+    worker_t *workers = calloc(_threads, sizeof(worker_t));
+    for (unsigned i = 0; i < _threads; i++) {
+        workers[i] = (worker_t){.id = i, .rng = _seed + i + 1, .ops = _stress_ops, .ok = true};
+    }
+    _run_workers(workers, _threads, _stress_worker);
+
+    bool ok = true;
+    uint64_t adds = 0;
+    for (unsigned i = 0; i < _threads; i++) {
+        ok &= workers[i].ok;
+        adds += workers[i].adds;
+    }
+    uint64_t total = 0;
+    uint64_t percpu_total = 0;
+    for (uint32_t key = 0; key < SHARED_COUNTERS; key++) {
+        uint32_t value;
+        if (bpf_store_lookup_global(key, &value) == 0) {
+            total += value;
+        }
+        /* Per-thread counts should match the shared one, and each other when merged */
+        uint64_t sum, max;
+        uint32_t values[CONFIG_BPF_PERCPU_SHARDS];
+        if (bpf_percpu_lookup(key, BPF_PERCPU_SUM, &sum) == 0 &&
+            bpf_percpu_lookup(key, BPF_PERCPU_MAX, &max) == 0 &&
+            bpf_percpu_lookup_all(key, values, CONFIG_BPF_PERCPU_SHARDS) == CONFIG_BPF_PERCPU_SHARDS) {
+            uint64_t shard_total = 0;
+            for (unsigned i = 0; i < CONFIG_BPF_PERCPU_SHARDS; i++) {
+                shard_total += values[i];
+            }
+            if (shard_total != sum || max > sum || (sum && !max)) {
+                printf("per-thread counter %u inconsistent\n", (unsigned)key);
+                ok = false;
+            }
+            percpu_total += sum;
+        }
+    }
+    if (total != adds || percpu_total != adds) {
+        printf("shared counters total %llu, per-thread %llu, expected %llu\n",
+               (unsigned long long)total, (unsigned long long)percpu_total,
+               (unsigned long long)adds);
+        ok = false;
+    }
+    bpf_percpu_clear();
+    store_t store = {"global", NULL, type};
+    ok = ok && _check_store(&store, SHARED_COUNTERS);
+    bpf_store_clear_global();
+
+    bpf_pool_stats_t after;
+    bpf_store_get_pool_stats(BPF_STORE_POOL_ENTRY, &after);
+    if (after.in_use != before.in_use || after.in_use + after.free != after.capacity) {
+        printf("pool has %zu in use, %zu free of %zu, expected %zu in use\n", after.in_use,
+               after.free, after.capacity, before.in_use);
+        ok = false;
+    }
+
+    printf("%s\n", ok ? "OK" : "FAILED");
+    free(workers);
+    return ok;
+}
+
+/*
+ * A watched counter incremented by every thread. The watcher coalesces changes
+ * as StoreWatch does, keeping the first old value and the latest new value, and
+ * a consumer thread takes them, so it must end up having seen the final value.
+ *
+ * Threads also change keys in a second watched range, one between the two which
+ * is not watched and one outside both, so two watches are called concurrently.
+ */
+#define WATCH_KEY           7
+#define WATCH_RANGE_FIRST   (WATCH_KEY + 2)
+#define WATCH_RANGE_KEYS    4
+#define WATCH_OTHER_KEYS    2           /* Keys changed but not watched */
+
+typedef struct {
+    pthread_mutex_t lock;
+    bool pending;
+    uint32_t old_value;
+    uint32_t new_value;
+    uint32_t last;                  /* New value of the last change, to check ordering */
+    uint32_t seen;                  /* Latest value taken by the consumer */
+    volatile bool done;
+    bool ok;
+} watch_state_t;
+
+static void _watch_cb(const bpf_store_change_t *change, void *param)
+{
+    watch_state_t *state = param;
+    /* Changes to one key must chain together */
+    if (change->key != WATCH_KEY || change->old_value != state->last) {
+        state->ok = false;
+    }
+    state->last = change->new_value;
+    pthread_mutex_lock(&state->lock);
+    if (!state->pending) {
+        state->pending = true;
+        state->old_value = change->old_value;
+    }
+    state->new_value = change->new_value;
+    if (state->new_value == state->old_value) {
+        state->pending = false;
+    }
+    pthread_mutex_unlock(&state->lock);
+}
+
+typedef struct {
+    uint32_t last[WATCH_RANGE_KEYS];
+    unsigned changes;
+    bool ok;
+} watch_range_t;
+
+static void _watch_range_cb(const bpf_store_change_t *change, void *param)
+{
+    watch_range_t *range = param;
+    uint32_t index = change->key - WATCH_RANGE_FIRST;
+    if (index >= WATCH_RANGE_KEYS || change->old_value != range->last[index]) {
+        range->ok = false;
+        return;
+    }
+    range->last[index] = change->new_value;
+    range->changes++;
+}
+
+static uint32_t _watch_other_key(unsigned index)
+{
+    /* Between the watched key and range, then beyond both */
+    return (index == 0) ? WATCH_KEY + 1 : WATCH_RANGE_FIRST + WATCH_RANGE_KEYS + 1000;
+}
+
+static bool _watch_take(watch_state_t *state)
+{
+    pthread_mutex_lock(&state->lock);
+    bool taken = state->pending;
+    if (taken) {
+        state->seen = state->new_value;
+        state->pending = false;
+    }
+    pthread_mutex_unlock(&state->lock);
+    return taken;
+}
+
+static void *_watch_consumer(void *arg)
+{
+    watch_state_t *state = arg;
+    while (!state->done) {
+        if (!_watch_take(state)) {
+            sched_yield();
+        }
+    }
+    return NULL;
+}
+
+static void *_watch_worker(void *arg)
+{
+    worker_t *w = arg;
+    uint32_t value;
+    pthread_barrier_wait(&_start_barrier);
+    for (unsigned op = 0; op < w->ops; op++) {
+        uint32_t delta = 1 + _worker_rand(w, 3);
+        if (bpf_store_fetch_add_global(WATCH_KEY, delta, &value) < 0) {
+            w->ok = false;
+            break;
+        }
+        w->adds += delta;
+
+        uint32_t index = _worker_rand(w, WATCH_RANGE_KEYS + WATCH_OTHER_KEYS);
+        if (index < WATCH_RANGE_KEYS) {
+            w->changes++;
+            bpf_store_fetch_add_global(WATCH_RANGE_FIRST + index, delta, NULL);
+        }
+        else {
+            bpf_store_fetch_add_global(_watch_other_key(index - WATCH_RANGE_KEYS), delta, NULL);
+        }
+    }
+    return NULL;
+}
+
+static bool _watch_stress(bpf_store_type_t type)
+{
+    bpf_store_set_global_type(type);
+    printf("\nglobal store (%s): %u threads, %u watched increments each... ",
+           type == BPF_STORE_TYPE_HASH ? "hash" : "tree", _threads, _stress_ops);
+    fflush(stdout);
+
+    watch_state_t state = {.ok = true};
+    pthread_mutex_init(&state.lock, NULL);
+    bpf_store_watch_t watch;
+    bpf_store_watch_global(&watch, WATCH_KEY, WATCH_KEY, _watch_cb, &state);
+    watch_range_t range = {.ok = true};
+    bpf_store_watch_t range_watch;
+    bpf_store_watch_global(&range_watch, WATCH_RANGE_FIRST, WATCH_RANGE_FIRST + WATCH_RANGE_KEYS - 1,
+                           _watch_range_cb, &range);
+    pthread_t consumer;
+    pthread_create(&consumer, NULL, _watch_consumer, &state);
+
+    worker_t *workers = calloc(_threads, sizeof(worker_t));
+    for (unsigned i = 0; i < _threads; i++) {
+        workers[i] = (worker_t){.id = i, .rng = _seed + i + 1, .ops = _stress_ops, .ok = true};
+    }
+    _run_workers(workers, _threads, _watch_worker);
+
+    state.done = true;
+    pthread_join(consumer, NULL);
+    _watch_take(&state);
+    bpf_store_unwatch_global(&watch);
+    bpf_store_unwatch_global(&range_watch);
+
+    bool ok = state.ok;
+    uint32_t expected = 0;
+    unsigned changes = 0;
+    for (unsigned i = 0; i < _threads; i++) {
+        ok &= workers[i].ok;
+        expected += workers[i].adds;
+        changes += workers[i].changes;
+    }
+    if (!range.ok || range.changes != changes) {
+        printf("range watch saw %u changes, expected %u%s\n", range.changes, changes,
+               range.ok ? "" : ", some out of order or out of range");
+        ok = false;
+    }
+    uint32_t value = 0;
+    bpf_store_lookup_global(WATCH_KEY, &value);
+    if (value != expected || state.last != value || state.seen != value) {
+        printf("counter %u, expected %u, last change to %u, consumer saw %u\n", (unsigned)value,
+               (unsigned)expected, (unsigned)state.last, (unsigned)state.seen);
+        ok = false;
+    }
+    if (!state.ok) {
+        printf("changes reported out of order\n");
+    }
+    pthread_mutex_destroy(&state.lock);
+    bpf_store_clear_global();
+
+    printf("%s\n", ok ? "OK" : "FAILED");
+    free(workers);
+    return ok;
+}
+
+/*
+ * Ring with the producer and consumer on separate threads. The consumer only reads
+ * when notified, so a missed notification leaves records unread.
+ */
+typedef struct {
+    ringbuf_t ring;
+    pthread_mutex_t lock;
+    pthread_cond_t notified;
+    unsigned notifications;         /* Not yet handled by the consumer */
+    bool done;
+    uint32_t received;
+    bool ok;
+} ring_test_t;
+
+static void *_ring_consumer(void *arg)
+{
+    ring_test_t *test = arg;
+    for (;;) {
+        pthread_mutex_lock(&test->lock);
+        while (test->notifications == 0 && !test->done) {
+            pthread_cond_wait(&test->notified, &test->lock);
+        }
+        if (test->notifications == 0) {
+            pthread_mutex_unlock(&test->lock);
+            break;
+        }
+        test->notifications--;
+        pthread_mutex_unlock(&test->lock);
+
+        uint32_t len;
+        const uint8_t *record;
+        while ((record = ringbuf_peek(&test->ring, &len)) != NULL) {
+            uint32_t seq = bpf_atomic_load(&test->received);
+            if (!_ring_check(record, len, seq)) {
+                printf("record %u damaged or out of order\n", (unsigned)seq);
+                test->ok = false;
+            }
+            ringbuf_consume(&test->ring);
+            bpf_atomic_store_seq_cst(&test->received, seq + 1);
+        }
+    }
+    return NULL;
+}
+
+static bool _ringbuf_threads(void)
+{
+    static ring_mem_t mem;
+    ring_test_t test = {.ok = true};
+    _ring_guard_init(&mem);
+    ringbuf_init(&test.ring, mem.data, RING_SIZE);
+    pthread_mutex_init(&test.lock, NULL);
+    pthread_cond_init(&test.notified, NULL);
+    const unsigned attempts = _stress_ops * 5;
+
+    printf("\nring buffer: producer and consumer threads, %u records... ", attempts);
+    fflush(stdout);
+
+    pthread_t consumer;
+    pthread_create(&consumer, NULL, _ring_consumer, &test);
+
+    uint32_t produced = 0;
+    uint32_t dropped = 0;
+    for (unsigned i = 0; i < attempts; i++) {
+        uint32_t len = sizeof(uint32_t) + _rand_below(RING_RECORD_MAX - sizeof(uint32_t));
+        uint8_t *record = ringbuf_reserve(&test.ring, len);
+        if (record == NULL) {
+            dropped++;
+            sched_yield();
+            continue;
+        }
+        _ring_fill(record, produced++, len);
+        if (ringbuf_submit(&test.ring)) {
+            pthread_mutex_lock(&test.lock);
+            test.notifications++;
+            pthread_cond_signal(&test.notified);
+            pthread_mutex_unlock(&test.lock);
+        }
+    }
+
+    /* Without further notifications, the consumer must still read every record */
+    for (unsigned ms = 0; ms < 5000 && bpf_atomic_load_seq_cst(&test.received) != produced; ms++) {
+        struct timespec delay = {0, 1000000};
+        nanosleep(&delay, NULL);
+    }
+    uint32_t received = bpf_atomic_load_seq_cst(&test.received);
+
+    pthread_mutex_lock(&test.lock);
+    test.done = true;
+    pthread_cond_signal(&test.notified);
+    pthread_mutex_unlock(&test.lock);
+    pthread_join(consumer, NULL);
+
+    bool ok = test.ok && _ring_guard_check(&mem);
+    if (received != produced) {
+        printf("consumer received %u of %u records\n", (unsigned)received, (unsigned)produced);
+        ok = false;
+    }
+    if (test.ring.dropped != dropped || test.ring.submitted != produced) {
+        printf("ring counts %u dropped, %u submitted, expected %u, %u\n",
+               (unsigned)test.ring.dropped, (unsigned)test.ring.submitted, (unsigned)dropped,
+               (unsigned)produced);
+        ok = false;
+    }
+    pthread_cond_destroy(&test.notified);
+    pthread_mutex_destroy(&test.lock);
+
+    printf("%s\n", ok ? "OK" : "FAILED");
+    if (ok) {
+        printf("%u records, %u dropped\n", (unsigned)produced, (unsigned)dropped);
+    }
+    return ok;
+}
+
+/*
+ * Shared queue with its producer and consumer maps on separate threads, the consumer
+ * reading only when notified by the queue.
+ */
+typedef struct {
+    bpf_map_t *map;
+    pthread_mutex_t lock;
+    pthread_cond_t notified;
+    unsigned notifications;         /* Not yet handled by the consumer */
+    bool done;
+    uint32_t received;
+    bool ok;
+} queue_test_t;
+
+static void _queue_signal(bpf_map_t *map, void *param)
+{
+    queue_test_t *test = param;
+    if (map != test->map) {
+        test->ok = false;
+    }
+    pthread_mutex_lock(&test->lock);
+    test->notifications++;
+    pthread_cond_signal(&test->notified);
+    pthread_mutex_unlock(&test->lock);
+}
+
+static void *_queue_consumer(void *arg)
+{
+    queue_test_t *test = arg;
+    for (;;) {
+        pthread_mutex_lock(&test->lock);
+        while (test->notifications == 0 && !test->done) {
+            pthread_cond_wait(&test->notified, &test->lock);
+        }
+        if (test->notifications == 0) {
+            pthread_mutex_unlock(&test->lock);
+            break;
+        }
+        test->notifications--;
+        pthread_mutex_unlock(&test->lock);
+
+        queue_record_t record;
+        while (bpf_map_queue_pop(test->map, &record) == 0) {
+            uint32_t seq = bpf_atomic_load(&test->received);
+            if (record.seq != seq || record.check != ~seq) {
+                printf("record %u damaged or out of order\n", (unsigned)seq);
+                test->ok = false;
+            }
+            bpf_atomic_store_seq_cst(&test->received, seq + 1);
+        }
+    }
+    return NULL;
+}
+
+static bool _queue_threads(void)
+{
+    map_container_t producer_container;
+    map_container_t consumer_container;
+    bpf_map_t *producer = _map_create(&producer_container, "queue", BPF_MAP_TYPE_QUEUE, 0,
+                                      sizeof(queue_record_t), QUEUE_RECORDS);
+    queue_test_t test = {
+        .map = _map_create(&consumer_container, "queue", BPF_MAP_TYPE_QUEUE, 0,
+                           sizeof(queue_record_t), QUEUE_RECORDS),
+        .ok = true,
+    };
+    if (producer == NULL || test.map == NULL) {
+        printf("cannot create queue maps\n");
+        return false;
+    }
+    pthread_mutex_init(&test.lock, NULL);
+    pthread_cond_init(&test.notified, NULL);
+    bpf_map_set_notify(test.map, _queue_signal, &test);
+    const unsigned records = _stress_ops * 5;
+
+    printf("\nshared queue: producer and consumer threads, %u records... ", records);
+    fflush(stdout);
+
+    pthread_t consumer;
+    pthread_create(&consumer, NULL, _queue_consumer, &test);
+
+    unsigned full = 0;
+    for (uint32_t seq = 0; seq < records;) {
+        if (_queue_push(producer, seq) == 0) {
+            seq++;
+        }
+        else {
+            full++;
+            sched_yield();
+        }
+    }
+
+    /* Without further notifications, the consumer must still read every record */
+    for (unsigned ms = 0; ms < 5000 && bpf_atomic_load_seq_cst(&test.received) != records; ms++) {
+        struct timespec delay = {0, 1000000};
+        nanosleep(&delay, NULL);
+    }
+    uint32_t received = bpf_atomic_load_seq_cst(&test.received);
+
+    pthread_mutex_lock(&test.lock);
+    test.done = true;
+    pthread_cond_signal(&test.notified);
+    pthread_mutex_unlock(&test.lock);
+    pthread_join(consumer, NULL);
+
+    bool ok = test.ok;
+    if (received != records || bpf_map_entries(producer) != 0) {
+        printf("consumer received %u of %u records\n", (unsigned)received, records);
+        ok = false;
+    }
+    bpf_map_destroy(&consumer_container.bpf);
+    bpf_map_destroy(&producer_container.bpf);
+    pthread_cond_destroy(&test.notified);
+    pthread_mutex_destroy(&test.lock);
+
+    printf("%s\n", ok ? "OK" : "FAILED");
+    if (ok) {
+        printf("%u records, queue full %u times\n", records, full);
+    }
+    return ok;
+}
+
+#endif /* CONFIG_BPF_CONCURRENT */
+
+static void _print_pool(void)
+{
+    bpf_pool_stats_t stats;
+    bpf_store_get_pool_stats(BPF_STORE_POOL_ENTRY, &stats);
+    printf("Pool: capacity %zu, in use %zu, high water %zu, %zu heap chunks, %u failures\n",
+           stats.capacity, stats.in_use, stats.high_water, stats.chunks, (unsigned)stats.failures);
+    bpf_store_reset_pool_stats();
+}
+
+static void _usage(const char *prog)
+{
+    printf("Usage: %s [options]\n"
+           "  -n KEYS     Largest key count to benchmark (default %zu)\n"
+           "  -b SECONDS  Stop growing a pattern once a run exceeds this (default %.0f)\n"
+           "  -z S        Zipf exponent (default %.2f)\n"
+           "  -o OPS      Stress test operations, 0 to skip (default %u)\n"
+           "  -k KEYS     Stress test key range (default %u)\n"
+           "  -s SEED     Random seed (default %u)\n"
+           "  -S          Stress test only\n"
+#if CONFIG_BPF_CONCURRENT
+           "  -t THREADS  Maximum threads for concurrent tests, 0 to skip (default %u)\n"
+#endif
+           , prog, _max_keys, _budget, _zipf_s, _stress_ops, _stress_keys, _seed
+#if CONFIG_BPF_CONCURRENT
+           , _threads
+#endif
+           );
+}
+
+int main(int argc, char *argv[])
+{
+    bool bench = true;
+    int opt;
+    while ((opt = getopt(argc, argv, "n:b:z:o:k:s:St:h")) != -1) {
+        switch (opt) {
+        case 'n':
+            _max_keys = strtoul(optarg, NULL, 0);
+            break;
+        case 'b':
+            _budget = atof(optarg);
+            break;
+        case 'z':
+            _zipf_s = atof(optarg);
+            break;
+        case 'o':
+            _stress_ops = strtoul(optarg, NULL, 0);
+            break;
+        case 'k':
+            _stress_keys = strtoul(optarg, NULL, 0);
+            break;
+        case 's':
+            _seed = strtoul(optarg, NULL, 0);
+            break;
+        case 'S':
+            bench = false;
+            break;
+#if CONFIG_BPF_CONCURRENT
+        case 't':
+            _threads = strtoul(optarg, NULL, 0);
+            break;
+#endif
+        default:
+            _usage(argv[0]);
+            return opt == 'h' ? 0 : 1;
+        }
+    }
+
+    _rng_state = 0x9E3779B97F4A7C15ULL ^ _seed;
+
+    bpf_store_init();
+
+    static bpf_t local_bpf;
+    const store_t stores[] = {
+        {"global", NULL, BPF_STORE_TYPE_TREE},
+        {"local", &local_bpf, BPF_STORE_TYPE_TREE},
+        {"global", NULL, BPF_STORE_TYPE_HASH},
+        {"local", &local_bpf, BPF_STORE_TYPE_HASH},
+    };
+    const unsigned num_stores = sizeof(stores) / sizeof(stores[0]);
+
+    printf("Pool: %u static entries of %u bytes (%u bytes), up to %u, growing by %u\n",
+           (unsigned)BPF_STORE_POOL_SIZE, (unsigned)sizeof(bpf_store_entry_t),
+           (unsigned)(BPF_STORE_POOL_SIZE * sizeof(bpf_store_entry_t)),
+           (unsigned)CONFIG_BPF_STORE_POOL_MAX, (unsigned)CONFIG_BPF_STORE_POOL_CHUNK);
+
+    bool ok = true;
+    for (unsigned i = 0; ok && i < num_stores; i++) {
+        if (!_select(&stores[i])) {
+            printf("%s store not empty, cannot change type\n", stores[i].name);
+            ok = false;
+            break;
+        }
+        if (bench) {
+            _benchmark(&stores[i]);
+        }
+        if (_stress_ops) {
+            ok &= _stress(&stores[i]);
+            ok &= _cache_stress(&stores[i]);
+        }
+        if (stores[i].type == BPF_STORE_TYPE_TREE) {
+            _print_pool();
+        }
+    }
+
+    if (ok && _stress_ops) {
+        ok &= _lpm_stress();
+        ok &= _ringbuf_stress();
+        ok &= _map_stress();
+    }
+
+#if CONFIG_BPF_CONCURRENT
+    for (unsigned i = 0; ok && _threads && i < num_stores; i++) {
+        if (stores[i].bpf) {
+            continue;
+        }
+        if (bench) {
+            _scaling(stores[i].type);
+        }
+        if (_stress_ops) {
+            ok &= _concurrent_stress(stores[i].type);
+            ok &= _watch_stress(stores[i].type);
+        }
+    }
+    if (ok && _threads && _stress_ops) {
+        ok &= _ringbuf_threads();
+        ok &= _queue_threads();
+    }
+    if (ok && _threads && bench) {
+        ok &= _counter_scaling();
+    }
+#endif
+
+    return ok ? 0 : 1;
+}
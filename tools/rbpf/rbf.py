@@ -13,14 +13,27 @@ HEADER = namedtuple('Header', 'magic version flags data_len bss_len rodata_len t
 SYMBOL_STRUCT = struct.Struct('<HHH')
 SYMBOL = namedtuple('Symbol', 'name_offset flags location_offset')
 
+# Map declarations in ELF, see bpf_map_def_t
+MAP_DEF_STRUCT = struct.Struct('<4I')
+MAP_DEF = namedtuple('MapDef', 'type key_size value_size max_entries')
+
+# Map table entry in RBF, see rbpf_map_t
+MAP_STRUCT = struct.Struct('<HBBIII')
+MAP = namedtuple('Map', 'name_offset type flags key_size value_size max_entries')
+MAP_COUNT_STRUCT = struct.Struct('<I')
+MAP_TYPES = {1: 'array', 2: 'hash', 3: 'counter', 4: 'lpm', 5: 'bloom', 6: 'count-min', 7: 'histogram',
+             8: 'window', 9: 'ringbuf', 10: 'queue'}
+
 TEXT = '.text'
 BSS = '.bss'
 DATA = '.data'
 RODATA = '.rodata'
 SYMBOLS = '.symtab'
 RELOCATIONS = '.rel.text'
+MAPS = 'maps'
 
 COMPRESSED = 0x01
+HAS_MAPS = 0x02
 
 class Symbol(object):
     def __init__(self, location, name, instruction=None):
@@ -31,7 +44,7 @@ class Symbol(object):
 class RBF(object):
 
 
-    def __init__(self, data, bss_len, rodata, text, symbols, header=None):
+    def __init__(self, data, bss_len, rodata, text, symbols, header=None, maps=None):
         self.data = data
         self.rodata = rodata
         self.text = text
@@ -43,6 +56,7 @@ class RBF(object):
             self.flags = 0
         self.instructions = instructions.parse_text(self.text, compressed=bool(self.flags & COMPRESSED))
         self.symbols = symbols
+        self.maps = maps or []
 
         def _round_len(bstr):
             if (len(bstr) % 8) != 0:
@@ -65,6 +79,9 @@ class RBF(object):
             syms.append(Symbol(symbol.location_offset, name, instruction))
         return syms
 
+    def _name(self, rodata_offset):
+        return self.rodata[rodata_offset:].split(b'\00')[0].decode('ascii')
+
     def instruction_by_address(self, address):
         for instruction in self.instructions:
             if instruction.address == address:
@@ -106,6 +123,14 @@ class RBF(object):
             print(f"\t\"{symbol.name}\": {hex(symbol.location)}")
         print()
 
+        if self.maps:
+            print("maps:")
+            for index, m in enumerate(self.maps):
+                type_name = MAP_TYPES.get(m.type, str(m.type))
+                print(f"\t{index}: \"{self._name(m.name_offset)}\" {type_name}, key {m.key_size} B, "
+                      f"value {m.value_size} B, {m.max_entries} entries")
+            print()
+
         print("data:")
         print("".join(data for data in RBF.obj_hexstr(self.data)))
 
@@ -122,9 +147,18 @@ class RBF(object):
                     print(f"<{symbol.name}>")
                 print(instr.full_print())
 
+    def _format_maps(self):
+        if not self.maps:
+            return bytearray()
+        data = bytearray(MAP_COUNT_STRUCT.pack(len(self.maps)))
+        for m in self.maps:
+            data += MAP_STRUCT.pack(*m)
+        return data
+
     def format(self):
         if not self.header:
-            self.header = HEADER(MAGIC, 0, 0, len(self.data), self.bss_len, len(self.rodata),
+            flags = HAS_MAPS if self.maps else 0
+            self.header = HEADER(MAGIC, 0, flags, len(self.data), self.bss_len, len(self.rodata),
                                  len(self.text), len(self.symbols))
 
         data = bytearray(HEADER_STRUCT.pack(*self.header))
@@ -133,12 +167,14 @@ class RBF(object):
         data += self.text
         for symbol in self.symbols:
             data += SYMBOL_STRUCT.pack(*symbol)
+        data += self._format_maps()
         return data
 
     def format_compressed(self):
         compressed_text = bytes().join(instr.compress() for instr in self.instructions)
         if not self.header:
-            self.header = HEADER(MAGIC, 0, COMPRESSED, len(self.data), len(self.rodata),
+            flags = COMPRESSED | (HAS_MAPS if self.maps else 0)
+            self.header = HEADER(MAGIC, 0, flags, len(self.data), len(self.rodata),
                                  len(compressed_text), len(self.symbols))
         data = bytearray(HEADER_STRUCT.pack(*self.header))
         data += self.data
@@ -146,6 +182,7 @@ class RBF(object):
         data += compressed_text
         for symbol in self.symbols:
             data += SYMBOL_STRUCT.pack(*symbol)
+        data += self._format_maps()
         return data
 
 
@@ -159,23 +196,29 @@ class RBF(object):
         offset += header.rodata_len
         text_start = rodata_end = offset
         offset += header.text_len
-        syms_start = text_end = offset
+        text_end = offset
         rodata = byte_data[rodata_start:rodata_end]
         data = byte_data[data_start:data_end]
         text = byte_data[text_start:text_end]
-        syms = byte_data[syms_start:]
 
         syms_array = []
-        while len(syms):
-            syms_array.append(
-                SYMBOL._make(SYMBOL_STRUCT.unpack_from(syms, 0))
-            )
-            syms = syms[SYMBOL_STRUCT.size:]
-        return RBF(data=data, bss_len=header.bss_len, rodata=rodata, text=text, symbols=syms_array, header=header)
+        for _ in range(header.functions_len):
+            syms_array.append(SYMBOL._make(SYMBOL_STRUCT.unpack_from(byte_data, offset)))
+            offset += SYMBOL_STRUCT.size
+
+        maps = []
+        if header.flags & HAS_MAPS:
+            (count,) = MAP_COUNT_STRUCT.unpack_from(byte_data, offset)
+            offset += MAP_COUNT_STRUCT.size
+            for _ in range(count):
+                maps.append(MAP._make(MAP_STRUCT.unpack_from(byte_data, offset)))
+                offset += MAP_STRUCT.size
+        return RBF(data=data, bss_len=header.bss_len, rodata=rodata, text=text, symbols=syms_array, header=header,
+                   maps=maps)
 
 
     @staticmethod
-    def _patch_text(text, elffile, relocation, data_len, bss_len, rodata):
+    def _patch_text(text, elffile, relocation, data_len, bss_len, rodata, map_offsets=()):
         rodata_len = len(rodata)
         entry = relocation.entry
         location = entry.r_offset
@@ -190,7 +233,26 @@ class RBF(object):
             section = elffile.get_section(symbol.entry.st_shndx)
             offset = symbol.entry.st_value
 
-        if section.name == RODATA:
+        if section.name == MAPS:
+            # Map references are replaced by the map index, handled by the helper functions
+            if text[location] != instructions.LDDW_OPCODE:
+                logging.error(f"No LDDW instruction at {hex(location)}")
+                return
+            instruction = instructions.LDDW._make(instructions.LDDW_STRUCT.unpack_from(text, location))
+            index = map_offsets.index(offset + instruction.immediate_l)
+            logging.info(f"Replacing {instruction} at {location} with map index {index}")
+            text[location:location+16] = instructions.LDDW_STRUCT.pack(
+                instructions.LDDW_OPCODE,
+                instruction.registers,
+                instruction.offset,
+                index,
+                0,
+                0,
+                0,
+                0
+            )
+            return
+        elif section.name == RODATA:
             offset += 0
             opcode = instructions.LDDWR_OPCODE
             opcode_name = 'LDDWR'
@@ -270,6 +332,26 @@ class RBF(object):
             sym_str = SYMBOL(offset, flags, text_offset)
             symbol_structs.append(sym_str)
             logging.debug(f"symbol {sym_str} generated with {name} and appended at {offset}")
+
+        # Map declarations, in order of address which gives the map index
+        maps = []
+        map_offsets = []
+        elf_maps = elffile.get_section_by_name(MAPS)
+        if elf_maps:
+            maps_index = elffile.get_section_index(MAPS)
+            map_data = elf_maps.data()
+            map_symbols = [symbol for symbol in symbols.iter_symbols()
+                           if symbol.entry['st_shndx'] == maps_index and symbol.entry['st_info']['type'] == 'STT_OBJECT']
+            for symbol in sorted(map_symbols, key=lambda symbol: symbol.entry['st_value']):
+                map_offset = symbol.entry['st_value']
+                definition = MAP_DEF._make(MAP_DEF_STRUCT.unpack_from(map_data, map_offset))
+                name_offset = len(rodata)
+                rodata += bytes(symbol.name, 'UTF-8') + b'\00'
+                maps.append(MAP(name_offset, definition.type, 0, definition.key_size, definition.value_size,
+                                definition.max_entries))
+                map_offsets.append(map_offset)
+                logging.info(f"Found map {symbol.name} {definition}")
+
         logging.info(f"Total rodata size: {len(rodata)}. Total data size: {len(data)}")
 
         if relocations:
@@ -285,6 +367,6 @@ class RBF(object):
                     section = elffile.get_section(symbol.entry.st_shndx)
                     logging.info(f"relocation at instruction {hex(entry['r_offset'])} for symbol {name} in {section.name} at {symbol.entry.st_value}")
 
-                RBF._patch_text(text, elffile, relocation, len(data), bss_len, rodata)
+                RBF._patch_text(text, elffile, relocation, len(data), bss_len, rodata, map_offsets)
 
-        return RBF(data=data, bss_len=bss_len, rodata=rodata, text=text, symbols=symbol_structs)
\ No newline at end of file
+        return RBF(data=data, bss_len=bss_len, rodata=rodata, text=text, symbols=symbol_structs, maps=maps)
\ No newline at end of file